@@ -0,0 +1,73 @@
+﻿#include "pch.h"
+#include "Broadcast.h"
+
+class BroadcastState
+{
+public:
+	BroadcastState(Broadcast::Channels&& channels, Broadcast::Payload payload, Broadcast::CompletionHandler handler) :
+		channels(std::move(channels)),
+		payload(payload),
+		handler(handler),
+		pending(this->channels.size()),
+		sent(0),
+		failed(0),
+		bytes(0)
+	{
+	}
+public:
+	void Completed(bool ok, size_t io_bytes)
+	{
+		if (ok)
+		{
+			++sent;
+			bytes += io_bytes;
+		}
+		else
+		{
+			++failed;
+		}
+		if (--pending == 0 && handler != nullptr)
+			handler({ sent, failed, bytes });
+	}
+public:
+	Broadcast::Channels channels;
+	Broadcast::Payload payload;
+	Broadcast::CompletionHandler handler;
+	std::atomic<size_t> pending;
+	std::atomic<size_t> sent;
+	std::atomic<size_t> failed;
+	std::atomic<uint64_t> bytes;
+};
+
+void Broadcast::Send(boost::asio::io_context& io, Channels channels, Payload payload, size_t shards, CompletionHandler handler)
+{
+	if (channels.empty() || payload == nullptr)
+	{
+		if (handler != nullptr)
+			handler({ 0, 0, 0 });
+		return;
+	}
+
+	auto state = std::make_shared<BroadcastState>(std::move(channels), payload, handler);
+	auto count = state->channels.size();
+	shards = (std::max)(static_cast<size_t>(1), (std::min)(shards, count));
+	for (size_t shard = 0; shard < shards; ++shard)
+	{
+		// 每个分片负责一段连续的通道, 所有写操作共享同一份数据和同一个计数器
+		auto first = count * shard / shards;
+		auto last = count * (shard + 1) / shards;
+		boost::asio::post(io, [state, first, last]()
+		{
+			IAsyncChannel::InputBuffer inbuffer;
+			inbuffer.buffer = state->payload->data();
+			inbuffer.bufferSize = state->payload->size();
+			for (auto i = first; i < last; ++i)
+			{
+				state->channels[i]->Write(inbuffer, [state](bool ok, size_t io_bytes)
+				{
+					state->Completed(ok, io_bytes);
+				});
+			}
+		});
+	}
+}
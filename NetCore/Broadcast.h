@@ -0,0 +1,24 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "IAsyncStream.h"
+
+class Broadcast
+{
+public:
+	using Payload = std::shared_ptr<const std::vector<uint8_t>>;
+	using Channels = std::vector<std::shared_ptr<IAsyncChannel>>;
+	struct Result
+	{
+		size_t sent;
+		size_t failed;
+		uint64_t bytes;
+	};
+	using CompletionHandler = std::function<void(const Result& result)>;
+public:
+	// 把同一份只读数据发送到所有通道, 通道按分片投递到 IO 线程上发起写操作,
+	// 全部写完成后调用一次 handler.
+	static void Send(boost::asio::io_context& io, Channels channels, Payload payload, size_t shards, CompletionHandler handler);
+};
@@ -0,0 +1,13 @@
+﻿#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// 不同线程频繁更新的计数放在不同的缓存行, 避免伪共享
+constexpr size_t kCACHE_LINE = 64;
+
+// 内存块需要多分配 kCACHE_LINE 字节, 返回块内第一个按缓存行对齐的地址
+inline uint8_t* CacheLineBase(uint8_t* block)
+{
+	auto address = reinterpret_cast<uintptr_t>(block);
+	return block + (kCACHE_LINE - address % kCACHE_LINE) % kCACHE_LINE;
+}
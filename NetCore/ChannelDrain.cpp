@@ -0,0 +1,229 @@
+﻿#include "pch.h"
+#include "ChannelDrain.h"
+#include "OEMStringHelper.hpp"
+#include <unordered_set>
+
+// 每片至少这么多通道, 通道不多时不必拆成多个任务
+constexpr size_t kMIN_SHARD = 256;
+
+struct ChannelDrain::Batch
+{
+	Batch(Channels channels, HalfClose halfClose, Close close, Completed completed, Mode mode) :
+		channels(std::move(channels)),
+		halfClose(halfClose),
+		close(close),
+		completed(completed),
+		graceful(mode == Mode::Graceful),
+		reset(mode == Mode::Abortive),
+		mutex(),
+		closed(),
+		waiting(),
+		shards(0),
+		finished(false),
+		timer(nullptr),
+		started(std::chrono::steady_clock::now())
+	{
+	}
+	Channels channels;
+	HalfClose halfClose;
+	Close close;
+	Completed completed;
+	bool graceful;
+	bool reset;
+	std::mutex mutex;
+	Channels closed;
+	// 优雅模式下还在等待对端关闭的通道; 用集合而不是计数, 同一通道被登记两次也不会多算
+	std::unordered_set<const IAsyncChannel*> waiting;
+	std::atomic<size_t> shards;     // 尚未完成的分片数
+	bool finished;
+	TimerWheel::Timer timer;
+	std::chrono::steady_clock::time_point started;
+};
+
+ChannelDrain::ChannelDrain(NetCore& core) :
+	m_Core(core),
+	m_Options({ Mode::Close, 3000 }),
+	m_Batch(nullptr),
+	m_LastDuration(0)
+{
+}
+
+IDevice::PD ChannelDrain::CreateProperties(std::shared_ptr<ChannelDrain> drain)
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	using PropertyGroup = PropertyDescriptionHelper::PropertyGroupDescription;
+	auto group = std::make_shared<PropertyGroup>(L"Drain", L"DEVICE.DRAIN.PROP.DRAIN");
+	auto pd = std::make_shared<StaticProperty>(
+		L"StopMode",
+		L"DEVICE.DRAIN.PROP.MODE",
+		uint8_t(0)
+		);
+	pd->AddEnumOptions(L"0", L"DEVICE.DRAIN.PROP.MODE.EM0", true);
+	pd->AddEnumOptions(L"1", L"DEVICE.DRAIN.PROP.MODE.EM1", true);
+	pd->AddEnumOptions(L"2", L"DEVICE.DRAIN.PROP.MODE.EM2", true);
+	pd->BindMethod(
+		[drain]() { return std::to_wstring(static_cast<int>(drain->m_Options.mode)); },
+		[drain](const std::wstring& value)
+	{
+		auto n = std::wcstoul(value.c_str(), nullptr, 10);
+		if (n > static_cast<unsigned long>(Mode::Abortive))
+			throw PropertyException("invalid stop mode: " + WStringToString(value));
+		drain->m_Options.mode = static_cast<Mode>(n);
+	});
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"DrainTimeout",
+		L"DEVICE.DRAIN.PROP.TIMEOUT",
+		uint32_t(3000)
+		);
+	pd->BindMethod(
+		[drain]() { return std::to_wstring(drain->m_Options.timeout); },
+		[drain](const std::wstring& value) { drain->m_Options.timeout = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"StopTime",
+		L"DEVICE.DRAIN.PROP.STOPTIME",
+		L"",
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[drain]()
+	{
+		std::wostringstream text;
+		text << std::fixed << std::setprecision(1) << drain->m_LastDuration / 1000.0;
+		return text.str();
+	},
+		nullptr
+		);
+	group->AddChild(pd);
+	return group;
+}
+
+void ChannelDrain::Run(Channels channels, HalfClose halfClose, Close close, Completed completed)
+{
+	auto batch = std::make_shared<Batch>(std::move(channels), halfClose, close, completed, m_Options.mode);
+	if (batch->graceful)
+	{
+		for (auto& channel : batch->channels)
+			batch->waiting.insert(channel.get());
+	}
+	std::atomic_store(&m_Batch, batch);
+	Dispatch(batch, !batch->graceful);
+}
+
+void ChannelDrain::Dispatch(const BatchPtr& batch, bool closing)
+{
+	auto count = batch->channels.size();
+	if (count == 0)
+	{
+		Finish(batch);
+		return;
+	}
+	auto threads = (std::max)(m_Core.GetIOThreadCount(), static_cast<size_t>(1));
+	auto shards = (std::min)(threads, (count + kMIN_SHARD - 1) / kMIN_SHARD);
+	auto step = (count + shards - 1) / shards;
+	batch->shards = shards;
+	auto self = shared_from_this();
+	for (size_t begin = 0; begin < count; begin += step)
+	{
+		auto end = (std::min)(begin + step, count);
+		m_Core.GetIOContext().post([self, batch, begin, end, closing]()
+		{
+			Channels closed;
+			std::vector<const IAsyncChannel*> idle;
+			for (auto i = begin; i < end; ++i)
+			{
+				auto& channel = batch->channels[i];
+				if (closing)
+				{
+					if (batch->close(channel, batch->reset))
+						closed.push_back(channel);
+				}
+				else if (!batch->halfClose(channel))
+				{
+					// 还没有连上的通道不会收到对端关闭, 直接关闭
+					if (batch->close(channel, batch->reset))
+						closed.push_back(channel);
+					idle.push_back(channel.get());
+				}
+			}
+			bool done = false;
+			{
+				std::unique_lock<std::mutex> lk(batch->mutex);
+				batch->closed.insert(batch->closed.end(), closed.begin(), closed.end());
+				for (auto channel : idle)
+					batch->waiting.erase(channel);
+				done = !closing && batch->waiting.empty();
+			}
+			if (done)
+				self->Finish(batch);
+			if (--batch->shards > 0)
+				return;
+			if (closing)
+			{
+				self->Finish(batch);
+				return;
+			}
+			// 全部半关闭后开始计时, 期间对端全部关闭时提前结束
+			std::unique_lock<std::mutex> lk(batch->mutex);
+			if (batch->finished)
+				return;
+			std::weak_ptr<Batch> weak = batch;
+			batch->timer = self->m_Core.GetTimerWheel().Schedule(std::chrono::milliseconds(self->m_Options.timeout), [self, weak]()
+			{
+				auto batch = weak.lock();
+				if (batch != nullptr)
+					self->Expire(batch);
+			});
+		});
+	}
+}
+
+void ChannelDrain::Expire(const BatchPtr& batch)
+{
+	{
+		std::unique_lock<std::mutex> lk(batch->mutex);
+		if (batch->finished)
+			return;
+	}
+	batch->reset = true;
+	Dispatch(batch, true);
+}
+
+bool ChannelDrain::Collect(const Channel& channel)
+{
+	auto batch = std::atomic_load(&m_Batch);
+	if (batch == nullptr)
+		return false;
+	bool done = false;
+	{
+		std::unique_lock<std::mutex> lk(batch->mutex);
+		if (batch->finished)
+			return false;
+		batch->closed.push_back(channel);
+		batch->waiting.erase(channel.get());
+		done = batch->graceful && batch->waiting.empty();
+	}
+	if (done)
+		Finish(batch);
+	return true;
+}
+
+void ChannelDrain::Finish(const BatchPtr& batch)
+{
+	Channels closed;
+	{
+		std::unique_lock<std::mutex> lk(batch->mutex);
+		if (batch->finished)
+			return;
+		batch->finished = true;
+		m_Core.GetTimerWheel().Cancel(batch->timer);
+		closed.swap(batch->closed);
+	}
+	std::atomic_store(&m_Batch, BatchPtr());
+	m_LastDuration = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - batch->started).count();
+	batch->completed(closed);
+}
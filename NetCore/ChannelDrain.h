@@ -0,0 +1,59 @@
+﻿#pragma once
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include "IAsyncStream.h"
+#include "NetCore.h"
+
+// 设备停止时批量关闭通道: 通道按 IO 线程数分片, 每片作为一个任务投递, 在各 IO 线程上并行关闭;
+// 关闭的通道攒成一批, 全部结束后通过 Completed 一次交给设备, 设备再一次通知界面.
+// 优雅模式先半关闭(只关闭发送方向), 对端读到结束后也关闭, 读取端读到结束时由设备调用 Collect 登记,
+// 全部登记后提前结束; 超时后剩下的连接以 RST 结束. 设置保存在设备中, 每次停止创建一批.
+class ChannelDrain : public std::enable_shared_from_this<ChannelDrain>
+{
+public:
+	enum class Mode
+	{
+		Close,          // 直接关闭(FIN), 不等待对端
+		Graceful,
+		Abortive        // SO_LINGER 为 0, 以 RST 结束, 不进入 TIME_WAIT
+	};
+	struct Options
+	{
+		Mode mode;
+		uint32_t timeout;       // 优雅模式等待对端关闭的毫秒数
+	};
+	using Channel = IDevice::Channel;
+	using Channels = std::vector<Channel>;
+	// 返回 false 表示通道没有打开(还在连接或已经关闭), 不必等待
+	using HalfClose = std::function<bool(const Channel& channel)>;
+	// 返回 false 表示通道已经关闭并通知过
+	using Close = std::function<bool(const Channel& channel, bool reset)>;
+	using Completed = std::function<void(const Channels& closed)>;
+public:
+	ChannelDrain(void) = delete;
+	ChannelDrain(const ChannelDrain&) = delete;
+	ChannelDrain(NetCore& core);
+	~ChannelDrain(void) = default;
+public:
+	static IDevice::PD CreateProperties(std::shared_ptr<ChannelDrain> drain);
+	// 在 IO 线程上调用, completed 在最后一片完成的线程上调用一次; 同一时间只有一批
+	void Run(Channels channels, HalfClose halfClose, Close close, Completed completed);
+	// 通道被对端关闭时由设备调用; 返回 false 表示不在排空中, 设备照常通知
+	bool Collect(const Channel& channel);
+private:
+	struct Batch;
+	using BatchPtr = std::shared_ptr<Batch>;
+	void Dispatch(const BatchPtr& batch, bool closing);
+	void Expire(const BatchPtr& batch);
+	void Finish(const BatchPtr& batch);
+private:
+	NetCore& m_Core;
+	Options m_Options;
+	BatchPtr m_Batch;
+	std::atomic<uint64_t> m_LastDuration;   // 最近一次停止用去的微秒数
+};
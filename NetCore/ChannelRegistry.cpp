@@ -0,0 +1,118 @@
+﻿#include "pch.h"
+#include "ChannelRegistry.h"
+
+// 初始槽位数(2 的幂), 装载率超过一半时扩容
+constexpr size_t kINITIAL_SLOTS = 16;
+
+ChannelRegistry::ChannelRegistry(void) :
+	m_Slots(kINITIAL_SLOTS, 0),
+	m_Shift(64 - 4),
+	m_Channels(),
+	m_Ids(),
+	m_NextId(1)
+{
+}
+
+size_t ChannelRegistry::Home(const IAsyncChannel* channel) const
+{
+	// 对象地址低位总是对齐为 0, 乘以黄金分割常数后取高位, 分布才均匀
+	return static_cast<size_t>((reinterpret_cast<uintptr_t>(channel) * UINT64_C(0x9E3779B97F4A7C15)) >> m_Shift);
+}
+
+size_t ChannelRegistry::Locate(const IAsyncChannel* channel) const
+{
+	auto mask = m_Slots.size() - 1;
+	auto slot = Home(channel);
+	while (m_Slots[slot] != 0 && m_Channels[m_Slots[slot] - 1].get() != channel)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+uint64_t ChannelRegistry::Add(const Channel& channel)
+{
+	auto slot = Locate(channel.get());
+	if (m_Slots[slot] != 0)
+		return m_Ids[m_Slots[slot] - 1];
+	if ((m_Channels.size() + 1) * 2 > m_Slots.size())
+	{
+		Rehash(m_Slots.size() * 2);
+		slot = Locate(channel.get());
+	}
+	auto id = m_NextId++;
+	m_Channels.push_back(channel);
+	m_Ids.push_back(id);
+	m_Slots[slot] = static_cast<uint32_t>(m_Channels.size());
+	return id;
+}
+
+bool ChannelRegistry::Remove(const IAsyncChannel* channel)
+{
+	auto mask = m_Slots.size() - 1;
+	auto slot = Locate(channel);
+	if (m_Slots[slot] == 0)
+		return false;
+
+	// 最后一个通道移到被移除的位置, 并修正它的槽位
+	size_t index = m_Slots[slot] - 1;
+	size_t last = m_Channels.size() - 1;
+	if (index != last)
+	{
+		m_Slots[Locate(m_Channels[last].get())] = static_cast<uint32_t>(index + 1);
+		m_Channels[index] = std::move(m_Channels[last]);
+		m_Ids[index] = m_Ids[last];
+	}
+	m_Channels.pop_back();
+	m_Ids.pop_back();
+
+	// 向后移位删除: 把探测链上后续的条目前移, 不留删除标记
+	m_Slots[slot] = 0;
+	auto next = (slot + 1) & mask;
+	while (m_Slots[next] != 0)
+	{
+		auto home = Home(m_Channels[m_Slots[next] - 1].get());
+		// home 不在 (slot, next] 区间内时, 条目可以移到空出的 slot
+		if (((next - home) & mask) >= ((next - slot) & mask))
+		{
+			m_Slots[slot] = m_Slots[next];
+			m_Slots[next] = 0;
+			slot = next;
+		}
+		next = (next + 1) & mask;
+	}
+	return true;
+}
+
+ChannelRegistry::Channel ChannelRegistry::Find(const IAsyncChannel* channel) const
+{
+	auto slot = Locate(channel);
+	if (m_Slots[slot] == 0)
+		return nullptr;
+	return m_Channels[m_Slots[slot] - 1];
+}
+
+uint64_t ChannelRegistry::IdOf(const IAsyncChannel* channel) const
+{
+	auto slot = Locate(channel);
+	if (m_Slots[slot] == 0)
+		return 0;
+	return m_Ids[m_Slots[slot] - 1];
+}
+
+void ChannelRegistry::Clear(void)
+{
+	m_Channels.clear();
+	m_Ids.clear();
+	m_Slots.assign(kINITIAL_SLOTS, 0);
+	m_Shift = 64 - 4;
+}
+
+void ChannelRegistry::Rehash(size_t capacity)
+{
+	unsigned bits = 0;
+	while ((size_t(1) << bits) < capacity)
+		++bits;
+	m_Slots.assign(size_t(1) << bits, 0);
+	m_Shift = 64 - bits;
+	for (size_t i = 0; i < m_Channels.size(); ++i)
+		m_Slots[Locate(m_Channels[i].get())] = static_cast<uint32_t>(i + 1);
+}
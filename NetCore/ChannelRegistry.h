@@ -0,0 +1,42 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include "IAsyncStream.h"
+
+// 通道登记表: 按通道指针开放寻址(线性探测)索引, 通道本身连续存放在数组中, 遍历不受空槽影响.
+// 登记, 查找和移除都是 O(1), 移除时用最后一个通道填补空位, 大量连接同时断开时也不会退化.
+// 每个登记的通道分配一个递增的数字编号, 同一地址被新通道复用时编号不同. 不加锁, 由调用方保证互斥.
+class ChannelRegistry
+{
+public:
+	using Channel = std::shared_ptr<IAsyncChannel>;
+	using Channels = std::vector<Channel>;
+public:
+	ChannelRegistry(void);
+	ChannelRegistry(const ChannelRegistry&) = delete;
+	~ChannelRegistry(void) = default;
+public:
+	// 返回通道编号, 已登记的通道返回原编号
+	uint64_t Add(const Channel& channel);
+	bool Remove(const IAsyncChannel* channel);
+	Channel Find(const IAsyncChannel* channel) const;
+	// 未登记时返回 0
+	uint64_t IdOf(const IAsyncChannel* channel) const;
+	void Clear(void);
+	// 顺序不固定, 移除通道后最后一个通道会移到空出的位置
+	const Channels& All(void) const { return m_Channels; }
+	size_t Size(void) const { return m_Channels.size(); }
+	bool Empty(void) const { return m_Channels.empty(); }
+private:
+	size_t Home(const IAsyncChannel* channel) const;
+	// 返回通道所在的槽位, 未登记时返回应插入的空槽位
+	size_t Locate(const IAsyncChannel* channel) const;
+	void Rehash(size_t capacity);
+private:
+	std::vector<uint32_t> m_Slots;     // 通道在 m_Channels 中的下标加 1, 0 表示空槽
+	unsigned m_Shift;
+	Channels m_Channels;
+	std::vector<uint64_t> m_Ids;
+	uint64_t m_NextId;
+};
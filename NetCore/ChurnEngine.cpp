@@ -0,0 +1,270 @@
+﻿#include "pch.h"
+#include "ChurnEngine.h"
+
+// 界面统计的刷新间隔, 以及实际新建速率的统计窗口
+constexpr auto kPROGRESS_INTERVAL = std::chrono::milliseconds(250);
+constexpr auto kRATE_WINDOW = std::chrono::seconds(1);
+
+ChurnEngine::ChurnEngine(boost::asio::io_context& io, const Options& options, Connector connector, Closer closer, Handler progress) :
+	m_Options(options),
+	m_Pacer(io, options.rate, options.concurrency),
+	m_Connector(connector),
+	m_Closer(closer),
+	m_OnProgress(progress),
+	m_Mutex(),
+	m_Running(false),
+	m_Slots(options.target, Slot{ State::Idle, 0, std::chrono::steady_clock::time_point() }),
+	m_Ready(),
+	m_Retries(),
+	m_Deadlines(),
+	m_LastProgress(),
+	m_LastRate(),
+	m_LastConnects(0),
+	m_LastError(),
+	m_Random(std::random_device()()),
+	m_Handshake(),
+	m_Pending(options.target),
+	m_Established(0),
+	m_Failed(0),
+	m_Connects(0),
+	m_Closes(0),
+	m_CloseErrors(0),
+	m_Rate(0)
+{
+	for (size_t i = 0; i < options.target; ++i)
+		m_Ready.push_back(i);
+}
+
+void ChurnEngine::Start(void)
+{
+	std::vector<size_t> launches;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (m_Running || m_Options.target == 0)
+			return;
+		m_Running = true;
+		auto now = std::chrono::steady_clock::now();
+		m_LastProgress = now;
+		m_LastRate = now;
+		m_Pacer.Reset(now);
+		Pump(now, launches);
+		Arm();
+	}
+	Launch(launches);
+}
+
+void ChurnEngine::Stop(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_Running = false;
+	m_Pacer.Cancel();
+	m_Ready.clear();
+	m_Retries.clear();
+	m_Deadlines.clear();
+	m_Pending = 0;
+}
+
+void ChurnEngine::Expire(size_t index)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	if (!m_Running || m_Slots[index].state != State::Open)
+		return;
+	m_Deadlines.emplace(std::chrono::steady_clock::now(), Deadline(index, m_Slots[index].generation));
+}
+
+void ChurnEngine::Dropped(size_t index)
+{
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		// 已在主动关闭的连接由 Close 负责回收
+		if (!m_Running || m_Slots[index].state != State::Open)
+			return;
+		m_Slots[index].state = State::Closing;
+		++m_CloseErrors;
+	}
+	Release(index);
+}
+
+std::wstring ChurnEngine::LastError(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	return m_LastError;
+}
+
+void ChurnEngine::Arm(void)
+{
+	auto self = shared_from_this();
+	m_Pacer.Arm([self]() { self->OnTick(); });
+}
+
+void ChurnEngine::OnTick(void)
+{
+	std::vector<size_t> launches;
+	std::vector<size_t> closes;
+	bool notify = false;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (!m_Running)
+			return;
+		auto now = std::chrono::steady_clock::now();
+		while (!m_Deadlines.empty() && m_Deadlines.begin()->first <= now)
+		{
+			// 按消息数提前关闭后, 原来的存活期限仍在表中, 按代数跳过
+			auto deadline = m_Deadlines.begin()->second;
+			m_Deadlines.erase(m_Deadlines.begin());
+			auto& slot = m_Slots[deadline.first];
+			if (slot.state != State::Open || slot.generation != deadline.second)
+				continue;
+			slot.state = State::Closing;
+			closes.push_back(deadline.first);
+		}
+		while (!m_Retries.empty() && m_Retries.begin()->first <= now)
+		{
+			m_Ready.push_back(m_Retries.begin()->second);
+			m_Retries.erase(m_Retries.begin());
+		}
+		Pump(now, launches);
+
+		if (now - m_LastRate >= kRATE_WINDOW)
+		{
+			uint64_t connects = m_Connects;
+			m_Rate = (connects - m_LastConnects) / std::chrono::duration<double>(now - m_LastRate).count();
+			m_LastConnects = connects;
+			m_LastRate = now;
+		}
+		if (now - m_LastProgress >= kPROGRESS_INTERVAL)
+		{
+			m_LastProgress = now;
+			notify = true;
+		}
+		Arm();
+	}
+	Close(closes);
+	Launch(launches);
+	if (notify && m_OnProgress)
+		m_OnProgress();
+}
+
+void ChurnEngine::Pump(std::chrono::steady_clock::time_point now, std::vector<size_t>& launches)
+{
+	m_Pacer.Refill(now);
+	while (m_Running && !m_Ready.empty() && m_Pacer.Ready(now))
+	{
+		auto index = m_Ready.front();
+		m_Ready.pop_front();
+		auto& slot = m_Slots[index];
+		slot.state = State::Connecting;
+		slot.started = std::chrono::steady_clock::now();
+		--m_Pending;
+		m_Pacer.Take();
+		launches.push_back(index);
+	}
+}
+
+void ChurnEngine::Launch(const std::vector<size_t>& launches)
+{
+	auto self = shared_from_this();
+	m_Pacer.Launch(launches, [self](size_t index)
+	{
+		// 投递期间可能已经停止, 此时不再发起连接
+		{
+			std::unique_lock<std::mutex> lk(self->m_Mutex);
+			if (!self->m_Running)
+			{
+				self->m_Pacer.Release();
+				return;
+			}
+		}
+		self->m_Connector(index, [self, index](bool ok, const std::wstring& message)
+		{
+			return self->OnConnected(index, ok, message);
+		});
+	});
+}
+
+void ChurnEngine::Close(const std::vector<size_t>& closes)
+{
+	for (auto index : closes)
+	{
+		if (!m_Closer(index, m_Options.reset))
+			++m_CloseErrors;
+		Release(index);
+	}
+}
+
+bool ChurnEngine::OnConnected(size_t index, bool ok, const std::wstring& message)
+{
+	std::vector<size_t> launches;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		m_Pacer.Release();
+		if (!m_Running)
+			return false;
+
+		auto now = std::chrono::steady_clock::now();
+		auto& slot = m_Slots[index];
+		if (ok)
+		{
+			m_Handshake.Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - slot.started).count()));
+			slot.state = State::Open;
+			++slot.generation;
+			++m_Established;
+			++m_Connects;
+			if (m_Options.lifetime > 0)
+				m_Deadlines.emplace(now + NextLifetime(), Deadline(index, slot.generation));
+		}
+		else
+		{
+			// 失败的位置等待一段时间再连接, 服务器不可用时不至于空转
+			m_LastError = message;
+			++m_Failed;
+			++m_Pending;
+			slot.state = State::Idle;
+			m_Retries.emplace(now + std::chrono::milliseconds(m_Options.backoff), index);
+		}
+		Pump(now, launches);
+	}
+	Launch(launches);
+	return true;
+}
+
+void ChurnEngine::Release(size_t index)
+{
+	std::vector<size_t> launches;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		--m_Established;
+		++m_Closes;
+		if (!m_Running)
+			return;
+		m_Slots[index].state = State::Idle;
+		++m_Pending;
+		m_Ready.push_back(index);
+		Pump(std::chrono::steady_clock::now(), launches);
+	}
+	Launch(launches);
+}
+
+std::chrono::steady_clock::duration ChurnEngine::NextLifetime(void)
+{
+	std::chrono::duration<double, std::milli> mean(m_Options.lifetime);
+	switch (m_Options.distribution)
+	{
+	case Lifetime::Uniform:
+	{
+		std::uniform_real_distribution<double> uniform(0.5, 1.5);
+		mean *= uniform(m_Random);
+		break;
+	}
+	case Lifetime::Exponential:
+	{
+		// 截断在 10 倍均值, 避免个别连接长期占住位置
+		std::exponential_distribution<double> exponential(1.0);
+		mean *= (std::min)(exponential(m_Random), 10.0);
+		break;
+	}
+	default:
+		break;
+	}
+	return std::chrono::duration_cast<std::chrono::steady_clock::duration>(mean);
+}
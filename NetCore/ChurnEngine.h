@@ -0,0 +1,114 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <string>
+#include <functional>
+#include "ConnectRamp.h"
+#include "ConnectPacer.h"
+#include "LatencyHistogram.h"
+
+// 多连接客户端的连接翻转: 每个连接存活一段随机时长(或发送够指定条数的消息)后关闭, 空出的位置按速率重新连接,
+// 保持目标连接数的同时持续产生新建/关闭连接的压力.
+class ChurnEngine : public std::enable_shared_from_this<ChurnEngine>
+{
+public:
+	enum class Lifetime
+	{
+		Fixed = 0,          // 固定时长
+		Uniform = 1,        // [0.5, 1.5) 倍之间均匀分布
+		Exponential = 2     // 指数分布, 均值为设定时长
+	};
+	struct Options
+	{
+		size_t target;          // 同时保持的连接数
+		uint32_t rate;          // 每秒新建的连接数, 0 表示不限制
+		uint32_t concurrency;   // 同时进行的握手数, 0 表示不限制
+		uint32_t backoff;       // 连接失败后该位置再次连接前的等待时间(毫秒)
+		uint32_t lifetime;      // 连接存活时长(毫秒), 0 表示不按时长关闭
+		Lifetime distribution;
+		uint32_t messages;      // 发送够该条数的消息后关闭, 0 表示不按消息数关闭
+		bool reset;             // 关闭时发送 RST 而不是 FIN
+	};
+	using Completion = ConnectRamp::Completion;
+	using Connector = ConnectRamp::Connector;
+	// 关闭指定位置的连接, 返回 false 表示关闭时出错
+	using Closer = std::function<bool(size_t index, bool reset)>;
+	using Handler = std::function<void(void)>;
+public:
+	ChurnEngine(void) = delete;
+	ChurnEngine(const ChurnEngine&) = delete;
+	ChurnEngine(boost::asio::io_context& io, const Options& options, Connector connector, Closer closer, Handler progress);
+	~ChurnEngine(void) = default;
+public:
+	void Start(void);
+	void Stop(void);
+	// 连接发送够消息数时调用, 下一个节拍关闭
+	void Expire(size_t index);
+	// 连接被对端或错误关闭时调用
+	void Dropped(size_t index);
+	size_t Pending(void) const { return m_Pending; }
+	size_t Handshaking(void) const { return m_Pacer.Handshaking(); }
+	size_t Established(void) const { return m_Established; }
+	size_t Failed(void) const { return m_Failed; }
+	uint64_t Connects(void) const { return m_Connects; }
+	uint64_t Closes(void) const { return m_Closes; }
+	uint64_t CloseErrors(void) const { return m_CloseErrors; }
+	double Rate(void) const { return m_Rate; }
+	LatencyHistogram::Summary Handshake(void) const { return m_Handshake.Snapshot(); }
+	std::wstring LastError(void);
+private:
+	enum class State
+	{
+		Idle,
+		Connecting,
+		Open,
+		Closing
+	};
+	struct Slot
+	{
+		State state;
+		uint32_t generation;
+		std::chrono::steady_clock::time_point started;
+	};
+	using Deadline = std::pair<size_t, uint32_t>;
+	void Arm(void);
+	void OnTick(void);
+	void Pump(std::chrono::steady_clock::time_point now, std::vector<size_t>& launches);
+	void Launch(const std::vector<size_t>& launches);
+	void Close(const std::vector<size_t>& closes);
+	bool OnConnected(size_t index, bool ok, const std::wstring& message);
+	void Release(size_t index);
+	std::chrono::steady_clock::duration NextLifetime(void);
+private:
+	Options m_Options;
+	ConnectPacer m_Pacer;
+	Connector m_Connector;
+	Closer m_Closer;
+	Handler m_OnProgress;
+	std::mutex m_Mutex;
+	bool m_Running;
+	std::vector<Slot> m_Slots;
+	std::deque<size_t> m_Ready;
+	std::multimap<std::chrono::steady_clock::time_point, size_t> m_Retries;
+	std::multimap<std::chrono::steady_clock::time_point, Deadline> m_Deadlines;
+	std::chrono::steady_clock::time_point m_LastProgress;
+	std::chrono::steady_clock::time_point m_LastRate;
+	uint64_t m_LastConnects;
+	std::wstring m_LastError;
+	std::mt19937 m_Random;
+	LatencyHistogram m_Handshake;
+	std::atomic<size_t> m_Pending;
+	std::atomic<size_t> m_Established;
+	std::atomic<size_t> m_Failed;
+	std::atomic<uint64_t> m_Connects;
+	std::atomic<uint64_t> m_Closes;
+	std::atomic<uint64_t> m_CloseErrors;
+	std::atomic<double> m_Rate;
+};
@@ -0,0 +1,56 @@
+﻿#include "pch.h"
+#include "ConnectPacer.h"
+
+// 节拍粒度, 也是停顿后最多补发的额度
+constexpr auto kTICK = std::chrono::milliseconds(10);
+
+ConnectPacer::ConnectPacer(boost::asio::io_context& io, uint32_t rate, uint32_t concurrency) :
+	m_Timer(io),
+	m_Rate(rate),
+	m_Concurrency(concurrency),
+	m_Interval(rate > 0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::seconds(1)) / rate : Clock::duration::zero()),
+	m_NextDue(),
+	m_Handshaking(0)
+{
+}
+
+void ConnectPacer::Refill(Clock::time_point now)
+{
+	if (m_Rate > 0 && now - m_NextDue > kTICK)
+		m_NextDue = now - kTICK;
+}
+
+bool ConnectPacer::Ready(Clock::time_point now) const
+{
+	if (m_Concurrency > 0 && m_Handshaking >= m_Concurrency)
+		return false;
+	return m_Rate == 0 || m_NextDue <= now;
+}
+
+void ConnectPacer::Take(void)
+{
+	++m_Handshaking;
+	m_NextDue += m_Interval;
+}
+
+void ConnectPacer::Arm(Tick tick)
+{
+	m_Timer.expires_after(kTICK);
+	m_Timer.async_wait([tick](const boost::system::error_code& ec)
+	{
+		if (!ec)
+			tick();
+	});
+}
+
+void ConnectPacer::Cancel(void)
+{
+	boost::system::error_code ec;
+	m_Timer.cancel(ec);
+}
+
+void ConnectPacer::Launch(const std::vector<size_t>& launches, Launcher launcher)
+{
+	for (auto index : launches)
+		boost::asio::post(m_Timer.get_executor(), [launcher, index]() { launcher(index); });
+}
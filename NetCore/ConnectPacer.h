@@ -0,0 +1,45 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+// 连接发起的节奏: 按每秒连接数和同时握手数放行, 定时器按固定节拍驱动; 连接爬坡和连接翻转共用.
+// Reset/Refill/Ready/Take 由调用者在自己的锁内调用.
+class ConnectPacer
+{
+public:
+	using Clock = std::chrono::steady_clock;
+	using Tick = std::function<void(void)>;
+	using Launcher = std::function<void(size_t index)>;
+public:
+	ConnectPacer(void) = delete;
+	ConnectPacer(const ConnectPacer&) = delete;
+	// rate 为每秒发起的连接数, concurrency 为同时进行的握手数, 0 表示不限制
+	ConnectPacer(boost::asio::io_context& io, uint32_t rate, uint32_t concurrency);
+	~ConnectPacer(void) = default;
+public:
+	// 发起额度从 now 开始累积
+	void Reset(Clock::time_point now) { m_NextDue = now; }
+	// 每轮放行之前调用: 停顿期间不累积发起额度, 避免放开后一次性涌出
+	void Refill(Clock::time_point now);
+	bool Ready(Clock::time_point now) const;
+	// 占用一个发起额度和一个握手名额
+	void Take(void);
+	// 握手结束(包括没有发起)时归还握手名额
+	void Release(void) { --m_Handshaking; }
+	size_t Handshaking(void) const { return m_Handshaking; }
+	// 下一个节拍调用 tick, 定时器取消后不再调用
+	void Arm(Tick tick);
+	void Cancel(void);
+	// 连接函数可能同步失败, 投递到 IO 线程执行以免在回调中层层递归
+	void Launch(const std::vector<size_t>& launches, Launcher launcher);
+private:
+	boost::asio::steady_timer m_Timer;
+	uint32_t m_Rate;
+	uint32_t m_Concurrency;
+	Clock::duration m_Interval;
+	Clock::time_point m_NextDue;
+	std::atomic<size_t> m_Handshaking;
+};
@@ -0,0 +1,207 @@
+﻿#include "pch.h"
+#include "ConnectRamp.h"
+
+// 界面统计的刷新间隔, 以及重试退避的上限
+constexpr auto kPROGRESS_INTERVAL = std::chrono::milliseconds(250);
+constexpr auto kMAX_BACKOFF = std::chrono::seconds(30);
+
+ConnectRamp::ConnectRamp(boost::asio::io_context& io, const Options& options, Connector connector, Handler progress, Handler complete) :
+	m_Options(options),
+	m_Pacer(io, options.rate, options.concurrency),
+	m_Connector(connector),
+	m_OnProgress(progress),
+	m_OnComplete(complete),
+	m_Mutex(),
+	m_Running(false),
+	m_Completed(false),
+	m_Next(0),
+	m_Attempts(options.target, 0),
+	m_Retries(),
+	m_LastProgress(),
+	m_Changed(false),
+	m_LastError(),
+	m_Random(std::random_device()()),
+	m_Pending(options.target),
+	m_Established(0),
+	m_Failed(0)
+{
+}
+
+void ConnectRamp::Start(void)
+{
+	std::vector<size_t> launches;
+	bool complete = false;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (m_Running || m_Completed)
+			return;
+		m_Running = true;
+		m_LastProgress = std::chrono::steady_clock::now();
+		m_Pacer.Reset(m_LastProgress);
+		if (m_Options.target == 0)
+		{
+			m_Completed = true;
+			complete = true;
+		}
+		else
+		{
+			Pump(launches);
+			Arm();
+		}
+	}
+	Launch(launches);
+	if (complete && m_OnComplete)
+		m_OnComplete();
+}
+
+void ConnectRamp::Stop(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_Running = false;
+	m_Pacer.Cancel();
+	m_Retries.clear();
+	m_Pending = 0;
+}
+
+std::wstring ConnectRamp::LastError(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	return m_LastError;
+}
+
+void ConnectRamp::Arm(void)
+{
+	auto self = shared_from_this();
+	m_Pacer.Arm([self]() { self->OnTick(); });
+}
+
+void ConnectRamp::OnTick(void)
+{
+	std::vector<size_t> launches;
+	bool notify = false;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (!m_Running)
+			return;
+		Pump(launches);
+		// 统计变化很快, 按固定间隔通知界面刷新
+		auto now = std::chrono::steady_clock::now();
+		if (m_Changed && now - m_LastProgress >= kPROGRESS_INTERVAL)
+		{
+			m_Changed = false;
+			m_LastProgress = now;
+			notify = true;
+		}
+		if (!m_Completed)
+			Arm();
+	}
+	Launch(launches);
+	if (notify && m_OnProgress)
+		m_OnProgress();
+}
+
+void ConnectRamp::Pump(std::vector<size_t>& launches)
+{
+	auto now = std::chrono::steady_clock::now();
+	m_Pacer.Refill(now);
+	while (m_Running && m_Pacer.Ready(now))
+	{
+		size_t index = 0;
+		if (!m_Retries.empty() && m_Retries.begin()->first <= now)
+		{
+			index = m_Retries.begin()->second;
+			m_Retries.erase(m_Retries.begin());
+		}
+		else if (m_Next < m_Options.target)
+		{
+			index = m_Next++;
+		}
+		else
+		{
+			break;
+		}
+
+		--m_Pending;
+		m_Pacer.Take();
+		m_Changed = true;
+		launches.push_back(index);
+	}
+}
+
+void ConnectRamp::Launch(const std::vector<size_t>& launches)
+{
+	auto self = shared_from_this();
+	m_Pacer.Launch(launches, [self](size_t index)
+	{
+		// 投递期间可能已经停止, 此时不再发起连接
+		{
+			std::unique_lock<std::mutex> lk(self->m_Mutex);
+			if (!self->m_Running)
+			{
+				self->m_Pacer.Release();
+				return;
+			}
+		}
+		self->m_Connector(index, [self, index](bool ok, const std::wstring& message)
+		{
+			return self->OnConnected(index, ok, message);
+		});
+	});
+}
+
+bool ConnectRamp::OnConnected(size_t index, bool ok, const std::wstring& message)
+{
+	std::vector<size_t> launches;
+	bool complete = false;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		m_Pacer.Release();
+		if (!m_Running)
+			return false;
+
+		m_Changed = true;
+		if (ok)
+		{
+			++m_Established;
+		}
+		else
+		{
+			m_LastError = message;
+			if (m_Attempts[index] < m_Options.retries)
+			{
+				auto attempt = ++m_Attempts[index];
+				m_Retries.emplace(std::chrono::steady_clock::now() + RetryDelay(attempt), index);
+				++m_Pending;
+			}
+			else
+			{
+				++m_Failed;
+			}
+		}
+
+		Pump(launches);
+		if (!m_Completed && m_Next >= m_Options.target && m_Pacer.Handshaking() == 0 && m_Retries.empty())
+		{
+			m_Completed = true;
+			complete = true;
+			m_Pacer.Cancel();
+		}
+	}
+	Launch(launches);
+	if (complete && m_OnComplete)
+		m_OnComplete();
+	return true;
+}
+
+std::chrono::steady_clock::duration ConnectRamp::RetryDelay(uint32_t attempt)
+{
+	// 指数退避, 再在 [0.5, 1.5) 倍之间随机抖动, 避免失败的连接同时重试
+	std::chrono::milliseconds delay(m_Options.backoff);
+	for (uint32_t i = 1; i < attempt && delay < kMAX_BACKOFF; ++i)
+		delay *= 2;
+	delay = (std::min)(delay, std::chrono::milliseconds(kMAX_BACKOFF));
+	if (delay.count() <= 0)
+		return std::chrono::steady_clock::duration::zero();
+	std::uniform_int_distribution<int64_t> jitter(delay.count() / 2, delay.count() + delay.count() / 2);
+	return std::chrono::milliseconds(jitter(m_Random));
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <string>
+#include <functional>
+#include "ConnectPacer.h"
+
+// 多连接客户端的连接爬坡: 按速率和同时握手数逐步发起连接, 失败后按带抖动的退避时间重试.
+class ConnectRamp : public std::enable_shared_from_this<ConnectRamp>
+{
+public:
+	struct Options
+	{
+		size_t target;          // 目标连接数
+		uint32_t rate;          // 每秒发起的连接数, 0 表示不限制
+		uint32_t concurrency;   // 同时进行的握手数, 0 表示不限制
+		uint32_t retries;       // 失败后的重试次数
+		uint32_t backoff;       // 首次重试的退避时间(毫秒), 之后逐次加倍
+	};
+	// 连接结束时调用, 返回 false 表示爬坡已停止, 调用者应关闭刚建立的连接
+	using Completion = std::function<bool(bool ok, const std::wstring& message)>;
+	using Connector = std::function<void(size_t index, Completion done)>;
+	using Handler = std::function<void(void)>;
+public:
+	ConnectRamp(void) = delete;
+	ConnectRamp(const ConnectRamp&) = delete;
+	ConnectRamp(boost::asio::io_context& io, const Options& options, Connector connector, Handler progress, Handler complete);
+	~ConnectRamp(void) = default;
+public:
+	void Start(void);
+	void Stop(void);
+	size_t Pending(void) const { return m_Pending; }
+	size_t Handshaking(void) const { return m_Pacer.Handshaking(); }
+	size_t Established(void) const { return m_Established; }
+	size_t Failed(void) const { return m_Failed; }
+	std::wstring LastError(void);
+private:
+	void Arm(void);
+	void OnTick(void);
+	void Pump(std::vector<size_t>& launches);
+	void Launch(const std::vector<size_t>& launches);
+	bool OnConnected(size_t index, bool ok, const std::wstring& message);
+	std::chrono::steady_clock::duration RetryDelay(uint32_t attempt);
+private:
+	Options m_Options;
+	ConnectPacer m_Pacer;
+	Connector m_Connector;
+	Handler m_OnProgress;
+	Handler m_OnComplete;
+	std::mutex m_Mutex;
+	bool m_Running;
+	bool m_Completed;
+	size_t m_Next;
+	std::vector<uint32_t> m_Attempts;
+	std::multimap<std::chrono::steady_clock::time_point, size_t> m_Retries;
+	std::chrono::steady_clock::time_point m_LastProgress;
+	bool m_Changed;
+	std::wstring m_LastError;
+	std::mt19937 m_Random;
+	std::atomic<size_t> m_Pending;
+	std::atomic<size_t> m_Established;
+	std::atomic<size_t> m_Failed;
+};
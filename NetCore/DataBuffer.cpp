@@ -1,6 +1,8 @@
-#include "pch.h"
+﻿#include "pch.h"
 #include "DataBuffer.h"
 #include "fast_memcpy.hpp"
+#include <algorithm>
+#include <vector>
 
 constexpr size_t kBLOCK_DATA_SIZE = 8192;
 class DataBufferPrivateImpl
@@ -18,7 +20,10 @@ public:
 		m_BlockFirst(nullptr),
 		m_BlockLast(nullptr),
 		m_BlockCount(0),
-		m_TotalUsed(0)
+		m_TotalUsed(0),
+		m_BlockIndex(),
+		m_BlockOffsets(),
+		m_IndexValid(false)
 	{
 		m_BlockFirst = new BufferBlock();
 		m_BlockFirst->prev = nullptr;
@@ -26,6 +31,7 @@ public:
 		m_BlockFirst->used = 0;
 		m_BlockLast = m_BlockFirst;
 		m_BlockCount = 1;
+		RebuildIndex();
 	}
 	~DataBufferPrivateImpl()
 	{
@@ -59,10 +65,57 @@ public:
 			m_TotalUsed = 0;
 			m_BlockCount = 1;
 		}
+		InvalidateIndex();
+		if (!all)
+			RebuildIndex();
+	}
+
+	void InvalidateIndex(void)
+	{
+		m_IndexValid = false;
+		m_BlockIndex.clear();
+		m_BlockOffsets.clear();
+	}
+
+	void RebuildIndex(void)
+	{
+		m_BlockIndex.clear();
+		m_BlockOffsets.clear();
+		m_BlockIndex.reserve(m_BlockCount);
+		m_BlockOffsets.reserve(m_BlockCount);
+		size_t offset = 0;
+		for (BufferBlock* block = m_BlockFirst; block != nullptr; block = block->next)
+		{
+			m_BlockIndex.push_back(block);
+			m_BlockOffsets.push_back(offset);
+			offset += block->used;
+		}
+		m_IndexValid = true;
+	}
+
+	// 修改块结构的操作结束前调用, 查找时只读索引, 多个读者可以并发访问
+	void SyncIndex(void)
+	{
+		if (!m_IndexValid)
+			RebuildIndex();
+	}
+
+	void IndexAppendedBlock(BufferBlock* prev, BufferBlock* block)
+	{
+		if (!m_IndexValid)
+			return;
+		if (m_BlockIndex.empty() || m_BlockIndex.back() != prev)
+		{
+			InvalidateIndex();
+			return;
+		}
+		m_BlockOffsets.push_back(m_BlockOffsets.back() + prev->used);
+		m_BlockIndex.push_back(block);
 	}
 
 	BufferBlock* RemoveBlock(BufferBlock* atBlock)
 	{
+		InvalidateIndex();
 		if (atBlock == m_BlockFirst)
 		{
 			atBlock->used = 0;
@@ -97,7 +150,14 @@ public:
 		if (block->next != nullptr)
 			block->next->prev = block;
 		if (atBlock == m_BlockLast)
+		{
 			m_BlockLast = block;
+			IndexAppendedBlock(atBlock, block);
+		}
+		else
+		{
+			InvalidateIndex();
+		}
 		++m_BlockCount;
 		return block;
 	}
@@ -114,6 +174,7 @@ public:
 		if (atBlock == m_BlockFirst)
 			m_BlockFirst = block;
 		++m_BlockCount;
+		InvalidateIndex();
 		return block;
 	}
 
@@ -126,6 +187,7 @@ public:
 		m_BlockFirst->prev = block;
 		m_BlockFirst = block;
 		++m_BlockCount;
+		InvalidateIndex();
 		return block;
 	}
 
@@ -136,20 +198,32 @@ public:
 		block->next = nullptr;
 		block->used = 0;
 		m_BlockLast->next = block;
+		IndexAppendedBlock(m_BlockLast, block);
 		m_BlockLast = block;
 		++m_BlockCount;
 		return block;
 	}
 
-	BufferBlock* FindBlockByOffset(size_t& offset)
+	BufferBlock* FindBlockByOffset(size_t& offset) const
 	{
-		for (BufferBlock* block = m_BlockFirst; block != nullptr; block = block->next)
+		if (offset >= m_TotalUsed)
+			return nullptr;
+		if (!m_IndexValid)
 		{
-			if (offset < block->used)
-				return block;
-			offset -= block->used;
+			// 修改过程中索引尚未重建, 按链表查找, 不修改索引
+			for (BufferBlock* block = m_BlockFirst; block != nullptr; block = block->next)
+			{
+				if (offset < block->used)
+					return block;
+				offset -= block->used;
+			}
+			return nullptr;
 		}
-		return nullptr;
+
+		auto it = std::upper_bound(m_BlockOffsets.begin(), m_BlockOffsets.end(), offset);
+		auto index = static_cast<size_t>(it - m_BlockOffsets.begin()) - 1;
+		offset -= m_BlockOffsets[index];
+		return m_BlockIndex[index];
 	}
 
 	size_t CopyData(BufferBlock* start, size_t offset, size_t size, void* buffer, BufferBlock** next = nullptr)
@@ -178,7 +252,7 @@ public:
 			}
 			start = start->next;
 		}
-		if (*next != nullptr)
+		if (next != nullptr)
 		{
 			*next = start;
 		}
@@ -189,6 +263,9 @@ public:
 	BufferBlock* m_BlockLast;
 	size_t m_BlockCount;
 	size_t m_TotalUsed;
+	std::vector<BufferBlock*> m_BlockIndex;
+	std::vector<size_t> m_BlockOffsets;
+	bool m_IndexValid;
 };
 
 DataBuffer::DataBuffer()
@@ -301,6 +378,7 @@ void DataBuffer::AppendFill(uint8_t fill, size_t size)
 
 void DataBuffer::Prepend(const void* data, size_t size)
 {
+	m_Impl->InvalidateIndex();
 	auto addsize = size;
 	auto block = m_Impl->m_BlockFirst;
 	auto p = reinterpret_cast<const uint8_t*>(data);
@@ -332,10 +410,12 @@ void DataBuffer::Prepend(const void* data, size_t size)
 		block->used += size;
 	}
 	m_Impl->m_TotalUsed += addsize;
+	m_Impl->SyncIndex();
 }
 
 void DataBuffer::PrependFill(uint8_t fill, size_t size)
 {
+	m_Impl->InvalidateIndex();
 	auto addsize = size;
 	auto block = m_Impl->m_BlockFirst;
 	auto freeSize = kBLOCK_DATA_SIZE - block->used;
@@ -365,6 +445,7 @@ void DataBuffer::PrependFill(uint8_t fill, size_t size)
 		block->used += size;
 	}
 	m_Impl->m_TotalUsed += addsize;
+	m_Impl->SyncIndex();
 }
 
 void DataBuffer::Insert(const void* data, size_t index, size_t size)
@@ -383,6 +464,7 @@ void DataBuffer::Insert(const void* data, size_t index, size_t size)
 
 	auto addsize = size;
 	auto block = m_Impl->FindBlockByOffset(index);
+	m_Impl->InvalidateIndex();
 	if (block == nullptr)
 		block = m_Impl->AppendBlock();
 	auto p = reinterpret_cast<const uint8_t*>(data);
@@ -427,6 +509,7 @@ void DataBuffer::Insert(const void* data, size_t index, size_t size)
 		block->used += size;
 	}
 	m_Impl->m_TotalUsed += addsize;
+	m_Impl->SyncIndex();
 }
 
 void DataBuffer::InsertFill(size_t index, size_t size, uint8_t fill)
@@ -445,6 +528,7 @@ void DataBuffer::InsertFill(size_t index, size_t size, uint8_t fill)
 
 	auto addsize = size;
 	auto block = m_Impl->FindBlockByOffset(index);
+	m_Impl->InvalidateIndex();
 	if (block == nullptr)
 		block = m_Impl->AppendBlock();
 	auto freeSize = kBLOCK_DATA_SIZE - block->used;
@@ -486,6 +570,7 @@ void DataBuffer::InsertFill(size_t index, size_t size, uint8_t fill)
 		block->used += size;
 	}
 	m_Impl->m_TotalUsed += addsize;
+	m_Impl->SyncIndex();
 }
 
 void DataBuffer::Replace(const void* dest, size_t destSize, size_t srcIndex, size_t srcSize)
@@ -598,6 +683,7 @@ void DataBuffer::Remove(size_t index, size_t size)
 	auto block = m_Impl->FindBlockByOffset(index);
 	if (block == nullptr)
 		return;
+	m_Impl->InvalidateIndex();
 	auto delsize = size;
 	auto endIndex = index + size;
 	if (endIndex > block->used)
@@ -638,10 +724,12 @@ void DataBuffer::Remove(size_t index, size_t size)
 			m_Impl->RemoveBlock(block);
 	}
 	m_Impl->m_TotalUsed -= delsize - size;
+	m_Impl->SyncIndex();
 }
 
 void DataBuffer::Compress(void)
 {
+	m_Impl->InvalidateIndex();
 	auto block = m_Impl->m_BlockFirst;
 	while (block != m_Impl->m_BlockLast)
 	{
@@ -673,12 +761,14 @@ void DataBuffer::Compress(void)
 				}
 				else
 				{
+					m_Impl->SyncIndex();
 					return;
 				}
 			}
 		}
 		block = block->next;
 	}
+	m_Impl->SyncIndex();
 }
 
 void DataBuffer::Resize(size_t size)
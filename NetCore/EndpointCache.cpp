@@ -0,0 +1,93 @@
+﻿#include "pch.h"
+#include "EndpointCache.h"
+
+// 解析结果的有效期, 解析失败时只短暂缓存, 避免大量连接同时重复解析
+constexpr auto kTTL = std::chrono::seconds(60);
+constexpr auto kNEGATIVE_TTL = std::chrono::seconds(2);
+
+EndpointCache::EndpointCache(boost::asio::io_context& io) :
+	m_IOContext(io),
+	m_Mutex(),
+	m_Entries()
+{
+}
+
+void EndpointCache::Resolve(const std::string& host, uint16_t port, ResolveHandler handler)
+{
+	// 数字地址不需要解析
+	boost::system::error_code ec;
+	auto address = boost::asio::ip::make_address(host, ec);
+	if (!ec)
+	{
+		auto endpoints = std::make_shared<std::vector<boost::asio::ip::tcp::endpoint>>(1, boost::asio::ip::tcp::endpoint(address, port));
+		boost::asio::post(m_IOContext, [handler, endpoints]() { handler(boost::system::error_code(), endpoints); });
+		return;
+	}
+
+	auto key = host + ":" + std::to_string(port);
+	EntryPtr entry;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		auto& slot = m_Entries[key];
+		if (slot == nullptr)
+		{
+			slot = std::make_shared<Entry>();
+			slot->resolving = false;
+		}
+		entry = slot;
+		if (entry->resolving)
+		{
+			entry->waiters.push_back(handler);
+			return;
+		}
+		if (entry->expires > std::chrono::steady_clock::now())
+		{
+			auto ecCached = entry->ec;
+			auto endpoints = entry->endpoints;
+			boost::asio::post(m_IOContext, [handler, ecCached, endpoints]() { handler(ecCached, endpoints); });
+			return;
+		}
+		entry->resolving = true;
+		entry->waiters.push_back(handler);
+	}
+
+	auto rslv = std::make_shared<boost::asio::ip::tcp::resolver>(m_IOContext);
+	rslv->async_resolve(host, std::to_string(port), [this, rslv, entry](const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results)
+	{
+		OnResolved(entry, ec, results);
+	});
+}
+
+void EndpointCache::Clear(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	for (auto it = m_Entries.begin(); it != m_Entries.end();)
+	{
+		if (it->second->resolving)
+			++it;
+		else
+			it = m_Entries.erase(it);
+	}
+}
+
+void EndpointCache::OnResolved(const EntryPtr& entry, const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results)
+{
+	auto endpoints = std::make_shared<std::vector<boost::asio::ip::tcp::endpoint>>();
+	for (const auto& result : results)
+		endpoints->push_back(result.endpoint());
+	auto ecResult = ec;
+	if (!ecResult && endpoints->empty())
+		ecResult = boost::asio::error::host_not_found;
+
+	std::vector<ResolveHandler> waiters;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		entry->ec = ecResult;
+		entry->endpoints = endpoints;
+		entry->expires = std::chrono::steady_clock::now() + (ecResult ? std::chrono::steady_clock::duration(kNEGATIVE_TTL) : std::chrono::steady_clock::duration(kTTL));
+		entry->resolving = false;
+		waiters.swap(entry->waiters);
+	}
+	for (auto& handler : waiters)
+		handler(ecResult, endpoints);
+}
@@ -0,0 +1,40 @@
+﻿#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+
+// 主机名解析缓存: 同一主机和端口在有效期内只解析一次, 解析进行中的请求合并等待同一结果.
+class EndpointCache
+{
+public:
+	using Endpoints = std::shared_ptr<const std::vector<boost::asio::ip::tcp::endpoint>>;
+	using ResolveHandler = std::function<void(const boost::system::error_code& ec, Endpoints endpoints)>;
+public:
+	EndpointCache(void) = delete;
+	EndpointCache(const EndpointCache&) = delete;
+	EndpointCache(boost::asio::io_context& io);
+	~EndpointCache(void) = default;
+public:
+	// handler 总是在 IO 线程上调用, 不会在 Resolve 内部直接调用
+	void Resolve(const std::string& host, uint16_t port, ResolveHandler handler);
+	void Clear(void);
+private:
+	struct Entry
+	{
+		boost::system::error_code ec;
+		Endpoints endpoints;
+		std::chrono::steady_clock::time_point expires;
+		bool resolving;
+		std::vector<ResolveHandler> waiters;
+	};
+	using EntryPtr = std::shared_ptr<Entry>;
+	void OnResolved(const EntryPtr& entry, const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::results_type results);
+private:
+	boost::asio::io_context& m_IOContext;
+	std::mutex m_Mutex;
+	std::unordered_map<std::string, EntryPtr> m_Entries;
+};
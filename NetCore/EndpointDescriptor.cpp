@@ -0,0 +1,71 @@
+﻿#include "pch.h"
+#include "EndpointDescriptor.h"
+#include "OEMStringHelper.hpp"
+
+EndpointDescriptor::EndpointDescriptor(const Endpoint& local, const Endpoint& remote) :
+	m_Local(local),
+	m_Remote(remote),
+	m_Formatted(),
+	m_Description(),
+	m_LocalText(),
+	m_RemoteText()
+{
+}
+
+const EndpointDescriptor::Ptr& EndpointDescriptor::None(void)
+{
+	static const Ptr none = std::make_shared<const EndpointDescriptor>(
+		Endpoint{ boost::asio::ip::address(), 0, false },
+		Endpoint{ boost::asio::ip::address(), 0, false });
+	return none;
+}
+
+const std::wstring& EndpointDescriptor::Description(void) const
+{
+	Format();
+	return m_Description;
+}
+
+const std::wstring& EndpointDescriptor::LocalText(void) const
+{
+	Format();
+	return m_LocalText;
+}
+
+const std::wstring& EndpointDescriptor::RemoteText(void) const
+{
+	Format();
+	return m_RemoteText;
+}
+
+void EndpointDescriptor::Format(void) const
+{
+	std::call_once(m_Formatted, [this]()
+	{
+		std::wstring local;
+		std::wstring remote;
+		if (m_Local.valid)
+		{
+			local = StringToWString(m_Local.address.to_string());
+			m_LocalText = local + L"#" + std::to_wstring(m_Local.port);
+			m_Description = L"local(" + local + L":" + std::to_wstring(m_Local.port) + L")";
+		}
+		else
+		{
+			m_LocalText = L"none";
+			m_Description = L"none";
+		}
+
+		if (m_Remote.valid)
+		{
+			remote = StringToWString(m_Remote.address.to_string());
+			m_RemoteText = remote + L"#" + std::to_wstring(m_Remote.port);
+			m_Description += L" <---> remote(" + remote + L":" + std::to_wstring(m_Remote.port) + L")";
+		}
+		else
+		{
+			m_RemoteText = L"none";
+			m_Description += L" <---> none";
+		}
+	});
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <mutex>
+
+// 通道两端地址的快照: 连接建立或接受时取一次, 之后不再变化, 读取时不再调用 local_endpoint/remote_endpoint.
+// 数值形式可以直接使用; 文本形式在第一次使用时格式化并缓存, 之后返回引用, 不再分配内存.
+class EndpointDescriptor
+{
+public:
+	struct Endpoint
+	{
+		boost::asio::ip::address address;
+		uint16_t port;
+		bool valid;
+	};
+	using Ptr = std::shared_ptr<const EndpointDescriptor>;
+public:
+	EndpointDescriptor(void) = delete;
+	EndpointDescriptor(const EndpointDescriptor&) = delete;
+	EndpointDescriptor(const Endpoint& local, const Endpoint& remote);
+	~EndpointDescriptor(void) = default;
+public:
+	// 取 socket 当前的两端地址, 取不到的一端为无效
+	template <class Socket>
+	static Ptr Capture(const Socket& socket)
+	{
+		boost::system::error_code ec;
+		auto local = socket.local_endpoint(ec);
+		Endpoint l = { local.address(), local.port(), !ec };
+		auto remote = socket.remote_endpoint(ec);
+		Endpoint r = { remote.address(), remote.port(), !ec };
+		return std::make_shared<const EndpointDescriptor>(l, r);
+	}
+	// 数据报通道的对端不是 socket 的连接地址, 由调用方给出
+	template <class Socket, class RemoteEndpoint>
+	static Ptr Capture(const Socket& socket, const RemoteEndpoint& remote)
+	{
+		boost::system::error_code ec;
+		auto local = socket.local_endpoint(ec);
+		Endpoint l = { local.address(), local.port(), !ec };
+		Endpoint r = { remote.address(), remote.port(), true };
+		return std::make_shared<const EndpointDescriptor>(l, r);
+	}
+	// 尚未连接时使用, 两端都显示为 none
+	static const Ptr& None(void);
+public:
+	const Endpoint& Local(void) const { return m_Local; }
+	const Endpoint& Remote(void) const { return m_Remote; }
+	// local(地址:端口) <---> remote(地址:端口)
+	const std::wstring& Description(void) const;
+	// 地址#端口
+	const std::wstring& LocalText(void) const;
+	const std::wstring& RemoteText(void) const;
+private:
+	void Format(void) const;
+private:
+	Endpoint m_Local;
+	Endpoint m_Remote;
+	mutable std::once_flag m_Formatted;
+	mutable std::wstring m_Description;
+	mutable std::wstring m_LocalText;
+	mutable std::wstring m_RemoteText;
+};
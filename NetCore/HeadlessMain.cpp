@@ -0,0 +1,56 @@
+﻿#include "pch.h"
+#include "NetCore.h"
+#include "HeadlessRunner.h"
+#include "OEMStringHelper.hpp"
+#include <iostream>
+#include <clocale>
+#include <unistd.h>
+
+// 非 Windows 平台的入口: 只有无界面模式, 参数与 NetDebugger --headless 相同
+int main(int argc, char* argv[])
+{
+	std::setlocale(LC_ALL, "");
+
+	std::vector<std::wstring> args;
+	for (int i = 1; i < argc; ++i)
+		args.push_back(StringToWString(argv[i]));
+
+	HeadlessRunner::Options options;
+	std::wstring error;
+	if (!HeadlessRunner::ParseArguments(args, options, error))
+	{
+		std::wcout << error << std::endl << HeadlessRunner::Usage();
+		return 2;
+	}
+	// 协调者启动代理进程时使用本程序的路径
+	char path[4096] = { 0 };
+	auto length = ::readlink("/proc/self/exe", path, sizeof(path) - 1);
+	options.executable = StringToWString(length > 0 ? std::string(path, length) : std::string(argv[0]));
+
+	boost::asio::io_context io;
+	NetCore core(io);
+	HeadlessRunner::DeviceTypes types;
+	for (auto& type : NetCore::GetDeviceTypes())
+		types.push_back(std::get<0>(type));
+	HeadlessRunner runner(io, [&core](const std::wstring& className) { return core.CreateDevice(className); }, types);
+
+	boost::asio::signal_set signals(io, SIGINT, SIGTERM);
+	signals.async_wait([&runner](const boost::system::error_code& ec, int)
+	{
+		if (!ec)
+			runner.Stop();
+	});
+
+	auto work = boost::asio::make_work_guard(io);
+	std::vector<std::thread> threads((std::max)(std::thread::hardware_concurrency(), 1u) * 2);
+	core.SetIOThreadCount(threads.size());
+	for (auto& thread : threads)
+		thread = std::thread([&io]() { io.run(); });
+
+	auto code = runner.Run(options, std::wcout);
+	// IO 线程退出后才能销毁 runner, 读完成回调仍持有它的指针
+	io.stop();
+	for (auto& thread : threads)
+		thread.join();
+	return code;
+}
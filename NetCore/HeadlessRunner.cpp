@@ -0,0 +1,709 @@
+﻿#include "pch.h"
+#include "HeadlessRunner.h"
+#include "PayloadTemplate.h"
+#include "TextEncodeType.h"
+#include "LoadCoordinator.h"
+#include <thread>
+#include <sstream>
+#include <iomanip>
+
+// 主循环检查停止条件和同步发送通道的周期, 以及停止设备后等待连接关闭的上限
+constexpr auto kPOLL_INTERVAL = std::chrono::milliseconds(50);
+constexpr auto kSTOP_TIMEOUT = std::chrono::seconds(5);
+constexpr size_t kREAD_BUFFER_SIZE = 1024 * 8;
+// 代理进程上报的周期, 比协调者的输出周期短, 减少两边周期错开造成的速率波动
+constexpr auto kAGENT_REPORT_INTERVAL = std::chrono::milliseconds(100);
+
+HeadlessRunner::HeadlessRunner(boost::asio::io_context& io, DeviceFactory factory, const DeviceTypes& types) :
+	m_IOContext(io),
+	m_Factory(factory),
+	m_Types(types),
+	m_Mutex(),
+	m_Channels(),
+	m_ChannelsChanged(false),
+	m_Scheduler(nullptr),
+	m_Probe(),
+	m_Stop(false),
+	m_Disconnected(false),
+	m_StatusMessage(),
+	m_Traffic(),
+	m_Connections(0),
+	m_Last(),
+	m_Watch(),
+	m_LiveSessions(nullptr),
+	m_ServedSessions(nullptr),
+	m_Agent(nullptr),
+	m_StartTime(),
+	m_LastReport()
+{
+}
+
+std::wstring HeadlessRunner::Usage(void)
+{
+	return
+		L"NetDebugger --headless --list\n"
+		L"NetDebugger --headless --device <class> [--describe] [--set <name>=<value>]...\n"
+		L"            [--send <text> | --send-hex <hex>] [--template]\n"
+		L"            [--interval <ms> | --interval-us <us>] [--burst <n>] [--poisson]\n"
+		L"            [--closed-loop] [--delimiter <hex>] [--latency]\n"
+		L"            [--duration <s>] [--report <ms>] [--watch <name>]... [--top <n>]\n"
+		L"            [--agents <n> [--agent-port <port>] | --coordinator <host>:<port>]\n";
+}
+
+bool HeadlessRunner::ParseArguments(const std::vector<std::wstring>& args, Options& options, std::wstring& error)
+{
+	options.list = false;
+	options.describe = false;
+	options.device.clear();
+	options.properties.clear();
+	options.payload.clear();
+	options.sendTemplate = false;
+	options.send.interval = std::chrono::milliseconds(1000);
+	options.send.burst = 1;
+	options.send.poisson = false;
+	options.send.coalesce = true;
+	options.send.closedLoop = false;
+	options.send.delimiter.clear();
+	options.latency = false;
+	options.duration = std::chrono::seconds(0);
+	options.report = std::chrono::milliseconds(1000);
+	options.watch.clear();
+	options.top = 0;
+	options.agents = 0;
+	options.agentPort = 0;
+	options.coordinator.clear();
+	options.arguments = args;
+
+	for (size_t i = 0; i < args.size(); ++i)
+	{
+		auto& arg = args[i];
+		auto value = [&](std::wstring& out)
+		{
+			if (i + 1 >= args.size())
+			{
+				error = L"missing value for " + arg;
+				return false;
+			}
+			out = args[++i];
+			return true;
+		};
+		auto number = [&](uint64_t& out)
+		{
+			std::wstring text;
+			if (!value(text))
+				return false;
+			wchar_t* end = nullptr;
+			out = std::wcstoull(text.c_str(), &end, 10);
+			if (text.empty() || *end != 0)
+			{
+				error = L"invalid number for " + arg + L": " + text;
+				return false;
+			}
+			return true;
+		};
+
+		std::wstring text;
+		uint64_t n = 0;
+		if (arg == L"--headless")
+		{
+			continue;
+		}
+		else if (arg == L"--list")
+		{
+			options.list = true;
+		}
+		else if (arg == L"--describe")
+		{
+			options.describe = true;
+		}
+		else if (arg == L"--device")
+		{
+			if (!value(options.device))
+				return false;
+		}
+		else if (arg == L"--set")
+		{
+			if (!value(text))
+				return false;
+			auto pos = text.find(L'=');
+			if (pos == std::wstring::npos || pos == 0)
+			{
+				error = L"expected <name>=<value>: " + text;
+				return false;
+			}
+			options.properties.emplace_back(text.substr(0, pos), text.substr(pos + 1));
+		}
+		else if (arg == L"--send")
+		{
+			if (!value(text))
+				return false;
+			options.payload.clear();
+			Transform::DecodeWStringTo(text, TextEncodeType::UTF8, options.payload);
+		}
+		else if (arg == L"--send-hex")
+		{
+			if (!value(text))
+				return false;
+			options.payload.clear();
+			Transform::DecodeWStringTo(text, TextEncodeType::HEX, options.payload);
+		}
+		else if (arg == L"--template")
+		{
+			options.sendTemplate = true;
+		}
+		else if (arg == L"--interval" || arg == L"--interval-us")
+		{
+			if (!number(n))
+				return false;
+			if (arg == L"--interval")
+				options.send.interval = std::chrono::milliseconds(n);
+			else
+				options.send.interval = std::chrono::microseconds(n);
+		}
+		else if (arg == L"--burst")
+		{
+			if (!number(n))
+				return false;
+			options.send.burst = static_cast<size_t>((std::max)(n, static_cast<uint64_t>(1)));
+		}
+		else if (arg == L"--poisson")
+		{
+			options.send.poisson = true;
+		}
+		else if (arg == L"--closed-loop")
+		{
+			options.send.closedLoop = true;
+		}
+		else if (arg == L"--delimiter")
+		{
+			if (!value(text))
+				return false;
+			options.send.delimiter.clear();
+			Transform::DecodeWStringTo(text, TextEncodeType::HEX, options.send.delimiter);
+		}
+		else if (arg == L"--latency")
+		{
+			options.latency = true;
+		}
+		else if (arg == L"--duration")
+		{
+			if (!number(n))
+				return false;
+			options.duration = std::chrono::seconds(n);
+		}
+		else if (arg == L"--report")
+		{
+			if (!number(n))
+				return false;
+			options.report = std::chrono::milliseconds((std::max)(n, static_cast<uint64_t>(100)));
+		}
+		else if (arg == L"--watch")
+		{
+			std::wstring name;
+			if (!value(name))
+				return false;
+			options.watch.push_back(name);
+		}
+		else if (arg == L"--top")
+		{
+			if (!number(n))
+				return false;
+			options.top = static_cast<size_t>(n);
+		}
+		else if (arg == L"--agents")
+		{
+			if (!number(n))
+				return false;
+			options.agents = static_cast<size_t>(n);
+		}
+		else if (arg == L"--agent-port")
+		{
+			if (!number(n))
+				return false;
+			if (n == 0 || n > 0xFFFF)
+			{
+				error = L"invalid port for " + arg + L": " + std::to_wstring(n);
+				return false;
+			}
+			options.agentPort = static_cast<uint16_t>(n);
+		}
+		else if (arg == L"--coordinator")
+		{
+			if (!value(options.coordinator))
+				return false;
+		}
+		else
+		{
+			error = L"unknown option: " + arg;
+			return false;
+		}
+	}
+
+	if (!options.list && options.device.empty())
+	{
+		error = L"--device or --list is required";
+		return false;
+	}
+	if (options.agents > 0 && !options.coordinator.empty())
+	{
+		error = L"--agents and --coordinator can not be used together";
+		return false;
+	}
+	// 与界面一致: 数据报设备逐条发送, 流式设备合并写入
+	options.send.coalesce = options.device.find(L"UDP") != 0;
+	return true;
+}
+
+IDevice::PD HeadlessRunner::FindProperty(const IDevice::PDTable& properties, const std::wstring& name)
+{
+	for (auto& pd : properties)
+	{
+		if (pd->Name() == name)
+			return pd;
+		auto child = FindProperty(pd->Childs(), name);
+		if (child != nullptr)
+			return child;
+	}
+	return nullptr;
+}
+
+void HeadlessRunner::Describe(const IDevice::PDTable& properties, const std::wstring& indent, std::wostream& out)
+{
+	for (auto& pd : properties)
+	{
+		if ((static_cast<int>(pd->Type()) & static_cast<int>(IDevice::PropertyType::Group)) != 0)
+		{
+			out << indent << L"[" << pd->Name() << L"]" << std::endl;
+			Describe(pd->Childs(), indent + L"  ", out);
+			continue;
+		}
+		out << indent << pd->Name() << L" = " << pd->GetValue();
+		out << L"  (default " << pd->DefaultValue();
+		if (pd->ChangeFlags() == IDevice::PropertyChangeFlags::Readonly)
+			out << L", readonly";
+		auto options = pd->Options();
+		if (!options.empty())
+		{
+			out << L", one of";
+			for (auto& opt : options)
+				out << L" " << opt.first;
+		}
+		out << L")" << std::endl;
+	}
+}
+
+int HeadlessRunner::Run(const Options& options, std::wostream& out)
+{
+	if (options.list)
+	{
+		for (auto& type : m_Types)
+			out << type << std::endl;
+		return 0;
+	}
+	if (options.agents > 0 && !options.describe)
+	{
+		LoadCoordinator coordinator(m_IOContext);
+		return coordinator.Run(options, m_Stop, out);
+	}
+	if (!options.coordinator.empty() && !options.describe)
+	{
+		// 代理进程: 从协调者取得分配的属性, 统计改为上报给协调者
+		auto planned = options;
+		std::wstring error;
+		m_Agent = std::make_shared<LoadAgent>(m_IOContext);
+		if (!m_Agent->Connect(options.coordinator, planned.properties, error))
+		{
+			out << L"coordinator " << options.coordinator << L": " << error << std::endl;
+			return 2;
+		}
+		m_Agent->OnStop([this]()
+		{
+			Stop();
+		});
+		auto code = RunDevice(planned, out);
+		m_Agent->Close();
+		return code;
+	}
+	return RunDevice(options, out);
+}
+
+int HeadlessRunner::RunDevice(const Options& options, std::wostream& out)
+{
+	auto device = m_Factory(options.device);
+	if (device == nullptr)
+	{
+		out << L"unknown device class: " << options.device << std::endl;
+		return 2;
+	}
+
+	// 属性按名称设置, 设置后重新枚举, 有些属性会改变其余属性的组成
+	for (auto& kv : options.properties)
+	{
+		auto pd = FindProperty(device->EnumProperties(), kv.first);
+		if (pd == nullptr)
+		{
+			out << L"unknown property: " << kv.first << std::endl;
+			return 2;
+		}
+		if (pd->ChangeFlags() == IDevice::PropertyChangeFlags::Readonly)
+		{
+			out << L"property is readonly: " << kv.first << std::endl;
+			return 2;
+		}
+		try
+		{
+			pd->SetValue(kv.second);
+		}
+		catch (const std::exception& e)
+		{
+			out << L"invalid value for " << kv.first << L": " << e.what() << std::endl;
+			return 2;
+		}
+	}
+	if (options.describe)
+	{
+		Describe(device->EnumProperties(), L"", out);
+		return 0;
+	}
+	m_Watch.clear();
+	for (auto& name : options.watch)
+	{
+		auto pd = FindProperty(device->EnumProperties(), name);
+		if (pd == nullptr)
+		{
+			out << L"unknown property: " << name << std::endl;
+			return 2;
+		}
+		m_Watch.push_back(pd);
+	}
+	// 内置服务处理的连接不交给运行器, 连接数从服务的统计中读取
+	m_LiveSessions = nullptr;
+	m_ServedSessions = nullptr;
+	auto behavior = FindProperty(device->EnumProperties(), L"Behavior");
+	if (behavior != nullptr && behavior->GetValue() != L"0")
+	{
+		m_LiveSessions = FindProperty(device->EnumProperties(), L"Sessions");
+		m_ServedSessions = FindProperty(device->EnumProperties(), L"Served");
+	}
+
+	SendScheduler::Template tpl = nullptr;
+	if (options.sendTemplate && !options.payload.empty())
+	{
+		auto compiled = std::make_shared<PayloadTemplate>();
+		std::wstring error;
+		if (!compiled->Compile(options.payload.data(), options.payload.size(), error))
+		{
+			out << L"template error: " << error << std::endl;
+			return 2;
+		}
+		tpl = compiled;
+	}
+
+	m_Probe.Configure(options.latency, options.send.delimiter);
+	if (!options.payload.empty())
+	{
+		// 发送字节由调度器计入各通道的流量统计
+		m_Scheduler = std::make_shared<SendScheduler>(m_IOContext, options.send, nullptr);
+		m_Scheduler->SetTraffic(&m_Traffic);
+		m_Scheduler->SetPayload(std::make_shared<const std::vector<uint8_t>>(options.payload), tpl);
+		m_Scheduler->SetProbe(options.latency ? &m_Probe : nullptr);
+		// 目标速率按设置的连接数计算, 不随实际建立的连接数变化
+		auto canons = FindProperty(device->EnumProperties(), L"CanonsCount");
+		if (canons != nullptr)
+			m_Scheduler->SetTargetCount(static_cast<size_t>(std::wcstoul(canons->GetValue().c_str(), nullptr, 10)));
+	}
+
+	device->OnChannelConnected([this](IDevice::Channel channel, const std::wstring& message)
+	{
+		OnChannelConnected(channel);
+	});
+	device->OnChannelDisconnected([this](IDevice::Channel channel, const std::wstring& message)
+	{
+		OnChannelDisconnected(channel);
+	});
+	device->OnChannelsDisconnected([this](const std::vector<IDevice::Channel>& channels, const std::wstring& message)
+	{
+		OnChannelsDisconnected(channels);
+	});
+	device->OnStatusChanged([this](IDevice::DeviceStatus status, const std::wstring& message)
+	{
+		if (status != IDevice::DeviceStatus::Disconnected)
+			return;
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		m_StatusMessage = message;
+		m_Disconnected = true;
+	});
+	// 注册时会立即回调一次当前状态(未连接), 启动前清除
+	m_Disconnected = false;
+
+	m_StartTime = std::chrono::steady_clock::now();
+	m_LastReport = m_StartTime;
+	device->Start();
+	if (m_Scheduler != nullptr)
+		m_Scheduler->Start();
+
+	while (!m_Stop && !m_Disconnected)
+	{
+		std::this_thread::sleep_for(kPOLL_INTERVAL);
+		if (m_Scheduler != nullptr)
+		{
+			// 连接变化较多时合并到一次更新, 避免每个连接都重建发送目标
+			SendScheduler::Channels channels;
+			bool changed = false;
+			{
+				std::unique_lock<std::mutex> lk(m_Mutex);
+				if (m_ChannelsChanged)
+				{
+					channels = m_Channels.All();
+					m_ChannelsChanged = false;
+					changed = true;
+				}
+			}
+			if (changed)
+				m_Scheduler->SetChannels(channels);
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (options.duration.count() > 0 && now - m_StartTime >= options.duration)
+			break;
+		if (now - m_LastReport >= (m_Agent != nullptr ? std::chrono::milliseconds(kAGENT_REPORT_INTERVAL) : options.report))
+			Report(out, false);
+	}
+
+	// 停止后通道都已关闭, 在停止之前列出
+	if (options.top > 0 && m_Agent == nullptr)
+		ReportTop(out, options.top);
+	if (m_Scheduler != nullptr)
+		m_Scheduler->Stop();
+	device->Stop();
+	auto deadline = std::chrono::steady_clock::now() + kSTOP_TIMEOUT;
+	while (!m_Disconnected && std::chrono::steady_clock::now() < deadline)
+		std::this_thread::sleep_for(kPOLL_INTERVAL);
+	device->OnChannelConnected(nullptr);
+	device->OnChannelDisconnected(nullptr);
+	device->OnChannelsDisconnected(nullptr);
+	device->OnStatusChanged(nullptr);
+
+	Report(out, true);
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (!m_StatusMessage.empty())
+			out << m_StatusMessage << std::endl;
+	}
+	return Collect().connections > 0 ? 0 : 1;
+}
+
+void HeadlessRunner::OnChannelConnected(IDevice::Channel channel)
+{
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		m_Channels.Add(channel);
+		m_ChannelsChanged = true;
+	}
+	++m_Connections;
+	m_Probe.Open(channel.get());
+	auto traffic = m_Traffic.Attach(channel.get(), channel->Description());
+	auto buffer = std::make_shared<std::vector<uint8_t>>(kREAD_BUFFER_SIZE);
+	ReadChannelData(channel, traffic, buffer);
+}
+
+void HeadlessRunner::OnChannelDisconnected(IDevice::Channel channel)
+{
+	m_Probe.Close(channel.get());
+	m_Traffic.Detach(channel.get());
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_Channels.Remove(channel.get());
+	m_ChannelsChanged = true;
+}
+
+void HeadlessRunner::OnChannelsDisconnected(const std::vector<IDevice::Channel>& channels)
+{
+	for (auto& channel : channels)
+	{
+		m_Probe.Close(channel.get());
+		m_Traffic.Detach(channel.get());
+	}
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	for (auto& channel : channels)
+		m_Channels.Remove(channel.get());
+	m_ChannelsChanged = true;
+}
+
+void HeadlessRunner::ReadChannelData(IDevice::Channel channel, TrafficCounters::Handle traffic, std::shared_ptr<std::vector<uint8_t>> buffer)
+{
+	channel->ReadSome(buffer, [this, channel, traffic, buffer](bool ok, size_t io_bytes)
+	{
+		if (ok && io_bytes > 0)
+		{
+			m_Traffic.Read(traffic, io_bytes);
+			m_Probe.OnReceived(channel.get(), buffer->data(), io_bytes);
+			if (m_Scheduler != nullptr)
+				m_Scheduler->OnReceived(channel.get(), buffer->data(), io_bytes);
+		}
+		if (ok)
+			ReadChannelData(channel, traffic, buffer);
+	});
+}
+
+static std::wstring HumanReadableBytes(double bytes)
+{
+	static const wchar_t* units[] = { L"B", L"KB", L"MB", L"GB", L"TB" };
+	size_t i = 0;
+	while (bytes >= 1024.0 && i + 1 < sizeof(units) / sizeof(units[0]))
+	{
+		bytes /= 1024.0;
+		++i;
+	}
+	std::wostringstream text;
+	text << std::fixed << std::setprecision(2) << bytes << L" " << units[i];
+	return text.str();
+}
+
+static std::wstring HumanReadableRate(double bytes)
+{
+	return HumanReadableBytes(bytes) + L"/s";
+}
+
+static std::wstring HumanReadableLatency(uint64_t ns)
+{
+	std::wostringstream text;
+	text << std::fixed << std::setprecision(2) << (ns / 1000000.0) << L"ms";
+	return text.str();
+}
+
+HeadlessRunner::Counters HeadlessRunner::Collect(void)
+{
+	Counters counters = {};
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		counters.channels = m_Channels.Size();
+	}
+	counters.connections = m_Connections;
+	if (m_LiveSessions != nullptr && m_ServedSessions != nullptr)
+	{
+		counters.channels += std::wcstoull(m_LiveSessions->GetValue().c_str(), nullptr, 10);
+		counters.connections += std::wcstoull(m_ServedSessions->GetValue().c_str(), nullptr, 10);
+	}
+	auto traffic = m_Traffic.Total();
+	counters.readBytes = traffic.readBytes;
+	counters.writeBytes = traffic.writeBytes;
+	counters.errors = traffic.errors;
+	if (m_Scheduler != nullptr)
+	{
+		counters.messages = m_Scheduler->SentMessages();
+		counters.targetRate = m_Scheduler->TargetRate();
+		counters.closedLoop = m_Scheduler->ClosedLoop();
+		counters.responses = m_Scheduler->Responses();
+		counters.timeouts = m_Scheduler->Timeouts();
+		counters.overruns = m_Scheduler->Overruns();
+	}
+	counters.latency = m_Probe.Enabled();
+	if (counters.latency)
+	{
+		counters.histogram = m_Probe.Export();
+		counters.unmatched = m_Probe.Unmatched();
+	}
+	return counters;
+}
+
+void HeadlessRunner::Merge(Counters& into, const Counters& from)
+{
+	into.channels += from.channels;
+	into.connections += from.connections;
+	into.readBytes += from.readBytes;
+	into.writeBytes += from.writeBytes;
+	into.errors += from.errors;
+	into.messages += from.messages;
+	into.targetRate += from.targetRate;
+	into.closedLoop = into.closedLoop || from.closedLoop;
+	into.responses += from.responses;
+	into.timeouts += from.timeouts;
+	into.overruns += from.overruns;
+	into.latency = into.latency || from.latency;
+	into.unmatched += from.unmatched;
+	LatencyHistogram::Accumulate(into.histogram, from.histogram);
+}
+
+std::wstring HeadlessRunner::FormatReport(const Counters& current, const Counters& last, double elapsed, double interval, bool final)
+{
+	auto seconds = final ? elapsed : interval;
+	if (seconds <= 0)
+		seconds = 1;
+
+	std::wostringstream line;
+	line << std::fixed << std::setprecision(1);
+	line << (final ? L"total " : L"") << L"[" << elapsed << L"s]";
+	line << L" conn " << current.channels << L"/" << current.connections;
+	if (final)
+	{
+		line << L" rx " << HumanReadableRate(current.readBytes / seconds) << L" tx " << HumanReadableRate(current.writeBytes / seconds);
+		line << L" msg " << (current.messages / seconds) << L"/s";
+	}
+	else
+	{
+		line << L" rx " << HumanReadableRate((current.readBytes - last.readBytes) / seconds);
+		line << L" tx " << HumanReadableRate((current.writeBytes - last.writeBytes) / seconds);
+		line << L" msg " << ((current.messages - last.messages) / seconds) << L"/s";
+	}
+	if (current.targetRate > 0)
+		line << L" (target " << current.targetRate << L"/s)";
+	if (current.closedLoop)
+		line << L" resp " << current.responses << L" timeout " << current.timeouts;
+	if (current.overruns > 0)
+		line << L" overrun " << current.overruns;
+	if (current.errors > 0)
+		line << L" error " << current.errors;
+	if (current.latency)
+	{
+		auto summary = LatencyHistogram::Summarize(current.histogram);
+		line << L" lat n=" << summary.count;
+		if (summary.count > 0)
+		{
+			line << L" p50 " << HumanReadableLatency(summary.p50) << L" p90 " << HumanReadableLatency(summary.p90);
+			line << L" p99 " << HumanReadableLatency(summary.p99) << L" p99.9 " << HumanReadableLatency(summary.p999);
+			line << L" max " << HumanReadableLatency(summary.max);
+		}
+		if (final)
+			line << L" unmatched " << current.unmatched;
+	}
+	return line.str();
+}
+
+void HeadlessRunner::Report(std::wostream& out, bool final)
+{
+	auto now = std::chrono::steady_clock::now();
+	auto counters = Collect();
+	if (m_Agent != nullptr)
+		m_Agent->Send(counters, final);
+	else
+	{
+		out << FormatReport(counters, m_Last, std::chrono::duration<double>(now - m_StartTime).count(), std::chrono::duration<double>(now - m_LastReport).count(), final);
+		// 设备自己的统计(只读属性)附在每行之后
+		for (auto& pd : m_Watch)
+			out << L" " << pd->Name() << L"=" << pd->GetValue();
+		out << std::endl;
+	}
+	m_Last = counters;
+	m_LastReport = now;
+}
+
+void HeadlessRunner::ReportTop(std::wostream& out, size_t count)
+{
+	auto print = [&out](const wchar_t* title, const std::vector<TrafficCounters::Talker>& talkers)
+	{
+		out << title << std::endl;
+		for (auto& talker : talkers)
+		{
+			auto& counters = talker.counters;
+			out << std::fixed << std::setprecision(1);
+			out << L"  #" << talker.id << L" " << talker.description;
+			out << L" rx " << HumanReadableBytes(static_cast<double>(counters.readBytes)) << L"/" << counters.readMessages;
+			out << L" tx " << HumanReadableBytes(static_cast<double>(counters.writeBytes)) << L"/" << counters.writeMessages;
+			if (counters.errors > 0)
+				out << L" error " << counters.errors;
+			out << L" idle " << (talker.idle / 1000.0) << L"s age " << (talker.age / 1000.0) << L"s" << std::endl;
+		}
+	};
+	print(L"top talkers:", m_Traffic.Top(count, TrafficCounters::Order::Bytes));
+	print(L"top idle:", m_Traffic.Top(count, TrafficCounters::Order::Idle));
+}
@@ -0,0 +1,116 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <functional>
+#include <ostream>
+#include "IAsyncStream.h"
+#include "SendScheduler.h"
+#include "LatencyProbe.h"
+#include "ChannelRegistry.h"
+#include "TrafficCounters.h"
+
+class LoadAgent;
+// 无界面运行设备: 按类名创建设备, 按属性名设置参数, 驱动定时发送/接收并周期输出统计.
+// 只依赖 IDevice 接口和 IO 上下文, 不使用任何窗口.
+class HeadlessRunner
+{
+public:
+	using DeviceFactory = std::function<std::shared_ptr<IDevice>(const std::wstring& className)>;
+	using DeviceTypes = std::vector<std::wstring>;
+	struct Options
+	{
+		bool list;
+		bool describe;
+		std::wstring device;
+		std::vector<std::pair<std::wstring, std::wstring>> properties;
+		std::vector<uint8_t> payload;
+		bool sendTemplate;
+		SendScheduler::Options send;
+		bool latency;
+		std::chrono::seconds duration;
+		std::chrono::milliseconds report;
+		// 每次输出统计时附带显示的设备属性
+		std::vector<std::wstring> watch;
+		// 停止前列出流量最大和最久没有读写的通道各 top 个, 0 表示不列出
+		size_t top;
+		// 多进程运行: agents > 0 时本进程作为协调者, 分配负载给代理进程并汇总统计;
+		// agentPort 为 0 时由协调者自行启动代理进程, 否则等待代理进程连接到该端口.
+		size_t agents;
+		uint16_t agentPort;
+		std::wstring coordinator;
+		// 启动代理进程所需的程序路径和原始参数, 由入口程序填写
+		std::wstring executable;
+		std::vector<std::wstring> arguments;
+	};
+	// 累计统计, 代理进程按此上报, 协调者合并后按同样的格式输出
+	struct Counters
+	{
+		uint64_t channels;
+		uint64_t connections;
+		uint64_t readBytes;
+		uint64_t writeBytes;
+		uint64_t errors;
+		uint64_t messages;
+		double targetRate;
+		bool closedLoop;
+		uint64_t responses;
+		uint64_t timeouts;
+		uint64_t overruns;
+		bool latency;
+		uint64_t unmatched;
+		LatencyHistogram::Data histogram;
+	};
+public:
+	HeadlessRunner(void) = delete;
+	HeadlessRunner(const HeadlessRunner&) = delete;
+	HeadlessRunner(boost::asio::io_context& io, DeviceFactory factory, const DeviceTypes& types);
+	~HeadlessRunner(void) = default;
+public:
+	static bool ParseArguments(const std::vector<std::wstring>& args, Options& options, std::wstring& error);
+	static std::wstring Usage(void);
+	// 返回进程退出码: 0 成功, 1 没有建立任何连接, 2 参数或设备错误
+	int Run(const Options& options, std::wostream& out);
+	void Stop(void) { m_Stop = true; }
+	static void Merge(Counters& into, const Counters& from);
+	// elapsed 为运行时长, interval 为与 last 之间的间隔; final 时按整个运行时长计算平均值
+	static std::wstring FormatReport(const Counters& current, const Counters& last, double elapsed, double interval, bool final);
+private:
+	int RunDevice(const Options& options, std::wostream& out);
+	void Describe(const IDevice::PDTable& properties, const std::wstring& indent, std::wostream& out);
+	static IDevice::PD FindProperty(const IDevice::PDTable& properties, const std::wstring& name);
+	void OnChannelConnected(IDevice::Channel channel);
+	void OnChannelDisconnected(IDevice::Channel channel);
+	void OnChannelsDisconnected(const std::vector<IDevice::Channel>& channels);
+	void ReadChannelData(IDevice::Channel channel, TrafficCounters::Handle traffic, std::shared_ptr<std::vector<uint8_t>> buffer);
+	Counters Collect(void);
+	void Report(std::wostream& out, bool final);
+	void ReportTop(std::wostream& out, size_t count);
+private:
+	boost::asio::io_context& m_IOContext;
+	DeviceFactory m_Factory;
+	DeviceTypes m_Types;
+	std::mutex m_Mutex;
+	ChannelRegistry m_Channels;
+	bool m_ChannelsChanged;
+	std::shared_ptr<SendScheduler> m_Scheduler;
+	LatencyProbe m_Probe;
+	std::atomic<bool> m_Stop;
+	std::atomic<bool> m_Disconnected;
+	std::wstring m_StatusMessage;
+	TrafficCounters m_Traffic;
+	std::atomic<uint64_t> m_Connections;
+	Counters m_Last;
+	IDevice::PDTable m_Watch;
+	// 内置服务的连接数统计, 设备没有启用内置服务时为空
+	IDevice::PD m_LiveSessions;
+	IDevice::PD m_ServedSessions;
+	std::shared_ptr<LoadAgent> m_Agent;
+	std::chrono::steady_clock::time_point m_StartTime;
+	std::chrono::steady_clock::time_point m_LastReport;
+};
@@ -1,4 +1,4 @@
-#pragma once
+﻿#pragma once
 #include <functional>
 #include <string>
 #include <cstdint>
@@ -8,6 +8,7 @@
 #include <exception>
 
 class IAsyncChannel;
+class EndpointDescriptor;
 class IDevice
 {
 public:
@@ -60,6 +61,7 @@ public:
 	using PDTable = std::vector<PD>;
 	using Channel = std::shared_ptr<IAsyncChannel>;
 	using ChannelHandler = std::function<void(Channel channel,const std::wstring& message)>;
+	using ChannelsHandler = std::function<void(const std::vector<Channel>& channels, const std::wstring& message)>;
 	using StatusHandler = std::function<void(DeviceStatus status, const std::wstring& message)>;
 	using PropertyHandler = std::function<void(void)>;
 public:
@@ -70,6 +72,8 @@ public:
 public:
 	virtual void OnChannelConnected(ChannelHandler handler) = 0;
 	virtual void OnChannelDisconnected(ChannelHandler handler) = 0;
+	// 大量通道同时断开时一次通知; 没有设置时逐个通过 OnChannelDisconnected 通知
+	virtual void OnChannelsDisconnected(ChannelsHandler handler) = 0;
 	virtual void OnStatusChanged(StatusHandler handler) = 0;
 	virtual void OnPropertyChanged(PropertyHandler handler) = 0;
 public:
@@ -82,6 +86,14 @@ class IAsyncChannel
 {
 public:
 	using IoCompletionHandler = std::function<void(bool ok, size_t io_bytes)>;
+	using FileProgressHandler = std::function<bool(size_t io_bytes)>;
+	// 缓冲发送文件时的参数: 每块读取的大小, 预读的块数, 每次写入的大小(数据报通道不能超过单个数据报)
+	struct FileOptions
+	{
+		size_t blockSize;
+		size_t blockCount;
+		size_t writeSize;
+	};
 	using OutputBuffer = std::shared_ptr<std::vector<uint8_t>>;
 	typedef struct { const void* buffer; size_t bufferSize; } InputBuffer;
 public:
@@ -89,6 +101,8 @@ public:
 	virtual std::wstring Description(void) const = 0;
 	virtual std::wstring LocalEndPoint(void) const = 0;
 	virtual std::wstring RemoteEndPoint(void) const = 0;
+	// 连接时缓存的两端地址, 热路径上使用时不会访问 socket 或分配内存; 不缓存地址的通道返回 nullptr
+	virtual std::shared_ptr<const EndpointDescriptor> Endpoints(void) const { return nullptr; }
 public:
 	virtual void Read(OutputBuffer buffer, IoCompletionHandler handler) = 0;
 	virtual void Write(InputBuffer buffer, IoCompletionHandler handler) = 0;
@@ -96,6 +110,13 @@ public:
 	virtual void WriteSome(InputBuffer buffer, IoCompletionHandler handler) = 0;
 	virtual void Cancel(void) = 0;
 	virtual void Close(void) = 0;
+	// 一次 Write 可能合并了多条消息, 发送调度在写完成后报告其中的消息条数, 需要按消息计数的通道重写
+	virtual void MessagesWritten(size_t messages) {}
+public:
+	// 发送文件内容, 文件不能打开时返回 false. 默认实现由后台线程按 options 预读文件, 再通过 Write 分块发送,
+	// 调用者需在 handler 调用前保持通道有效; 支持的通道由内核直接发送, 不经过用户态缓冲区.
+	// progress 每发送一段调用一次, 返回 false 则中止; handler 在结束时调用.
+	virtual bool SendFile(const std::wstring& path, uint64_t offset, uint64_t length, const FileOptions& options, FileProgressHandler progress, IoCompletionHandler handler);
 };
 
 class CommunicationDevice : public IDevice
@@ -104,6 +125,7 @@ public:
 	CommunicationDevice() :
 		m_OnConnected(nullptr),
 		m_OnDisconnected(nullptr),
+		m_OnChannelsDisconnected(nullptr),
 		m_OnStatusChanged(nullptr),
 		m_OnPropertyChanged(nullptr),
 		m_Status(DeviceStatus::Disconnected)
@@ -120,6 +142,10 @@ public:
 	{
 		m_OnDisconnected = handler;
 	}
+	virtual void OnChannelsDisconnected(ChannelsHandler handler)
+	{
+		m_OnChannelsDisconnected = handler;
+	}
 	virtual void OnStatusChanged(StatusHandler handler)
 	{
 		m_OnStatusChanged = handler;
@@ -152,6 +178,16 @@ protected:
 			m_OnDisconnected(channel, message);
 		}
 	}
+	virtual void ChannelsDisconnected(const std::vector<Channel>& channels, const std::wstring& message)
+	{
+		if (m_OnChannelsDisconnected != nullptr)
+		{
+			m_OnChannelsDisconnected(channels, message);
+			return;
+		}
+		for (auto& channel : channels)
+			ChannelDisconnected(channel, message);
+	}
 	virtual void StatusChanged(DeviceStatus status, const std::wstring& message)
 	{
 		if (m_Status != status)
@@ -173,6 +209,7 @@ protected:
 private:
 	ChannelHandler m_OnConnected;
 	ChannelHandler m_OnDisconnected;
+	ChannelsHandler m_OnChannelsDisconnected;
 	StatusHandler m_OnStatusChanged;
 	PropertyHandler m_OnPropertyChanged;
 	std::atomic<DeviceStatus> m_Status;
@@ -425,7 +462,7 @@ namespace PropertyDescriptionHelper
 			m_Setter = nullptr;
 		}
 	public:
-		// ͨ PropertyDescription ̳
+		// 通过 PropertyDescription 继承
 		virtual std::wstring Name() const override
 		{
 			return m_Name;
@@ -513,7 +550,7 @@ namespace PropertyDescriptionHelper
 			m_Options.clear();
 		}
 	public:
-		// ͨ PropertyDescription ̳
+		// 通过 PropertyDescription 继承
 		virtual EnumOptions Options() const override
 		{
 			auto type = static_cast<IDevice::PropertyType>(static_cast<int>(IDevice::PropertyType::Boolean) | static_cast<int>(IDevice::PropertyType::Enum));
@@ -550,7 +587,7 @@ namespace PropertyDescriptionHelper
 				m_Type = static_cast<IDevice::PropertyType>(static_cast<int>(m_Type) | static_cast<int>(IDevice::PropertyType::Enum));
 		}
 	public:
-		// ͨ PropertyDescription ̳
+		// 通过 PropertyDescription 继承
 		virtual EnumOptions Options() const override
 		{
 			if (m_OptionsEnumHandler == nullptr)
@@ -580,7 +617,7 @@ namespace PropertyDescriptionHelper
 			m_ChangeFlags = changeFlags;
 		}
 	public:
-		// ͨ PropertyDescription ̳
+		// 通过 PropertyDescription 继承
 		virtual std::wstring Name() const override
 		{
 			return m_Name;
@@ -0,0 +1,145 @@
+﻿#include "pch.h"
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram(void) :
+	m_ShardBlock(new uint8_t[sizeof(Shard) * kSHARDS + kCACHE_LINE]),
+	m_Shards(reinterpret_cast<Shard*>(CacheLineBase(m_ShardBlock.get()))),
+	m_Min(UINT64_MAX),
+	m_Max(0)
+{
+	for (size_t s = 0; s < kSHARDS; ++s)
+		new (&m_Shards[s]) Shard;
+	Reset();
+}
+
+void LatencyHistogram::Record(uint64_t value)
+{
+	auto& shard = m_Shards[ShardIndex()];
+	shard.counts[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	shard.sum.fetch_add(value, std::memory_order_relaxed);
+
+	// 极值很少变化, 只在需要时才做比较交换
+	auto current = m_Min.load(std::memory_order_relaxed);
+	while (value < current && !m_Min.compare_exchange_weak(current, value, std::memory_order_relaxed));
+	current = m_Max.load(std::memory_order_relaxed);
+	while (value > current && !m_Max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+
+LatencyHistogram::Data LatencyHistogram::Export(void) const
+{
+	Data data;
+	data.counts.assign(kBUCKETS, 0);
+	data.sum = 0;
+	for (size_t s = 0; s < kSHARDS; ++s)
+	{
+		const auto& shard = m_Shards[s];
+		for (size_t i = 0; i < kBUCKETS; ++i)
+			data.counts[i] += shard.counts[i].load(std::memory_order_relaxed);
+		data.sum += shard.sum.load(std::memory_order_relaxed);
+	}
+	data.min = m_Min.load(std::memory_order_relaxed);
+	data.max = m_Max.load(std::memory_order_relaxed);
+	return data;
+}
+
+void LatencyHistogram::Accumulate(Data& into, const Data& from)
+{
+	if (into.counts.empty())
+	{
+		into = from;
+		return;
+	}
+	if (from.counts.empty())
+		return;
+	if (into.counts.size() < from.counts.size())
+		into.counts.resize(from.counts.size(), 0);
+	for (size_t i = 0; i < from.counts.size(); ++i)
+		into.counts[i] += from.counts[i];
+	into.sum += from.sum;
+	into.min = (std::min)(into.min, from.min);
+	into.max = (std::max)(into.max, from.max);
+}
+
+LatencyHistogram::Summary LatencyHistogram::Summarize(const Data& data)
+{
+	const auto& counts = data.counts;
+	uint64_t total = 0;
+	for (auto n : counts)
+		total += n;
+
+	Summary summary{};
+	summary.count = total;
+	if (total == 0)
+		return summary;
+	summary.min = data.min;
+	summary.max = data.max;
+	summary.mean = data.sum / total;
+
+	const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	uint64_t* results[] = { &summary.p50, &summary.p90, &summary.p99, &summary.p999 };
+	size_t q = 0;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < counts.size() && q < 4; ++i)
+	{
+		seen += counts[i];
+		while (q < 4 && seen > 0 && seen >= static_cast<uint64_t>(quantiles[q] * total + 0.5))
+		{
+			// 桶的代表值不超过实际的最大值和最小值
+			*results[q] = (std::max)(summary.min, (std::min)(BucketValue(i), summary.max));
+			++q;
+		}
+	}
+	for (; q < 4; ++q)
+		*results[q] = summary.max;
+	return summary;
+}
+
+void LatencyHistogram::Reset(void)
+{
+	for (size_t s = 0; s < kSHARDS; ++s)
+	{
+		auto& shard = m_Shards[s];
+		for (size_t i = 0; i < kBUCKETS; ++i)
+			shard.counts[i].store(0, std::memory_order_relaxed);
+		shard.sum.store(0, std::memory_order_relaxed);
+	}
+	m_Min = UINT64_MAX;
+	m_Max = 0;
+}
+
+size_t LatencyHistogram::BucketIndex(uint64_t value)
+{
+	constexpr uint64_t kLINEAR = uint64_t(1) << kSUB_BUCKET_BITS;
+	constexpr uint64_t kLIMIT = (uint64_t(1) << kMAX_VALUE_BITS) - 1;
+	if (value > kLIMIT)
+		value = kLIMIT;
+	if (value < kLINEAR)
+		return static_cast<size_t>(value);
+
+	size_t bits = 0;
+	for (auto v = value; v > 1; v >>= 1)
+		++bits;
+	// 取最高的 kSUB_BUCKET_BITS 位作为区间内的序号
+	auto shift = bits - (kSUB_BUCKET_BITS - 1);
+	return (shift << (kSUB_BUCKET_BITS - 1)) + static_cast<size_t>(value >> shift);
+}
+
+uint64_t LatencyHistogram::BucketValue(size_t index)
+{
+	constexpr size_t kLINEAR = size_t(1) << kSUB_BUCKET_BITS;
+	constexpr size_t kHALF = kLINEAR / 2;
+	if (index < kLINEAR)
+		return index;
+	auto shift = index / kHALF - 1;
+	auto sub = static_cast<uint64_t>(index - shift * kHALF);
+	auto low = sub << shift;
+	auto high = ((sub + 1) << shift) - 1;
+	return low + (high - low) / 2;
+}
+
+size_t LatencyHistogram::ShardIndex(void)
+{
+	static std::atomic<size_t> next(0);
+	thread_local size_t index = next++ % kSHARDS;
+	return index;
+}
@@ -0,0 +1,65 @@
+﻿#pragma once
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "CacheLine.h"
+
+// HDR 风格的对数分桶直方图(单位纳秒): 每个 2 的幂区间再等分为 64 份, 相对误差约 1.5%.
+// 记录时每个线程固定使用一个分片, 只做无锁的原子累加; 读取时合并所有分片.
+class LatencyHistogram
+{
+public:
+	struct Summary
+	{
+		uint64_t count;
+		uint64_t min;
+		uint64_t max;
+		uint64_t mean;
+		uint64_t p50;
+		uint64_t p90;
+		uint64_t p99;
+		uint64_t p999;
+	};
+	// 合并后的原始分桶计数, 用于跨进程汇总: 多个直方图的 Data 累加后再计算分位数
+	struct Data
+	{
+		std::vector<uint64_t> counts;
+		uint64_t sum;
+		uint64_t min;
+		uint64_t max;
+	};
+public:
+	LatencyHistogram(void);
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	~LatencyHistogram(void) = default;
+public:
+	void Record(uint64_t value);
+	Summary Snapshot(void) const { return Summarize(Export()); }
+	Data Export(void) const;
+	void Reset(void);
+public:
+	static Summary Summarize(const Data& data);
+	static void Accumulate(Data& into, const Data& from);
+private:
+	static constexpr size_t kSUB_BUCKET_BITS = 7;
+	static constexpr size_t kMAX_VALUE_BITS = 36;
+	// 最高位为第 kMAX_VALUE_BITS-1 位的区间也要占 64 个桶, 更大的值按上限记入最后一个桶
+	static constexpr size_t kBUCKETS = (kMAX_VALUE_BITS - kSUB_BUCKET_BITS + 2) << (kSUB_BUCKET_BITS - 1);
+	static constexpr size_t kSHARDS = 16;
+	// 分片从按缓存行对齐的内存块中分配, 大小补齐到缓存行的整数倍, 相邻分片不共用缓存行
+	struct Shard
+	{
+		std::atomic<uint64_t> counts[kBUCKETS];
+		std::atomic<uint64_t> sum;
+		uint8_t padding[kCACHE_LINE - (kBUCKETS + 1) * sizeof(std::atomic<uint64_t>) % kCACHE_LINE];
+	};
+	static size_t BucketIndex(uint64_t value);
+	static uint64_t BucketValue(size_t index);
+	static size_t ShardIndex(void);
+private:
+	std::unique_ptr<uint8_t[]> m_ShardBlock;
+	Shard* m_Shards;
+	std::atomic<uint64_t> m_Min;
+	std::atomic<uint64_t> m_Max;
+};
@@ -0,0 +1,190 @@
+﻿#include "pch.h"
+#include "LatencyProbe.h"
+
+// 时间戳字段: 4 字节标记 + 8 字节发送时刻(单调时钟纳秒, 小端)
+static const uint8_t kSTAMP_MAGIC[4] = { 0xA5, 'L', 'T', 0x5A };
+// 每个通道最多记录的未应答请求, 超出后不再计入
+constexpr size_t kMAX_PENDING = 64 * 1024;
+// 超过该值的往返时间视为误匹配
+constexpr uint64_t kMAX_RTT = 3600ull * 1000 * 1000 * 1000;
+
+size_t LatencyProbe::WriteStamp(uint8_t* out, uint64_t sent)
+{
+	memcpy(out, kSTAMP_MAGIC, sizeof(kSTAMP_MAGIC));
+	for (size_t i = 0; i < 8; ++i)
+		out[sizeof(kSTAMP_MAGIC) + i] = static_cast<uint8_t>(sent >> (i * 8));
+	return kSTAMP_SIZE;
+}
+
+uint64_t LatencyProbe::Now(void)
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+LatencyProbe::LatencyProbe(void) :
+	m_Enabled(false),
+	m_Delimiter(),
+	m_Shards(),
+	m_Histogram(),
+	m_Unmatched(0)
+{
+}
+
+void LatencyProbe::Configure(bool enabled, const std::vector<uint8_t>& delimiter)
+{
+	// 只在设备启动前调用, 此时没有 IO 回调在使用这些参数
+	m_Enabled = enabled;
+	m_Delimiter = delimiter;
+	Reset();
+}
+
+size_t LatencyProbe::ShardIndex(const IAsyncChannel* key)
+{
+	auto value = reinterpret_cast<uintptr_t>(key) >> 4;
+	value ^= value >> 7;
+	return value % kSHARD_COUNT;
+}
+
+void LatencyProbe::Open(const IAsyncChannel* key)
+{
+	if (!m_Enabled)
+		return;
+	auto channel = std::make_shared<Channel>();
+	channel->matched = 0;
+	auto& shard = m_Shards[ShardIndex(key)];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	shard.channels[key] = channel;
+}
+
+void LatencyProbe::Close(const IAsyncChannel* key)
+{
+	auto& shard = m_Shards[ShardIndex(key)];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	auto it = shard.channels.find(key);
+	if (it == shard.channels.end())
+		return;
+	std::unique_lock<std::mutex> clk(it->second->mutex);
+	m_Unmatched += it->second->pending.size();
+	clk.unlock();
+	shard.channels.erase(it);
+}
+
+LatencyProbe::ChannelPtr LatencyProbe::Find(const IAsyncChannel* key) const
+{
+	auto& shard = m_Shards[ShardIndex(key)];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	auto it = shard.channels.find(key);
+	return it != shard.channels.end() ? it->second : nullptr;
+}
+
+void LatencyProbe::OnSent(const IAsyncChannel* key, size_t messages, uint64_t sent)
+{
+	if (!m_Enabled || m_Delimiter.empty())
+		return;
+	auto channel = Find(key);
+	if (channel == nullptr)
+		return;
+	if (sent == 0)
+		sent = Now();
+	std::unique_lock<std::mutex> lk(channel->mutex);
+	for (size_t i = 0; i < messages; ++i)
+	{
+		if (channel->pending.size() >= kMAX_PENDING)
+		{
+			m_Unmatched += messages - i;
+			break;
+		}
+		channel->pending.push_back(sent);
+	}
+}
+
+void LatencyProbe::OnReceived(const IAsyncChannel* key, const uint8_t* data, size_t size)
+{
+	if (!m_Enabled)
+		return;
+	auto channel = Find(key);
+	if (channel == nullptr)
+		return;
+	auto now = Now();
+	std::unique_lock<std::mutex> lk(channel->mutex);
+	if (m_Delimiter.empty())
+		ScanStamps(*channel, data, size, now);
+	else
+		ScanDelimiters(*channel, data, size, now);
+}
+
+void LatencyProbe::ScanStamps(Channel& channel, const uint8_t* data, size_t size, uint64_t now)
+{
+	// 标记可能跨越两次接收, 已匹配的部分保存在通道中
+	size_t i = 0;
+	while (i < size)
+	{
+		if (channel.matched == 0)
+		{
+			auto p = static_cast<const uint8_t*>(memchr(data + i, kSTAMP_MAGIC[0], size - i));
+			if (p == nullptr)
+				break;
+			i = p - data;
+		}
+
+		auto c = data[i];
+		if (channel.matched < sizeof(kSTAMP_MAGIC) && c != kSTAMP_MAGIC[channel.matched])
+		{
+			// 标记首字节不重复出现, 失配后只需重新检查当前字节
+			channel.matched = 0;
+			if (c != kSTAMP_MAGIC[0])
+			{
+				++i;
+				continue;
+			}
+		}
+		channel.stamp[channel.matched++] = c;
+		++i;
+		if (channel.matched == kSTAMP_SIZE)
+		{
+			uint64_t sent = 0;
+			for (size_t k = 0; k < 8; ++k)
+				sent |= static_cast<uint64_t>(channel.stamp[sizeof(kSTAMP_MAGIC) + k]) << (k * 8);
+			Record(sent, now);
+			channel.matched = 0;
+		}
+	}
+}
+
+void LatencyProbe::ScanDelimiters(Channel& channel, const uint8_t* data, size_t size, uint64_t now)
+{
+	for (size_t i = 0; i < size; ++i)
+	{
+		auto c = data[i];
+		if (c != m_Delimiter[channel.matched])
+		{
+			channel.matched = 0;
+			if (c != m_Delimiter[0])
+				continue;
+		}
+		if (++channel.matched < m_Delimiter.size())
+			continue;
+		channel.matched = 0;
+		if (!channel.pending.empty())
+		{
+			Record(channel.pending.front(), now);
+			channel.pending.pop_front();
+		}
+	}
+}
+
+void LatencyProbe::Record(uint64_t sent, uint64_t now)
+{
+	if (sent > now || now - sent > kMAX_RTT)
+	{
+		++m_Unmatched;
+		return;
+	}
+	m_Histogram.Record(now - sent);
+}
+
+void LatencyProbe::Reset(void)
+{
+	m_Histogram.Reset();
+	m_Unmatched = 0;
+}
@@ -0,0 +1,64 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+#include "LatencyHistogram.h"
+
+// 请求/响应延迟测量, 支持两种匹配方式:
+//   时间戳: 发送内容带 ${stamp} 字段(标记 + 发送时刻), 对端原样返回, 从接收数据中找出标记计算往返时间;
+//   分隔符: 每个通道按顺序记录发送时刻, 接收数据中每出现一次分隔符, 对应最早一条未应答的请求.
+class IAsyncChannel;
+class LatencyProbe
+{
+public:
+	static constexpr size_t kSTAMP_SIZE = 12;
+	static size_t WriteStamp(uint8_t* out, uint64_t sent);
+	static uint64_t Now(void);
+public:
+	LatencyProbe(void);
+	LatencyProbe(const LatencyProbe&) = delete;
+	~LatencyProbe(void) = default;
+public:
+	// 分隔符为空时使用时间戳方式
+	void Configure(bool enabled, const std::vector<uint8_t>& delimiter);
+	bool Enabled(void) const { return m_Enabled; }
+	void Open(const IAsyncChannel* key);
+	void Close(const IAsyncChannel* key);
+	// sent 为计划发送时刻, 按计划时刻计时, 发送落后时排队的时间也计入延迟; 为 0 时取当前时刻
+	void OnSent(const IAsyncChannel* key, size_t messages, uint64_t sent = 0);
+	void OnReceived(const IAsyncChannel* key, const uint8_t* data, size_t size);
+	LatencyHistogram::Summary Summary(void) const { return m_Histogram.Snapshot(); }
+	LatencyHistogram::Data Export(void) const { return m_Histogram.Export(); }
+	uint64_t Unmatched(void) const { return m_Unmatched; }
+	void Reset(void);
+private:
+	struct Channel
+	{
+		std::mutex mutex;
+		std::deque<uint64_t> pending;
+		size_t matched;
+		uint8_t stamp[kSTAMP_SIZE];
+	};
+	using ChannelPtr = std::shared_ptr<Channel>;
+	static constexpr size_t kSHARD_COUNT = 64;
+	struct alignas(64) Shard
+	{
+		mutable std::mutex mutex;
+		std::unordered_map<const IAsyncChannel*, ChannelPtr> channels;
+	};
+	static size_t ShardIndex(const IAsyncChannel* key);
+	ChannelPtr Find(const IAsyncChannel* key) const;
+	void ScanStamps(Channel& channel, const uint8_t* data, size_t size, uint64_t now);
+	void ScanDelimiters(Channel& channel, const uint8_t* data, size_t size, uint64_t now);
+	void Record(uint64_t sent, uint64_t now);
+private:
+	std::atomic<bool> m_Enabled;
+	std::vector<uint8_t> m_Delimiter;
+	Shard m_Shards[kSHARD_COUNT];
+	LatencyHistogram m_Histogram;
+	std::atomic<uint64_t> m_Unmatched;
+};
@@ -0,0 +1,616 @@
+﻿#include "pch.h"
+#include "LoadCoordinator.h"
+#include "TextEncodeType.h"
+#include "OEMStringHelper.hpp"
+#include <thread>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <istream>
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+// 本地启动的代理进程连接到协调者的上限, 以及通知停止后等待最终统计的上限
+constexpr auto kPOLL_INTERVAL = std::chrono::milliseconds(50);
+constexpr auto kCONNECT_TIMEOUT = std::chrono::seconds(10);
+constexpr auto kFINISH_TIMEOUT = std::chrono::seconds(10);
+
+static std::string ToUTF8(const std::wstring& text)
+{
+	std::vector<uint8_t> bytes;
+	Transform::DecodeWStringTo(text, TextEncodeType::UTF8, bytes);
+	return std::string(bytes.begin(), bytes.end());
+}
+
+static std::wstring FromUTF8(const std::string& text)
+{
+	return Transform::DecodeToWString(std::vector<uint8_t>(text.begin(), text.end()), TextEncodeType::UTF8);
+}
+
+static bool ReadLine(boost::asio::streambuf& buffer, std::string& line)
+{
+	std::istream stream(&buffer);
+	if (!std::getline(stream, line))
+		return false;
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+	return true;
+}
+
+LoadAgent::LoadAgent(boost::asio::io_context& io) :
+	m_IOContext(io),
+	m_Socket(io),
+	m_Buffer(),
+	m_Mutex(),
+	m_StopHandler(nullptr)
+{
+}
+
+bool LoadAgent::Connect(const std::wstring& coordinator, Properties& properties, std::wstring& error)
+{
+	auto pos = coordinator.rfind(L':');
+	if (pos == std::wstring::npos || pos == 0)
+	{
+		error = L"expected <host>:<port>";
+		return false;
+	}
+	boost::system::error_code ec;
+	boost::asio::ip::tcp::resolver resolver(m_IOContext);
+	auto results = resolver.resolve(ToUTF8(coordinator.substr(0, pos)), ToUTF8(coordinator.substr(pos + 1)), ec);
+	if (!ec)
+		boost::asio::connect(m_Socket, results, ec);
+	if (ec)
+	{
+		error = StringToWString(ec.message());
+		return false;
+	}
+	m_Socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+
+	// 所有代理都连接后协调者才下发分配, 各代理收到 "go" 后同时开始
+	properties.clear();
+	for (;;)
+	{
+		std::string line;
+		boost::asio::read_until(m_Socket, m_Buffer, '\n', ec);
+		if (ec)
+		{
+			error = StringToWString(ec.message());
+			return false;
+		}
+		ReadLine(m_Buffer, line);
+		if (line == "go")
+			break;
+		if (line.compare(0, 4, "set ") != 0)
+			continue;
+		auto text = FromUTF8(line.substr(4));
+		auto eq = text.find(L'=');
+		if (eq != std::wstring::npos && eq > 0)
+			properties.emplace_back(text.substr(0, eq), text.substr(eq + 1));
+	}
+	ReadCommand();
+	return true;
+}
+
+void LoadAgent::OnStop(StopHandler handler)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_StopHandler = handler;
+}
+
+void LoadAgent::NotifyStop(void)
+{
+	StopHandler handler;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		handler = m_StopHandler;
+	}
+	if (handler != nullptr)
+		handler();
+}
+
+void LoadAgent::ReadCommand(void)
+{
+	auto self = shared_from_this();
+	boost::asio::async_read_until(m_Socket, m_Buffer, '\n', [self](const boost::system::error_code& ec, size_t bytes)
+	{
+		if (ec)
+		{
+			// 协调者退出时同样停止, 不留下无人汇总的代理进程
+			if (ec != boost::asio::error::operation_aborted)
+				self->NotifyStop();
+			return;
+		}
+		std::string line;
+		ReadLine(self->m_Buffer, line);
+		if (line == "stop")
+			self->NotifyStop();
+		self->ReadCommand();
+	});
+}
+
+void LoadAgent::Send(const HeadlessRunner::Counters& counters, bool final)
+{
+	auto line = std::string(final ? "final " : "stat ") + Serialize(counters) + "\n";
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	boost::system::error_code ec;
+	boost::asio::write(m_Socket, boost::asio::buffer(line), ec);
+}
+
+void LoadAgent::Close(void)
+{
+	OnStop(nullptr);
+	boost::system::error_code ec;
+	m_Socket.shutdown(boost::asio::socket_base::shutdown_both, ec);
+	m_Socket.close(ec);
+}
+
+std::string LoadAgent::Serialize(const HeadlessRunner::Counters& counters)
+{
+	std::ostringstream text;
+	text << std::fixed << std::setprecision(3);
+	text << "chan=" << counters.channels;
+	text << " conn=" << counters.connections;
+	text << " rx=" << counters.readBytes;
+	text << " tx=" << counters.writeBytes;
+	text << " err=" << counters.errors;
+	text << " msg=" << counters.messages;
+	text << " target=" << counters.targetRate;
+	text << " closed=" << (counters.closedLoop ? 1 : 0);
+	text << " resp=" << counters.responses;
+	text << " timeout=" << counters.timeouts;
+	text << " overrun=" << counters.overruns;
+	text << " lat=" << (counters.latency ? 1 : 0);
+	text << " unmatched=" << counters.unmatched;
+	// 直方图只传输非零分桶: 下标:计数
+	auto& histogram = counters.histogram;
+	if (!histogram.counts.empty())
+	{
+		text << " sum=" << histogram.sum << " min=" << histogram.min << " max=" << histogram.max << " hist=";
+		bool first = true;
+		for (size_t i = 0; i < histogram.counts.size(); ++i)
+		{
+			if (histogram.counts[i] == 0)
+				continue;
+			text << (first ? "" : ",") << i << ":" << histogram.counts[i];
+			first = false;
+		}
+	}
+	return text.str();
+}
+
+bool LoadAgent::Deserialize(const std::string& text, HeadlessRunner::Counters& counters)
+{
+	counters = HeadlessRunner::Counters();
+	std::istringstream stream(text);
+	std::string token;
+	bool histogram = false;
+	while (stream >> token)
+	{
+		auto eq = token.find('=');
+		if (eq == std::string::npos)
+			return false;
+		auto key = token.substr(0, eq);
+		auto value = token.substr(eq + 1);
+		auto number = std::strtoull(value.c_str(), nullptr, 10);
+		if (key == "chan")
+			counters.channels = number;
+		else if (key == "conn")
+			counters.connections = number;
+		else if (key == "rx")
+			counters.readBytes = number;
+		else if (key == "tx")
+			counters.writeBytes = number;
+		else if (key == "err")
+			counters.errors = number;
+		else if (key == "msg")
+			counters.messages = number;
+		else if (key == "target")
+			counters.targetRate = std::strtod(value.c_str(), nullptr);
+		else if (key == "closed")
+			counters.closedLoop = number != 0;
+		else if (key == "resp")
+			counters.responses = number;
+		else if (key == "timeout")
+			counters.timeouts = number;
+		else if (key == "overrun")
+			counters.overruns = number;
+		else if (key == "lat")
+			counters.latency = number != 0;
+		else if (key == "unmatched")
+			counters.unmatched = number;
+		else if (key == "sum")
+			counters.histogram.sum = number;
+		else if (key == "min")
+			counters.histogram.min = number;
+		else if (key == "max")
+			counters.histogram.max = number;
+		else if (key == "hist")
+		{
+			std::istringstream buckets(value);
+			std::string bucket;
+			while (std::getline(buckets, bucket, ','))
+			{
+				auto colon = bucket.find(':');
+				if (colon == std::string::npos)
+					return false;
+				auto index = static_cast<size_t>(std::strtoull(bucket.c_str(), nullptr, 10));
+				if (index >= counters.histogram.counts.size())
+					counters.histogram.counts.resize(index + 1, 0);
+				counters.histogram.counts[index] = std::strtoull(bucket.c_str() + colon + 1, nullptr, 10);
+				histogram = true;
+			}
+		}
+	}
+	// 没有任何样本时保持空直方图, 合并时不影响其余代理的最小值
+	if (!histogram)
+		counters.histogram = LatencyHistogram::Data();
+	return true;
+}
+
+
+LoadCoordinator::LoadCoordinator(boost::asio::io_context& io) :
+	m_IOContext(io),
+	m_Acceptor(io),
+	m_Mutex(),
+	m_Agents(),
+	m_Expected(0),
+	m_Processes()
+{
+}
+
+std::vector<LoadCoordinator::Properties> LoadCoordinator::Plan(const Properties& properties, size_t agents)
+{
+	std::vector<Properties> plan(agents);
+	for (auto& kv : properties)
+	{
+		if (kv.first == L"CanonsCount" || kv.first == L"ConnectRate")
+		{
+			wchar_t* end = nullptr;
+			auto total = std::wcstoull(kv.second.c_str(), &end, 10);
+			if (!kv.second.empty() && *end == 0)
+			{
+				for (size_t i = 0; i < agents; ++i)
+				{
+					auto share = total / agents + (i < total % agents ? 1 : 0);
+					// 建连速率 0 表示不限制, 拆分后不能变成 0
+					if (kv.first == L"ConnectRate" && total > 0)
+						share = (std::max)(share, static_cast<decltype(share)>(1));
+					plan[i].emplace_back(kv.first, std::to_wstring(share));
+				}
+				continue;
+			}
+		}
+		else if (kv.first == L"LocalAddress")
+		{
+			std::vector<std::wstring> addresses;
+			std::wistringstream stream(kv.second);
+			std::wstring address;
+			while (std::getline(stream, address, L','))
+			{
+				if (!address.empty())
+					addresses.push_back(address);
+			}
+			if (!addresses.empty())
+			{
+				// 地址多于代理时轮流分配, 少于代理时多个代理共用
+				for (size_t i = 0; i < agents; ++i)
+				{
+					std::wstring assigned;
+					for (size_t j = i % addresses.size(); j < addresses.size(); j += agents)
+						assigned += (assigned.empty() ? L"" : L",") + addresses[j];
+					plan[i].emplace_back(kv.first, assigned);
+				}
+				continue;
+			}
+		}
+		for (auto& agent : plan)
+			agent.push_back(kv);
+	}
+	return plan;
+}
+
+void LoadCoordinator::Accept(void)
+{
+	m_Acceptor.async_accept([this](const boost::system::error_code& ec, boost::asio::ip::tcp::socket socket)
+	{
+		if (ec)
+			return;
+		auto agent = std::make_shared<Agent>();
+		agent->socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(socket));
+		agent->buffer = std::make_shared<boost::asio::streambuf>();
+		agent->counters = HeadlessRunner::Counters();
+		agent->reported = false;
+		agent->finished = false;
+		boost::system::error_code ecSet;
+		agent->socket->set_option(boost::asio::ip::tcp::no_delay(true), ecSet);
+		{
+			std::unique_lock<std::mutex> lk(m_Mutex);
+			m_Agents.push_back(agent);
+			if (m_Agents.size() >= m_Expected)
+				return;
+		}
+		Accept();
+	});
+}
+
+void LoadCoordinator::ReadStat(const AgentPtr& agent)
+{
+	boost::asio::async_read_until(*agent->socket, *agent->buffer, '\n', [agent](const boost::system::error_code& ec, size_t bytes)
+	{
+		if (ec)
+		{
+			// 代理异常退出时保留它最后一次上报的统计
+			std::unique_lock<std::mutex> lk(agent->mutex);
+			agent->finished = true;
+			return;
+		}
+		std::string line;
+		ReadLine(*agent->buffer, line);
+		auto pos = line.find(' ');
+		auto kind = line.substr(0, pos);
+		HeadlessRunner::Counters counters;
+		if (pos != std::string::npos && (kind == "stat" || kind == "final") && LoadAgent::Deserialize(line.substr(pos + 1), counters))
+		{
+			std::unique_lock<std::mutex> lk(agent->mutex);
+			agent->counters = counters;
+			agent->reported = true;
+			agent->finished = kind == "final";
+		}
+		ReadStat(agent);
+	});
+}
+
+HeadlessRunner::Counters LoadCoordinator::Total(size_t& finished)
+{
+	HeadlessRunner::Counters total = HeadlessRunner::Counters();
+	finished = 0;
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	for (auto& agent : m_Agents)
+	{
+		std::unique_lock<std::mutex> lkAgent(agent->mutex);
+		if (agent->reported)
+			HeadlessRunner::Merge(total, agent->counters);
+		if (agent->finished)
+			++finished;
+	}
+	return total;
+}
+
+void LoadCoordinator::Broadcast(const std::string& line)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	for (auto& agent : m_Agents)
+	{
+		boost::system::error_code ec;
+		boost::asio::write(*agent->socket, boost::asio::buffer(line), ec);
+	}
+}
+
+void LoadCoordinator::CloseAll(void)
+{
+	boost::system::error_code ec;
+	m_Acceptor.close(ec);
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	for (auto& agent : m_Agents)
+	{
+		agent->socket->shutdown(boost::asio::socket_base::shutdown_both, ec);
+		agent->socket->close(ec);
+	}
+}
+
+#ifdef _WIN32
+// 按 CommandLineToArgvW 的规则给参数加引号
+static std::wstring QuoteArgument(const std::wstring& arg)
+{
+	if (!arg.empty() && arg.find_first_of(L" \t\"") == std::wstring::npos)
+		return arg;
+	std::wstring result = L"\"";
+	size_t slashes = 0;
+	for (auto c : arg)
+	{
+		if (c == L'\\')
+		{
+			++slashes;
+			continue;
+		}
+		result.append(c == L'"' ? slashes * 2 + 1 : slashes, L'\\');
+		result += c;
+		slashes = 0;
+	}
+	result.append(slashes * 2, L'\\');
+	result += L'"';
+	return result;
+}
+#endif
+
+bool LoadCoordinator::Spawn(const HeadlessRunner::Options& options, std::wostream& out)
+{
+	if (options.executable.empty())
+	{
+		out << L"coordinator: executable path is unknown, start agents with --coordinator" << std::endl;
+		return false;
+	}
+	// 代理使用相同的参数, 去掉协调者自己的选项并指向本协调者
+	std::vector<std::wstring> args;
+	for (size_t i = 0; i < options.arguments.size(); ++i)
+	{
+		auto& arg = options.arguments[i];
+		if (arg == L"--agents" || arg == L"--agent-port")
+		{
+			++i;
+			continue;
+		}
+		args.push_back(arg);
+	}
+	boost::system::error_code ec;
+	args.push_back(L"--coordinator");
+	args.push_back(L"127.0.0.1:" + std::to_wstring(m_Acceptor.local_endpoint(ec).port()));
+
+	for (size_t i = 0; i < m_Expected; ++i)
+	{
+#ifdef _WIN32
+		std::wstring command = QuoteArgument(options.executable);
+		for (auto& arg : args)
+			command += L" " + QuoteArgument(arg);
+		STARTUPINFOW si = { sizeof(si) };
+		PROCESS_INFORMATION pi = { 0 };
+		if (!::CreateProcessW(options.executable.c_str(), &command[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+		{
+			out << L"failed to start agent: error " << ::GetLastError() << std::endl;
+			return false;
+		}
+		::CloseHandle(pi.hThread);
+		m_Processes.push_back(pi.hProcess);
+#else
+		std::vector<std::string> strings;
+		strings.push_back(WStringToString(options.executable));
+		for (auto& arg : args)
+			strings.push_back(WStringToString(arg));
+		std::vector<char*> argv;
+		for (auto& s : strings)
+			argv.push_back(&s[0]);
+		argv.push_back(nullptr);
+		pid_t pid = 0;
+		auto err = ::posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ);
+		if (err != 0)
+		{
+			out << L"failed to start agent: " << StringToWString(std::strerror(err)) << std::endl;
+			return false;
+		}
+		m_Processes.push_back(pid);
+#endif
+	}
+	return true;
+}
+
+void LoadCoordinator::Reap(void)
+{
+	for (auto process : m_Processes)
+	{
+#ifdef _WIN32
+		::WaitForSingleObject(process, INFINITE);
+		::CloseHandle(process);
+#else
+		int status = 0;
+		::waitpid(process, &status, 0);
+#endif
+	}
+	m_Processes.clear();
+}
+
+int LoadCoordinator::Run(const HeadlessRunner::Options& options, const std::atomic<bool>& stop, std::wostream& out)
+{
+	m_Expected = options.agents;
+	auto plan = Plan(options.properties, m_Expected);
+
+	// 只监听本机回环地址, 代理进程与协调者运行在同一台机器上
+	boost::system::error_code ec;
+	boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::address_v4::loopback(), options.agentPort);
+	m_Acceptor.open(endpoint.protocol(), ec);
+	if (!ec)
+		m_Acceptor.set_option(boost::asio::socket_base::reuse_address(true), ec);
+	if (!ec)
+		m_Acceptor.bind(endpoint, ec);
+	if (!ec)
+		m_Acceptor.listen(boost::asio::socket_base::max_listen_connections, ec);
+	if (ec)
+	{
+		out << L"coordinator: " << StringToWString(ec.message()) << std::endl;
+		return 2;
+	}
+	Accept();
+
+	bool spawned = options.agentPort == 0;
+	if (spawned)
+	{
+		if (!Spawn(options, out))
+		{
+			CloseAll();
+			Reap();
+			return 2;
+		}
+	}
+	else
+	{
+		out << L"waiting for " << m_Expected << L" agents on 127.0.0.1:" << options.agentPort << std::endl;
+	}
+
+	// 自行启动的代理有连接时限, 手工启动的代理一直等到中断
+	auto deadline = std::chrono::steady_clock::now() + kCONNECT_TIMEOUT;
+	size_t connected = 0;
+	while (!stop)
+	{
+		{
+			std::unique_lock<std::mutex> lk(m_Mutex);
+			connected = m_Agents.size();
+		}
+		if (connected >= m_Expected)
+			break;
+		if (spawned && std::chrono::steady_clock::now() >= deadline)
+			break;
+		std::this_thread::sleep_for(kPOLL_INTERVAL);
+	}
+	if (connected < m_Expected)
+	{
+		out << L"only " << connected << L" of " << m_Expected << L" agents connected" << std::endl;
+		CloseAll();
+		Reap();
+		return 2;
+	}
+
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		for (size_t i = 0; i < m_Agents.size(); ++i)
+		{
+			std::string lines;
+			for (auto& kv : plan[i])
+				lines += "set " + ToUTF8(kv.first + L"=" + kv.second) + "\n";
+			lines += "go\n";
+			boost::asio::write(*m_Agents[i]->socket, boost::asio::buffer(lines), ec);
+			ReadStat(m_Agents[i]);
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	auto lastReport = start;
+	auto finishDeadline = start;
+	bool stopping = false;
+	size_t finished = 0;
+	HeadlessRunner::Counters last = HeadlessRunner::Counters();
+	for (;;)
+	{
+		std::this_thread::sleep_for(kPOLL_INTERVAL);
+		auto now = std::chrono::steady_clock::now();
+		auto total = Total(finished);
+		if (finished >= m_Expected)
+			break;
+		if (stop && !stopping)
+		{
+			stopping = true;
+			finishDeadline = now + kFINISH_TIMEOUT;
+			Broadcast("stop\n");
+		}
+		if (stopping && now >= finishDeadline)
+			break;
+		if (now - lastReport >= options.report)
+		{
+			auto elapsed = std::chrono::duration<double>(now - start).count();
+			auto interval = std::chrono::duration<double>(now - lastReport).count();
+			out << HeadlessRunner::FormatReport(total, last, elapsed, interval, false);
+			out << L" agents " << (m_Expected - finished) << L"/" << m_Expected << std::endl;
+			last = total;
+			lastReport = now;
+		}
+	}
+
+	auto total = Total(finished);
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	out << HeadlessRunner::FormatReport(total, total, elapsed, elapsed, true);
+	out << L" agents " << finished << L"/" << m_Expected << std::endl;
+	CloseAll();
+	Reap();
+	return total.connections > 0 ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <ostream>
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+#include "HeadlessRunner.h"
+
+// 多进程协调运行: 协调者通过本机 TCP 连接控制若干代理进程, 每个代理进程运行一个设备.
+// 协议为按行的文本(UTF-8):
+//   协调者 -> 代理: "set <name>=<value>" 若干行, "go" 开始运行, "stop" 提前停止;
+//   代理 -> 协调者: "stat <counters>" 周期上报累计统计, "final <counters>" 运行结束.
+class LoadAgent : public std::enable_shared_from_this<LoadAgent>
+{
+public:
+	using Properties = std::vector<std::pair<std::wstring, std::wstring>>;
+	using StopHandler = std::function<void(void)>;
+public:
+	LoadAgent(void) = delete;
+	LoadAgent(const LoadAgent&) = delete;
+	LoadAgent(boost::asio::io_context& io);
+	~LoadAgent(void) = default;
+public:
+	// 连接协调者并等待分配, 分配的属性替换 properties 中的命令行设置
+	bool Connect(const std::wstring& coordinator, Properties& properties, std::wstring& error);
+	void OnStop(StopHandler handler);
+	void Send(const HeadlessRunner::Counters& counters, bool final);
+	void Close(void);
+public:
+	static std::string Serialize(const HeadlessRunner::Counters& counters);
+	static bool Deserialize(const std::string& text, HeadlessRunner::Counters& counters);
+private:
+	void ReadCommand(void);
+	void NotifyStop(void);
+private:
+	boost::asio::io_context& m_IOContext;
+	boost::asio::ip::tcp::socket m_Socket;
+	boost::asio::streambuf m_Buffer;
+	std::mutex m_Mutex;
+	StopHandler m_StopHandler;
+};
+
+class LoadCoordinator
+{
+public:
+	using Properties = std::vector<std::pair<std::wstring, std::wstring>>;
+public:
+	LoadCoordinator(void) = delete;
+	LoadCoordinator(const LoadCoordinator&) = delete;
+	LoadCoordinator(boost::asio::io_context& io);
+	~LoadCoordinator(void) = default;
+public:
+	// 返回值与 HeadlessRunner::Run 相同, stop 置位时通知所有代理停止并等待其最终统计
+	int Run(const HeadlessRunner::Options& options, const std::atomic<bool>& stop, std::wostream& out);
+	// 按代理数量拆分连接数、建连速率和本地地址列表, 其余属性原样下发
+	static std::vector<Properties> Plan(const Properties& properties, size_t agents);
+private:
+	struct Agent
+	{
+		std::mutex mutex;
+		std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+		std::shared_ptr<boost::asio::streambuf> buffer;
+		HeadlessRunner::Counters counters;
+		bool reported;
+		bool finished;
+	};
+	using AgentPtr = std::shared_ptr<Agent>;
+	void Accept(void);
+	static void ReadStat(const AgentPtr& agent);
+	bool Spawn(const HeadlessRunner::Options& options, std::wostream& out);
+	void Reap(void);
+	HeadlessRunner::Counters Total(size_t& finished);
+	void Broadcast(const std::string& line);
+	void CloseAll(void);
+private:
+	boost::asio::io_context& m_IOContext;
+	boost::asio::ip::tcp::acceptor m_Acceptor;
+	std::mutex m_Mutex;
+	std::vector<AgentPtr> m_Agents;
+	size_t m_Expected;
+#ifdef _WIN32
+	std::vector<HANDLE> m_Processes;
+#else
+	std::vector<pid_t> m_Processes;
+#endif
+};
@@ -313,14 +313,20 @@ namespace MQTT
 		int port = 0;
 		URL::parse(options.serverURL, host, port);
 		this->mConnectOptions = options;
-		boost::system::error_code ec;
-		boost::asio::ip::tcp::resolver rslv(mSocket.get_io_service());
+		auto client = shared_from_this();
+		auto rslv = std::make_shared<boost::asio::ip::tcp::resolver>(mSocket.get_io_service());
 		boost::asio::ip::tcp::resolver::query qry(host, std::to_string(port));
-		boost::asio::ip::tcp::resolver::iterator iter = rslv.resolve(qry, ec);
+		rslv->async_resolve(qry, [client, rslv, buffer](const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator iter)
+		{
+			client->onResolved(client, ec, iter, buffer);
+		});
+	}
+
+	void MQTTClient::onResolved(MQTTClientPtr client, const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator iter, IOBuffer buffer)
+	{
 		boost::asio::ip::tcp::resolver::iterator end;
-		if (iter != end)
+		if (!ec && iter != end)
 		{
-			auto client = shared_from_this();
 			boost::asio::async_connect(
 				mSocket,
 				iter,
@@ -368,8 +374,8 @@ namespace MQTT
 		}
 		else
 		{
-			mConnectedCallback(MQTTErrorCode::CONNECTION_TIMEOUT);
-			mDisconnectedCallback(MQTTErrorCode::CONNECTION_TIMEOUT);
+			client->mConnectedCallback(MQTTErrorCode::CONNECTION_TIMEOUT);
+			client->mDisconnectedCallback(MQTTErrorCode::CONNECTION_TIMEOUT);
 		}
 	}
 
@@ -86,6 +86,7 @@ namespace MQTT
 		void Publish(const std::string& topic, const uint8_t* payload, size_t payloadSize, MessageQOS qos, bool retain, MQTTTransactionCallback handler);
 		void Ping(MQTTClientPtr client);
 	private:
+		void onResolved(MQTTClientPtr client, const boost::system::error_code& ec, tcp::resolver::iterator iter, IOBuffer buffer);
 		void onReadMQTTPacket(MQTTClientPtr client, IOBuffer buffer);
 		void onReadMQTTPacketLength(MQTTClientPtr client, size_t offset, IOBuffer buffer);
 		void onReadMQTTPacketLengthCompleted(MQTTClientPtr client, IOBuffer buffer);
@@ -0,0 +1,41 @@
+﻿#include "pch.h"
+#include "NetCore.h"
+
+NetCore::NetCore(boost::asio::io_context& io) :
+	m_IOContext(io),
+	m_IOThreadCount(1),
+	m_EndpointCache(io),
+	m_TimerWheel(io)
+{
+}
+
+std::map<std::wstring, NetCore::CreatorNode>& NetCore::CreatorMap(void)
+{
+	static std::map<std::wstring, CreatorNode> creators;
+	return creators;
+}
+
+std::shared_ptr<IDevice> NetCore::CreateDevice(const std::wstring& className)
+{
+	auto& creators = CreatorMap();
+	auto it = creators.find(className);
+	if (it == creators.end())
+		return nullptr;
+	auto crector = std::get<2>(it->second);
+	return crector(*this);
+}
+
+void NetCore::RegisterDeviceClass(const std::wstring& className, const std::wstring& title, FactoryCreator crector)
+{
+	CreatorMap().insert(std::make_pair(className, std::make_tuple(className, title, crector)));
+}
+
+NetCore::TypeDesc NetCore::GetDeviceTypes(void)
+{
+	TypeDesc results;
+	for (auto& kv : CreatorMap())
+	{
+		results.push_back(std::make_tuple(std::get<0>(kv.second), std::get<1>(kv.second)));
+	}
+	return results;
+}
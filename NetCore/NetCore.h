@@ -0,0 +1,75 @@
+﻿#pragma once
+#include <map>
+#include <tuple>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+#include "EndpointCache.h"
+#include "TimerWheel.h"
+
+// 设备运行环境: 设备和通道只通过它取得 IO 上下文, 解析缓存和超时用的时间轮, 不依赖界面程序.
+// 设备类在各自的源文件中用 REGISTER_CLASS_TITLE 注册到全局类表.
+class IDevice;
+class NetCore
+{
+public:
+	using FactoryCreator = std::function<std::shared_ptr<IDevice>(NetCore& core)>;
+	using TypeDesc = std::vector<std::tuple<std::wstring, std::wstring>>;
+public:
+	NetCore(void) = delete;
+	NetCore(const NetCore&) = delete;
+	NetCore(boost::asio::io_context& io);
+	~NetCore(void) = default;
+public:
+	boost::asio::io_context& GetIOContext(void) { return m_IOContext; }
+	size_t GetIOThreadCount(void) const { return m_IOThreadCount; }
+	void SetIOThreadCount(size_t count) { m_IOThreadCount = count; }
+	EndpointCache& GetEndpointCache(void) { return m_EndpointCache; }
+	TimerWheel& GetTimerWheel(void) { return m_TimerWheel; }
+public:
+	std::shared_ptr<IDevice> CreateDevice(const std::wstring& className);
+	static TypeDesc GetDeviceTypes(void);
+	static void RegisterDeviceClass(const std::wstring& className, const std::wstring& title, FactoryCreator crector);
+private:
+	using CreatorNode = std::tuple<std::wstring, std::wstring, FactoryCreator>;
+	// 注册发生在静态初始化期间, 类表用函数内静态变量保证先于注册构造
+	static std::map<std::wstring, CreatorNode>& CreatorMap(void);
+private:
+	boost::asio::io_context& m_IOContext;
+	size_t m_IOThreadCount;
+	EndpointCache m_EndpointCache;
+	TimerWheel m_TimerWheel;
+};
+
+class AutoRegisterCDClass
+{
+public:
+	AutoRegisterCDClass(const std::wstring& className, const std::wstring& title, NetCore::FactoryCreator creator)
+	{
+		NetCore::RegisterDeviceClass(className, title, creator);
+	}
+	AutoRegisterCDClass(const std::wstring& className, NetCore::FactoryCreator creator)
+	{
+		NetCore::RegisterDeviceClass(className, className, creator);
+	}
+
+	~AutoRegisterCDClass(void) = default;
+};
+
+#define REGISTER_CLASS(className) \
+	AutoRegisterCDClass _AutoRegisterDevice_##className##_object__(	\
+		L"" #className, \
+		[](NetCore& core){ \
+			return std::dynamic_pointer_cast<IDevice>(std::make_shared<className>(core)); \
+		} \
+	)
+
+#define REGISTER_CLASS_TITLE(className,title) \
+	AutoRegisterCDClass _AutoRegisterDevice_##className##_object__(	\
+		L"" #className, \
+		title, \
+		[](NetCore& core){ \
+			return std::dynamic_pointer_cast<IDevice>(std::make_shared<className>(core)); \
+		} \
+	)
@@ -1,4 +1,6 @@
-#pragma once
+﻿#pragma once
+
+#ifdef _WIN32
 
 inline std::string WStringToString(const std::wstring& unicode)
 {
@@ -17,3 +19,20 @@ inline std::wstring StringToWString(const std::string& mstring)
 	::MultiByteToWideChar(CP_OEMCP, 0, mstring.data(), (int)mstring.length(), const_cast<wchar_t*>(wstr.data()), (int)wstr.length());
 	return wstr;
 }
+#else
+#include <locale>
+#include <codecvt>
+
+// 非 Windows 平台没有 OEM 代码页, 系统和 boost 返回的多字节文本按 UTF-8 处理
+inline std::string WStringToString(const std::wstring& unicode)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> cvt;
+	return cvt.to_bytes(unicode);
+}
+
+inline std::wstring StringToWString(const std::string& mstring)
+{
+	std::wstring_convert<std::codecvt_utf8<wchar_t>> cvt(std::string(), std::wstring(L"?"));
+	return cvt.from_bytes(mstring);
+}
+#endif
@@ -0,0 +1,432 @@
+﻿#include "pch.h"
+#include "PayloadTemplate.h"
+#include "LatencyProbe.h"
+#include <array>
+
+constexpr size_t kMAX_DECIMAL_WIDTH = 20;
+constexpr size_t kMAX_HEX_WIDTH = 16;
+constexpr size_t kMAX_RANDOM_SIZE = 64 * 1024;
+
+static const uint16_t* Crc16Table(void)
+{
+	static const auto table = []()
+	{
+		std::array<uint16_t, 256> result;
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint16_t crc = static_cast<uint16_t>(i);
+			for (int k = 0; k < 8; ++k)
+				crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ 0xA001) : static_cast<uint16_t>(crc >> 1);
+			result[i] = crc;
+		}
+		return result;
+	}();
+	return table.data();
+}
+
+static const uint32_t* Crc32Table(void)
+{
+	static const auto table = []()
+	{
+		std::array<uint32_t, 256> result;
+		for (uint32_t i = 0; i < 256; ++i)
+		{
+			uint32_t crc = i;
+			for (int k = 0; k < 8; ++k)
+				crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320) : (crc >> 1);
+			result[i] = crc;
+		}
+		return result;
+	}();
+	return table.data();
+}
+
+PayloadTemplate::PayloadTemplate(void) :
+	m_Ops(),
+	m_Literals(),
+	m_MaxSize(0),
+	m_Patches(0),
+	m_Static(true)
+{
+}
+
+bool PayloadTemplate::ParseFormat(const std::string& name, Format& format)
+{
+	static const std::pair<const char*, Format> formats[] = {
+		{ "dec", Format::Decimal },
+		{ "hex", Format::Hex },
+		{ "u8", Format::U8 },
+		{ "u16", Format::U16BE },
+		{ "u16le", Format::U16LE },
+		{ "u32", Format::U32BE },
+		{ "u32le", Format::U32LE },
+		{ "u64", Format::U64BE },
+		{ "u64le", Format::U64LE },
+	};
+	for (auto& f : formats)
+	{
+		if (name == f.first)
+		{
+			format = f.second;
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t PayloadTemplate::FormatWidth(Format format)
+{
+	switch (format)
+	{
+	case Format::Decimal:
+		return kMAX_DECIMAL_WIDTH;
+	case Format::Hex:
+		return kMAX_HEX_WIDTH;
+	case Format::U8:
+		return 1;
+	case Format::U16BE:
+	case Format::U16LE:
+		return 2;
+	case Format::U32BE:
+	case Format::U32LE:
+		return 4;
+	default:
+		return 8;
+	}
+}
+
+bool PayloadTemplate::CompileField(const std::string& field, std::wstring& error)
+{
+	std::string name = field;
+	std::string arg;
+	auto colon = field.find(':');
+	if (colon != std::string::npos)
+	{
+		name = field.substr(0, colon);
+		arg = field.substr(colon + 1);
+	}
+
+	Op op = { OpType::Literal, Format::Decimal, 0, 0 };
+	if (name == "seq" || name == "client" || name == "time")
+	{
+		op.type = name == "seq" ? OpType::Sequence : (name == "client" ? OpType::Client : OpType::Time);
+		if (!arg.empty() && !ParseFormat(arg, op.format))
+		{
+			error = L"无效的字段格式: " + std::wstring(field.begin(), field.end());
+			return false;
+		}
+		m_MaxSize += FormatWidth(op.format);
+	}
+	else if (name == "rand" || name == "randhex")
+	{
+		op.type = name == "rand" ? OpType::Random : OpType::RandomHex;
+		auto size = arg.empty() ? 0 : strtoul(arg.c_str(), nullptr, 10);
+		if (size == 0 || size > kMAX_RANDOM_SIZE)
+		{
+			error = L"无效的随机数长度: " + std::wstring(field.begin(), field.end());
+			return false;
+		}
+		op.size = static_cast<uint32_t>(size);
+		m_MaxSize += size;
+	}
+	else if (name == "begin")
+	{
+		op.type = OpType::Begin;
+	}
+	else if (name == "stamp")
+	{
+		op.type = OpType::Stamp;
+		m_MaxSize += LatencyProbe::kSTAMP_SIZE;
+	}
+	else if (name == "len" || name == "sum8" || name == "xor8" || name == "crc16" || name == "crc32")
+	{
+		if (name == "len")
+		{
+			op.type = OpType::Length;
+			op.format = Format::U16BE;
+		}
+		else if (name == "sum8" || name == "xor8")
+		{
+			op.type = name == "sum8" ? OpType::Sum8 : OpType::Xor8;
+			op.format = Format::U8;
+		}
+		else if (name == "crc16")
+		{
+			op.type = OpType::Crc16;
+			op.format = Format::U16LE;
+		}
+		else
+		{
+			op.type = OpType::Crc32;
+			op.format = Format::U32BE;
+		}
+		// 长度和校验字段要在消息生成后回填, 只能使用定长格式
+		if (!arg.empty() && (!ParseFormat(arg, op.format) || op.format == Format::Decimal || op.format == Format::Hex))
+		{
+			error = L"无效的字段格式: " + std::wstring(field.begin(), field.end());
+			return false;
+		}
+		if (++m_Patches > kMAX_PATCHES)
+		{
+			error = L"长度和校验字段过多";
+			return false;
+		}
+		m_MaxSize += FormatWidth(op.format);
+	}
+	else
+	{
+		error = L"未知的字段: " + std::wstring(field.begin(), field.end());
+		return false;
+	}
+	m_Ops.push_back(op);
+	m_Static = false;
+	return true;
+}
+
+bool PayloadTemplate::Compile(const uint8_t* data, size_t size, std::wstring& error)
+{
+	m_Ops.clear();
+	m_Literals.clear();
+	m_MaxSize = 0;
+	m_Patches = 0;
+	m_Static = true;
+
+	auto appendLiteral = [this](const uint8_t* p, size_t n)
+	{
+		if (n == 0)
+			return;
+		if (!m_Ops.empty() && m_Ops.back().type == OpType::Literal)
+		{
+			m_Ops.back().size += static_cast<uint32_t>(n);
+		}
+		else
+		{
+			Op op = { OpType::Literal, Format::Decimal, static_cast<uint32_t>(m_Literals.size()), static_cast<uint32_t>(n) };
+			m_Ops.push_back(op);
+		}
+		m_Literals.insert(m_Literals.end(), p, p + n);
+		m_MaxSize += n;
+	};
+
+	size_t i = 0;
+	size_t start = 0;
+	while (i < size)
+	{
+		if (data[i] != '$' || i + 1 >= size)
+		{
+			++i;
+			continue;
+		}
+		if (data[i + 1] == '$')
+		{
+			appendLiteral(data + start, i + 1 - start);
+			i += 2;
+			start = i;
+			continue;
+		}
+		if (data[i + 1] != '{')
+		{
+			++i;
+			continue;
+		}
+		auto end = static_cast<const uint8_t*>(memchr(data + i + 2, '}', size - i - 2));
+		if (end == nullptr)
+		{
+			error = L"字段缺少结束符 }";
+			return false;
+		}
+		appendLiteral(data + start, i - start);
+		std::string field(reinterpret_cast<const char*>(data + i + 2), reinterpret_cast<const char*>(end));
+		if (!CompileField(field, error))
+			return false;
+		i = static_cast<size_t>(end - data) + 1;
+		start = i;
+	}
+	appendLiteral(data + start, size - start);
+	return true;
+}
+
+uint64_t PayloadTemplate::NextRandom(uint64_t& state)
+{
+	// xorshift64*, 只用于生成测试数据
+	if (state == 0)
+		state = 0x9E3779B97F4A7C15ULL;
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 0x2545F4914F6CDD1DULL;
+}
+
+size_t PayloadTemplate::WriteNumber(uint64_t value, Format format, uint8_t* out)
+{
+	switch (format)
+	{
+	case Format::Decimal:
+	{
+		uint8_t digits[kMAX_DECIMAL_WIDTH];
+		size_t n = 0;
+		do
+		{
+			digits[n++] = static_cast<uint8_t>('0' + value % 10);
+			value /= 10;
+		} while (value != 0);
+		for (size_t i = 0; i < n; ++i)
+			out[i] = digits[n - 1 - i];
+		return n;
+	}
+	case Format::Hex:
+	{
+		static const char hex[] = "0123456789abcdef";
+		uint8_t digits[kMAX_HEX_WIDTH];
+		size_t n = 0;
+		do
+		{
+			digits[n++] = static_cast<uint8_t>(hex[value & 0x0F]);
+			value >>= 4;
+		} while (value != 0);
+		for (size_t i = 0; i < n; ++i)
+			out[i] = digits[n - 1 - i];
+		return n;
+	}
+	case Format::U8:
+		out[0] = static_cast<uint8_t>(value);
+		return 1;
+	case Format::U16BE:
+	case Format::U32BE:
+	case Format::U64BE:
+	{
+		auto width = FormatWidth(format);
+		for (size_t i = 0; i < width; ++i)
+			out[i] = static_cast<uint8_t>(value >> ((width - 1 - i) * 8));
+		return width;
+	}
+	default:
+	{
+		auto width = FormatWidth(format);
+		for (size_t i = 0; i < width; ++i)
+			out[i] = static_cast<uint8_t>(value >> (i * 8));
+		return width;
+	}
+	}
+}
+
+size_t PayloadTemplate::Render(Context& context, uint8_t* out) const
+{
+	struct Patch
+	{
+		const Op* op;
+		size_t position;
+		size_t begin;
+	};
+	Patch patches[kMAX_PATCHES];
+	size_t patchCount = 0;
+	size_t position = 0;
+	size_t begin = 0;
+
+	for (auto& op : m_Ops)
+	{
+		switch (op.type)
+		{
+		case OpType::Literal:
+			memcpy(out + position, m_Literals.data() + op.offset, op.size);
+			position += op.size;
+			break;
+		case OpType::Sequence:
+			position += WriteNumber(context.sequence, op.format, out + position);
+			break;
+		case OpType::Client:
+			position += WriteNumber(context.client, op.format, out + position);
+			break;
+		case OpType::Time:
+			position += WriteNumber(context.time, op.format, out + position);
+			break;
+		case OpType::Random:
+			for (size_t i = 0; i < op.size; i += 8)
+			{
+				auto value = NextRandom(context.random);
+				memcpy(out + position + i, &value, (std::min)(static_cast<size_t>(8), op.size - i));
+			}
+			position += op.size;
+			break;
+		case OpType::RandomHex:
+		{
+			static const char hex[] = "0123456789abcdef";
+			uint64_t value = 0;
+			for (size_t i = 0; i < op.size; ++i)
+			{
+				if ((i & 15) == 0)
+					value = NextRandom(context.random);
+				out[position + i] = static_cast<uint8_t>(hex[value & 0x0F]);
+				value >>= 4;
+			}
+			position += op.size;
+			break;
+		}
+		case OpType::Begin:
+			begin = position;
+			break;
+		case OpType::Stamp:
+			position += LatencyProbe::WriteStamp(out + position, context.stamp != 0 ? context.stamp : LatencyProbe::Now());
+			break;
+		default:
+			patches[patchCount++] = { &op, position, begin };
+			position += FormatWidth(op.format);
+			break;
+		}
+	}
+
+	// 长度先于校验回填, 校验按位置先后计算, 后面的校验可以覆盖前面的字段
+	for (size_t i = 0; i < patchCount; ++i)
+	{
+		if (patches[i].op->type == OpType::Length)
+			WriteNumber(position, patches[i].op->format, out + patches[i].position);
+	}
+	for (size_t i = 0; i < patchCount; ++i)
+	{
+		auto& patch = patches[i];
+		auto data = out + patch.begin;
+		auto length = patch.position - patch.begin;
+		uint64_t value = 0;
+		switch (patch.op->type)
+		{
+		case OpType::Sum8:
+		{
+			uint8_t sum = 0;
+			for (size_t k = 0; k < length; ++k)
+				sum += data[k];
+			value = sum;
+			break;
+		}
+		case OpType::Xor8:
+		{
+			uint8_t sum = 0;
+			for (size_t k = 0; k < length; ++k)
+				sum ^= data[k];
+			value = sum;
+			break;
+		}
+		case OpType::Crc16:
+		{
+			auto table = Crc16Table();
+			uint16_t crc = 0xFFFF;
+			for (size_t k = 0; k < length; ++k)
+				crc = static_cast<uint16_t>((crc >> 8) ^ table[(crc ^ data[k]) & 0xFF]);
+			value = crc;
+			break;
+		}
+		case OpType::Crc32:
+		{
+			auto table = Crc32Table();
+			uint32_t crc = 0xFFFFFFFF;
+			for (size_t k = 0; k < length; ++k)
+				crc = (crc >> 8) ^ table[(crc ^ data[k]) & 0xFF];
+			value = crc ^ 0xFFFFFFFF;
+			break;
+		}
+		default:
+			continue;
+		}
+		WriteNumber(value, patch.op->format, out + patch.position);
+	}
+	return position;
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 发送模板: 在发送内容中用 ${...} 描述每条消息不同的字段, 编译一次后逐条生成.
+//   ${seq[:fmt]}      本通道消息序号
+//   ${client[:fmt]}   通道编号
+//   ${time[:fmt]}     当前时间(毫秒)
+//   ${rand:N}         N 个随机字节
+//   ${randhex:N}      N 个随机十六进制字符
+//   ${len:fmt}        整条消息的长度
+//   ${stamp}          延迟测量用的时间戳(12 字节), 对端原样返回后计算往返时间
+//   ${begin}          校验范围的起点, 默认从消息开头开始
+//   ${sum8} ${xor8} ${crc16[:fmt]} ${crc32[:fmt]}  校验值, 范围到该字段之前
+//   $$                字符 $
+// fmt: dec hex u8 u16 u16le u32 u32le u64 u64le (不带 le 的为大端)
+class PayloadTemplate
+{
+public:
+	struct Context
+	{
+		uint64_t sequence;
+		uint64_t client;
+		uint64_t time;
+		uint64_t random;
+		// ${stamp} 写入的发送时刻(LatencyProbe::Now), 为 0 时取生成时的当前时刻
+		uint64_t stamp;
+	};
+public:
+	PayloadTemplate(void);
+	~PayloadTemplate(void) = default;
+public:
+	bool Compile(const uint8_t* data, size_t size, std::wstring& error);
+	bool IsStatic(void) const { return m_Static; }
+	size_t MaxSize(void) const { return m_MaxSize; }
+	size_t Render(Context& context, uint8_t* out) const;
+private:
+	enum class OpType : uint8_t
+	{
+		Literal,
+		Sequence,
+		Client,
+		Time,
+		Random,
+		RandomHex,
+		Stamp,
+		Length,
+		Begin,
+		Sum8,
+		Xor8,
+		Crc16,
+		Crc32
+	};
+	enum class Format : uint8_t
+	{
+		Decimal,
+		Hex,
+		U8,
+		U16BE,
+		U16LE,
+		U32BE,
+		U32LE,
+		U64BE,
+		U64LE
+	};
+	struct Op
+	{
+		OpType type;
+		Format format;
+		uint32_t offset;
+		uint32_t size;
+	};
+	bool CompileField(const std::string& field, std::wstring& error);
+	static bool ParseFormat(const std::string& name, Format& format);
+	static size_t FormatWidth(Format format);
+	static size_t WriteNumber(uint64_t value, Format format, uint8_t* out);
+	static uint64_t NextRandom(uint64_t& state);
+private:
+	static constexpr size_t kMAX_PATCHES = 16;
+	std::vector<Op> m_Ops;
+	std::vector<uint8_t> m_Literals;
+	size_t m_MaxSize;
+	size_t m_Patches;
+	bool m_Static;
+};
@@ -0,0 +1,287 @@
+﻿#include "pch.h"
+#include "ReceiveStore.h"
+#include <algorithm>
+#include <cstring>
+
+// 接收记录的排序键: 分片号放在序号的高位, 时间相同的记录先按分片再按分片内的顺序排列
+constexpr int kSHARD_SHIFT = 56;
+
+ReceiveStore::Channel::Channel(const std::wstring& endpoint, size_t shard) :
+	m_Extents(),
+	m_Size(0),
+	m_Retained(false),
+	m_Shard(shard),
+	m_EndPoint(endpoint),
+	m_ReceivedBytes(0),
+	m_DroppedBytes(0)
+{
+}
+
+ReceiveStore::ReceiveStore(void) :
+	m_Limit(SIZE_MAX),
+	m_MemoryUsed(0),
+	m_DroppedBytes(0),
+	m_Collected(),
+	m_View(),
+	m_ViewSize(0)
+{
+	for (auto& shard : m_Shards)
+	{
+		shard.size = 0;
+		shard.sequence = 0;
+	}
+}
+
+size_t ReceiveStore::ShardIndex(const IAsyncChannel* key)
+{
+	// 通道对象按指针分片, 低位是对齐位, 先去掉再散列
+	auto value = reinterpret_cast<uintptr_t>(key) >> 4;
+	value ^= value >> 7;
+	return value % kSHARD_COUNT;
+}
+
+size_t ReceiveStore::CopyShardData(const Shard& shard, size_t offset, size_t size, uint8_t* buffer)
+{
+	if (offset >= shard.size)
+		return 0;
+	size = (std::min)(size, shard.size - offset);
+	for (size_t copied = 0; copied < size;)
+	{
+		auto start = (offset + copied) % kBLOCK_SIZE;
+		auto length = (std::min)(kBLOCK_SIZE - start, size - copied);
+		memcpy(buffer + copied, shard.blocks[(offset + copied) / kBLOCK_SIZE].get() + start, length);
+		copied += length;
+	}
+	return size;
+}
+
+bool ReceiveStore::Full(void) const
+{
+	return m_DroppedBytes > 0 || m_MemoryUsed + kBLOCK_SIZE > m_Limit;
+}
+
+// 内存额度只在分片申请新数据块时计算, 不是每次追加都访问共享的计数
+bool ReceiveStore::Reserve(size_t bytes)
+{
+	auto used = m_MemoryUsed.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+	if (used <= m_Limit.load(std::memory_order_relaxed))
+		return true;
+	m_MemoryUsed.fetch_sub(bytes, std::memory_order_relaxed);
+	return false;
+}
+
+ReceiveStore::ChannelPtr ReceiveStore::Open(const IAsyncChannel* key, const std::wstring& endpoint)
+{
+	auto index = ShardIndex(key);
+	auto channel = std::make_shared<Channel>(endpoint, index);
+	auto& shard = m_Shards[index];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	shard.channels[key] = channel;
+	return channel;
+}
+
+void ReceiveStore::Close(const IAsyncChannel* key)
+{
+	// 只从索引中移除, 已收到的数据保留到清空
+	auto& shard = m_Shards[ShardIndex(key)];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	shard.channels.erase(key);
+}
+
+ReceiveStore::ChannelPtr ReceiveStore::Find(const IAsyncChannel* key) const
+{
+	auto& shard = m_Shards[ShardIndex(key)];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	auto it = shard.channels.find(key);
+	if (it == shard.channels.end())
+		return nullptr;
+	return it->second;
+}
+
+size_t ReceiveStore::ChannelCount(void) const
+{
+	size_t count = 0;
+	for (auto& shard : m_Shards)
+	{
+		std::unique_lock<std::mutex> lk(shard.mutex);
+		count += shard.channels.size();
+	}
+	return count;
+}
+
+void ReceiveStore::Append(const ChannelPtr& channel, const void* data, size_t size)
+{
+	if (size == 0)
+		return;
+
+	auto& shard = m_Shards[channel->m_Shard];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	auto capacity = shard.blocks.size() * kBLOCK_SIZE;
+	if (shard.size + size > capacity)
+	{
+		auto blocks = (shard.size + size - capacity + kBLOCK_SIZE - 1) / kBLOCK_SIZE;
+		if (!Reserve(blocks * kBLOCK_SIZE))
+		{
+			channel->m_DroppedBytes.store(channel->m_DroppedBytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+			m_DroppedBytes.fetch_add(size, std::memory_order_relaxed);
+			return;
+		}
+		for (size_t i = 0; i < blocks; ++i)
+			shard.blocks.emplace_back(new uint8_t[kBLOCK_SIZE]);
+	}
+
+	auto offset = shard.size;
+	auto p = static_cast<const uint8_t*>(data);
+	for (size_t copied = 0; copied < size;)
+	{
+		auto start = (offset + copied) % kBLOCK_SIZE;
+		auto length = (std::min)(kBLOCK_SIZE - start, size - copied);
+		memcpy(shard.blocks[(offset + copied) / kBLOCK_SIZE].get() + start, p + copied, length);
+		copied += length;
+	}
+
+	if (!channel->m_Retained)
+	{
+		channel->m_Retained = true;
+		shard.retained.push_back(channel);
+	}
+	auto& extents = channel->m_Extents;
+	if (!extents.empty() && extents.back().offset + extents.back().size == offset)
+		extents.back().size += size;
+	else
+		extents.push_back({ offset, size });
+	// 通道计数只在分片锁内修改, 不需要原子的读改写
+	channel->m_Size += size;
+	channel->m_ReceivedBytes.store(channel->m_ReceivedBytes.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+
+	// 时间和序号都在分片锁内取得, 同一分片的记录按追加顺序排列
+	auto order = (static_cast<uint64_t>(channel->m_Shard) << kSHARD_SHIFT) | shard.sequence++;
+	shard.pending.push_back({ Clock::now().time_since_epoch().count(), order, channel.get(), offset, size });
+	shard.size += size;
+}
+
+size_t ReceiveStore::ChannelSize(const Channel& channel) const
+{
+	auto& shard = m_Shards[channel.m_Shard];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	return channel.m_Size;
+}
+
+size_t ReceiveStore::CopyChannelData(const Channel& channel, size_t offset, size_t size, void* buffer) const
+{
+	auto& shard = m_Shards[channel.m_Shard];
+	std::unique_lock<std::mutex> lk(shard.mutex);
+	auto p = static_cast<uint8_t*>(buffer);
+	size_t copied = 0;
+	size_t position = 0;
+	for (auto& extent : channel.m_Extents)
+	{
+		if (copied == size)
+			break;
+		if (offset + copied < position + extent.size)
+		{
+			auto start = offset + copied - position;
+			auto length = (std::min)(extent.size - start, size - copied);
+			copied += CopyShardData(shard, extent.offset + start, length, p + copied);
+		}
+		position += extent.size;
+	}
+	return copied;
+}
+
+size_t ReceiveStore::Collect(CollectHandler handler)
+{
+	// 各分片的记录已经按时间排列, 依次取出后两两归并, 分片锁只在取出时持有
+	m_Collected.clear();
+	std::vector<size_t> runs;
+	for (auto& shard : m_Shards)
+	{
+		std::unique_lock<std::mutex> lk(shard.mutex);
+		if (shard.pending.empty())
+			continue;
+		runs.push_back(m_Collected.size());
+		m_Collected.insert(m_Collected.end(), shard.pending.begin(), shard.pending.end());
+		shard.pending.clear();
+	}
+	if (m_Collected.empty())
+		return 0;
+
+	auto less = [](const Segment& a, const Segment& b)
+	{
+		return a.time != b.time ? a.time < b.time : a.order < b.order;
+	};
+	runs.push_back(m_Collected.size());
+	while (runs.size() > 2)
+	{
+		std::vector<size_t> merged;
+		for (size_t i = 0; i + 1 < runs.size(); i += 2)
+		{
+			merged.push_back(runs[i]);
+			if (i + 2 < runs.size())
+				std::inplace_merge(m_Collected.begin() + runs[i], m_Collected.begin() + runs[i + 1], m_Collected.begin() + runs[i + 2], less);
+		}
+		merged.push_back(m_Collected.size());
+		runs.swap(merged);
+	}
+
+	size_t total = 0;
+	for (auto& segment : m_Collected)
+	{
+		if (handler)
+			handler(*segment.channel, Clock::time_point(Clock::duration(segment.time)), segment.size);
+		// 同一分片连续的数据合并成一项
+		auto shard = static_cast<size_t>(segment.order >> kSHARD_SHIFT);
+		if (!m_View.empty() && m_View.back().shard == shard && m_View.back().offset + m_View.back().size == segment.offset)
+			m_View.back().size += segment.size;
+		else
+			m_View.push_back({ m_ViewSize, shard, segment.offset, segment.size });
+		m_ViewSize += segment.size;
+		total += segment.size;
+	}
+	return total;
+}
+
+size_t ReceiveStore::CopyData(size_t offset, size_t size, void* buffer) const
+{
+	if (offset >= m_ViewSize)
+		return 0;
+	size = (std::min)(size, m_ViewSize - offset);
+	auto it = std::upper_bound(m_View.begin(), m_View.end(), offset, [](size_t value, const ViewEntry& entry) { return value < entry.position; });
+	--it;
+	auto p = static_cast<uint8_t*>(buffer);
+	size_t copied = 0;
+	for (; copied < size && it != m_View.end(); ++it)
+	{
+		auto start = offset + copied - it->position;
+		auto length = (std::min)(it->size - start, size - copied);
+		auto& shard = m_Shards[it->shard];
+		std::unique_lock<std::mutex> lk(shard.mutex);
+		length = CopyShardData(shard, it->offset + start, length, p + copied);
+		if (length == 0)
+			break;
+		copied += length;
+	}
+	return copied;
+}
+
+void ReceiveStore::Clear(void)
+{
+	for (auto& shard : m_Shards)
+	{
+		std::unique_lock<std::mutex> lk(shard.mutex);
+		for (auto& channel : shard.retained)
+		{
+			channel->m_Extents.clear();
+			channel->m_Size = 0;
+			channel->m_Retained = false;
+		}
+		shard.retained.clear();
+		m_MemoryUsed.fetch_sub(shard.blocks.size() * kBLOCK_SIZE, std::memory_order_relaxed);
+		shard.blocks.clear();
+		shard.size = 0;
+		shard.pending.clear();
+	}
+	m_View.clear();
+	m_ViewSize = 0;
+	m_DroppedBytes = 0;
+}
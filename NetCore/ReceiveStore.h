@@ -0,0 +1,115 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+
+// 接收数据按分片保存: 通道按指针分到固定的分片, 读完成只锁所在的分片, 数据顺序写入分片自己的数据块,
+// 序号按分片分配; 每个通道记录自己的数据在分片中的位置, 可以单独读取.
+// 界面定时把各分片新的接收记录按时间合并到一个只增长的视图, 视图只记录数据在哪个分片的哪个位置,
+// 读取时直接从分片的数据块复制, 数据只在接收时复制一次.
+class IAsyncChannel;
+class ReceiveStore
+{
+public:
+	using Clock = std::chrono::system_clock;
+	class Channel
+	{
+		friend class ReceiveStore;
+	public:
+		Channel(void) = delete;
+		Channel(const Channel&) = delete;
+		Channel(const std::wstring& endpoint, size_t shard);
+		~Channel(void) = default;
+	public:
+		const std::wstring& EndPoint(void) const { return m_EndPoint; }
+		uint64_t ReceivedBytes(void) const { return m_ReceivedBytes; }
+		uint64_t DroppedBytes(void) const { return m_DroppedBytes; }
+	private:
+		struct Extent
+		{
+			size_t offset;
+			size_t size;
+		};
+		// 以下成员由所在分片的锁保护
+		std::vector<Extent> m_Extents;
+		size_t m_Size;
+		bool m_Retained;
+		size_t m_Shard;
+		std::wstring m_EndPoint;
+		std::atomic<uint64_t> m_ReceivedBytes;
+		std::atomic<uint64_t> m_DroppedBytes;
+	};
+	using ChannelPtr = std::shared_ptr<Channel>;
+	using CollectHandler = std::function<void(const Channel& channel, Clock::time_point time, size_t size)>;
+public:
+	ReceiveStore(void);
+	ReceiveStore(const ReceiveStore&) = delete;
+	~ReceiveStore(void) = default;
+public:
+	// 内存上限按数据块计算, 达到上限后新收到的数据丢弃并计数, 由界面保存或清空后继续接收
+	void Limit(size_t bytes) { m_Limit = bytes; }
+	size_t Limit(void) const { return m_Limit; }
+	size_t MemoryUsed(void) const { return m_MemoryUsed; }
+	bool Full(void) const;
+	uint64_t DroppedBytes(void) const { return m_DroppedBytes; }
+	ChannelPtr Open(const IAsyncChannel* key, const std::wstring& endpoint);
+	void Close(const IAsyncChannel* key);
+	ChannelPtr Find(const IAsyncChannel* key) const;
+	size_t ChannelCount(void) const;
+	void Append(const ChannelPtr& channel, const void* data, size_t size);
+	// 单个通道保存的数据
+	size_t ChannelSize(const Channel& channel) const;
+	size_t CopyChannelData(const Channel& channel, size_t offset, size_t size, void* buffer) const;
+	// 合并视图只能由一个线程访问(或由调用方加锁): Collect 把新的接收记录按时间追加到视图末尾,
+	// 每条记录追加前调用一次 handler, 此时 Size() 是这条记录在视图中的位置
+	size_t Collect(CollectHandler handler);
+	size_t Size(void) const { return m_ViewSize; }
+	size_t CopyData(size_t offset, size_t size, void* buffer) const;
+	void Clear(void);
+private:
+	static constexpr size_t kSHARD_COUNT = 64;
+	static constexpr size_t kBLOCK_SIZE = 64 * 1024;
+	struct Segment
+	{
+		Clock::rep time;
+		uint64_t order;
+		const Channel* channel;
+		size_t offset;
+		size_t size;
+	};
+	struct alignas(64) Shard
+	{
+		mutable std::mutex mutex;
+		std::unordered_map<const IAsyncChannel*, ChannelPtr> channels;
+		// 在分片中有数据的通道, 关闭后仍保留到清空, 接收记录只保存通道指针
+		std::vector<ChannelPtr> retained;
+		std::vector<std::unique_ptr<uint8_t[]>> blocks;
+		size_t size;
+		std::vector<Segment> pending;
+		uint64_t sequence;
+	};
+	struct ViewEntry
+	{
+		size_t position;
+		size_t shard;
+		size_t offset;
+		size_t size;
+	};
+	static size_t ShardIndex(const IAsyncChannel* key);
+	static size_t CopyShardData(const Shard& shard, size_t offset, size_t size, uint8_t* buffer);
+	bool Reserve(size_t bytes);
+private:
+	Shard m_Shards[kSHARD_COUNT];
+	std::atomic<size_t> m_Limit;
+	std::atomic<size_t> m_MemoryUsed;
+	std::atomic<uint64_t> m_DroppedBytes;
+	std::vector<Segment> m_Collected;
+	std::vector<ViewEntry> m_View;
+	size_t m_ViewSize;
+};
@@ -0,0 +1,487 @@
+﻿#include "pch.h"
+#include "SendScheduler.h"
+
+// 单次定时器到期最多补发的消息数, 以及落后太多时放弃追赶的阈值
+constexpr uint64_t kMAX_DUE_PER_TICK = 1024 * 1024;
+constexpr auto kMAX_LAG = std::chrono::seconds(1);
+// 流式通道合并写入的上限, 以及每个通道允许积压的消息数
+constexpr size_t kMAX_BATCH_BYTES = 1024 * 1024;
+constexpr uint64_t kMAX_BACKLOG = 1024 * 1024;
+// 数据报通道每个通道同时进行的写操作上限
+constexpr size_t kMAX_DATAGRAM_INFLIGHT = 1024;
+// 闭环模式检查补发的周期, 以及多久收不到响应就认为消息已丢失
+constexpr auto kCLOSED_LOOP_TICK = std::chrono::milliseconds(100);
+constexpr auto kRESPONSE_TIMEOUT = std::chrono::seconds(5);
+
+// 计划时刻换算为 LatencyProbe::Now 的单位
+static uint64_t DueTime(std::chrono::steady_clock::time_point time)
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+}
+
+SendScheduler::SendScheduler(boost::asio::io_context& io, const Options& options, SentHandler handler) :
+	m_Timer(io),
+	m_Options(options),
+	m_OnSent(handler),
+	m_Probe(nullptr),
+	m_Traffic(nullptr),
+	m_Mutex(),
+	m_Running(false),
+	m_Payload(),
+	m_Template(),
+	m_Targets(),
+	m_TargetIndex(),
+	m_TargetCount(0),
+	m_PeakTargets(0),
+	m_DueSlots(),
+	m_FreeBuffers(),
+	m_NextClient(0),
+	m_NextDue(),
+	m_Random(std::random_device()()),
+	m_Exponential(1.0),
+	m_SentMessages(0),
+	m_Responses(0),
+	m_Timeouts(0),
+	m_Overruns(0)
+{
+	if (m_Options.interval.count() <= 0)
+		m_Options.interval = std::chrono::milliseconds(1);
+	if (m_Options.burst == 0)
+		m_Options.burst = 1;
+}
+
+void SendScheduler::SetPayload(Payload payload, Template tpl)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_Payload = payload;
+	m_Template = (tpl != nullptr && !tpl->IsStatic()) ? tpl : nullptr;
+}
+
+void SendScheduler::SetChannels(const Channels& channels)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	std::vector<TargetPtr> targets;
+	std::unordered_map<const IAsyncChannel*, TargetPtr> index;
+	for (auto& channel : channels)
+	{
+		auto it = m_TargetIndex.find(channel.get());
+		if (it != m_TargetIndex.end())
+		{
+			targets.push_back(it->second);
+			index.emplace(channel.get(), it->second);
+			continue;
+		}
+		auto target = std::make_shared<Target>();
+		target->channel = channel;
+		target->writing = false;
+		target->inflight = 0;
+		target->backlog = 0;
+		target->outstanding = 0;
+		target->matched = 0;
+		target->activity = std::chrono::steady_clock::now();
+		target->traffic = m_Traffic != nullptr ? m_Traffic->Find(channel.get()) : TrafficCounters::Handle{ nullptr, 0 };
+		target->context.sequence = 0;
+		target->context.client = m_NextClient++;
+		target->context.time = 0;
+		target->context.random = m_Random();
+		target->context.stamp = 0;
+		targets.push_back(target);
+		index.emplace(channel.get(), target);
+	}
+	m_Targets.swap(targets);
+	m_TargetIndex.swap(index);
+	m_PeakTargets = (std::max)(m_PeakTargets, m_Targets.size());
+}
+
+void SendScheduler::SetTargetCount(size_t count)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_TargetCount = count;
+}
+
+void SendScheduler::Start(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	if (m_Running)
+		return;
+	m_Running = true;
+	m_NextDue = std::chrono::steady_clock::now();
+	Arm();
+}
+
+void SendScheduler::Stop(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_Running = false;
+	boost::system::error_code ec;
+	m_Timer.cancel(ec);
+	for (auto& target : m_Targets)
+	{
+		target->backlog = 0;
+		target->schedule.clear();
+		target->outstanding = 0;
+	}
+}
+
+double SendScheduler::TargetRate(void)
+{
+	if (m_Options.closedLoop)
+		return 0.0;
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	auto perSecond = 1000000000.0 / static_cast<double>(m_Options.interval.count());
+	// 按设置的通道数计算, 断开或写失败的通道仍算在目标内, 实际速率不足时才能看出来
+	auto targets = m_TargetCount > 0 ? m_TargetCount : m_PeakTargets;
+	return perSecond * static_cast<double>(m_Options.burst) * static_cast<double>(targets);
+}
+
+void SendScheduler::Arm(void)
+{
+	auto self = shared_from_this();
+	m_Timer.expires_at(m_NextDue);
+	m_Timer.async_wait([self](const boost::system::error_code& ec)
+	{
+		if (!ec)
+			self->OnTick();
+	});
+}
+
+std::chrono::steady_clock::duration SendScheduler::NextInterval(void)
+{
+	if (!m_Options.poisson)
+		return std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_Options.interval);
+	// 泊松过程: 间隔服从以 interval 为均值的指数分布
+	auto scale = m_Exponential(m_Random);
+	auto ns = static_cast<int64_t>(scale * static_cast<double>(m_Options.interval.count()));
+	return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns));
+}
+
+void SendScheduler::OnTick(void)
+{
+	std::vector<std::function<void()>> writes;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (!m_Running)
+			return;
+
+		if (m_Options.closedLoop)
+		{
+			OnClosedLoopTick(writes);
+			Arm();
+		}
+		else
+		{
+			// 按绝对时间计算到期的消息数, 定时器精度不足时一次补齐, 不会累积漂移
+			// 每批消息记下计划时刻, 延迟从计划时刻算起, 发送落后时排队的时间不会被漏掉
+			auto now = std::chrono::steady_clock::now();
+			uint64_t due = 0;
+			m_DueSlots.clear();
+			while (m_NextDue <= now && due < kMAX_DUE_PER_TICK)
+			{
+				m_DueSlots.push_back({ DueTime(m_NextDue), m_Options.burst });
+				due += m_Options.burst;
+				m_NextDue += NextInterval();
+			}
+			if (now - m_NextDue > kMAX_LAG)
+			{
+				m_Overruns += due;
+				m_NextDue = now;
+				m_DueSlots.clear();
+			}
+
+			if (!m_DueSlots.empty() && m_Payload != nullptr && !m_Payload->empty())
+			{
+				for (auto& target : m_Targets)
+					Enqueue(target, m_DueSlots.data(), m_DueSlots.size(), writes);
+			}
+			Arm();
+		}
+	}
+
+	for (auto& write : writes)
+		write();
+}
+
+void SendScheduler::OnClosedLoopTick(std::vector<std::function<void()>>& writes)
+{
+	// 新加入的通道在这里发出第一批消息; 长时间没有响应的通道视为消息丢失, 重新补满窗口
+	auto now = std::chrono::steady_clock::now();
+	m_NextDue = now + kCLOSED_LOOP_TICK;
+	if (m_Payload == nullptr || m_Payload->empty())
+		return;
+	// 闭环模式的消息在补发时才产生, 计划时刻就是当前时刻
+	Slot slot = { DueTime(now), 0 };
+	for (auto& target : m_Targets)
+	{
+		if (target->outstanding > 0 && now - target->activity > kRESPONSE_TIMEOUT)
+		{
+			m_Timeouts += target->outstanding;
+			target->outstanding = 0;
+		}
+		if (target->outstanding >= m_Options.burst)
+			continue;
+		slot.count = m_Options.burst - target->outstanding;
+		target->outstanding += slot.count;
+		target->activity = now;
+		Enqueue(target, &slot, 1, writes);
+	}
+}
+
+void SendScheduler::OnReceived(const IAsyncChannel* channel, const uint8_t* data, size_t size)
+{
+	if (!m_Options.closedLoop || size == 0)
+		return;
+
+	std::vector<std::function<void()>> writes;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		auto it = m_TargetIndex.find(channel);
+		if (it == m_TargetIndex.end())
+			return;
+		auto& target = it->second;
+
+		// 分隔符可能被拆在两次读之间, 已匹配的长度保存在通道上
+		uint64_t responses = 0;
+		auto& delimiter = m_Options.delimiter;
+		if (delimiter.empty())
+		{
+			responses = 1;
+		}
+		else
+		{
+			for (size_t i = 0; i < size; ++i)
+			{
+				if (data[i] == delimiter[target->matched])
+				{
+					if (++target->matched == delimiter.size())
+					{
+						++responses;
+						target->matched = 0;
+					}
+				}
+				else
+				{
+					target->matched = (data[i] == delimiter[0]) ? 1 : 0;
+				}
+			}
+		}
+		if (responses == 0)
+			return;
+
+		m_Responses += responses;
+		target->activity = std::chrono::steady_clock::now();
+		// 每收到一条响应就补发一条, 未应答的数量保持不变
+		Slot slot = { DueTime(target->activity), (std::min)(responses, target->outstanding) };
+		if (m_Running && slot.count > 0 && m_Payload != nullptr && !m_Payload->empty())
+			Enqueue(target, &slot, 1, writes);
+		else
+			target->outstanding -= slot.count;
+	}
+
+	for (auto& write : writes)
+		write();
+}
+
+size_t SendScheduler::MessageMaxSize(void) const
+{
+	return m_Template != nullptr ? m_Template->MaxSize() : m_Payload->size();
+}
+
+size_t SendScheduler::RenderMessage(Target& target, uint64_t time, uint8_t* out)
+{
+	target.context.time = time;
+	auto size = m_Template->Render(target.context, out);
+	++target.context.sequence;
+	return size;
+}
+
+SendScheduler::Buffer* SendScheduler::AcquireBuffer(void)
+{
+	if (m_FreeBuffers.empty())
+		return new Buffer();
+	auto buffer = m_FreeBuffers.back().release();
+	m_FreeBuffers.pop_back();
+	return buffer;
+}
+
+void SendScheduler::Enqueue(const TargetPtr& target, const Slot* slots, size_t count, std::vector<std::function<void()>>& writes)
+{
+	if (!m_Options.coalesce)
+	{
+		// 数据报通道每条消息单独发送
+		auto payload = m_Payload;
+		auto self = shared_from_this();
+		auto time = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+		uint64_t remaining = 0;
+		for (size_t s = 0; s < count; ++s)
+			remaining += slots[s].count;
+		for (size_t s = 0; s < count; ++s)
+		{
+			auto due = slots[s].due;
+			for (uint64_t i = 0; i < slots[s].count; ++i)
+			{
+				if (target->inflight >= kMAX_DATAGRAM_INFLIGHT)
+				{
+					m_Overruns += remaining;
+					return;
+				}
+				--remaining;
+				++target->inflight;
+				Buffer* buffer = nullptr;
+				if (m_Template != nullptr)
+				{
+					// 模板消息直接生成到缓冲池中的缓冲区, 写完成后归还
+					buffer = AcquireBuffer();
+					buffer->resize(m_Template->MaxSize());
+					target->context.stamp = due;
+					buffer->resize(RenderMessage(*target, time, buffer->data()));
+				}
+				writes.push_back([self, target, payload, buffer, due]()
+				{
+					if (self->m_Probe != nullptr)
+						self->m_Probe->OnSent(target->channel.get(), 1, due);
+					IAsyncChannel::InputBuffer inbuffer;
+					inbuffer.buffer = buffer != nullptr ? buffer->data() : payload->data();
+					inbuffer.bufferSize = buffer != nullptr ? buffer->size() : payload->size();
+					target->channel->Write(inbuffer, [self, target, payload, buffer](bool ok, size_t io_bytes)
+					{
+						self->OnWritten(target, ok, io_bytes, 1, buffer);
+					});
+				});
+			}
+		}
+		return;
+	}
+
+	auto& schedule = target->schedule;
+	for (size_t s = 0; s < count; ++s)
+	{
+		if (!schedule.empty() && schedule.back().due == slots[s].due)
+			schedule.back().count += slots[s].count;
+		else
+			schedule.push_back(slots[s]);
+		target->backlog += slots[s].count;
+	}
+	if (target->backlog > kMAX_BACKLOG)
+	{
+		// 超出积压上限时丢弃最新到期的消息
+		auto excess = target->backlog - kMAX_BACKLOG;
+		m_Overruns += excess;
+		target->backlog = kMAX_BACKLOG;
+		while (excess > 0)
+		{
+			auto& last = schedule.back();
+			auto n = (std::min)(excess, last.count);
+			last.count -= n;
+			excess -= n;
+			if (last.count == 0)
+				schedule.pop_back();
+		}
+	}
+	if (!target->writing)
+		Flush(target, writes);
+}
+
+void SendScheduler::Flush(const TargetPtr& target, std::vector<std::function<void()>>& writes)
+{
+	// 流式通道把到期的消息合并成一次写入, 同一通道只有一个写操作
+	auto maxSize = MessageMaxSize();
+	auto batch = (std::max)(static_cast<uint64_t>(1), static_cast<uint64_t>(kMAX_BATCH_BYTES / maxSize));
+	auto count = static_cast<size_t>((std::min)(target->backlog, batch));
+	target->backlog -= count;
+	// 按到期顺序取出这一批消息的计划时刻, 写完成之前只有这一个写操作使用
+	auto& sending = target->sending;
+	sending.clear();
+	for (uint64_t left = count; left > 0;)
+	{
+		auto& first = target->schedule.front();
+		auto n = (std::min)(left, first.count);
+		sending.push_back({ first.due, n });
+		first.count -= n;
+		left -= n;
+		if (first.count == 0)
+			target->schedule.pop_front();
+	}
+	target->buffer.resize(count * maxSize);
+	if (m_Template != nullptr)
+	{
+		auto time = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+		size_t size = 0;
+		for (auto& slot : sending)
+		{
+			target->context.stamp = slot.due;
+			for (uint64_t i = 0; i < slot.count; ++i)
+				size += RenderMessage(*target, time, target->buffer.data() + size);
+		}
+		target->buffer.resize(size);
+	}
+	else
+	{
+		auto& payload = *m_Payload;
+		for (size_t i = 0; i < count; ++i)
+			memcpy(target->buffer.data() + i * payload.size(), payload.data(), payload.size());
+	}
+	target->writing = true;
+
+	auto self = shared_from_this();
+	writes.push_back([self, target, count]()
+	{
+		if (self->m_Probe != nullptr)
+		{
+			for (auto& slot : target->sending)
+				self->m_Probe->OnSent(target->channel.get(), static_cast<size_t>(slot.count), slot.due);
+		}
+		IAsyncChannel::InputBuffer inbuffer;
+		inbuffer.buffer = target->buffer.data();
+		inbuffer.bufferSize = target->buffer.size();
+		target->channel->Write(inbuffer, [self, target, count](bool ok, size_t io_bytes)
+		{
+			self->OnWritten(target, ok, io_bytes, count, nullptr);
+		});
+	});
+}
+
+void SendScheduler::OnWritten(const TargetPtr& target, bool ok, size_t io_bytes, size_t messages, Buffer* buffer)
+{
+	if (ok)
+	{
+		m_SentMessages += messages;
+		target->channel->MessagesWritten(messages);
+		if (m_OnSent)
+			m_OnSent(io_bytes);
+	}
+	if (m_Traffic != nullptr)
+		m_Traffic->Written(target->traffic, ok, io_bytes, messages);
+
+	std::vector<std::function<void()>> writes;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (!m_Options.coalesce)
+		{
+			--target->inflight;
+			if (buffer != nullptr)
+				m_FreeBuffers.emplace_back(buffer);
+		}
+		else
+		{
+			target->writing = false;
+			if (!ok)
+			{
+				target->backlog = 0;
+				target->schedule.clear();
+			}
+			else if (m_Running && target->backlog > 0 && m_Payload != nullptr && !m_Payload->empty())
+				Flush(target, writes);
+		}
+		if (!ok)
+		{
+			// 通道已经失效, 不再向它发送
+			auto it = std::find(m_Targets.begin(), m_Targets.end(), target);
+			if (it != m_Targets.end())
+				m_Targets.erase(it);
+			m_TargetIndex.erase(target->channel.get());
+		}
+	}
+
+	for (auto& write : writes)
+		write();
+}
@@ -0,0 +1,118 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <unordered_map>
+#include "IAsyncStream.h"
+#include "PayloadTemplate.h"
+#include "LatencyProbe.h"
+#include "TrafficCounters.h"
+
+class SendScheduler : public std::enable_shared_from_this<SendScheduler>
+{
+public:
+	using Payload = std::shared_ptr<const std::vector<uint8_t>>;
+	using Template = std::shared_ptr<const PayloadTemplate>;
+	using Channels = std::vector<std::shared_ptr<IAsyncChannel>>;
+	using SentHandler = std::function<void(size_t io_bytes)>;
+	// 开环: 按固定速率发送, 与对端是否响应无关;
+	// 闭环: 每个通道保持 burst 条未应答的消息, 收到一条响应再发一条.
+	struct Options
+	{
+		std::chrono::nanoseconds interval;
+		size_t burst;
+		bool poisson;
+		bool coalesce;
+		bool closedLoop;
+		std::vector<uint8_t> delimiter;
+	};
+public:
+	SendScheduler(void) = delete;
+	SendScheduler(const SendScheduler&) = delete;
+	SendScheduler(boost::asio::io_context& io, const Options& options, SentHandler handler);
+	~SendScheduler(void) = default;
+public:
+	void SetPayload(Payload payload, Template tpl = nullptr);
+	void SetChannels(const Channels& channels);
+	// 设置的通道数, 用于计算目标速率; 未设置时取发送目标数的最大值
+	void SetTargetCount(size_t count);
+	void SetProbe(LatencyProbe* probe) { m_Probe = probe; }
+	// 写完成计入通道各自的流量统计, 需在 SetChannels 之前设置
+	void SetTraffic(TrafficCounters* traffic) { m_Traffic = traffic; }
+	void Start(void);
+	void Stop(void);
+	// 闭环模式下由读完成调用, 分隔符为空时每次读到的数据算作一条响应
+	void OnReceived(const IAsyncChannel* channel, const uint8_t* data, size_t size);
+	// 开环模式下的目标速率(条/秒), 闭环模式没有目标速率, 返回 0
+	double TargetRate(void);
+	bool ClosedLoop(void) const { return m_Options.closedLoop; }
+	uint64_t SentMessages(void) const { return m_SentMessages; }
+	uint64_t Responses(void) const { return m_Responses; }
+	uint64_t Timeouts(void) const { return m_Timeouts; }
+	uint64_t Overruns(void) const { return m_Overruns; }
+private:
+	// 一批按计划同时到期的消息, 计划时刻与 LatencyProbe::Now 使用同一时钟(纳秒)
+	struct Slot
+	{
+		uint64_t due;
+		uint64_t count;
+	};
+	struct Target
+	{
+		std::shared_ptr<IAsyncChannel> channel;
+		bool writing;
+		size_t inflight;
+		uint64_t backlog;
+		// 积压消息的计划时刻, 以及正在写入的一批消息的计划时刻
+		std::deque<Slot> schedule;
+		std::vector<Slot> sending;
+		uint64_t outstanding;
+		size_t matched;
+		std::chrono::steady_clock::time_point activity;
+		TrafficCounters::Handle traffic;
+		std::vector<uint8_t> buffer;
+		PayloadTemplate::Context context;
+	};
+	using TargetPtr = std::shared_ptr<Target>;
+	using Buffer = std::vector<uint8_t>;
+	size_t MessageMaxSize(void) const;
+	size_t RenderMessage(Target& target, uint64_t time, uint8_t* out);
+	Buffer* AcquireBuffer(void);
+	void Arm(void);
+	void OnTick(void);
+	void OnClosedLoopTick(std::vector<std::function<void()>>& writes);
+	std::chrono::steady_clock::duration NextInterval(void);
+	void Enqueue(const TargetPtr& target, const Slot* slots, size_t count, std::vector<std::function<void()>>& writes);
+	void Flush(const TargetPtr& target, std::vector<std::function<void()>>& writes);
+	void OnWritten(const TargetPtr& target, bool ok, size_t io_bytes, size_t messages, Buffer* buffer);
+private:
+	boost::asio::steady_timer m_Timer;
+	Options m_Options;
+	SentHandler m_OnSent;
+	LatencyProbe* m_Probe;
+	TrafficCounters* m_Traffic;
+	std::mutex m_Mutex;
+	bool m_Running;
+	Payload m_Payload;
+	Template m_Template;
+	std::vector<TargetPtr> m_Targets;
+	std::unordered_map<const IAsyncChannel*, TargetPtr> m_TargetIndex;
+	size_t m_TargetCount;
+	size_t m_PeakTargets;
+	std::vector<Slot> m_DueSlots;
+	std::vector<std::unique_ptr<Buffer>> m_FreeBuffers;
+	uint64_t m_NextClient;
+	std::chrono::steady_clock::time_point m_NextDue;
+	std::mt19937_64 m_Random;
+	std::exponential_distribution<double> m_Exponential;
+	std::atomic<uint64_t> m_SentMessages;
+	std::atomic<uint64_t> m_Responses;
+	std::atomic<uint64_t> m_Timeouts;
+	std::atomic<uint64_t> m_Overruns;
+};
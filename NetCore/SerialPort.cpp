@@ -1,9 +1,8 @@
-#include "pch.h"
+﻿#include "pch.h"
 #include "SerialPort.h"
-#include "NetDebugger.h"
 #include "OEMStringHelper.hpp"
 
-SerialPort::SerialPort() :
+SerialPort::SerialPort(NetCore& core) :
 	m_PortName(),
 	m_BaudRate(19200),
 	m_CharacterSize(8),
@@ -12,7 +11,7 @@ SerialPort::SerialPort() :
 	m_FlowControl(boost::asio::serial_port::flow_control::none),
 	m_DTRState(false),
 	m_Writing(),
-	m_SerialPort(theApp.GetIOContext())
+	m_SerialPort(core.GetIOContext())
 {
 	m_Writing.clear();
 }
@@ -252,7 +251,7 @@ IDevice::PDTable SerialPort::EnumProperties()
 					0,
 					NULL);
 
-				CStringA message(lpMsgBuf);
+				std::string message(lpMsgBuf);
 				::LocalFree(lpMsgBuf);
 				throw PropertyException(message);
 			}
@@ -489,7 +488,7 @@ class SerialPortStream :
 	friend class SerialPortSwitch;
 	friend class SerialPortToTCPClient;
 public:
-	SerialPortStream() :
+	SerialPortStream(NetCore& core) :
 		m_PortName(),
 		m_BaudRate(19200),
 		m_CharacterSize(8),
@@ -499,7 +498,7 @@ public:
 		m_DTRState(false),
 		m_Writing(),
 		m_Opened(false),
-		m_SerialPort(theApp.GetIOContext())
+		m_SerialPort(core.GetIOContext())
 	{
 		m_Writing.clear();
 	}
@@ -814,7 +813,7 @@ public:
 						0,
 						NULL);
 
-					CStringA message(lpMsgBuf);
+					std::string message(lpMsgBuf);
 					::LocalFree(lpMsgBuf);
 					throw PropertyException(message);
 				}
@@ -927,9 +926,9 @@ class SerialPortSwitch :
 {
 	friend class SerialPortStream<SerialPortSwitch>;
 public:
-	SerialPortSwitch():
-		m_SerialPortA(std::make_shared<SerialPortStream<SerialPortSwitch>>()),
-		m_SerialPortB(std::make_shared<SerialPortStream<SerialPortSwitch>>())
+	SerialPortSwitch(NetCore& core):
+		m_SerialPortA(std::make_shared<SerialPortStream<SerialPortSwitch>>(core)),
+		m_SerialPortB(std::make_shared<SerialPortStream<SerialPortSwitch>>(core))
 	{
 	}
 	virtual ~SerialPortSwitch()
@@ -938,7 +937,7 @@ public:
 		m_SerialPortB->Close();
 	}
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override
 	{
 		return false;
@@ -1053,10 +1052,11 @@ class TcpForwardClientChannel :
 {
 	friend SerialPortToTCPClient;
 public:
-	TcpForwardClientChannel() :
+	TcpForwardClientChannel(NetCore& core) :
+		m_Core(core),
 		m_Device(),
 		m_Target(),
-		m_Socket(theApp.GetIOContext()),
+		m_Socket(core.GetIOContext()),
 		m_Opened(false),
 		m_ChannelGroupName()
 	{
@@ -1066,7 +1066,7 @@ public:
 		CloseChannel();
 	}
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override
 	{
 		if (sizeof(size_t) == sizeof(void*))
@@ -1278,22 +1278,21 @@ protected:
 		if (m_Opened.compare_exchange_weak(state, true))
 		{
 			auto channel = shared_from_this();
-			boost::system::error_code ec;
-			auto rslv = std::make_shared<boost::asio::ip::tcp::resolver>(theApp.GetIOContext());
-			boost::asio::ip::tcp::resolver::query qry(WStringToString(m_ServerURL), std::to_string(m_RemotePort));
 			auto keepAlive = m_Keepalive;
-			rslv->async_resolve(qry, [rslv, channel, keepAlive, handler](const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator iter)
+			m_Core.GetEndpointCache().Resolve(WStringToString(m_ServerURL), static_cast<uint16_t>(m_RemotePort), [channel, keepAlive, handler](const boost::system::error_code& ec, EndpointCache::Endpoints endpoints)
 				{
 					if (ec)
 					{
+						channel->m_Opened = false;
 						handler(ec);
 					}
 					else
 					{
 						boost::asio::async_connect(
 							channel->m_Socket,
-							iter,
-							[rslv, channel, keepAlive, handler](const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator iter)
+							endpoints->begin(),
+							endpoints->end(),
+							[endpoints, channel, keepAlive, handler](const boost::system::error_code& ec, std::vector<boost::asio::ip::tcp::endpoint>::const_iterator iter)
 							{
 								if (ec)
 								{
@@ -1384,6 +1383,7 @@ protected:
 	}
 	void CloseChannel(const boost::system::error_code& ecClose);
 private:
+	NetCore& m_Core;
 	std::weak_ptr<SerialPortToTCPClient> m_Device;
 	std::weak_ptr<IAsyncChannel> m_Target;
 	boost::asio::ip::tcp::socket m_Socket;
@@ -1401,9 +1401,9 @@ class SerialPortToTCPClient :
 	friend class SerialPortStream<SerialPortToTCPClient>;
 	friend class TcpForwardClientChannel;
 public:
-	SerialPortToTCPClient() :
-		m_SerialPort(std::make_shared<SerialPortStream<SerialPortToTCPClient>>()),
-		m_TCPClient(std::make_shared<TcpForwardClientChannel>())
+	SerialPortToTCPClient(NetCore& core) :
+		m_SerialPort(std::make_shared<SerialPortStream<SerialPortToTCPClient>>(core)),
+		m_TCPClient(std::make_shared<TcpForwardClientChannel>(core))
 	{
 	}
 	virtual ~SerialPortToTCPClient()
@@ -1412,7 +1412,7 @@ public:
 		m_TCPClient->Close();
 	}
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override
 	{
 		return false;
@@ -1,5 +1,6 @@
-#pragma once
+﻿#pragma once
 #include "IAsyncStream.h"
+#include "NetCore.h"
 
 class SerialPort :
 	public CommunicationDevice,
@@ -7,17 +8,17 @@ class SerialPort :
 	public std::enable_shared_from_this<SerialPort>
 {
 public:
-	SerialPort();
+	SerialPort(NetCore& core);
 	virtual ~SerialPort();
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override;
 	virtual bool IsServer(void) override;
 	virtual PDTable EnumProperties() override;
 	virtual void Start(void) override;
 	virtual void Stop(void) override;
 
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
@@ -0,0 +1,536 @@
+﻿#include "pch.h"
+#include "ServerBehavior.h"
+#include "TextEncodeType.h"
+#include "OEMStringHelper.hpp"
+
+// chargen 按 RFC 864 生成: 95 个可打印字符循环, 每行 72 个字符, 每行起始字符依次后移
+constexpr size_t kCHARGEN_LINE = 72;
+constexpr size_t kCHARGEN_CHARS = 95;
+constexpr size_t kCHARGEN_PERIOD = kCHARGEN_CHARS * (kCHARGEN_LINE + 2);
+// 限速时每次写出约 10 毫秒的数据, 速率较低时也能均匀发送
+constexpr uint32_t kCHARGEN_SLICES = 100;
+// UDP 数据报最大负载(65535 - IP 头 20 - UDP 头 8), chargen 每个数据报不超过这个长度
+constexpr size_t kMAX_DATAGRAM = 65507;
+
+struct ServerBehavior::Session
+{
+	Session(boost::asio::io_context& io, std::shared_ptr<IAsyncChannel> channel, size_t bufferSize) :
+		channel(channel),
+		buffer(std::make_shared<std::vector<uint8_t>>(bufferSize)),
+		bufferSize(bufferSize),
+		timer(io),
+		matched(0),
+		pending(0),
+		thinking(false),
+		offset(0),
+		due(std::chrono::steady_clock::now()),
+		ended(false)
+	{
+	}
+	std::shared_ptr<IAsyncChannel> channel;
+	IAsyncChannel::OutputBuffer buffer;
+	size_t bufferSize;
+	boost::asio::steady_timer timer;
+	size_t matched;         // 请求结束符已匹配的字节数, 结束符跨两次读取时接着匹配
+	size_t pending;         // 尚未应答的请求数
+	bool thinking;
+	size_t offset;          // chargen 在字符流中的位置
+	std::chrono::steady_clock::time_point due;
+	std::atomic<bool> ended;
+};
+
+struct ServerBehavior::Datagram
+{
+	Datagram(boost::asio::io_context& io, boost::asio::ip::udp::socket& socket, std::shared_ptr<void> owner, size_t bufferSize) :
+		socket(socket),
+		owner(owner),
+		buffer(bufferSize),
+		sender(),
+		timer(io),
+		source(io),
+		offset(0),
+		due(std::chrono::steady_clock::now())
+	{
+	}
+	boost::asio::ip::udp::socket& socket;
+	std::shared_ptr<void> owner;
+	std::vector<uint8_t> buffer;
+	boost::asio::ip::udp::endpoint sender;
+	boost::asio::steady_timer timer;
+	boost::asio::steady_timer source;
+	size_t offset;
+	std::chrono::steady_clock::time_point due;
+};
+
+ServerBehavior::ServerBehavior(boost::asio::io_context& io) :
+	m_IOContext(io),
+	m_Options({ Mode::None, 64 * 1024, 0, 0, std::wstring(), std::wstring() }),
+	m_Chargen(),
+	m_Response(),
+	m_Delimiter(),
+	m_Mutex(),
+	m_Live(),
+	m_Sessions(0),
+	m_Served(0),
+	m_Requests(0),
+	m_BytesIn(0),
+	m_BytesOut(0),
+	m_SendErrors(0)
+{
+}
+
+IDevice::PD ServerBehavior::CreateProperties(std::shared_ptr<ServerBehavior> behavior)
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	using PropertyGroup = PropertyDescriptionHelper::PropertyGroupDescription;
+	auto group = std::make_shared<PropertyGroup>(L"ServerBehavior", L"DEVICE.BEHAVIOR.PROP.BEHAVIOR");
+	auto pd = std::make_shared<StaticProperty>(
+		L"Behavior",
+		L"DEVICE.BEHAVIOR.PROP.MODE",
+		uint8_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->AddEnumOptions(L"0", L"DEVICE.BEHAVIOR.PROP.MODE.EM0", true);
+	pd->AddEnumOptions(L"1", L"DEVICE.BEHAVIOR.PROP.MODE.EM1", true);
+	pd->AddEnumOptions(L"2", L"DEVICE.BEHAVIOR.PROP.MODE.EM2", true);
+	pd->AddEnumOptions(L"3", L"DEVICE.BEHAVIOR.PROP.MODE.EM3", true);
+	pd->AddEnumOptions(L"4", L"DEVICE.BEHAVIOR.PROP.MODE.EM4", true);
+	pd->BindMethod(
+		[behavior]() { return std::to_wstring(static_cast<int>(behavior->m_Options.mode)); },
+		[behavior](const std::wstring& value)
+	{
+		auto n = std::wcstoul(value.c_str(), nullptr, 10);
+		if (n > static_cast<unsigned long>(Mode::Response))
+			throw PropertyException("invalid server behavior: " + WStringToString(value));
+		behavior->m_Options.mode = static_cast<Mode>(n);
+	});
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"BufferSize",
+		L"DEVICE.BEHAVIOR.PROP.BUFFERSIZE",
+		uint32_t(64 * 1024),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[behavior]() { return std::to_wstring(behavior->m_Options.bufferSize); },
+		[behavior](const std::wstring& value)
+	{
+		auto n = std::wcstoul(value.c_str(), nullptr, 10);
+		if (n < 1 || n > 16 * 1024 * 1024)
+			throw PropertyException("buffer size must be between 1 and 16777216: " + WStringToString(value));
+		behavior->m_Options.bufferSize = static_cast<uint32_t>(n);
+	});
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"ChargenRate",
+		L"DEVICE.BEHAVIOR.PROP.RATE",
+		uint32_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[behavior]() { return std::to_wstring(behavior->m_Options.rate); },
+		[behavior](const std::wstring& value) { behavior->m_Options.rate = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"Response",
+		L"DEVICE.BEHAVIOR.PROP.RESPONSE",
+		L"",
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[behavior]() { return behavior->m_Options.response; },
+		[behavior](const std::wstring& value) { behavior->m_Options.response = value; }
+	);
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"RequestDelimiter",
+		L"DEVICE.BEHAVIOR.PROP.DELIMITER",
+		L"",
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[behavior]() { return behavior->m_Options.delimiter; },
+		[behavior](const std::wstring& value) { behavior->m_Options.delimiter = value; }
+	);
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"ThinkTime",
+		L"DEVICE.BEHAVIOR.PROP.THINKTIME",
+		uint32_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[behavior]() { return std::to_wstring(behavior->m_Options.thinkTime); },
+		[behavior](const std::wstring& value) { behavior->m_Options.thinkTime = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	group->AddChild(pd);
+
+	auto counter = [&group, behavior](const wchar_t* name, const wchar_t* title, std::atomic<uint64_t> ServerBehavior::* member)
+	{
+		auto pd = std::make_shared<StaticProperty>(name, title, uint32_t(0), IDevice::PropertyChangeFlags::Readonly);
+		pd->BindMethod([behavior, member]() { return std::to_wstring((*behavior.*member).load()); }, nullptr);
+		group->AddChild(pd);
+	};
+	counter(L"Sessions", L"DEVICE.BEHAVIOR.PROP.SESSIONS", &ServerBehavior::m_Sessions);
+	counter(L"Served", L"DEVICE.BEHAVIOR.PROP.SERVED", &ServerBehavior::m_Served);
+	counter(L"Requests", L"DEVICE.BEHAVIOR.PROP.REQUESTS", &ServerBehavior::m_Requests);
+	counter(L"BytesIn", L"DEVICE.BEHAVIOR.PROP.BYTESIN", &ServerBehavior::m_BytesIn);
+	counter(L"BytesOut", L"DEVICE.BEHAVIOR.PROP.BYTESOUT", &ServerBehavior::m_BytesOut);
+	counter(L"SendErrors", L"DEVICE.BEHAVIOR.PROP.SENDERRORS", &ServerBehavior::m_SendErrors);
+	return group;
+}
+
+void ServerBehavior::Prepare(void)
+{
+	m_Sessions = 0;
+	m_Served = 0;
+	m_Requests = 0;
+	m_BytesIn = 0;
+	m_BytesOut = 0;
+	m_SendErrors = 0;
+
+	// 多生成一个缓冲区长度, 从字符流任意位置开始的一次写出都是连续内存
+	auto chargen = std::make_shared<std::vector<uint8_t>>();
+	chargen->reserve(kCHARGEN_PERIOD + m_Options.bufferSize);
+	for (size_t line = 0; chargen->size() < kCHARGEN_PERIOD + m_Options.bufferSize; ++line)
+	{
+		for (size_t i = 0; i < kCHARGEN_LINE; ++i)
+			chargen->push_back(static_cast<uint8_t>(' ' + (line + i) % kCHARGEN_CHARS));
+		chargen->push_back('\r');
+		chargen->push_back('\n');
+	}
+	m_Chargen = chargen;
+
+	auto response = std::make_shared<std::vector<uint8_t>>();
+	Transform::DecodeWStringTo(m_Options.response, TextEncodeType::HEX, *response);
+	m_Response = response;
+	m_Delimiter.clear();
+	Transform::DecodeWStringTo(m_Options.delimiter, TextEncodeType::HEX, m_Delimiter);
+}
+
+void ServerBehavior::Serve(std::shared_ptr<IAsyncChannel> channel)
+{
+	auto session = std::make_shared<Session>(m_IOContext, channel, m_Options.bufferSize);
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		m_Live.insert(session);
+	}
+	++m_Sessions;
+	++m_Served;
+	// chargen 同时读取并丢弃对端发来的数据, 对端关闭时读取失败结束会话
+	if (m_Options.mode == Mode::Chargen)
+		Generate(session);
+	Read(session);
+}
+
+void ServerBehavior::Read(const SessionPtr& session)
+{
+	if (session->ended)
+		return;
+	auto self = shared_from_this();
+	// WebSocket 读取会把缓冲区调整为消息长度, 容量不变, 这里只恢复长度不重新分配
+	session->buffer->resize(session->bufferSize);
+	session->channel->ReadSome(session->buffer, [self, session](bool ok, size_t io_bytes)
+	{
+		if (!ok)
+		{
+			self->End(session);
+			return;
+		}
+		self->OnRead(session, io_bytes);
+	});
+}
+
+void ServerBehavior::OnRead(const SessionPtr& session, size_t io_bytes)
+{
+	m_BytesIn += io_bytes;
+	auto self = shared_from_this();
+	switch (m_Options.mode)
+	{
+	case Mode::Echo:
+		// 直接写出刚收到的缓冲区, 写完再读下一次
+		++m_Requests;
+		session->channel->Write({ session->buffer->data(), io_bytes }, [self, session](bool ok, size_t io_bytes)
+		{
+			if (!ok)
+			{
+				self->End(session);
+				return;
+			}
+			self->m_BytesOut += io_bytes;
+			self->Read(session);
+		});
+		break;
+	case Mode::Response:
+		session->pending += CountRequests(session, session->buffer->data(), io_bytes);
+		Respond(session);
+		break;
+	default:
+		++m_Requests;
+		Read(session);
+		break;
+	}
+}
+
+size_t ServerBehavior::CountRequests(const SessionPtr& session, const uint8_t* data, size_t size)
+{
+	if (m_Delimiter.empty())
+		return 1;
+	size_t count = 0;
+	for (size_t i = 0; i < size; ++i)
+	{
+		// 结束符通常只有一两个字节, 失配时从头重新匹配即可
+		if (data[i] != m_Delimiter[session->matched])
+			session->matched = data[i] == m_Delimiter[0] ? 1 : 0;
+		else
+			++session->matched;
+		if (session->matched == m_Delimiter.size())
+		{
+			++count;
+			session->matched = 0;
+		}
+	}
+	return count;
+}
+
+void ServerBehavior::Respond(const SessionPtr& session)
+{
+	auto self = shared_from_this();
+	// 应答为空时只计数, 一次处理完所有积压的请求
+	do
+	{
+		if (session->ended)
+			return;
+		if (session->pending == 0)
+		{
+			Read(session);
+			return;
+		}
+		// 每个应答前等待思考时间, 模拟逐个处理请求的服务
+		if (m_Options.thinkTime > 0 && !session->thinking)
+		{
+			session->thinking = true;
+			session->timer.expires_after(std::chrono::milliseconds(m_Options.thinkTime));
+			session->timer.async_wait([self, session](const boost::system::error_code& ec)
+			{
+				if (ec)
+				{
+					self->End(session);
+					return;
+				}
+				self->Respond(session);
+			});
+			return;
+		}
+		session->thinking = false;
+		--session->pending;
+		++m_Requests;
+	} while (m_Response->empty());
+	auto response = m_Response;
+	session->channel->Write({ response->data(), response->size() }, [self, session, response](bool ok, size_t io_bytes)
+	{
+		if (!ok)
+		{
+			self->End(session);
+			return;
+		}
+		self->m_BytesOut += io_bytes;
+		self->Respond(session);
+	});
+}
+
+size_t ServerBehavior::ChunkSize(void) const
+{
+	if (m_Options.rate == 0)
+		return m_Options.bufferSize;
+	return (std::min)((std::max)(m_Options.rate / kCHARGEN_SLICES, 1u), m_Options.bufferSize);
+}
+
+std::chrono::steady_clock::duration ServerBehavior::ChunkInterval(size_t size) const
+{
+	return std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(static_cast<double>(size) / m_Options.rate));
+}
+
+void ServerBehavior::Generate(const SessionPtr& session)
+{
+	if (session->ended)
+		return;
+	auto self = shared_from_this();
+	auto chargen = m_Chargen;
+	auto size = ChunkSize();
+	auto data = chargen->data() + session->offset;
+	session->offset = (session->offset + size) % kCHARGEN_PERIOD;
+	session->channel->Write({ data, size }, [self, session, chargen](bool ok, size_t io_bytes)
+	{
+		if (!ok)
+		{
+			self->End(session);
+			return;
+		}
+		self->m_BytesOut += io_bytes;
+		if (self->m_Options.rate == 0)
+		{
+			self->Generate(session);
+			return;
+		}
+		// 按截止时间排期, 不累积落后的额度, 避免对端暂停接收后集中涌出
+		auto now = std::chrono::steady_clock::now();
+		session->due += self->ChunkInterval(io_bytes);
+		if (session->due <= now)
+		{
+			session->due = now;
+			self->Generate(session);
+			return;
+		}
+		session->timer.expires_at(session->due);
+		session->timer.async_wait([self, session](const boost::system::error_code& ec)
+		{
+			if (ec)
+				self->End(session);
+			else
+				self->Generate(session);
+		});
+	});
+}
+
+void ServerBehavior::End(const SessionPtr& session)
+{
+	if (session->ended.exchange(true))
+		return;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		m_Live.erase(session);
+	}
+	--m_Sessions;
+	session->channel->Close();
+}
+
+void ServerBehavior::Shutdown(void)
+{
+	std::vector<SessionPtr> sessions;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		sessions.assign(m_Live.begin(), m_Live.end());
+	}
+	for (auto& session : sessions)
+		End(session);
+}
+
+void ServerBehavior::Serve(boost::asio::ip::udp::socket& socket, std::shared_ptr<void> owner)
+{
+	auto datagram = std::make_shared<Datagram>(m_IOContext, socket, owner, m_Options.bufferSize);
+	++m_Sessions;
+	++m_Served;
+	if (m_Options.mode == Mode::Chargen)
+		Source(datagram);
+	Receive(datagram);
+}
+
+void ServerBehavior::Receive(const DatagramPtr& datagram)
+{
+	auto self = shared_from_this();
+	datagram->socket.async_receive_from(
+		boost::asio::buffer(datagram->buffer.data(), datagram->buffer.size()),
+		datagram->sender,
+		[self, datagram](const boost::system::error_code& ec, size_t io_bytes)
+	{
+		if (ec && ec != boost::asio::error::message_size)
+		{
+			// 对端不可达等错误只影响单个数据报, 套接字关闭时才结束
+			self->Resume(datagram, ec);
+			return;
+		}
+		self->m_BytesIn += io_bytes;
+		++self->m_Requests;
+		switch (self->m_Options.mode)
+		{
+		case Mode::Echo:
+			self->Reply(datagram, datagram->buffer.data(), io_bytes);
+			break;
+		case Mode::Response:
+			if (self->m_Response->empty())
+				self->Receive(datagram);
+			else if (self->m_Options.thinkTime == 0)
+				self->Reply(datagram, self->m_Response->data(), self->m_Response->size());
+			else
+			{
+				datagram->timer.expires_after(std::chrono::milliseconds(self->m_Options.thinkTime));
+				datagram->timer.async_wait([self, datagram](const boost::system::error_code& ec)
+				{
+					if (ec)
+						self->Resume(datagram, ec);
+					else
+						self->Reply(datagram, self->m_Response->data(), self->m_Response->size());
+				});
+			}
+			break;
+		default:
+			self->Receive(datagram);
+			break;
+		}
+	});
+}
+
+void ServerBehavior::Reply(const DatagramPtr& datagram, const uint8_t* data, size_t size)
+{
+	auto self = shared_from_this();
+	auto response = m_Response;
+	datagram->socket.async_send_to(
+		boost::asio::const_buffer(data, size),
+		datagram->sender,
+		[self, datagram, response](const boost::system::error_code& ec, size_t io_bytes)
+	{
+		if (!ec)
+			self->m_BytesOut += io_bytes;
+		else if (ec != boost::asio::error::operation_aborted)
+			++self->m_SendErrors;
+		self->Resume(datagram, ec);
+	});
+}
+
+void ServerBehavior::Resume(const DatagramPtr& datagram, const boost::system::error_code& ec)
+{
+	if (ec == boost::asio::error::operation_aborted || !datagram->socket.is_open())
+	{
+		--m_Sessions;
+		return;
+	}
+	Receive(datagram);
+}
+
+void ServerBehavior::Source(const DatagramPtr& datagram)
+{
+	auto self = shared_from_this();
+	auto chargen = m_Chargen;
+	auto size = (std::min)(ChunkSize(), kMAX_DATAGRAM);
+	auto data = chargen->data() + datagram->offset;
+	datagram->offset = (datagram->offset + size) % kCHARGEN_PERIOD;
+	// 数据报只能发给已连接的对端, 对端未监听(connection_refused)时继续发送, 其他错误计数后停止
+	datagram->socket.async_send(
+		boost::asio::const_buffer(data, size),
+		[self, datagram, chargen, size](const boost::system::error_code& ec, size_t io_bytes)
+	{
+		if (ec && ec != boost::asio::error::connection_refused)
+		{
+			if (ec != boost::asio::error::operation_aborted)
+				++self->m_SendErrors;
+			return;
+		}
+		self->m_BytesOut += io_bytes;
+		auto now = std::chrono::steady_clock::now();
+		if (self->m_Options.rate > 0)
+			datagram->due = (std::max)(datagram->due + self->ChunkInterval(size), now);
+		datagram->source.expires_at(self->m_Options.rate > 0 ? datagram->due : now);
+		datagram->source.async_wait([self, datagram](const boost::system::error_code& ec)
+		{
+			if (!ec)
+				self->Source(datagram);
+		});
+	});
+}
@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <unordered_set>
+#include <chrono>
+#include "IAsyncStream.h"
+
+// 服务端内置的对端行为, 用于压测客户端: 回显, 丢弃, 按速率发送字符流(chargen), 固定应答.
+// 开启后通道不交给界面, 收发全部在 IO 线程上完成; 每个连接只分配一次读缓冲区, 回显直接写出收到的缓冲区,
+// chargen 和应答数据在启动时生成一份, 所有连接共用, 不再复制.
+class ServerBehavior : public std::enable_shared_from_this<ServerBehavior>
+{
+public:
+	enum class Mode
+	{
+		None,
+		Echo,
+		Discard,
+		Chargen,
+		Response
+	};
+	struct Options
+	{
+		Mode mode;
+		uint32_t bufferSize;      // 每个连接的读缓冲区和 chargen 每次写出的最大字节数
+		uint32_t rate;            // chargen 每秒字节数, 0 表示不限制
+		uint32_t thinkTime;       // 固定应答前等待的毫秒数
+		std::wstring response;    // 固定应答内容(十六进制)
+		std::wstring delimiter;   // 请求结束符(十六进制), 为空时每次读到的数据算一个请求
+	};
+public:
+	ServerBehavior(void) = delete;
+	ServerBehavior(const ServerBehavior&) = delete;
+	ServerBehavior(boost::asio::io_context& io);
+	~ServerBehavior(void) = default;
+public:
+	static IDevice::PD CreateProperties(std::shared_ptr<ServerBehavior> behavior);
+	bool Enabled(void) const { return m_Options.mode != Mode::None; }
+	Mode GetMode(void) const { return m_Options.mode; }
+	// 设备启动时调用: 清零统计, 按当前设置生成共用的发送数据
+	void Prepare(void);
+	// 服务一个流式通道(TCP, WebSocket), 通道出错或关闭时结束
+	void Serve(std::shared_ptr<IAsyncChannel> channel);
+	// 设备停止时调用, 关闭所有正在服务的流式通道; 数据报服务随套接字关闭结束
+	void Shutdown(void);
+	// 服务一个数据报套接字: 回显/丢弃/应答按每个数据报的来源地址回复, chargen 按速率发给已连接的对端.
+	// owner 保证套接字在服务期间有效
+	void Serve(boost::asio::ip::udp::socket& socket, std::shared_ptr<void> owner);
+private:
+	struct Session;
+	struct Datagram;
+	using SessionPtr = std::shared_ptr<Session>;
+	using DatagramPtr = std::shared_ptr<Datagram>;
+	void Read(const SessionPtr& session);
+	void OnRead(const SessionPtr& session, size_t io_bytes);
+	void Respond(const SessionPtr& session);
+	void Generate(const SessionPtr& session);
+	void End(const SessionPtr& session);
+	size_t CountRequests(const SessionPtr& session, const uint8_t* data, size_t size);
+	void Receive(const DatagramPtr& datagram);
+	// 套接字关闭(或操作被取消)时结束会话, 否则继续接收下一个数据报
+	void Resume(const DatagramPtr& datagram, const boost::system::error_code& ec);
+	void Reply(const DatagramPtr& datagram, const uint8_t* data, size_t size);
+	void Source(const DatagramPtr& datagram);
+	size_t ChunkSize(void) const;
+	std::chrono::steady_clock::duration ChunkInterval(size_t size) const;
+private:
+	boost::asio::io_context& m_IOContext;
+	Options m_Options;
+	std::shared_ptr<const std::vector<uint8_t>> m_Chargen;
+	std::shared_ptr<const std::vector<uint8_t>> m_Response;
+	std::vector<uint8_t> m_Delimiter;
+	std::mutex m_Mutex;
+	std::unordered_set<SessionPtr> m_Live;
+	std::atomic<uint64_t> m_Sessions;
+	std::atomic<uint64_t> m_Served;
+	std::atomic<uint64_t> m_Requests;
+	std::atomic<uint64_t> m_BytesIn;
+	std::atomic<uint64_t> m_BytesOut;
+	std::atomic<uint64_t> m_SendErrors;
+};
@@ -0,0 +1,222 @@
+﻿#include "pch.h"
+#include "SocketTuning.h"
+
+template<int Level, int Name>
+using IntegerOption = boost::asio::detail::socket_option::integer<Level, Name>;
+
+// 未定义的选项在当前系统上不可用, 对应的设置被跳过, 读回时显示为 n/a
+#if defined(TCP_KEEPIDLE)
+#define TUNING_TCP_KEEPIDLE TCP_KEEPIDLE
+#elif defined(TCP_KEEPALIVE)
+#define TUNING_TCP_KEEPIDLE TCP_KEEPALIVE
+#endif
+
+SocketTuning::SocketTuning(void) :
+	m_Options({ false, 0, 0, false, 0, false, 0, 0, 0, 0 }),
+	m_Sampled(false),
+	m_Mutex(),
+	m_Effective()
+{
+}
+
+IDevice::PD SocketTuning::CreateProperties(std::shared_ptr<SocketTuning> tuning)
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	using PropertyGroup = PropertyDescriptionHelper::PropertyGroupDescription;
+	auto group = std::make_shared<PropertyGroup>(L"Tuning", L"DEVICE.TCPTUNING.PROP.TUNING");
+	auto flag = [&group, tuning](const wchar_t* name, const wchar_t* title, bool Options::* member)
+	{
+		auto pd = std::make_shared<StaticProperty>(name, title, bool(false), IDevice::PropertyChangeFlags::CanChangeBeforeStart);
+		pd->BindMethod(
+			[tuning, member]() { return std::to_wstring(tuning->m_Options.*member ? 1 : 0); },
+			[tuning, member](const std::wstring& value) { tuning->m_Options.*member = value == L"1"; });
+		group->AddChild(pd);
+	};
+	auto number = [&group, tuning](const wchar_t* name, const wchar_t* title, uint32_t Options::* member)
+	{
+		auto pd = std::make_shared<StaticProperty>(name, title, uint32_t(0), IDevice::PropertyChangeFlags::CanChangeBeforeStart);
+		pd->BindMethod(
+			[tuning, member]() { return std::to_wstring(tuning->m_Options.*member); },
+			[tuning, member](const std::wstring& value) { tuning->m_Options.*member = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); });
+		group->AddChild(pd);
+	};
+	flag(L"NoDelay", L"DEVICE.TCPTUNING.PROP.NODELAY", &Options::noDelay);
+	number(L"SendBuffer", L"DEVICE.TCPTUNING.PROP.SNDBUF", &Options::sendBuffer);
+	number(L"ReceiveBuffer", L"DEVICE.TCPTUNING.PROP.RCVBUF", &Options::receiveBuffer);
+	flag(L"QuickAck", L"DEVICE.TCPTUNING.PROP.QUICKACK", &Options::quickAck);
+	number(L"NotSentLowat", L"DEVICE.TCPTUNING.PROP.NOTSENTLOWAT", &Options::notSentLowat);
+	flag(L"LingerReset", L"DEVICE.TCPTUNING.PROP.LINGERRESET", &Options::lingerReset);
+	number(L"UserTimeout", L"DEVICE.TCPTUNING.PROP.USERTIMEOUT", &Options::userTimeout);
+	number(L"KeepIdle", L"DEVICE.TCPTUNING.PROP.KEEPIDLE", &Options::keepIdle);
+	number(L"KeepInterval", L"DEVICE.TCPTUNING.PROP.KEEPINTERVAL", &Options::keepInterval);
+	number(L"KeepCount", L"DEVICE.TCPTUNING.PROP.KEEPCOUNT", &Options::keepCount);
+
+	auto pd = std::make_shared<StaticProperty>(L"Effective", L"DEVICE.TCPTUNING.PROP.EFFECTIVE", L"", IDevice::PropertyChangeFlags::Readonly);
+	pd->BindMethod([tuning]() { return tuning->Effective(); }, nullptr);
+	group->AddChild(pd);
+	return group;
+}
+
+void SocketTuning::Reset(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_Effective.clear();
+	m_Sampled = false;
+}
+
+std::wstring SocketTuning::Effective(void)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	return m_Effective;
+}
+
+template<typename Socket>
+static void SetBuffers(Socket& socket, uint32_t sendBuffer, uint32_t receiveBuffer)
+{
+	// 选项设置失败不影响连接, 读回的实际值会反映出来
+	boost::system::error_code ec;
+	if (sendBuffer > 0)
+		socket.set_option(boost::asio::socket_base::send_buffer_size(static_cast<int>(sendBuffer)), ec);
+	if (receiveBuffer > 0)
+		socket.set_option(boost::asio::socket_base::receive_buffer_size(static_cast<int>(receiveBuffer)), ec);
+}
+
+void SocketTuning::ApplyBuffers(boost::asio::ip::tcp::acceptor& acceptor)
+{
+	SetBuffers(acceptor, m_Options.sendBuffer, m_Options.receiveBuffer);
+}
+
+void SocketTuning::ApplyBuffers(boost::asio::ip::tcp::socket& socket)
+{
+	SetBuffers(socket, m_Options.sendBuffer, m_Options.receiveBuffer);
+}
+
+// 与 boost::asio::async_connect 的端点序列版本相同, 但每次尝试都在打开套接字后设置缓冲区;
+// 套接字被关闭(超时)时不再尝试后面的端点
+static void ConnectNext(std::shared_ptr<SocketTuning> tuning, boost::asio::ip::tcp::socket& socket, SocketTuning::Endpoints endpoints, size_t index, const boost::system::error_code& last, SocketTuning::ConnectHandler handler)
+{
+	if (index >= endpoints->size())
+	{
+		handler(last);
+		return;
+	}
+	auto& endpoint = (*endpoints)[index];
+	boost::system::error_code ec;
+	socket.close(ec);
+	socket.open(endpoint.protocol(), ec);
+	if (ec)
+	{
+		ConnectNext(tuning, socket, endpoints, index + 1, ec, handler);
+		return;
+	}
+	if (tuning != nullptr)
+		tuning->ApplyBuffers(socket);
+	socket.async_connect(endpoint, [tuning, &socket, endpoints, index, handler](const boost::system::error_code& ec)
+	{
+		if (!ec || ec == boost::asio::error::operation_aborted || !socket.is_open())
+			handler(ec ? boost::system::error_code(boost::asio::error::operation_aborted) : ec);
+		else
+			ConnectNext(tuning, socket, endpoints, index + 1, ec, handler);
+	});
+}
+
+void SocketTuning::Connect(std::shared_ptr<SocketTuning> tuning, boost::asio::ip::tcp::socket& socket, Endpoints endpoints, ConnectHandler handler)
+{
+	ConnectNext(tuning, socket, endpoints, 0, boost::asio::error::not_found, handler);
+}
+
+void SocketTuning::Apply(boost::asio::ip::tcp::socket& socket)
+{
+	// 收发缓冲区已在 listen 或 connect 之前设置, 这里只设置逐连接的选项
+	boost::system::error_code ec;
+	auto& options = m_Options;
+	if (options.noDelay)
+		socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+#ifdef TCP_QUICKACK
+	if (options.quickAck)
+		socket.set_option(IntegerOption<IPPROTO_TCP, TCP_QUICKACK>(1), ec);
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+	if (options.notSentLowat > 0)
+		socket.set_option(IntegerOption<IPPROTO_TCP, TCP_NOTSENT_LOWAT>(static_cast<int>(options.notSentLowat)), ec);
+#endif
+	if (options.lingerReset)
+		socket.set_option(boost::asio::socket_base::linger(true, 0), ec);
+#ifdef TCP_USER_TIMEOUT
+	if (options.userTimeout > 0)
+		socket.set_option(IntegerOption<IPPROTO_TCP, TCP_USER_TIMEOUT>(static_cast<int>(options.userTimeout)), ec);
+#endif
+	if (options.keepIdle > 0 || options.keepInterval > 0 || options.keepCount > 0)
+	{
+		socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
+#ifdef TUNING_TCP_KEEPIDLE
+		if (options.keepIdle > 0)
+			socket.set_option(IntegerOption<IPPROTO_TCP, TUNING_TCP_KEEPIDLE>(static_cast<int>(options.keepIdle)), ec);
+#endif
+#ifdef TCP_KEEPINTVL
+		if (options.keepInterval > 0)
+			socket.set_option(IntegerOption<IPPROTO_TCP, TCP_KEEPINTVL>(static_cast<int>(options.keepInterval)), ec);
+#endif
+#ifdef TCP_KEEPCNT
+		if (options.keepCount > 0)
+			socket.set_option(IntegerOption<IPPROTO_TCP, TCP_KEEPCNT>(static_cast<int>(options.keepCount)), ec);
+#endif
+	}
+
+	bool sampled = false;
+	if (m_Sampled.compare_exchange_strong(sampled, true))
+	{
+		auto effective = Query(socket);
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		m_Effective = effective;
+	}
+}
+
+template<typename Option>
+static std::wstring QueryOption(boost::asio::ip::tcp::socket& socket)
+{
+	Option option;
+	boost::system::error_code ec;
+	socket.get_option(option, ec);
+	if (ec)
+		return L"n/a";
+	return std::to_wstring(option.value());
+}
+
+std::wstring SocketTuning::Query(boost::asio::ip::tcp::socket& socket)
+{
+	std::wstring result;
+	result += L"nodelay=" + QueryOption<boost::asio::ip::tcp::no_delay>(socket);
+	result += L" sndbuf=" + QueryOption<boost::asio::socket_base::send_buffer_size>(socket);
+	result += L" rcvbuf=" + QueryOption<boost::asio::socket_base::receive_buffer_size>(socket);
+#ifdef TCP_QUICKACK
+	result += L" quickack=" + QueryOption<IntegerOption<IPPROTO_TCP, TCP_QUICKACK>>(socket);
+#else
+	result += L" quickack=n/a";
+#endif
+#ifdef TCP_NOTSENT_LOWAT
+	result += L" lowat=" + QueryOption<IntegerOption<IPPROTO_TCP, TCP_NOTSENT_LOWAT>>(socket);
+#else
+	result += L" lowat=n/a";
+#endif
+	boost::asio::socket_base::linger linger;
+	boost::system::error_code ec;
+	socket.get_option(linger, ec);
+	result += L" linger=" + (ec ? std::wstring(L"n/a") : linger.enabled() ? std::to_wstring(linger.timeout()) : std::wstring(L"off"));
+#ifdef TCP_USER_TIMEOUT
+	result += L" usertimeout=" + QueryOption<IntegerOption<IPPROTO_TCP, TCP_USER_TIMEOUT>>(socket);
+#else
+	result += L" usertimeout=n/a";
+#endif
+	result += L" keepalive=" + QueryOption<boost::asio::socket_base::keep_alive>(socket);
+#ifdef TUNING_TCP_KEEPIDLE
+	result += L" idle=" + QueryOption<IntegerOption<IPPROTO_TCP, TUNING_TCP_KEEPIDLE>>(socket);
+#endif
+#ifdef TCP_KEEPINTVL
+	result += L" intvl=" + QueryOption<IntegerOption<IPPROTO_TCP, TCP_KEEPINTVL>>(socket);
+#endif
+#ifdef TCP_KEEPCNT
+	result += L" cnt=" + QueryOption<IntegerOption<IPPROTO_TCP, TCP_KEEPCNT>>(socket);
+#endif
+	return result;
+}
@@ -0,0 +1,56 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <functional>
+#include "IAsyncStream.h"
+
+// TCP 套接字调优参数; 数值为 0 或开关关闭时保持系统默认值.
+// 收发缓冲区决定握手时通告的窗口缩放, 在 listen 或 connect 之前设置, 其余选项在连接建立或接受后设置.
+// 系统不支持的选项直接跳过, 实际生效的值从第一个调优的套接字读回.
+class SocketTuning
+{
+public:
+	struct Options
+	{
+		bool noDelay;
+		uint32_t sendBuffer;
+		uint32_t receiveBuffer;
+		bool quickAck;
+		uint32_t notSentLowat;
+		bool lingerReset;       // SO_LINGER(0): 关闭时直接复位, 不进入 TIME_WAIT
+		uint32_t userTimeout;   // 毫秒
+		uint32_t keepIdle;      // 秒, 以下三项任一非 0 时同时开启 Keepalive
+		uint32_t keepInterval;  // 秒
+		uint32_t keepCount;
+	};
+	using Endpoints = std::shared_ptr<const std::vector<boost::asio::ip::tcp::endpoint>>;
+	using ConnectHandler = std::function<void(const boost::system::error_code& ec)>;
+public:
+	SocketTuning(const SocketTuning&) = delete;
+	SocketTuning(void);
+	~SocketTuning(void) = default;
+public:
+	// 生成 "Tuning" 属性组, 属性绑定到 tuning, 设备在 EnumProperties 中加入
+	static IDevice::PD CreateProperties(std::shared_ptr<SocketTuning> tuning);
+	// 监听套接字在 listen 之前设置, 接受的连接继承; 客户端套接字在打开之后, 连接之前设置
+	void ApplyBuffers(boost::asio::ip::tcp::acceptor& acceptor);
+	void ApplyBuffers(boost::asio::ip::tcp::socket& socket);
+	// 依次尝试连接各个端点, 每次打开套接字后先设置收发缓冲区; tuning 为空时不设置
+	static void Connect(std::shared_ptr<SocketTuning> tuning, boost::asio::ip::tcp::socket& socket, Endpoints endpoints, ConnectHandler handler);
+	// 连接建立或接受后设置逐连接的选项
+	void Apply(boost::asio::ip::tcp::socket& socket);
+	// 设备启动时调用, 之后第一个调优的套接字重新读回实际值
+	void Reset(void);
+	std::wstring Effective(void);
+private:
+	std::wstring Query(boost::asio::ip::tcp::socket& socket);
+private:
+	Options m_Options;
+	std::atomic<bool> m_Sampled;
+	std::mutex m_Mutex;
+	std::wstring m_Effective;
+};
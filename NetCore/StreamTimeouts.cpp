@@ -0,0 +1,180 @@
+﻿#include "pch.h"
+#include "StreamTimeouts.h"
+
+StreamTimeouts::StreamTimeouts(void) :
+	m_Options({ 0, 0, 0, 0 }),
+	m_TimedOut(0)
+{
+}
+
+IDevice::PD StreamTimeouts::CreateProperties(std::shared_ptr<StreamTimeouts> timeouts, bool connect, bool handshake)
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	using PropertyGroup = PropertyDescriptionHelper::PropertyGroupDescription;
+	auto group = std::make_shared<PropertyGroup>(L"Timeouts", L"DEVICE.TIMEOUTS.PROP.TIMEOUTS");
+	auto number = [&group, timeouts](const wchar_t* name, const wchar_t* title, uint32_t Options::* member)
+	{
+		auto pd = std::make_shared<StaticProperty>(name, title, uint32_t(0), IDevice::PropertyChangeFlags::CanChangeBeforeStart);
+		pd->BindMethod(
+			[timeouts, member]() { return std::to_wstring(timeouts->m_Options.*member); },
+			[timeouts, member](const std::wstring& value) { timeouts->m_Options.*member = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); });
+		group->AddChild(pd);
+	};
+	if (connect)
+		number(L"ConnectTimeout", L"DEVICE.TIMEOUTS.PROP.CONNECT", &Options::connect);
+	if (handshake)
+		number(L"HandshakeTimeout", L"DEVICE.TIMEOUTS.PROP.HANDSHAKE", &Options::handshake);
+	number(L"IdleTimeout", L"DEVICE.TIMEOUTS.PROP.IDLE", &Options::idle);
+	number(L"WriteStallTimeout", L"DEVICE.TIMEOUTS.PROP.WRITESTALL", &Options::writeStall);
+
+	auto pd = std::make_shared<StaticProperty>(L"TimedOut", L"DEVICE.TIMEOUTS.PROP.TIMEDOUT", uint32_t(0), IDevice::PropertyChangeFlags::Readonly);
+	pd->BindMethod([timeouts]() { return std::to_wstring(timeouts->TimedOut()); }, nullptr);
+	group->AddChild(pd);
+	return group;
+}
+
+StreamTimeouts::WatchdogPtr StreamTimeouts::Watch(TimerWheel& wheel, Phase phase, Watchdog::Expired expired)
+{
+	if (m_Options.connect == 0 && m_Options.handshake == 0 && m_Options.idle == 0 && m_Options.writeStall == 0)
+		return nullptr;
+	auto watchdog = std::make_shared<Watchdog>(wheel, shared_from_this(), expired);
+	watchdog->Enter(phase);
+	return watchdog;
+}
+
+StreamTimeouts::Watchdog::Watchdog(TimerWheel& wheel, std::shared_ptr<StreamTimeouts> owner, Expired expired) :
+	m_Wheel(wheel),
+	m_Owner(owner),
+	m_Options(owner->m_Options),
+	m_Expired(expired),
+	m_Mutex(),
+	m_Phase(Phase::Closed),
+	m_Generation(0),
+	m_Timer(nullptr),
+	m_TimedOut(false),
+	m_Activity(0),
+	m_WriteProgress(0),
+	m_Writing(0)
+{
+}
+
+StreamTimeouts::Watchdog::~Watchdog(void)
+{
+	m_Wheel.Cancel(m_Timer);
+}
+
+void StreamTimeouts::Watchdog::Enter(Phase phase)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	// 已经关闭或超时的不再重新进入
+	if (m_Phase == Phase::Closed && m_Generation > 0)
+		return;
+	m_Phase = phase;
+	m_Wheel.Cancel(m_Timer);
+	m_Timer = nullptr;
+	++m_Generation;
+	switch (phase)
+	{
+	case Phase::Connect:
+		Arm(m_Options.connect);
+		break;
+	case Phase::Handshake:
+		Arm(m_Options.handshake);
+		break;
+	case Phase::Open:
+	{
+		// 空闲和写阻塞共用一个条目, 按较短的一个检查; 登记后时间轮的当前时间才是最新的
+		uint64_t delay = m_Options.idle;
+		if (m_Options.writeStall > 0 && (delay == 0 || m_Options.writeStall < delay))
+			delay = m_Options.writeStall;
+		Arm(delay);
+		m_Activity = m_Wheel.Now();
+		m_WriteProgress = m_Wheel.Now();
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+void StreamTimeouts::Watchdog::BeginWrite(void)
+{
+	if (m_Writing++ == 0)
+		m_WriteProgress = m_Wheel.Now();
+}
+
+void StreamTimeouts::Watchdog::Progress(void)
+{
+	auto now = m_Wheel.Now();
+	m_WriteProgress = now;
+	m_Activity = now;
+}
+
+void StreamTimeouts::Watchdog::EndWrite(void)
+{
+	Progress();
+	--m_Writing;
+}
+
+void StreamTimeouts::Watchdog::Arm(uint64_t delay)
+{
+	if (delay == 0)
+		return;
+	std::weak_ptr<Watchdog> weak = shared_from_this();
+	auto generation = m_Generation;
+	m_Timer = m_Wheel.Schedule(std::chrono::milliseconds(delay), [weak, generation]()
+	{
+		auto watchdog = weak.lock();
+		if (watchdog != nullptr)
+			watchdog->OnTimer(generation);
+	});
+}
+
+void StreamTimeouts::Watchdog::OnTimer(uint32_t generation)
+{
+	Phase phase = Phase::Closed;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (generation != m_Generation || m_Phase == Phase::Closed)
+			return;
+		m_Timer = nullptr;
+		if (m_Phase == Phase::Open)
+		{
+			// 期间有过读写时按最后一次活动时间顺延, 不算超时
+			auto now = m_Wheel.Now();
+			uint64_t next = 0;
+			bool expired = false;
+			if (m_Options.idle > 0)
+			{
+				auto deadline = m_Activity + m_Options.idle;
+				if (deadline <= now)
+					expired = true;
+				else
+					next = deadline - now;
+			}
+			if (m_Options.writeStall > 0)
+			{
+				auto deadline = m_WriteProgress + m_Options.writeStall;
+				if (m_Writing > 0 && deadline <= now)
+					expired = true;
+				else
+				{
+					auto wait = m_Writing > 0 ? deadline - now : m_Options.writeStall;
+					if (next == 0 || wait < next)
+						next = wait;
+				}
+			}
+			if (!expired)
+			{
+				Arm(next);
+				return;
+			}
+		}
+		phase = m_Phase;
+		m_Phase = Phase::Closed;
+		m_TimedOut = true;
+	}
+	++m_Owner->m_TimedOut;
+	if (m_Expired)
+		m_Expired(phase);
+}
@@ -0,0 +1,81 @@
+﻿#pragma once
+#include <cstdint>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include "IAsyncStream.h"
+#include "TimerWheel.h"
+
+// 流式设备的连接生命周期超时: 连接, 握手, 空闲和写阻塞. 设置保存在设备中, 每个通道一个 Watchdog,
+// 挂在 NetCore 共用的时间轮上; 读写时只更新时间戳, 到期时再检查是否真的超时, 不需要每次读写都重新登记.
+class StreamTimeouts : public std::enable_shared_from_this<StreamTimeouts>
+{
+public:
+	struct Options
+	{
+		uint32_t connect;       // 毫秒, 0 表示不限制
+		uint32_t handshake;
+		uint32_t idle;
+		uint32_t writeStall;
+	};
+	enum class Phase
+	{
+		Connect,
+		Handshake,
+		Open,
+		Closed
+	};
+	class Watchdog : public std::enable_shared_from_this<Watchdog>
+	{
+	public:
+		// 参数为超时发生时所处的阶段
+		using Expired = std::function<void(Phase phase)>;
+	public:
+		Watchdog(void) = delete;
+		Watchdog(const Watchdog&) = delete;
+		Watchdog(TimerWheel& wheel, std::shared_ptr<StreamTimeouts> owner, Expired expired);
+		~Watchdog(void);
+	public:
+		void Enter(Phase phase);
+		void Stop(void) { Enter(Phase::Closed); }
+		bool TimedOut(void) const { return m_TimedOut; }
+		// 读写完成时调用, 只更新时间戳
+		void Touch(void) { m_Activity = m_Wheel.Now(); }
+		// 写操作开始和结束时成对调用; 长时间的写(发送文件)中途有进展时调用 Progress
+		void BeginWrite(void);
+		void Progress(void);
+		void EndWrite(void);
+	private:
+		void Arm(uint64_t delay);
+		void OnTimer(uint32_t generation);
+	private:
+		TimerWheel& m_Wheel;
+		std::shared_ptr<StreamTimeouts> m_Owner;
+		Options m_Options;
+		Expired m_Expired;
+		std::mutex m_Mutex;
+		Phase m_Phase;
+		uint32_t m_Generation;
+		TimerWheel::Timer m_Timer;
+		std::atomic<bool> m_TimedOut;
+		std::atomic<uint64_t> m_Activity;
+		std::atomic<uint64_t> m_WriteProgress;
+		std::atomic<uint32_t> m_Writing;
+	};
+	using WatchdogPtr = std::shared_ptr<Watchdog>;
+public:
+	StreamTimeouts(void);
+	StreamTimeouts(const StreamTimeouts&) = delete;
+	~StreamTimeouts(void) = default;
+public:
+	// 没有主动连接或握手阶段的设备不显示对应的超时
+	static IDevice::PD CreateProperties(std::shared_ptr<StreamTimeouts> timeouts, bool connect, bool handshake);
+	// 所有超时都为 0 时返回 nullptr, 通道不产生任何开销
+	WatchdogPtr Watch(TimerWheel& wheel, Phase phase, Watchdog::Expired expired);
+	void Reset(void) { m_TimedOut = 0; }
+	uint64_t TimedOut(void) const { return m_TimedOut; }
+private:
+	Options m_Options;
+	std::atomic<uint64_t> m_TimedOut;
+};
@@ -0,0 +1,1069 @@
+﻿#include "pch.h"
+#include "TCPClient.h"
+#include "OEMStringHelper.hpp"
+#include "TransmitFile.h"
+
+#include<vector>
+
+static std::wstring ProtocolToWstring(const boost::asio::ip::tcp::endpoint::protocol_type& protocol)
+{
+	std::wstring result = L"TCP/IP";
+	if (protocol.family() == AF_INET)
+		result += L"V4";
+	if (protocol.family() == AF_INET6)
+		result += L"V6";
+	return result;
+}
+
+TCPClientChannel::TCPClientChannel(NetCore& core):
+	m_Core(core),
+	m_Socket(core.GetIOContext()),
+	m_Opened(false),
+	m_Device(),
+	m_Slot(0),
+	m_Messages(0),
+	m_MessageLimit(0),
+	m_OnMessageLimit(nullptr),
+	m_Watchdog(nullptr),
+	m_Endpoints(nullptr)
+{
+
+}
+
+TCPClientChannel::~TCPClientChannel(void)
+{
+	CloseSocket();
+}
+
+void TCPClientChannel::Connect(const std::wstring& host, int port, bool keepAlive, const boost::asio::ip::address& local, std::shared_ptr<SocketTuning> tuning, std::shared_ptr<StreamTimeouts> timeouts, std::function<void(const boost::system::error_code ec)> handler)
+{
+	bool state = false;
+	if (m_Opened.compare_exchange_weak(state, true))
+	{
+		auto channel = shared_from_this();
+		std::weak_ptr<TCPClientChannel> weak = channel;
+		m_Watchdog = nullptr;
+		if (timeouts != nullptr)
+		{
+			m_Watchdog = timeouts->Watch(m_Core.GetTimerWheel(), StreamTimeouts::Phase::Connect, [weak](StreamTimeouts::Phase phase)
+			{
+				auto channel = weak.lock();
+				if (channel != nullptr)
+					channel->OnTimeout(phase);
+			});
+		}
+		m_Core.GetEndpointCache().Resolve(WStringToString(host), static_cast<uint16_t>(port), [channel, keepAlive, local, tuning, handler](const boost::system::error_code &ec, EndpointCache::Endpoints endpoints)
+		{
+			auto watchdog = channel->m_Watchdog;
+			if (ec || (watchdog != nullptr && watchdog->TimedOut()))
+			{
+				channel->m_Opened = false;
+				if (watchdog != nullptr)
+					watchdog->Stop();
+				handler(ec ? ec : boost::asio::error::timed_out);
+				return;
+			}
+
+			auto connected = [endpoints, channel, watchdog, keepAlive, tuning, handler](const boost::system::error_code& ec)
+			{
+				auto result = ec;
+				if (ec)
+				{
+					channel->CloseSocket();
+					// 超时时由时间轮关闭 socket, 连接以 operation_aborted 结束, 按超时报告
+					if (watchdog != nullptr && watchdog->TimedOut())
+						result = boost::asio::error::timed_out;
+				}
+				else
+				{
+					boost::system::error_code ecSet;
+					channel->m_Socket.set_option(boost::asio::socket_base::keep_alive(keepAlive), ecSet);
+					if (tuning != nullptr)
+						tuning->Apply(channel->m_Socket);
+					std::atomic_store(&channel->m_Endpoints, EndpointDescriptor::Capture(channel->m_Socket));
+					if (watchdog != nullptr)
+						watchdog->Enter(StreamTimeouts::Phase::Open);
+				}
+				handler(result);
+			};
+			if (local.is_unspecified())
+			{
+				SocketTuning::Connect(tuning, channel->m_Socket, endpoints, connected);
+				return;
+			}
+
+			// 绑定本地地址后只能连接同一地址族的远端地址
+			auto iter = std::find_if(endpoints->begin(), endpoints->end(), [&local](const boost::asio::ip::tcp::endpoint& endpoint)
+			{
+				return endpoint.address().is_v4() == local.is_v4();
+			});
+			boost::system::error_code ecBind = boost::asio::error::address_family_not_supported;
+			if (iter != endpoints->end())
+			{
+				channel->m_Socket.open(iter->protocol(), ecBind);
+#ifdef IP_BIND_ADDRESS_NO_PORT
+				// 端口推迟到 connect 时按四元组分配, 否则每个本地地址最多只有一份临时端口可用
+				boost::system::error_code ecSet;
+				channel->m_Socket.set_option(boost::asio::detail::socket_option::boolean<IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT>(true), ecSet);
+#endif
+				if (!ecBind)
+					channel->m_Socket.bind(boost::asio::ip::tcp::endpoint(local, 0), ecBind);
+				if (!ecBind && tuning != nullptr)
+					tuning->ApplyBuffers(channel->m_Socket);
+			}
+			if (ecBind)
+				connected(ecBind);
+			else
+				channel->m_Socket.async_connect(*iter, connected);
+		});
+	}
+}
+
+bool TCPClientChannel::CloseSocket(void)
+{
+	bool state = true;
+	if (m_Opened.compare_exchange_weak(state, false))
+	{
+		boost::system::error_code ec;
+		m_Socket.cancel(ec);
+		m_Socket.shutdown(m_Socket.shutdown_both, ec);
+		m_Socket.close(ec);
+		if (m_Watchdog != nullptr)
+			m_Watchdog->Stop();
+		return true;
+	}
+	return false;
+}
+
+bool TCPClientChannel::Shutdown(bool reset, boost::system::error_code& ec)
+{
+	bool state = true;
+	if (!m_Opened.compare_exchange_strong(state, false))
+		return false;
+	boost::system::error_code ecCancel;
+	m_Socket.cancel(ecCancel);
+	// SO_LINGER 为 0 时 close 直接发送 RST, 不经过 FIN 和 TIME_WAIT
+	if (reset)
+		m_Socket.set_option(boost::asio::socket_base::linger(true, 0), ec);
+	else
+		m_Socket.shutdown(m_Socket.shutdown_both, ec);
+	boost::system::error_code ecClose;
+	m_Socket.close(ecClose);
+	if (!ec)
+		ec = ecClose;
+	if (m_Watchdog != nullptr)
+		m_Watchdog->Stop();
+	return true;
+}
+
+bool TCPClientChannel::HalfClose(void)
+{
+	if (!m_Opened)
+		return false;
+	boost::system::error_code ec;
+	m_Socket.shutdown(m_Socket.shutdown_send, ec);
+	return !ec;
+}
+
+void TCPClientChannel::OnTimeout(StreamTimeouts::Phase phase)
+{
+	// 连接阶段只关闭 socket, 由连接回调报告失败; 已建立的连接按断开通知设备
+	if (phase == StreamTimeouts::Phase::Open)
+	{
+		CloseSocket(boost::asio::error::timed_out);
+		return;
+	}
+	boost::system::error_code ec;
+	m_Socket.close(ec);
+}
+
+void TCPClientChannel::SetMessageLimit(uint32_t limit, std::function<void(void)> handler)
+{
+	m_Messages = 0;
+	m_MessageLimit = limit;
+	m_OnMessageLimit = handler;
+}
+
+void TCPClientChannel::MessagesWritten(size_t messages)
+{
+	if (m_MessageLimit == 0 || !m_OnMessageLimit)
+		return;
+	// 一批消息可能跨过上限, 只有跨过上限的那一批回调
+	auto before = m_Messages.fetch_add(messages);
+	if (before < m_MessageLimit && before + messages >= m_MessageLimit)
+		m_OnMessageLimit();
+}
+
+void TCPClientChannel::CloseSocket(const boost::system::error_code& ecClose)
+{
+	if (CloseSocket())
+	{
+		auto dev = m_Device.lock();
+		if (dev != nullptr)
+		{
+			dev->NotifyChannelClose(shared_from_this(), ecClose);
+		}
+	}
+}
+
+std::wstring TCPClientChannel::Id(void) const
+{
+	if (sizeof(size_t) == sizeof(void*))
+		return std::to_wstring(reinterpret_cast<size_t>(this));
+	else
+		return std::to_wstring(reinterpret_cast<uint64_t>(this));
+}
+
+std::wstring TCPClientChannel::Description(void) const
+{
+	return Endpoints()->Description();
+}
+
+std::wstring TCPClientChannel::LocalEndPoint(void) const
+{
+	return Endpoints()->LocalText();
+}
+
+std::wstring TCPClientChannel::RemoteEndPoint(void) const
+{
+	return Endpoints()->RemoteText();
+}
+
+std::shared_ptr<const EndpointDescriptor> TCPClientChannel::Endpoints(void) const
+{
+	// 单连接客户端重连时会替换, 原子地读取
+	auto endpoints = std::atomic_load(&m_Endpoints);
+	return endpoints != nullptr ? endpoints : EndpointDescriptor::None();
+}
+
+void TCPClientChannel::Read(OutputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	boost::asio::async_read(
+		m_Socket,
+		boost::asio::buffer(buffer->data(), buffer->size()),
+		[client, watchdog, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (!ec && watchdog != nullptr)
+			watchdog->Touch();
+		if (handler != nullptr)
+			handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseSocket(ec);
+		}
+	}
+	);
+}
+void TCPClientChannel::Write(InputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+		watchdog->BeginWrite();
+	boost::asio::async_write(
+		m_Socket,
+		boost::asio::const_buffer(buffer.buffer, buffer.bufferSize),
+		[client, watchdog, handler, this](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (watchdog != nullptr)
+			watchdog->EndWrite();
+		if (handler != nullptr)
+			handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseSocket(ec);
+		}
+	});
+}
+bool TCPClientChannel::SendFile(const std::wstring& path, uint64_t offset, uint64_t length, const FileOptions& options, FileProgressHandler progress, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+	{
+		// 文件发送期间有进展就不算空闲
+		progress = [watchdog, progress](size_t io_bytes)
+		{
+			watchdog->Progress();
+			return progress == nullptr || progress(io_bytes);
+		};
+	}
+	if (AsyncTransmitFile(
+		m_Socket,
+		path,
+		offset,
+		length,
+		progress,
+		[client, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (handler != nullptr)
+			handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseSocket(ec);
+		}
+	}))
+		return true;
+	// 不支持由内核发送时, 由默认实现分块写入
+	return IAsyncChannel::SendFile(path, offset, length, options, progress, handler);
+}
+void TCPClientChannel::ReadSome(OutputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	m_Socket.async_read_some(
+		boost::asio::buffer(buffer->data(), buffer->size()),
+		[client, watchdog, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (!ec && watchdog != nullptr)
+			watchdog->Touch();
+		handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseSocket(ec);
+		}
+	}
+	);
+}
+void TCPClientChannel::WriteSome(InputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+		watchdog->BeginWrite();
+	m_Socket.async_write_some(
+		boost::asio::const_buffer(buffer.buffer, buffer.bufferSize),
+		[client, watchdog, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (watchdog != nullptr)
+			watchdog->EndWrite();
+		handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseSocket(ec);
+		}
+	});
+}
+
+void TCPClientChannel::Cancel(void)
+{
+	boost::system::error_code ec;
+	m_Socket.cancel(ec);
+}
+
+void TCPClientChannel::Close(void)
+{
+	CloseSocket(boost::system::errc::make_error_code(boost::system::errc::connection_aborted));
+}
+
+std::wstring TCPClientChannel::GetProtocol()
+{
+	boost::system::error_code ec;
+	auto local = m_Socket.local_endpoint(ec);
+	if (ec)
+		return StringToWString(ec.message());
+	else
+		return ProtocolToWstring(local.protocol());
+}
+
+
+
+TCPClient::TCPClient(NetCore& core):
+	m_Core(core),
+	m_ServerURL(L"127.0.0.1"),
+	m_RemotePort(0),
+	m_Keepalive(false),
+	m_LocalAddress(),
+	m_LocalAddresses(),
+	m_Tuning(std::make_shared<SocketTuning>()),
+	m_Timeouts(std::make_shared<StreamTimeouts>())
+{
+
+}
+
+TCPClient::~TCPClient(void)
+{
+}
+
+bool TCPClient::IsServer(void)
+{
+	return false;
+}
+
+boost::asio::ip::address TCPClient::LocalAddress(size_t index) const
+{
+	if (m_LocalAddresses.empty())
+		return boost::asio::ip::address();
+	return m_LocalAddresses[index % m_LocalAddresses.size()];
+}
+
+IDevice::PDTable TCPClient::EnumProperties()
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	PDTable results;
+	auto self = GetSharedPtr();
+	auto pd = std::make_shared<StaticProperty>(
+		L"Host",
+		L"DEVICE.TCPCLIENT.PROP.HOST",
+		L"127.0.0.1",
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return self->m_ServerURL; },
+		[self](const std::wstring& value) { self->m_ServerURL = value; }
+	);
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"RemotePort",
+		L"DEVICE.TCPCLIENT.PROP.REMOTEPORT",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RemotePort); },
+		[self](const std::wstring& value) { self->m_RemotePort = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"Keepalive",
+		L"DEVICE.TCPCLIENT.PROP.KEEPALIVE",
+		bool(false),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_Keepalive ? 1 : 0); },
+		[self](const std::wstring& value) { self->m_Keepalive = value == L"1"; });
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"LocalAddress",
+		L"DEVICE.TCPCLIENT.PROP.LOCALADDRESS",
+		L"",
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return self->m_LocalAddress; },
+		[self](const std::wstring& value)
+	{
+		// 逗号分隔的本地地址列表, 为空时由系统选择
+		std::vector<boost::asio::ip::address> addresses;
+		size_t begin = 0;
+		while (begin <= value.size())
+		{
+			auto end = value.find(L',', begin);
+			if (end == std::wstring::npos)
+				end = value.size();
+			auto item = value.substr(begin, end - begin);
+			item.erase(0, item.find_first_not_of(L' '));
+			item.erase(item.find_last_not_of(L' ') + 1);
+			if (!item.empty())
+			{
+				boost::system::error_code ec;
+				auto address = boost::asio::ip::make_address(WStringToString(item), ec);
+				if (ec)
+					throw PropertyException("invalid local address: " + WStringToString(item));
+				addresses.push_back(address);
+			}
+			begin = end + 1;
+		}
+		self->m_LocalAddress = value;
+		self->m_LocalAddresses = addresses;
+	});
+	results.push_back(pd);
+	results.push_back(SocketTuning::CreateProperties(m_Tuning));
+	results.push_back(StreamTimeouts::CreateProperties(m_Timeouts, true, false));
+
+	pd = std::make_shared<StaticProperty>(
+		L"Protocol",
+		L"DEVICE.TCPCLIENT.PROP.PROTOCOL",
+		L"",
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]() { return self->GetProtocol(); },
+		nullptr
+	);
+	results.push_back(pd);
+	return results;
+}
+
+
+
+
+
+TCPSingleClient::TCPSingleClient(NetCore& core):
+	TCPClient(core),
+	m_Channel(std::make_shared<TCPClientChannel>(core))
+{
+
+}
+
+TCPSingleClient::~TCPSingleClient(void)
+{
+	m_Channel.reset();
+}
+
+
+void TCPSingleClient::Start(void)
+{
+	if (Started())
+		return;
+
+	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	m_Tuning->Reset();
+	m_Timeouts->Reset();
+	auto client = shared_from_this();
+	m_Channel->Connect(m_ServerURL, m_RemotePort, m_Keepalive, LocalAddress(0), m_Tuning, m_Timeouts, [client](const boost::system::error_code& ec)
+	{
+		if (ec)
+		{
+			client->StatusChanged(DeviceStatus::Disconnected, StringToWString(ec.message()));
+			client->PropertyChanged();
+			client->ChannelConnected(client->m_Channel, StringToWString(ec.message()));
+		}
+		else
+		{
+			client->StatusChanged(DeviceStatus::Connected, StringToWString(ec.message()));
+			client->PropertyChanged();
+			client->ChannelConnected(client->m_Channel, StringToWString(ec.message()));
+			client->m_Channel->SetOwner(client);
+		}
+	});
+}
+
+void TCPSingleClient::Stop(void)
+{
+	if (m_Channel->CloseSocket())
+	{
+		ChannelDisconnected(m_Channel, std::wstring());
+		PropertyChanged();
+		StatusChanged(DeviceStatus::Disconnected, std::wstring());
+	}
+}
+
+std::wstring TCPSingleClient::GetProtocol()
+{
+	return m_Channel->GetProtocol();
+}
+
+void TCPSingleClient::NotifyChannelClose(std::shared_ptr<TCPClientChannel> channel, const boost::system::error_code& ecClose)
+{
+	ChannelDisconnected(m_Channel, std::wstring());
+	PropertyChanged();
+	StatusChanged(DeviceStatus::Disconnected, std::wstring());
+}
+
+
+
+TCPMultipleClient::TCPMultipleClient(NetCore& core):
+	TCPClient(core),
+	m_Mutex(),
+	m_Channels(),
+	m_RampOptions({ 0, 500, 128, 0, 500 }),
+	m_Ramp(nullptr),
+	m_ChurnOptions({ 0, 500, 128, 500, 0, ChurnEngine::Lifetime::Fixed, 0, false }),
+	m_Churn(nullptr),
+	m_Drain(std::make_shared<ChannelDrain>(core))
+{
+
+}
+
+TCPMultipleClient::~TCPMultipleClient(void)
+{
+
+}
+
+IDevice::PDTable TCPMultipleClient::EnumProperties()
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	auto properties = TCPClient::EnumProperties();
+	auto self = shared_from_this();
+	auto pd = std::make_shared<StaticProperty>(
+		L"CanonsCount",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CANONSCOUNT",
+		uint16_t(10),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { std::unique_lock<std::mutex> lk(self->m_Mutex); return std::to_wstring(self->m_Channels.size()); },
+		[self](const std::wstring& value) { self->UpdateCanonsCount(static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10))); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectRate",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CONNRATE",
+		uint32_t(500),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.rate); },
+		[self](const std::wstring& value) { self->m_RampOptions.rate = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectConcurrency",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.HANDSHAKES",
+		uint16_t(128),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.concurrency); },
+		[self](const std::wstring& value) { self->m_RampOptions.concurrency = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectRetries",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.RETRIES",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.retries); },
+		[self](const std::wstring& value) { self->m_RampOptions.retries = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectBackoff",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.BACKOFF",
+		uint16_t(500),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.backoff); },
+		[self](const std::wstring& value) { self->m_RampOptions.backoff = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectedConuter",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CONNCOUNT",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]()
+	{
+		auto churn = self->m_Churn;
+		if (self->Started() && churn != nullptr)
+			return std::to_wstring(churn->Established());
+		return std::to_wstring((self->Started() && self->m_Ramp != nullptr) ? self->m_Ramp->Established() : 0);
+	},
+		nullptr
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"PendingConuter",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.PENDINGCOUNT",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]()
+	{
+		auto churn = self->m_Churn;
+		if (self->Started() && churn != nullptr)
+			return std::to_wstring(churn->Pending() + churn->Handshaking());
+		return std::to_wstring((self->Started() && self->m_Ramp != nullptr) ? self->m_Ramp->Pending() + self->m_Ramp->Handshaking() : 0);
+	},
+		nullptr
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"FailedConuter",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.FAILEDCOUNT",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]()
+	{
+		auto churn = self->m_Churn;
+		if (self->Started() && churn != nullptr)
+			return std::to_wstring(churn->Failed());
+		return std::to_wstring((self->Started() && self->m_Ramp != nullptr) ? self->m_Ramp->Failed() : 0);
+	},
+		nullptr
+	);
+	properties.push_back(pd);
+	properties.push_back(CreateChurnProperties());
+	properties.push_back(ChannelDrain::CreateProperties(m_Drain));
+	return properties;
+}
+
+IDevice::PD TCPMultipleClient::CreateChurnProperties(void)
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	using PropertyGroup = PropertyDescriptionHelper::PropertyGroupDescription;
+	auto self = shared_from_this();
+	auto group = std::make_shared<PropertyGroup>(L"Churn", L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURN");
+	auto pd = std::make_shared<StaticProperty>(
+		L"ChurnLifetime",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNLIFETIME",
+		uint32_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_ChurnOptions.lifetime); },
+		[self](const std::wstring& value) { self->m_ChurnOptions.lifetime = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	group->AddChild(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ChurnDistribution",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNDIST",
+		uint8_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->AddEnumOptions(L"0", L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNDIST.EM0", true);
+	pd->AddEnumOptions(L"1", L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNDIST.EM1", true);
+	pd->AddEnumOptions(L"2", L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNDIST.EM2", true);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(static_cast<int>(self->m_ChurnOptions.distribution)); },
+		[self](const std::wstring& value)
+	{
+		auto n = std::wcstoul(value.c_str(), nullptr, 10);
+		if (n > static_cast<unsigned long>(ChurnEngine::Lifetime::Exponential))
+			throw PropertyException("invalid lifetime distribution: " + WStringToString(value));
+		self->m_ChurnOptions.distribution = static_cast<ChurnEngine::Lifetime>(n);
+	});
+	group->AddChild(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ChurnMessages",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNMESSAGES",
+		uint32_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_ChurnOptions.messages); },
+		[self](const std::wstring& value) { self->m_ChurnOptions.messages = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	group->AddChild(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ChurnClose",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNCLOSE",
+		uint8_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->AddEnumOptions(L"0", L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNCLOSE.EM0", true);
+	pd->AddEnumOptions(L"1", L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNCLOSE.EM1", true);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_ChurnOptions.reset ? 1 : 0); },
+		[self](const std::wstring& value) { self->m_ChurnOptions.reset = value == L"1"; }
+	);
+	group->AddChild(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"ChurnRate",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CHURNRATE",
+		L"",
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]()
+	{
+		auto churn = self->m_Churn;
+		if (churn == nullptr)
+			return std::wstring();
+		std::wostringstream text;
+		text << std::fixed << std::setprecision(1) << churn->Rate() << L"/s (" << churn->Connects() << L" opened, " << churn->Closes() << L" closed)";
+		return text.str();
+	},
+		nullptr
+	);
+	group->AddChild(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"HandshakeLatency",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.HANDSHAKE",
+		L"",
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]()
+	{
+		auto churn = self->m_Churn;
+		if (churn == nullptr)
+			return std::wstring();
+		auto summary = churn->Handshake();
+		if (summary.count == 0)
+			return std::wstring();
+		std::wostringstream text;
+		text << std::fixed << std::setprecision(2);
+		text << L"p50 " << summary.p50 / 1000000.0 << L"ms p99 " << summary.p99 / 1000000.0 << L"ms max " << summary.max / 1000000.0 << L"ms";
+		return text.str();
+	},
+		nullptr
+	);
+	group->AddChild(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"CloseErrors",
+		L"DEVICE.TCPMULTIPLECLIENT.PROP.CLOSEERRORS",
+		uint32_t(0),
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]()
+	{
+		auto churn = self->m_Churn;
+		return std::to_wstring(churn != nullptr ? churn->CloseErrors() : 0);
+	},
+		nullptr
+	);
+	group->AddChild(pd);
+	return group;
+}
+
+void TCPMultipleClient::Start(void)
+{
+	if (Started())
+		return;
+
+	m_Tuning->Reset();
+	m_Timeouts->Reset();
+	if (m_ChurnOptions.lifetime > 0 || m_ChurnOptions.messages > 0)
+	{
+		StartChurn();
+		return;
+	}
+	m_Churn = nullptr;
+
+	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	// 连接按速率和并发握手数逐步发起, 避免一次性涌向服务器的 SYN 队列
+	std::weak_ptr<TCPMultipleClient> weak = shared_from_this();
+	auto options = m_RampOptions;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		options.target = m_Channels.size();
+	}
+	m_Ramp = std::make_shared<ConnectRamp>(
+		m_Core.GetIOContext(),
+		options,
+		[weak](size_t index, ConnectRamp::Completion done)
+		{
+			auto client = weak.lock();
+			if (client == nullptr)
+			{
+				done(false, std::wstring());
+				return;
+			}
+			// 每次尝试都使用新的通道, 重试不受上次失败状态的影响
+			auto channel = std::make_shared<TCPClientChannel>(client->m_Core);
+			{
+				std::unique_lock<std::mutex> lk(client->m_Mutex);
+				client->m_Channels.at(index) = channel;
+			}
+			ConnectChannel(client, channel, client->LocalAddress(index), done);
+		},
+		[weak]()
+		{
+			auto client = weak.lock();
+			if (client != nullptr)
+				client->PropertyChanged();
+		},
+		[weak]()
+		{
+			auto client = weak.lock();
+			if (client == nullptr)
+				return;
+			auto ramp = client->m_Ramp;
+			if (ramp->Established() == 0)
+			{
+				client->PropertyChanged();
+				client->StatusChanged(DeviceStatus::Disconnected, ramp->LastError());
+			}
+			else
+			{
+				client->StatusChanged(DeviceStatus::Connected, std::wstring(L""));
+				client->PropertyChanged();
+			}
+		});
+	m_Ramp->Start();
+}
+
+void TCPMultipleClient::ConnectChannel(std::shared_ptr<TCPMultipleClient> client, std::shared_ptr<TCPClientChannel> channel, const boost::asio::ip::address& local, ConnectRamp::Completion done)
+{
+	channel->Connect(client->m_ServerURL, client->m_RemotePort, client->m_Keepalive, local, client->m_Tuning, client->m_Timeouts, [client, channel, done](const boost::system::error_code& ec)
+	{
+		if (ec)
+		{
+			done(false, StringToWString(ec.message()));
+			return;
+		}
+		if (!done(true, std::wstring()))
+		{
+			channel->CloseSocket();
+			return;
+		}
+		channel->SetOwner(client);
+		client->ChannelConnected(channel, StringToWString(ec.message()));
+		// 第一个连接建立后即进入已连接状态, 其余连接继续在后台爬坡
+		client->StatusChanged(DeviceStatus::Connected, std::wstring(L""));
+	});
+}
+
+void TCPMultipleClient::StartChurn(void)
+{
+	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	m_Ramp = nullptr;
+	// 连接数, 新建速率和并发握手数沿用爬坡的设置
+	std::weak_ptr<TCPMultipleClient> weak = shared_from_this();
+	auto options = m_ChurnOptions;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		options.target = m_Channels.size();
+	}
+	options.rate = m_RampOptions.rate;
+	options.concurrency = m_RampOptions.concurrency;
+	options.backoff = m_RampOptions.backoff;
+	m_Churn = std::make_shared<ChurnEngine>(
+		m_Core.GetIOContext(),
+		options,
+		[weak](size_t index, ChurnEngine::Completion done)
+		{
+			auto client = weak.lock();
+			if (client == nullptr)
+			{
+				done(false, std::wstring());
+				return;
+			}
+			auto channel = std::make_shared<TCPClientChannel>(client->m_Core);
+			channel->SetSlot(index);
+			{
+				std::unique_lock<std::mutex> lk(client->m_Mutex);
+				client->m_Channels.at(index) = channel;
+			}
+			ConnectChannel(client, channel, client->LocalAddress(index), [client, channel, index, done](bool ok, const std::wstring& message)
+			{
+				if (!done(ok, message))
+					return false;
+				// 在通知连接建立之前设置, 保证计数从第一条消息开始
+				auto churn = client->m_Churn;
+				if (ok && churn != nullptr && client->m_ChurnOptions.messages > 0)
+				{
+					std::weak_ptr<ChurnEngine> engine = churn;
+					channel->SetMessageLimit(client->m_ChurnOptions.messages, [engine, index]()
+					{
+						auto churn = engine.lock();
+						if (churn != nullptr)
+							churn->Expire(index);
+					});
+				}
+				return true;
+			});
+		},
+		[weak](size_t index, bool reset)
+		{
+			auto client = weak.lock();
+			return client == nullptr || client->CloseChannel(index, reset);
+		},
+		[weak]()
+		{
+			auto client = weak.lock();
+			if (client != nullptr)
+				client->PropertyChanged();
+		});
+	m_Churn->Start();
+}
+
+bool TCPMultipleClient::CloseChannel(size_t index, bool reset)
+{
+	std::shared_ptr<TCPClientChannel> channel;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		channel = m_Channels.at(index);
+	}
+	if (channel == nullptr)
+		return true;
+	boost::system::error_code ec;
+	// 已被对端关闭的连接由 NotifyChannelClose 处理
+	if (!channel->Shutdown(reset, ec))
+		return true;
+	ChannelDisconnected(channel, StringToWString(ec.message()));
+	return !ec;
+}
+
+void TCPMultipleClient::Stop(void)
+{
+	if (!Started())
+		return;
+	StatusChanged(DeviceStatus::Disconnecting, std::wstring());
+	auto client = shared_from_this();
+	auto ramp = m_Ramp;
+	auto churn = m_Churn;
+	m_Core.GetIOContext().post([client, ramp, churn]()
+	{
+		if (ramp != nullptr)
+			ramp->Stop();
+		if (churn != nullptr)
+			churn->Stop();
+		ChannelDrain::Channels channels;
+		{
+			std::unique_lock<std::mutex> lk(client->m_Mutex);
+			channels.reserve(client->m_Channels.size());
+			for (auto& channel : client->m_Channels)
+			{
+				if (channel != nullptr)
+					channels.push_back(channel);
+				channel = nullptr;
+			}
+		}
+		// 翻转模式下位置上可能是已经关闭并通知过的连接, Shutdown 返回 false, 不再通知
+		client->m_Drain->Run(
+			std::move(channels),
+			[](const ChannelDrain::Channel& channel) { return std::static_pointer_cast<TCPClientChannel>(channel)->HalfClose(); },
+			[](const ChannelDrain::Channel& channel, bool reset)
+		{
+			boost::system::error_code ec;
+			return std::static_pointer_cast<TCPClientChannel>(channel)->Shutdown(reset, ec);
+		},
+			[client](const ChannelDrain::Channels& closed)
+		{
+			client->ChannelsDisconnected(closed, std::wstring());
+			client->PropertyChanged();
+			client->StatusChanged(DeviceStatus::Disconnected, std::wstring());
+		});
+	});
+}
+
+void TCPMultipleClient::NotifyChannelClose(std::shared_ptr<TCPClientChannel> channel, const boost::system::error_code& ecClose)
+{
+	// 停止过程中被对端关闭的连接并入批量通知
+	if (m_Drain->Collect(channel))
+		return;
+	ChannelDisconnected(channel, StringToWString(ecClose.message()));
+	auto churn = m_Churn;
+	if (churn != nullptr)
+		churn->Dropped(channel->Slot());
+}
+
+std::wstring TCPMultipleClient::GetProtocol()
+{
+	std::shared_ptr<TCPClientChannel> ch;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		if (m_Channels.empty())
+			return L"";
+		ch = m_Channels[0];
+	}
+	if (ch != nullptr)
+		return ch->GetProtocol();
+	return L"";
+}
+
+void TCPMultipleClient::UpdateCanonsCount(size_t newCount)
+{
+	if (newCount >= 0xFFFF)
+		newCount = 0xFFFF;
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	m_Channels.resize(newCount);
+}
+
+
+REGISTER_CLASS_TITLE(TCPSingleClient, L"DEVICE.CLASS.TCPCLIENT.TITLE");
+REGISTER_CLASS_TITLE(TCPMultipleClient, L"DEVICE.CLASS.TCPMULTIPLECLIENT.TITLE");
\ No newline at end of file
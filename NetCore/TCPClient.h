@@ -1,5 +1,12 @@
-#pragma once
+﻿#pragma once
 #include "IAsyncStream.h"
+#include "ConnectRamp.h"
+#include "ChurnEngine.h"
+#include "SocketTuning.h"
+#include "StreamTimeouts.h"
+#include "EndpointDescriptor.h"
+#include "ChannelDrain.h"
+#include "NetCore.h"
 
 class TCPClient;
 class TCPClientChannel :
@@ -7,41 +14,62 @@ class TCPClientChannel :
 	public std::enable_shared_from_this<TCPClientChannel>
 {
 public:
-	TCPClientChannel(void);
+	TCPClientChannel(NetCore& core);
 	virtual ~TCPClientChannel(void);
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
 	virtual std::wstring RemoteEndPoint(void) const override;
+	virtual std::shared_ptr<const EndpointDescriptor> Endpoints(void) const override;
 	virtual void Read(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Write(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void ReadSome(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void WriteSome(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Cancel(void) override;
 	virtual void Close(void) override;
+	virtual bool SendFile(const std::wstring& path, uint64_t offset, uint64_t length, const FileOptions& options, FileProgressHandler progress, IoCompletionHandler handler) override;
 public:
 	void SetOwner(std::shared_ptr<TCPClient> owner) { m_Device = owner; }
 	std::wstring GetProtocol();
 	bool CloseSocket(void);
-	void Connect(const std::wstring& host, int port, bool keepAlive,std::function<void(const boost::system::error_code ec)> handler);
+	// 主动关闭, reset 时以 RST 结束连接; 返回 false 表示连接已经关闭, ec 为关闭过程中的错误
+	bool Shutdown(bool reset, boost::system::error_code& ec);
+	// 只关闭发送方向, 对端读到结束后也关闭, 由读取端读到结束时关闭通道; 返回 false 表示连接没有打开
+	bool HalfClose(void);
+	// 连接在客户端中的位置序号
+	void SetSlot(size_t slot) { m_Slot = slot; }
+	size_t Slot(void) const { return m_Slot; }
+	// 发送调度报告的消息累计达到 limit 条时回调一次, limit 为 0 表示不限制
+	void SetMessageLimit(uint32_t limit, std::function<void(void)> handler);
+	virtual void MessagesWritten(size_t messages) override;
+	// local 不是未指定地址时, 连接前先绑定到该本地地址(端口由系统分配)
+	void Connect(const std::wstring& host, int port, bool keepAlive, const boost::asio::ip::address& local, std::shared_ptr<SocketTuning> tuning, std::shared_ptr<StreamTimeouts> timeouts, std::function<void(const boost::system::error_code ec)> handler);
 private:
 	void CloseSocket(const boost::system::error_code& ecClose);
+	void OnTimeout(StreamTimeouts::Phase phase);
 private:
+	NetCore& m_Core;
 	boost::asio::ip::tcp::socket m_Socket;
 	std::atomic<bool> m_Opened;
 	std::weak_ptr<TCPClient> m_Device;
+	size_t m_Slot;
+	std::atomic<uint64_t> m_Messages;
+	uint32_t m_MessageLimit;
+	std::function<void(void)> m_OnMessageLimit;
+	StreamTimeouts::WatchdogPtr m_Watchdog;
+	EndpointDescriptor::Ptr m_Endpoints;
 };
 
 class TCPClient :
 	public CommunicationDevice
 {
 public:
-	TCPClient(void);
+	TCPClient(NetCore& core);
 	virtual ~TCPClient(void);
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsServer(void) override;
 	virtual PDTable EnumProperties() override;
 public:
@@ -49,10 +77,17 @@ public:
 protected:
 	virtual std::shared_ptr<TCPClient> GetSharedPtr() = 0;
 	virtual std::wstring GetProtocol() = 0;
+	// 多个本地地址时按连接序号轮流使用, 用于突破单个源地址的临时端口数量限制
+	boost::asio::ip::address LocalAddress(size_t index) const;
 protected:
+	NetCore& m_Core;
 	std::wstring m_ServerURL;
 	std::uint16_t m_RemotePort;
 	bool m_Keepalive;
+	std::wstring m_LocalAddress;
+	std::vector<boost::asio::ip::address> m_LocalAddresses;
+	std::shared_ptr<SocketTuning> m_Tuning;
+	std::shared_ptr<StreamTimeouts> m_Timeouts;
 };
 
 class TCPSingleClient :
@@ -60,10 +95,10 @@ class TCPSingleClient :
 	public std::enable_shared_from_this<TCPSingleClient>
 {
 public:
-	TCPSingleClient(void);
+	TCPSingleClient(NetCore& core);
 	virtual ~TCPSingleClient(void) ;
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override { return true; }
 	virtual void Start(void) override;
 	virtual void Stop(void) override;
@@ -82,10 +117,10 @@ class TCPMultipleClient :
 	public std::enable_shared_from_this<TCPMultipleClient>
 {
 public:
-	TCPMultipleClient(void);
+	TCPMultipleClient(NetCore& core);
 	virtual ~TCPMultipleClient(void);
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override{ return false; }
 	virtual PDTable EnumProperties() override;
 	virtual void Start(void) override;
@@ -96,9 +131,17 @@ public:
 protected:
 	virtual std::shared_ptr<TCPClient> GetSharedPtr() { return this->shared_from_this(); }
 	void UpdateCanonsCount(size_t newCount);
-	static void ConnectChannel(std::shared_ptr<TCPMultipleClient> client, std::shared_ptr<TCPClientChannel> channel);
+	static void ConnectChannel(std::shared_ptr<TCPMultipleClient> client, std::shared_ptr<TCPClientChannel> channel, const boost::asio::ip::address& local, ConnectRamp::Completion done);
+	void StartChurn(void);
+	bool CloseChannel(size_t index, bool reset);
+	PD CreateChurnProperties(void);
 private:
+	// 连接函数在 IO 线程上写入各位置, 停止时清空, 都在锁内进行
+	std::mutex m_Mutex;
 	std::vector<std::shared_ptr<TCPClientChannel>> m_Channels;
-	std::atomic<size_t> m_ConnectConuter;
-	std::atomic<size_t> m_FailedConuter;
+	ConnectRamp::Options m_RampOptions;
+	std::shared_ptr<ConnectRamp> m_Ramp;
+	ChurnEngine::Options m_ChurnOptions;
+	std::shared_ptr<ChurnEngine> m_Churn;
+	std::shared_ptr<ChannelDrain> m_Drain;
 };
@@ -0,0 +1,506 @@
+﻿#include "pch.h"
+#include "TCPServer.h"
+#include "OEMStringHelper.hpp"
+#include "TransmitFile.h"
+
+// 文件描述符或内存耗尽时 accept 会立即再次失败, 等待一段时间后再接受
+constexpr auto kACCEPT_BACKOFF = std::chrono::milliseconds(100);
+
+static std::wstring ProtocolToWstring(const boost::asio::ip::tcp::endpoint::protocol_type& protocol)
+{
+	std::wstring result = L"TCP/IP";
+	if (protocol.family() == AF_INET)
+		result += L"V4";
+	if (protocol.family() == AF_INET6)
+		result += L"V6";
+	return result;
+}
+
+TCPServer::TCPServer(NetCore& core):
+	m_Core(core),
+	m_ListenAddress(L"127.0.0.1"),
+	m_ListenPort(0),
+	m_ReuseAddress(false),
+	m_Keepalive(false),
+	m_AcceptorCount(1),
+	m_PendingAccepts(1),
+	m_Acceptors(),
+	m_Tuning(std::make_shared<SocketTuning>()),
+	m_Timeouts(std::make_shared<StreamTimeouts>()),
+	m_Behavior(std::make_shared<ServerBehavior>(core.GetIOContext()))
+{
+
+}
+
+TCPServer::~TCPServer()
+{
+}
+
+bool TCPServer::IsServer(void)
+{
+	return true;
+}
+
+bool TCPServer::IsSingleChannel(void)
+{
+	return false;
+}
+
+IDevice::PDTable TCPServer::EnumProperties()
+{
+	using StaticProperty = PropertyDescriptionHelper::StaticPropertyDescription;
+	PDTable results;
+	auto self = shared_from_this();
+	auto pd = std::make_shared<StaticProperty>(
+		L"ListenAddress",
+		L"DEVICE.TCPSERVER.PROP.LISTENADDRESS",
+		L"127.0.0.1",
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->AddEnumOptions(L"0.0.0.0", L"0.0.0.0", false);
+	pd->AddEnumOptions(L"127.0.0.1", L"127.0.0.1", false);
+	pd->AddEnumOptions(L"0:0:0:0:0:0:0:0", L"0:0:0:0:0:0:0:0", false);
+	pd->AddEnumOptions(L"0:0:0:0:0:0:0:1", L"0:0:0:0:0:0:0:1", false);
+	pd->BindMethod(
+		[self]() { return self->m_ListenAddress; },
+		[self](const std::wstring& value) { self->m_ListenAddress = value; }
+	);
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"ListenPort",
+		L"DEVICE.TCPSERVER.PROP.LISTENPORT",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_ListenPort); },
+		[self](const std::wstring& value) { self->m_ListenPort = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"ReuseAddress",
+		L"DEVICE.TCPSERVER.PROP.REUSEADDRESS",
+		bool(false),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_ReuseAddress ? 1 : 0); },
+		[self](const std::wstring& value) { self->m_ReuseAddress = value == L"1"; }
+	);
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"Keepalive",
+		L"DEVICE.TCPSERVER.PROP.KEEPALIVE",
+		bool(false),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_Keepalive ? 1 : 0); },
+		[self](const std::wstring& value) { self->m_Keepalive = value == L"1"; });
+	results.push_back(pd);
+	results.push_back(SocketTuning::CreateProperties(m_Tuning));
+	results.push_back(StreamTimeouts::CreateProperties(m_Timeouts, false, false));
+	results.push_back(ServerBehavior::CreateProperties(m_Behavior));
+
+	pd = std::make_shared<StaticProperty>(
+		L"Acceptors",
+		L"DEVICE.TCPSERVER.PROP.ACCEPTORS",
+		uint16_t(1),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_AcceptorCount); },
+		[self](const std::wstring& value) { self->m_AcceptorCount = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"PendingAccepts",
+		L"DEVICE.TCPSERVER.PROP.PENDINGACCEPTS",
+		uint16_t(1),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_PendingAccepts); },
+		[self](const std::wstring& value) { self->m_PendingAccepts = static_cast<std::uint16_t>((std::max)(std::wcstoul(value.c_str(), nullptr, 10), 1ul)); }
+	);
+	results.push_back(pd);
+
+	pd = std::make_shared<StaticProperty>(
+		L"Protocol",
+		L"DEVICE.TCPSERVER.PROP.PROTOCOL",
+		L"",
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]()
+	{
+		boost::system::error_code ec = boost::asio::error::not_connected;
+		boost::asio::ip::tcp::endpoint local;
+		if (!self->m_Acceptors.empty())
+			local = self->m_Acceptors.front()->local_endpoint(ec);
+		if (ec)
+			return StringToWString(ec.message());
+		else
+			return ProtocolToWstring(local.protocol());
+	},
+		nullptr
+		);
+	results.push_back(pd);
+
+	return results;
+}
+
+void TCPServer::Start(void)
+{
+	if (Started())
+		return;
+
+	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	m_Tuning->Reset();
+	m_Timeouts->Reset();
+	m_Behavior->Prepare();
+	boost::system::error_code ec;
+	auto address = boost::asio::ip::address::from_string(WStringToString(m_ListenAddress), ec);
+	if (ec)
+	{
+		Close(ec);
+		return;
+	}
+
+	boost::asio::ip::tcp::endpoint ep(address, m_ListenPort);
+	// 0 表示每个 IO 线程一个监听套接字; 不支持 SO_REUSEPORT 的系统只能使用一个
+	size_t count = m_AcceptorCount == 0 ? m_Core.GetIOThreadCount() : m_AcceptorCount;
+#ifndef SO_REUSEPORT
+	count = 1;
+#endif
+	count = (std::max)(count, static_cast<size_t>(1));
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (!OpenAcceptor(ep, count > 1, ec))
+		{
+			Close(ec);
+			return;
+		}
+		// 端口为 0 时其余监听套接字绑定到第一个分配到的端口
+		if (i == 0)
+			ep.port(m_Acceptors.front()->local_endpoint(ec).port());
+	}
+
+	for (auto& acceptor : m_Acceptors)
+	{
+		for (size_t i = 0; i < m_PendingAccepts; ++i)
+			StartAcceptClient(acceptor);
+	}
+	PropertyChanged();
+	StatusChanged(DeviceStatus::Connected, StringToWString(ec.message()));
+}
+
+bool TCPServer::OpenAcceptor(const boost::asio::ip::tcp::endpoint& ep, bool reusePort, boost::system::error_code& ec)
+{
+	auto acceptor = std::make_shared<boost::asio::ip::tcp::acceptor>(m_Core.GetIOContext());
+	m_Acceptors.push_back(acceptor);
+	acceptor->open(ep.protocol(), ec);
+	if (ec)
+		return false;
+	// 地址复用选项必须在 bind 之前设置才有效
+	acceptor->set_option(boost::asio::socket_base::reuse_address(m_ReuseAddress), ec);
+	if (ec)
+		return false;
+#ifdef SO_REUSEPORT
+	if (reusePort)
+	{
+		acceptor->set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true), ec);
+		if (ec)
+			return false;
+	}
+#endif
+	acceptor->bind(ep, ec);
+	if (ec)
+		return false;
+	m_Tuning->ApplyBuffers(*acceptor);
+	acceptor->listen(acceptor->max_listen_connections, ec);
+	return !ec;
+}
+
+void TCPServer::CloseAcceptors(void)
+{
+	boost::system::error_code ec;
+	for (auto& acceptor : m_Acceptors)
+	{
+		acceptor->cancel(ec);
+		acceptor->close(ec);
+	}
+	m_Acceptors.clear();
+}
+
+void TCPServer::Close(const boost::system::error_code& errorCode)
+{
+	CloseAcceptors();
+	m_Behavior->Shutdown();
+	PropertyChanged();
+	StatusChanged(DeviceStatus::Disconnected, StringToWString(errorCode.message()));
+}
+
+void TCPServer::StartAcceptClient(Acceptor acceptor)
+{
+	auto server = this->shared_from_this();
+	// 析构时已经关闭套接字, 不能在删除器里调用 Close: 它会在引用计数归零后调用 shared_from_this
+	auto channel = std::make_shared<TcpChannel>(server);
+
+	acceptor->async_accept(channel->m_Socket, [server, acceptor, channel](const boost::system::error_code& ec)
+	{
+		if (!ec)
+		{
+			// 先投递下一次 accept, 接受速率不受连接通知处理时间的影响
+			server->StartAcceptClient(acceptor);
+			boost::system::error_code ecSet;
+			channel->m_Socket.set_option(boost::asio::socket_base::reuse_address(server->m_ReuseAddress), ecSet);
+			channel->m_Socket.set_option(boost::asio::socket_base::keep_alive(server->m_Keepalive), ecSet);
+			server->m_Tuning->Apply(channel->m_Socket);
+			channel->m_Endpoints = EndpointDescriptor::Capture(channel->m_Socket);
+			std::weak_ptr<TcpChannel> weak = channel;
+			channel->m_Watchdog = server->m_Timeouts->Watch(server->m_Core.GetTimerWheel(), StreamTimeouts::Phase::Open, [weak](StreamTimeouts::Phase phase)
+			{
+				auto channel = weak.lock();
+				if (channel != nullptr)
+					channel->CloseChannel(true, boost::asio::error::timed_out);
+			});
+			if (server->m_Behavior->Enabled())
+			{
+				// 内置服务直接在 IO 线程上收发, 通道不交给界面
+				channel->m_Served = true;
+				server->m_Behavior->Serve(channel);
+			}
+			else
+				server->ChannelConnected(channel,StringToWString(ec.message()));
+		}
+		else if (ec != boost::asio::error::operation_aborted && acceptor->is_open())
+		{
+			// 对端在握手完成前重置等错误只影响这一个连接, 继续接受
+			if (ec == boost::asio::error::no_descriptors || ec == boost::system::errc::too_many_files_open_in_system ||
+				ec == boost::asio::error::no_buffer_space || ec == boost::asio::error::no_memory)
+			{
+				auto timer = std::make_shared<boost::asio::steady_timer>(server->m_Core.GetIOContext(), kACCEPT_BACKOFF);
+				timer->async_wait([server, acceptor, timer](const boost::system::error_code& ec)
+				{
+					if (!ec && acceptor->is_open())
+						server->StartAcceptClient(acceptor);
+				});
+			}
+			else
+				server->StartAcceptClient(acceptor);
+		}
+	});
+}
+
+void TCPServer::Stop(void)
+{
+	if (Started())
+	{
+		StatusChanged(DeviceStatus::Disconnecting, std::wstring());
+		CloseAcceptors();
+		m_Behavior->Shutdown();
+		PropertyChanged();
+		StatusChanged(DeviceStatus::Disconnected, std::wstring());
+	}
+}
+
+TcpChannel::TcpChannel(std::shared_ptr<TCPServer> owner) :
+	m_Owner(owner),
+	m_Socket(owner->m_Core.GetIOContext()),
+	m_Watchdog(nullptr),
+	m_Endpoints(nullptr),
+	m_Served(false)
+{
+
+}
+
+TcpChannel::~TcpChannel(void)
+{
+	CloseChannel(false, boost::system::errc::make_error_code(boost::system::errc::success));
+}
+
+std::wstring TcpChannel::Id(void) const
+{
+	if (sizeof(size_t) == sizeof(void*))
+		return std::to_wstring(reinterpret_cast<size_t>(this));
+	else
+		return std::to_wstring(reinterpret_cast<uint64_t>(this));
+}
+
+std::wstring TcpChannel::Description(void) const
+{
+	return Endpoints()->Description();
+}
+
+
+std::wstring TcpChannel::LocalEndPoint(void) const
+{
+	return Endpoints()->LocalText();
+}
+
+std::wstring TcpChannel::RemoteEndPoint(void) const
+{
+	return Endpoints()->RemoteText();
+}
+
+std::shared_ptr<const EndpointDescriptor> TcpChannel::Endpoints(void) const
+{
+	return m_Endpoints != nullptr ? m_Endpoints : EndpointDescriptor::None();
+}
+
+void TcpChannel::Read(OutputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	boost::asio::async_read(
+		m_Socket,
+		boost::asio::buffer(buffer->data(), buffer->size()),
+		[client, watchdog, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (!ec && watchdog != nullptr)
+			watchdog->Touch();
+		if (handler != nullptr)
+			handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseChannel(true, ec);
+		}
+	}
+	);
+}
+void TcpChannel::Write(InputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+		watchdog->BeginWrite();
+	boost::asio::async_write(
+		m_Socket,
+		boost::asio::const_buffer(buffer.buffer, buffer.bufferSize),
+		[client, watchdog, handler, this](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (watchdog != nullptr)
+			watchdog->EndWrite();
+		if (handler != nullptr)
+			handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseChannel(true, ec);
+		}
+	}
+	);
+}
+bool TcpChannel::SendFile(const std::wstring& path, uint64_t offset, uint64_t length, const FileOptions& options, FileProgressHandler progress, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+	{
+		// 文件发送期间有进展就不算空闲
+		progress = [watchdog, progress](size_t io_bytes)
+		{
+			watchdog->Progress();
+			return progress == nullptr || progress(io_bytes);
+		};
+	}
+	if (AsyncTransmitFile(
+		m_Socket,
+		path,
+		offset,
+		length,
+		progress,
+		[client, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (handler != nullptr)
+			handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseChannel(true, ec);
+		}
+	}))
+		return true;
+	// 不支持由内核发送时, 由默认实现分块写入
+	return IAsyncChannel::SendFile(path, offset, length, options, progress, handler);
+}
+void TcpChannel::ReadSome(OutputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	m_Socket.async_read_some(
+		boost::asio::buffer(buffer->data(), buffer->size()),
+		[client, watchdog, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (!ec && watchdog != nullptr)
+			watchdog->Touch();
+		handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseChannel(true, ec);
+		}
+	}
+	);
+}
+void TcpChannel::WriteSome(InputBuffer buffer, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+		watchdog->BeginWrite();
+	m_Socket.async_write_some(
+		boost::asio::const_buffer(buffer.buffer, buffer.bufferSize),
+		[client, watchdog, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (watchdog != nullptr)
+			watchdog->EndWrite();
+		handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseChannel(true, ec);
+		}
+	}
+	);
+}
+
+void TcpChannel::Cancel(void)
+{
+	boost::system::error_code ec;
+	m_Socket.cancel(ec);
+}
+
+void TcpChannel::Close(void)
+{
+	CloseChannel(true, boost::system::errc::make_error_code(boost::system::errc::operation_canceled));
+}
+
+void TcpChannel::CloseChannel(bool notify, const boost::system::error_code& error)
+{
+	boost::system::error_code ec;
+	if (m_Socket.is_open())
+	{
+		m_Socket.cancel(ec);
+		m_Socket.shutdown(m_Socket.shutdown_both, ec);
+		m_Socket.close(ec);
+		if (m_Watchdog != nullptr)
+			m_Watchdog->Stop();
+		if (notify && !m_Served)
+		{
+			auto owner = m_Owner.lock();
+			if(owner!=nullptr)
+				owner->ChannelDisconnected(shared_from_this(), StringToWString(error.message()));
+		}
+	}
+}
+
+
+REGISTER_CLASS_TITLE(TCPServer, L"DEVICE.CLASS.TCPSERVER.TITLE");
\ No newline at end of file
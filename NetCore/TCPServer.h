@@ -1,5 +1,10 @@
-#pragma once
+﻿#pragma once
 #include "IAsyncStream.h"
+#include "SocketTuning.h"
+#include "StreamTimeouts.h"
+#include "EndpointDescriptor.h"
+#include "ServerBehavior.h"
+#include "NetCore.h"
 
 class TcpChannel;
 class TCPServer :
@@ -8,25 +13,36 @@ class TCPServer :
 {
 	friend class TcpChannel;
 public:
-	TCPServer(void);
+	TCPServer(NetCore& core);
 	virtual ~TCPServer(void);
 
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override;
 	virtual bool IsServer(void) override;
 	virtual PDTable EnumProperties() override;
 	virtual void Start(void) override;
 	virtual void Stop(void) override;
 private:
-	void StartAcceptClient(void);
+	using Acceptor = std::shared_ptr<boost::asio::ip::tcp::acceptor>;
+	bool OpenAcceptor(const boost::asio::ip::tcp::endpoint& ep, bool reusePort, boost::system::error_code& ec);
+	void StartAcceptClient(Acceptor acceptor);
+	void CloseAcceptors(void);
 	void Close(const boost::system::error_code& errorCode);
 private:
+	NetCore& m_Core;
 	std::wstring m_ListenAddress;
 	std::uint16_t m_ListenPort;
 	bool m_ReuseAddress;
 	bool m_Keepalive;
-	boost::asio::ip::tcp::acceptor m_Acceptor;
+	// 多个监听套接字通过 SO_REUSEPORT 绑定同一端口, 由内核把新连接分散到各自的接受队列;
+	// 每个监听套接字同时保持多个未完成的 accept.
+	std::uint16_t m_AcceptorCount;
+	std::uint16_t m_PendingAccepts;
+	std::vector<Acceptor> m_Acceptors;
+	std::shared_ptr<SocketTuning> m_Tuning;
+	std::shared_ptr<StreamTimeouts> m_Timeouts;
+	std::shared_ptr<ServerBehavior> m_Behavior;
 };
 
 class TcpChannel :
@@ -38,20 +54,26 @@ public:
 	TcpChannel(std::shared_ptr<TCPServer> owner);
 	virtual ~TcpChannel(void);
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
 	virtual std::wstring RemoteEndPoint(void) const override;
+	virtual std::shared_ptr<const EndpointDescriptor> Endpoints(void) const override;
 	virtual void Read(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Write(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void ReadSome(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void WriteSome(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Cancel(void) override;
 	virtual void Close(void) override;
+	virtual bool SendFile(const std::wstring& path, uint64_t offset, uint64_t length, const FileOptions& options, FileProgressHandler progress, IoCompletionHandler handler) override;
 protected:
 	void CloseChannel(bool notify, const boost::system::error_code& ec);
 private:
 	std::weak_ptr<TCPServer> m_Owner;
 	boost::asio::ip::tcp::socket m_Socket;
+	StreamTimeouts::WatchdogPtr m_Watchdog;
+	EndpointDescriptor::Ptr m_Endpoints;
+	// 由内置服务处理的通道没有交给界面, 关闭时不通知
+	bool m_Served;
 };
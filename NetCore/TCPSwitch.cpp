@@ -1,7 +1,7 @@
 #include "pch.h"
-#include "NetDebugger.h"
 #include "TCPSwitch.h"
 #include "OEMStringHelper.hpp"
+#include "TransmitFile.h"
 
 static std::wstring ProtocolToWstring(const boost::asio::ip::tcp::endpoint::protocol_type& protocol)
 {
@@ -13,14 +13,17 @@ static std::wstring ProtocolToWstring(const boost::asio::ip::tcp::endpoint::prot
 	return result;
 }
 
-TCPForwardServer::TCPForwardServer() :
+TCPForwardServer::TCPForwardServer(NetCore& core) :
+	m_Core(core),
 	m_ListenAddress(L"127.0.0.1"),
 	m_ListenPort(0),
 	m_RemoteHost(L"127.0.0.1"),
 	m_RemotePort(0),
 	m_ReuseAddress(false),
 	m_Keepalive(false),
-	m_Acceptor(theApp.GetIOContext())
+	m_Acceptor(core.GetIOContext()),
+	m_Tuning(std::make_shared<SocketTuning>()),
+	m_Timeouts(std::make_shared<StreamTimeouts>())
 {
 
 }
@@ -129,6 +132,8 @@ IDevice::PDTable TCPForwardServer::EnumProperties()
 		[self]() { return std::to_wstring(self->m_Keepalive ? 1 : 0); },
 		[self](const std::wstring& value) { self->m_Keepalive = value == L"1"; });
 	results.push_back(pd);
+	results.push_back(SocketTuning::CreateProperties(m_Tuning));
+	results.push_back(StreamTimeouts::CreateProperties(m_Timeouts, true, false));
 	return results;
 }
 
@@ -138,6 +143,8 @@ void TCPForwardServer::Start(void)
 		return;
 
 	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	m_Tuning->Reset();
+	m_Timeouts->Reset();
 	boost::system::error_code ec;
 	auto address = boost::asio::ip::address::from_string(WStringToString(m_ListenAddress), ec);
 	if (ec)
@@ -160,6 +167,8 @@ void TCPForwardServer::Start(void)
 		Close(ec);
 		return;
 	}
+	// Accepted sockets inherit the buffer sizes, which must be set before listen to affect the window scale
+	m_Tuning->ApplyBuffers(m_Acceptor);
 	m_Acceptor.listen(m_Acceptor.max_listen_connections, ec);
 	if (ec)
 	{
@@ -215,10 +224,13 @@ void TCPForwardServer::StartAcceptClient(void)
 	{
 		if (!ec)
 		{
+			server->StartAcceptClient();
 			boost::system::error_code ecSet;
 			channelClient->m_Opened = true;
 			channelClient->m_Socket.set_option(boost::asio::socket_base::reuse_address(server->m_ReuseAddress), ecSet);
 			channelClient->m_Socket.set_option(boost::asio::socket_base::keep_alive(server->m_Keepalive), ecSet);
+			server->m_Tuning->Apply(channelClient->m_Socket);
+			channelClient->m_Endpoints = EndpointDescriptor::Capture(channelClient->m_Socket);
 			channelClient->m_ChannelGroupName = L"#";
 			channelClient->m_ChannelGroupName += std::to_wstring((size_t)channelClient->m_Socket.native_handle());
 			channelClient->m_ChannelGroupName += L"-Client : ";
@@ -232,32 +244,58 @@ void TCPForwardServer::StartAcceptClient(void)
 			channelServer->m_ChannelGroupName += std::to_wstring((size_t)channelClient->m_Socket.native_handle());
 			channelServer->m_ChannelGroupName += L"-Server : ";
 
+			// The connect timeout covers resolving and connecting to the remote host;
+			// on expiry both sockets are closed and the pending connect fails.
+			std::weak_ptr<TcpForwardChannel> weakClient = channelClient;
+			std::weak_ptr<TcpForwardChannel> weakServer = channelServer;
+			channelClient->m_Watchdog = server->m_Timeouts->Watch(server->m_Core.GetTimerWheel(), StreamTimeouts::Phase::Connect, [weakClient, weakServer](StreamTimeouts::Phase phase)
+			{
+				auto client = weakClient.lock();
+				auto target = weakServer.lock();
+				if (phase == StreamTimeouts::Phase::Open)
+				{
+					if (client != nullptr)
+						client->CloseChannel(boost::asio::error::timed_out);
+					return;
+				}
+				boost::system::error_code ecClose;
+				if (target != nullptr)
+					target->m_Socket.close(ecClose);
+				if (client != nullptr)
+					client->CloseChannel();
+			});
+
 			ConnectServer(server, channelClient, channelServer);
-			server->StartAcceptClient();
 		}
 	});
 }
 
 void TCPForwardServer::ConnectServer(std::shared_ptr<TCPForwardServer> self, std::shared_ptr<TcpForwardChannel> channelClient, std::shared_ptr<TcpForwardChannel> channelServer)
 {
-	boost::system::error_code ec;
-	auto rslv = std::make_shared<boost::asio::ip::tcp::resolver>(theApp.GetIOContext());
-	boost::asio::ip::tcp::resolver::query qry(WStringToString(self->m_RemoteHost), std::to_string(self->m_RemotePort));
-	rslv->async_resolve(qry, [rslv, self, channelClient, channelServer](const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator iter)
+	self->m_Core.GetEndpointCache().Resolve(WStringToString(self->m_RemoteHost), self->m_RemotePort, [self, channelClient, channelServer](const boost::system::error_code &ec, EndpointCache::Endpoints endpoints)
 	{
 		if (!ec)
 		{
-			boost::asio::async_connect(
-				channelServer->m_Socket,
-				iter,
-				[rslv, self, channelClient, channelServer](const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator iter)
+			SocketTuning::Connect(self->m_Tuning, channelServer->m_Socket, endpoints, [self, channelClient, channelServer](const boost::system::error_code& ec)
 			{
 				if (!ec)
 				{
 					boost::system::error_code ecSet;
 					channelServer->m_Socket.set_option(boost::asio::socket_base::reuse_address(self->m_ReuseAddress), ecSet);
 					channelServer->m_Socket.set_option(boost::asio::socket_base::keep_alive(self->m_Keepalive), ecSet);
+					self->m_Tuning->Apply(channelServer->m_Socket);
+					channelServer->m_Endpoints = EndpointDescriptor::Capture(channelServer->m_Socket);
 					channelServer->m_Opened = true;
+					if (channelClient->m_Watchdog != nullptr)
+					{
+						if (channelClient->m_Watchdog->TimedOut())
+						{
+							channelServer->CloseChannel();
+							return;
+						}
+						channelClient->m_Watchdog->Enter(StreamTimeouts::Phase::Open);
+						channelServer->Watch(self->m_Timeouts);
+					}
 
 					channelClient->m_Target = channelServer;
 					channelServer->m_Target = channelClient;
@@ -278,12 +316,28 @@ void TCPForwardServer::NotifyChannelClose(std::shared_ptr<TcpForwardChannel> cha
 TcpForwardChannel::TcpForwardChannel(std::shared_ptr<TCPForwardServer> owner):
 	m_Owner(owner),
 	m_Target(),
-	m_Socket(theApp.GetIOContext()),
+	m_Socket(owner->m_Core.GetIOContext()),
 	m_Opened(false),
-	m_ChannelGroupName()
+	m_ChannelGroupName(),
+	m_Watchdog(nullptr),
+	m_Endpoints(nullptr)
 {
 }
 
+void TcpForwardChannel::Watch(std::shared_ptr<StreamTimeouts> timeouts)
+{
+	auto owner = m_Owner.lock();
+	if (owner == nullptr)
+		return;
+	std::weak_ptr<TcpForwardChannel> weak = shared_from_this();
+	m_Watchdog = timeouts->Watch(owner->m_Core.GetTimerWheel(), StreamTimeouts::Phase::Open, [weak](StreamTimeouts::Phase phase)
+	{
+		auto channel = weak.lock();
+		if (channel != nullptr)
+			channel->CloseChannel(boost::asio::error::timed_out);
+	});
+}
+
 TcpForwardChannel::~TcpForwardChannel(void)
 {
 	CloseChannel();
@@ -299,6 +353,8 @@ bool TcpForwardChannel::CloseChannel(void)
 		m_Socket.cancel(ec);
 		m_Socket.shutdown(m_Socket.shutdown_both, ec);
 		m_Socket.close(ec);
+		if (m_Watchdog != nullptr)
+			m_Watchdog->Stop();
 		return true;
 	}
 	return false;
@@ -344,76 +400,37 @@ std::wstring TcpForwardChannel::Id(void) const
 
 std::wstring TcpForwardChannel::Description(void) const
 {
-	std::wstring result = m_ChannelGroupName;
-	boost::system::error_code ec;
-	auto local = m_Socket.remote_endpoint(ec);
-	if (ec)
-	{
-		result += L"none" + result;
-	}
-	else
-	{
-		result += L"local(";
-		result += StringToWString(local.address().to_string()) + L":" + std::to_wstring(local.port());
-		result += L")";
-	}
-
-	auto remote = m_Socket.remote_endpoint(ec);
-	if (ec)
-	{
-		result += L" <---> none";
-	}
-	else
-	{
-		result += L" <---> remote(";
-		result += StringToWString(remote.address().to_string()) + L":" + std::to_wstring(remote.port());
-		result += L")";
-	}
-	return result;
+	return m_ChannelGroupName + Endpoints()->Description();
 }
 
 std::wstring TcpForwardChannel::LocalEndPoint(void) const
 {
-	std::wstring result;
-	boost::system::error_code ec;
-	auto local = m_Socket.local_endpoint(ec);
-	if (ec)
-	{
-		result = L"none";
-	}
-	else
-	{
-		result = StringToWString(local.address().to_string()) + L"#" + std::to_wstring(local.port());
-	}
-	return result;
+	return Endpoints()->LocalText();
 }
 
 std::wstring TcpForwardChannel::RemoteEndPoint(void) const
 {
-	std::wstring result;
-	boost::system::error_code ec;
-	auto local = m_Socket.remote_endpoint(ec);
-	if (ec)
-	{
-		result = L"none";
-	}
-	else
-	{
-		result = StringToWString(local.address().to_string()) + L"#" + std::to_wstring(local.port());
-	}
-	return result;
+	return Endpoints()->RemoteText();
+}
+
+std::shared_ptr<const EndpointDescriptor> TcpForwardChannel::Endpoints(void) const
+{
+	return m_Endpoints != nullptr ? m_Endpoints : EndpointDescriptor::None();
 }
 
 void TcpForwardChannel::Read(OutputBuffer buffer, IoCompletionHandler handler)
 {
 	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
 	boost::asio::async_read(
 		m_Socket,
 		boost::asio::buffer(buffer->data(), buffer->size()),
-		[client, buffer, handler](const boost::system::error_code& ec, size_t bytestransfer)
+		[client, watchdog, buffer, handler](const boost::system::error_code& ec, size_t bytestransfer)
 	{
 		if (!ec && bytestransfer > 0)
 		{
+			if (watchdog != nullptr)
+				watchdog->Touch();
 			auto tsp = client->m_Target.lock();
 			if (tsp != nullptr)
 			{
@@ -444,11 +461,16 @@ void TcpForwardChannel::Read(OutputBuffer buffer, IoCompletionHandler handler)
 void TcpForwardChannel::Write(InputBuffer buffer, IoCompletionHandler handler)
 {
 	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+		watchdog->BeginWrite();
 	boost::asio::async_write(
 		m_Socket,
 		boost::asio::const_buffer(buffer.buffer, buffer.bufferSize),
-		[client, handler, this](const boost::system::error_code& ec, size_t bytestransfer)
+		[client, watchdog, handler, this](const boost::system::error_code& ec, size_t bytestransfer)
 	{
+		if (watchdog != nullptr)
+			watchdog->EndWrite();
 		if (handler != nullptr)
 			handler(!ec, bytestransfer);
 		if (ec)
@@ -458,16 +480,52 @@ void TcpForwardChannel::Write(InputBuffer buffer, IoCompletionHandler handler)
 		}
 	});
 }
+bool TcpForwardChannel::SendFile(const std::wstring& path, uint64_t offset, uint64_t length, const FileOptions& options, FileProgressHandler progress, IoCompletionHandler handler)
+{
+	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+	{
+		// A file transfer that makes progress does not count as idle
+		progress = [watchdog, progress](size_t io_bytes)
+		{
+			watchdog->Progress();
+			return progress == nullptr || progress(io_bytes);
+		};
+	}
+	if (AsyncTransmitFile(
+		m_Socket,
+		path,
+		offset,
+		length,
+		progress,
+		[client, handler](const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (handler != nullptr)
+			handler(!ec, bytestransfer);
+		if (ec)
+		{
+			if (ec != boost::system::errc::operation_canceled)
+				client->CloseChannel(ec);
+		}
+	}))
+		return true;
+	// Fall back to buffered writes when the kernel cannot send the file
+	return IAsyncChannel::SendFile(path, offset, length, options, progress, handler);
+}
 
 void TcpForwardChannel::ReadSome(OutputBuffer buffer, IoCompletionHandler handler)
 {
 	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
 	m_Socket.async_read_some(
 		boost::asio::buffer(buffer->data(), buffer->size()),
-		[client, buffer, handler](const boost::system::error_code& ec, size_t bytestransfer)
+		[client, watchdog, buffer, handler](const boost::system::error_code& ec, size_t bytestransfer)
 	{
 		if (!ec && bytestransfer > 0)
 		{
+			if (watchdog != nullptr)
+				watchdog->Touch();
 			auto tsp = client->m_Target.lock();
 			if (tsp != nullptr)
 			{
@@ -499,10 +557,15 @@ void TcpForwardChannel::ReadSome(OutputBuffer buffer, IoCompletionHandler handle
 void TcpForwardChannel::WriteSome(InputBuffer buffer, IoCompletionHandler handler)
 {
 	auto client = shared_from_this();
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+		watchdog->BeginWrite();
 	m_Socket.async_write_some(
 		boost::asio::const_buffer(buffer.buffer, buffer.bufferSize),
-		[client, handler](const boost::system::error_code& ec, size_t bytestransfer)
+		[client, watchdog, handler](const boost::system::error_code& ec, size_t bytestransfer)
 	{
+		if (watchdog != nullptr)
+			watchdog->EndWrite();
 		handler(!ec, bytestransfer);
 		if (ec)
 		{
@@ -1,17 +1,22 @@
-#pragma once
+﻿#pragma once
 #include "IAsyncStream.h"
+#include "SocketTuning.h"
+#include "StreamTimeouts.h"
+#include "EndpointDescriptor.h"
+#include "NetCore.h"
 
 class TcpForwardChannel;
 class TCPForwardServer :
 	public CommunicationDevice,
 	public std::enable_shared_from_this<TCPForwardServer>
 {
+	friend class TcpForwardChannel;
 public:
-	TCPForwardServer(void);
+	TCPForwardServer(NetCore& core);
 	virtual ~TCPForwardServer(void);
 
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override;
 	virtual bool IsServer(void) override;
 	virtual PDTable EnumProperties() override;
@@ -24,6 +29,7 @@ private:
 	static void ConnectServer(std::shared_ptr<TCPForwardServer> self, std::shared_ptr<TcpForwardChannel> channelClient, std::shared_ptr<TcpForwardChannel> channelServer);
 	void Close(const boost::system::error_code& errorCode);
 private:
+	NetCore& m_Core;
 	std::wstring m_ListenAddress;
 	std::uint16_t m_ListenPort;
 	std::wstring m_RemoteHost;
@@ -31,6 +37,8 @@ private:
 	bool m_ReuseAddress;
 	bool m_Keepalive;
 	boost::asio::ip::tcp::acceptor m_Acceptor;
+	std::shared_ptr<SocketTuning> m_Tuning;
+	std::shared_ptr<StreamTimeouts> m_Timeouts;
 };
 
 class TcpForwardChannel :
@@ -42,26 +50,31 @@ public:
 	TcpForwardChannel(std::shared_ptr<TCPForwardServer> owner);
 	virtual ~TcpForwardChannel(void);
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
 	virtual std::wstring RemoteEndPoint(void) const override;
+	virtual std::shared_ptr<const EndpointDescriptor> Endpoints(void) const override;
 	virtual void Read(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Write(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void ReadSome(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void WriteSome(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Cancel(void) override;
 	virtual void Close(void) override;
+	virtual bool SendFile(const std::wstring& path, uint64_t offset, uint64_t length, const FileOptions& options, FileProgressHandler progress, IoCompletionHandler handler) override;
 protected:
 	bool CloseChannel(void);
 	void CloseChannel(const boost::system::error_code& ecClose);
 	void TargetCloseChannel(const boost::system::error_code& ecClose);
+	void Watch(std::shared_ptr<StreamTimeouts> timeouts);
 private:
 	std::weak_ptr<TCPForwardServer> m_Owner;
 	std::weak_ptr<TcpForwardChannel> m_Target;
 	boost::asio::ip::tcp::socket m_Socket;
 	std::atomic<bool> m_Opened;
 	std::wstring m_ChannelGroupName;
+	StreamTimeouts::WatchdogPtr m_Watchdog;
+	EndpointDescriptor::Ptr m_Endpoints;
 };
 
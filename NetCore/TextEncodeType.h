@@ -197,7 +197,7 @@ namespace Transform
 				std::wstring result;
 				result.reserve(data.size() / sizeof(wchar_t));
 				auto first = reinterpret_cast<const wchar_t*>(data.data());
-				auto last = first + data.size();
+				auto last = first + (data.size() / sizeof(wchar_t));
 				result.assign(first, last);
 				return result;
 			}
@@ -0,0 +1,103 @@
+﻿#include "pch.h"
+#include "TimerWheel.h"
+
+// 节拍 50 毫秒, 1024 个槽位, 一圈约 51 秒
+constexpr auto kTICK = std::chrono::milliseconds(50);
+constexpr size_t kSLOTS = 1024;
+
+TimerWheel::TimerWheel(boost::asio::io_context& io) :
+	m_Timer(io),
+	m_Origin(std::chrono::steady_clock::now()),
+	m_Mutex(),
+	m_Slots(kSLOTS),
+	m_Current(0),
+	m_Armed(false),
+	m_Count(0),
+	m_Now(0)
+{
+}
+
+uint64_t TimerWheel::CurrentTick(void) const
+{
+	return static_cast<uint64_t>((std::chrono::steady_clock::now() - m_Origin) / kTICK);
+}
+
+TimerWheel::Timer TimerWheel::Schedule(std::chrono::milliseconds delay, Handler handler)
+{
+	auto ticks = static_cast<uint64_t>((delay + kTICK - std::chrono::milliseconds(1)) / kTICK);
+	auto timer = std::make_shared<Entry>();
+	timer->handler = handler;
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	if (!m_Armed)
+	{
+		// 停止期间没有条目, 直接跳到当前时间
+		m_Current = CurrentTick();
+		m_Now = m_Current * kTICK.count();
+		m_Armed = true;
+		Arm();
+	}
+	timer->expiry = m_Current + (std::max)(ticks, static_cast<uint64_t>(1));
+	m_Slots[timer->expiry % kSLOTS].push_back(timer);
+	++m_Count;
+	return timer;
+}
+
+void TimerWheel::Cancel(const Timer& timer)
+{
+	if (timer == nullptr)
+		return;
+	// 条目留在槽位中, 轮到时再移除
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	timer->handler = nullptr;
+}
+
+void TimerWheel::Arm(void)
+{
+	m_Timer.expires_at(m_Origin + kTICK * (m_Current + 1));
+	m_Timer.async_wait([this](const boost::system::error_code& ec)
+	{
+		if (!ec)
+			OnTick();
+	});
+}
+
+void TimerWheel::OnTick(void)
+{
+	std::vector<Handler> expired;
+	{
+		std::unique_lock<std::mutex> lk(m_Mutex);
+		// 线程调度延迟时按实际经过的节拍补上, 每个槽位只检查一次
+		auto target = CurrentTick();
+		auto end = (std::min)(target, m_Current + kSLOTS);
+		while (m_Current < end)
+		{
+			++m_Current;
+			auto& slot = m_Slots[m_Current % kSLOTS];
+			size_t keep = 0;
+			for (size_t i = 0; i < slot.size(); ++i)
+			{
+				auto& timer = slot[i];
+				if (timer->handler == nullptr || timer->expiry <= target)
+				{
+					if (timer->handler != nullptr)
+						expired.push_back(std::move(timer->handler));
+					timer->handler = nullptr;
+					--m_Count;
+					continue;
+				}
+				if (keep != i)
+					slot[keep] = std::move(timer);
+				++keep;
+			}
+			slot.resize(keep);
+		}
+		m_Current = target;
+		m_Now = m_Current * kTICK.count();
+		if (m_Count > 0)
+			Arm();
+		else
+			m_Armed = false;
+	}
+	for (auto& handler : expired)
+		handler();
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <functional>
+
+// 哈希时间轮: 所有通道的超时共用一个定时器, 每个节拍只检查当前槽位中的条目.
+// 登记和取消都是 O(1), 超过一圈的条目留在槽位中等下一圈; 没有条目时定时器停止, 不产生空转唤醒.
+class TimerWheel
+{
+public:
+	using Handler = std::function<void(void)>;
+	struct Entry
+	{
+		uint64_t expiry;
+		Handler handler;
+	};
+	using Timer = std::shared_ptr<Entry>;
+public:
+	TimerWheel(void) = delete;
+	TimerWheel(const TimerWheel&) = delete;
+	TimerWheel(boost::asio::io_context& io);
+	~TimerWheel(void) = default;
+public:
+	// handler 在 IO 线程上调用, 精度为一个节拍
+	Timer Schedule(std::chrono::milliseconds delay, Handler handler);
+	void Cancel(const Timer& timer);
+	// 粗粒度的当前时间(毫秒), 定时器运行期间每个节拍更新一次, 用于记录活动时间而不读取系统时钟
+	uint64_t Now(void) const { return m_Now; }
+	size_t Size(void) const { return m_Count; }
+private:
+	uint64_t CurrentTick(void) const;
+	void Arm(void);
+	void OnTick(void);
+private:
+	boost::asio::steady_timer m_Timer;
+	std::chrono::steady_clock::time_point m_Origin;
+	std::mutex m_Mutex;
+	std::vector<std::vector<Timer>> m_Slots;
+	uint64_t m_Current;
+	bool m_Armed;
+	std::atomic<size_t> m_Count;
+	std::atomic<uint64_t> m_Now;
+};
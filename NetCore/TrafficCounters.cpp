@@ -0,0 +1,247 @@
+﻿#include "pch.h"
+#include "TrafficCounters.h"
+#include "CacheLine.h"
+
+// 每块登记 256 个通道; 总量分散到 64 个线程槽, 线程数更多时共用槽位
+constexpr size_t kSLAB_ENTRIES = 256;
+constexpr size_t kCELLS = 64;
+
+struct TrafficCounters::Entry
+{
+	// 读写完成时更新的字段放在最前面, 正好占一个缓存行
+	std::atomic<uint64_t> id;
+	std::atomic<uint64_t> readBytes;
+	std::atomic<uint64_t> writeBytes;
+	std::atomic<uint64_t> readMessages;
+	std::atomic<uint64_t> writeMessages;
+	std::atomic<uint64_t> errors;
+	std::atomic<uint64_t> activity;
+	uint64_t since;
+	std::wstring description;
+};
+
+struct TrafficCounters::Cell
+{
+	std::atomic<uint64_t> readBytes;
+	std::atomic<uint64_t> writeBytes;
+	std::atomic<uint64_t> readMessages;
+	std::atomic<uint64_t> writeMessages;
+	std::atomic<uint64_t> errors;
+	uint8_t padding[kCACHE_LINE - 5 * sizeof(std::atomic<uint64_t>)];
+};
+
+// 记录之间的间隔取整到缓存行
+constexpr size_t kENTRY_STRIDE = (sizeof(TrafficCounters::Entry) + kCACHE_LINE - 1) / kCACHE_LINE * kCACHE_LINE;
+
+
+// Entry 和 Cell 的计数字段同名
+template<typename T>
+static void ClearCounters(T& counters)
+{
+	counters.readBytes.store(0, std::memory_order_relaxed);
+	counters.writeBytes.store(0, std::memory_order_relaxed);
+	counters.readMessages.store(0, std::memory_order_relaxed);
+	counters.writeMessages.store(0, std::memory_order_relaxed);
+	counters.errors.store(0, std::memory_order_relaxed);
+}
+
+TrafficCounters::TrafficCounters(void) :
+	m_Origin(std::chrono::steady_clock::now()),
+	m_Mutex(),
+	m_Slabs(),
+	m_Free(),
+	m_Index(),
+	m_NextId(1),
+	m_CellBlock(new uint8_t[sizeof(Cell) * kCELLS + kCACHE_LINE]),
+	m_Cells(reinterpret_cast<Cell*>(CacheLineBase(m_CellBlock.get())))
+{
+	for (size_t i = 0; i < kCELLS; ++i)
+	{
+		new (&m_Cells[i]) Cell;
+		ClearCounters(m_Cells[i]);
+	}
+}
+
+TrafficCounters::~TrafficCounters(void)
+{
+	for (auto& slab : m_Slabs)
+	{
+		auto base = CacheLineBase(slab.get());
+		for (size_t i = 0; i < kSLAB_ENTRIES; ++i)
+			reinterpret_cast<Entry*>(base + i * kENTRY_STRIDE)->~Entry();
+	}
+}
+
+void TrafficCounters::Grow(void)
+{
+	std::unique_ptr<uint8_t[]> slab(new uint8_t[kSLAB_ENTRIES * kENTRY_STRIDE + kCACHE_LINE]);
+	auto base = CacheLineBase(slab.get());
+	m_Slabs.push_back(std::move(slab));
+	// 倒序放入, 先分配低地址的记录
+	for (size_t i = kSLAB_ENTRIES; i > 0; --i)
+	{
+		auto entry = new (base + (i - 1) * kENTRY_STRIDE) Entry;
+		entry->id.store(0, std::memory_order_relaxed);
+		m_Free.push_back(entry);
+	}
+}
+
+TrafficCounters::Cell& TrafficCounters::LocalCell(void) const
+{
+	static std::atomic<size_t> next(0);
+	thread_local size_t index = next++ % kCELLS;
+	return m_Cells[index];
+}
+
+uint64_t TrafficCounters::Now(void) const
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_Origin).count());
+}
+
+TrafficCounters::Handle TrafficCounters::Attach(const IAsyncChannel* channel, const std::wstring& description)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	auto it = m_Index.find(channel);
+	if (it != m_Index.end())
+		return Handle{ it->second, it->second->id.load(std::memory_order_relaxed) };
+	if (m_Free.empty())
+		Grow();
+	auto entry = m_Free.back();
+	m_Free.pop_back();
+	ClearCounters(*entry);
+	entry->since = Now();
+	entry->activity.store(entry->since, std::memory_order_relaxed);
+	entry->description = description;
+	auto id = m_NextId++;
+	entry->id.store(id, std::memory_order_release);
+	m_Index.emplace(channel, entry);
+	return Handle{ entry, id };
+}
+
+void TrafficCounters::Detach(const IAsyncChannel* channel)
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	auto it = m_Index.find(channel);
+	if (it == m_Index.end())
+		return;
+	it->second->id.store(0, std::memory_order_release);
+	m_Free.push_back(it->second);
+	m_Index.erase(it);
+}
+
+TrafficCounters::Handle TrafficCounters::Find(const IAsyncChannel* channel) const
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	auto it = m_Index.find(channel);
+	if (it == m_Index.end())
+		return Handle{ nullptr, 0 };
+	return Handle{ it->second, it->second->id.load(std::memory_order_relaxed) };
+}
+
+void TrafficCounters::Read(const Handle& handle, size_t io_bytes)
+{
+	auto& cell = LocalCell();
+	cell.readBytes.fetch_add(io_bytes, std::memory_order_relaxed);
+	cell.readMessages.fetch_add(1, std::memory_order_relaxed);
+	auto entry = handle.entry;
+	if (entry == nullptr || entry->id.load(std::memory_order_relaxed) != handle.id)
+		return;
+	entry->readBytes.fetch_add(io_bytes, std::memory_order_relaxed);
+	entry->readMessages.fetch_add(1, std::memory_order_relaxed);
+	entry->activity.store(Now(), std::memory_order_relaxed);
+}
+
+void TrafficCounters::Written(const Handle& handle, bool ok, size_t io_bytes, size_t messages)
+{
+	auto& cell = LocalCell();
+	if (ok)
+	{
+		cell.writeBytes.fetch_add(io_bytes, std::memory_order_relaxed);
+		cell.writeMessages.fetch_add(messages, std::memory_order_relaxed);
+	}
+	else
+		cell.errors.fetch_add(1, std::memory_order_relaxed);
+	auto entry = handle.entry;
+	if (entry == nullptr || entry->id.load(std::memory_order_relaxed) != handle.id)
+		return;
+	if (ok)
+	{
+		entry->writeBytes.fetch_add(io_bytes, std::memory_order_relaxed);
+		entry->writeMessages.fetch_add(messages, std::memory_order_relaxed);
+		entry->activity.store(Now(), std::memory_order_relaxed);
+	}
+	else
+		entry->errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+TrafficCounters::Counters TrafficCounters::Total(void) const
+{
+	Counters total = {};
+	for (size_t i = 0; i < kCELLS; ++i)
+	{
+		auto& cell = m_Cells[i];
+		total.readBytes += cell.readBytes.load(std::memory_order_relaxed);
+		total.writeBytes += cell.writeBytes.load(std::memory_order_relaxed);
+		total.readMessages += cell.readMessages.load(std::memory_order_relaxed);
+		total.writeMessages += cell.writeMessages.load(std::memory_order_relaxed);
+		total.errors += cell.errors.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+size_t TrafficCounters::Size(void) const
+{
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	return m_Index.size();
+}
+
+std::vector<TrafficCounters::Talker> TrafficCounters::Top(size_t count, Order order) const
+{
+	std::vector<Talker> talkers;
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	// 先只按排序键挑出前 count 个, 上万个通道时不必复制所有通道的描述
+	std::vector<std::pair<uint64_t, Entry*>> keys;
+	keys.reserve(m_Index.size());
+	auto now = Now();
+	for (auto& item : m_Index)
+	{
+		auto entry = item.second;
+		uint64_t key = 0;
+		if (order == Order::Bytes)
+			key = entry->readBytes.load(std::memory_order_relaxed) + entry->writeBytes.load(std::memory_order_relaxed);
+		else
+			key = now - (std::min)(now, entry->activity.load(std::memory_order_relaxed));
+		keys.emplace_back(key, entry);
+	}
+	count = (std::min)(count, keys.size());
+	std::partial_sort(keys.begin(), keys.begin() + count, keys.end(), [](const std::pair<uint64_t, Entry*>& a, const std::pair<uint64_t, Entry*>& b)
+	{
+		return a.first > b.first;
+	});
+	talkers.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		auto entry = keys[i].second;
+		Talker talker;
+		talker.id = entry->id.load(std::memory_order_relaxed);
+		talker.description = entry->description;
+		talker.counters.readBytes = entry->readBytes.load(std::memory_order_relaxed);
+		talker.counters.writeBytes = entry->writeBytes.load(std::memory_order_relaxed);
+		talker.counters.readMessages = entry->readMessages.load(std::memory_order_relaxed);
+		talker.counters.writeMessages = entry->writeMessages.load(std::memory_order_relaxed);
+		talker.counters.errors = entry->errors.load(std::memory_order_relaxed);
+		talker.idle = now - (std::min)(now, entry->activity.load(std::memory_order_relaxed));
+		talker.age = now - (std::min)(now, entry->since);
+		talkers.push_back(std::move(talker));
+	}
+	return talkers;
+}
+
+void TrafficCounters::Reset(void)
+{
+	for (size_t i = 0; i < kCELLS; ++i)
+		ClearCounters(m_Cells[i]);
+	std::unique_lock<std::mutex> lk(m_Mutex);
+	for (auto& item : m_Index)
+		ClearCounters(*item.second);
+}
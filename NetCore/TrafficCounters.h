@@ -0,0 +1,75 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <unordered_map>
+#include "IAsyncStream.h"
+
+// 按通道的流量统计: 字节, 消息, 错误和最后活动时间. 通道记录按块(slab)分配并按缓存行对齐,
+// 不同通道的计数不在同一缓存行上; 总量按线程分散到各自缓存行上的计数槽, 读取时再汇总,
+// IO 线程之间不再争用同一个原子变量. 登记和移除加锁, 读写计数只做无锁的原子加.
+class TrafficCounters
+{
+public:
+	struct Counters
+	{
+		uint64_t readBytes;
+		uint64_t writeBytes;
+		uint64_t readMessages;
+		uint64_t writeMessages;
+		uint64_t errors;
+	};
+	struct Talker
+	{
+		uint64_t id;
+		std::wstring description;
+		Counters counters;
+		uint64_t idle;          // 距最后一次读写的毫秒数
+		uint64_t age;           // 登记以来的毫秒数
+	};
+	enum class Order
+	{
+		Bytes,                  // 收发字节最多的通道
+		Idle                    // 最久没有读写的通道
+	};
+	struct Entry;
+	// 登记时返回, 读写完成时传回; 通道移除后记录可能被新通道复用, 按编号区分, 旧的句柄不再计数
+	struct Handle
+	{
+		Entry* entry;
+		uint64_t id;
+	};
+public:
+	TrafficCounters(void);
+	TrafficCounters(const TrafficCounters&) = delete;
+	~TrafficCounters(void);
+public:
+	Handle Attach(const IAsyncChannel* channel, const std::wstring& description);
+	void Detach(const IAsyncChannel* channel);
+	// 未登记时返回空句柄, 空句柄只计入总量
+	Handle Find(const IAsyncChannel* channel) const;
+	void Read(const Handle& handle, size_t io_bytes);
+	void Written(const Handle& handle, bool ok, size_t io_bytes, size_t messages);
+	Counters Total(void) const;
+	size_t Size(void) const;
+	std::vector<Talker> Top(size_t count, Order order) const;
+	void Reset(void);
+private:
+	struct Cell;
+	Cell& LocalCell(void) const;
+	uint64_t Now(void) const;
+	void Grow(void);
+private:
+	std::chrono::steady_clock::time_point m_Origin;
+	mutable std::mutex m_Mutex;
+	std::vector<std::unique_ptr<uint8_t[]>> m_Slabs;
+	std::vector<Entry*> m_Free;
+	std::unordered_map<const IAsyncChannel*, Entry*> m_Index;
+	uint64_t m_NextId;
+	std::unique_ptr<uint8_t[]> m_CellBlock;
+	Cell* m_Cells;
+};
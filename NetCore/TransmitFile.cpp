@@ -0,0 +1,513 @@
+﻿#include "pch.h"
+#include "TransmitFile.h"
+#include <cstdio>
+#include <deque>
+#include <thread>
+#include <condition_variable>
+#include "OEMStringHelper.hpp"
+
+#if defined(BOOST_ASIO_HAS_WINDOWS_OVERLAPPED_PTR)
+// 单次 TransmitFile 的长度上限为 2^31-1, 分段发送同时用于进度回报
+constexpr uint64_t kTRANSMIT_CHUNK_SIZE = 1024 * 1024 * 64;
+
+class TransmitFileOperation :
+	public std::enable_shared_from_this<TransmitFileOperation>
+{
+public:
+	TransmitFileOperation(
+		boost::asio::ip::tcp::socket& socket,
+		HANDLE file,
+		uint64_t offset,
+		uint64_t length,
+		IAsyncChannel::FileProgressHandler progress,
+		TransmitFileHandler handler) :
+		m_Socket(socket),
+		m_File(file),
+		m_Offset(offset),
+		m_Remaining(length),
+		m_Transferred(0),
+		m_Progress(progress),
+		m_Handler(handler)
+	{
+	}
+	~TransmitFileOperation(void)
+	{
+		::CloseHandle(m_File);
+	}
+public:
+	void Next(void)
+	{
+		if (m_Remaining == 0)
+		{
+			Complete(boost::system::error_code());
+			return;
+		}
+
+		auto self = shared_from_this();
+		auto chunk = static_cast<DWORD>((std::min)(m_Remaining, kTRANSMIT_CHUNK_SIZE));
+		boost::asio::windows::overlapped_ptr overlapped(
+			m_Socket.get_executor().context(),
+			[self](const boost::system::error_code& ec, size_t bytestransfer)
+		{
+			self->OnTransmitted(ec, bytestransfer);
+		});
+		overlapped.get()->Offset = static_cast<DWORD>(m_Offset & 0xFFFFFFFF);
+		overlapped.get()->OffsetHigh = static_cast<DWORD>(m_Offset >> 32);
+
+		auto ok = ::TransmitFile(m_Socket.native_handle(), m_File, chunk, 0, overlapped.get(), nullptr, 0);
+		auto lastError = ::GetLastError();
+		if (!ok && lastError != ERROR_IO_PENDING)
+		{
+			boost::system::error_code ec(lastError, boost::asio::error::get_system_category());
+			overlapped.complete(ec, 0);
+		}
+		else
+		{
+			overlapped.release();
+		}
+	}
+private:
+	void OnTransmitted(const boost::system::error_code& ec, size_t bytestransfer)
+	{
+		if (ec)
+		{
+			Complete(ec);
+			return;
+		}
+		if (bytestransfer == 0)
+		{
+			Complete(boost::asio::error::eof);
+			return;
+		}
+
+		m_Offset += bytestransfer;
+		m_Remaining -= (std::min)(m_Remaining, static_cast<uint64_t>(bytestransfer));
+		m_Transferred += bytestransfer;
+		if (m_Progress != nullptr && !m_Progress(bytestransfer))
+		{
+			Complete(boost::asio::error::operation_aborted);
+			return;
+		}
+		Next();
+	}
+
+	void Complete(const boost::system::error_code& ec)
+	{
+		if (m_Handler != nullptr)
+			m_Handler(ec, static_cast<size_t>(m_Transferred));
+	}
+private:
+	boost::asio::ip::tcp::socket& m_Socket;
+	HANDLE m_File;
+	uint64_t m_Offset;
+	uint64_t m_Remaining;
+	uint64_t m_Transferred;
+	IAsyncChannel::FileProgressHandler m_Progress;
+	TransmitFileHandler m_Handler;
+};
+#elif defined(__linux__)
+#include <sys/sendfile.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+// 每次 sendfile 的长度上限; 每一段都先等待 socket 可写再发送, 不在调用线程或 IO 线程上阻塞
+constexpr uint64_t kSENDFILE_CHUNK_SIZE = 1024 * 1024 * 16;
+
+class SendFileOperation :
+	public std::enable_shared_from_this<SendFileOperation>
+{
+public:
+	SendFileOperation(
+		boost::asio::ip::tcp::socket& socket,
+		int file,
+		uint64_t offset,
+		uint64_t length,
+		IAsyncChannel::FileProgressHandler progress,
+		TransmitFileHandler handler) :
+		m_Socket(socket),
+		m_File(file),
+		m_Offset(offset),
+		m_Remaining(length),
+		m_Transferred(0),
+		m_Progress(progress),
+		m_Handler(handler)
+	{
+	}
+	~SendFileOperation(void)
+	{
+		::close(m_File);
+	}
+public:
+	void Wait(void)
+	{
+		auto self = shared_from_this();
+		m_Socket.async_wait(boost::asio::ip::tcp::socket::wait_write, [self](const boost::system::error_code& ec)
+		{
+			if (ec)
+				self->Complete(ec);
+			else
+				self->Next();
+		});
+	}
+private:
+	void Next(void)
+	{
+		if (m_Remaining == 0)
+		{
+			Complete(boost::system::error_code());
+			return;
+		}
+
+		auto chunk = static_cast<size_t>((std::min)(m_Remaining, kSENDFILE_CHUNK_SIZE));
+		auto offset = static_cast<off_t>(m_Offset);
+		auto sent = ::sendfile(m_Socket.native_handle(), m_File, &offset, chunk);
+		if (sent < 0)
+		{
+			if (errno == EINTR)
+			{
+				Next();
+				return;
+			}
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+			{
+				Complete(boost::system::error_code(errno, boost::system::system_category()));
+				return;
+			}
+			Wait();
+			return;
+		}
+		if (sent == 0)
+		{
+			// 文件比请求的长度短
+			Complete(boost::asio::error::eof);
+			return;
+		}
+
+		m_Offset += static_cast<uint64_t>(sent);
+		m_Remaining -= (std::min)(m_Remaining, static_cast<uint64_t>(sent));
+		m_Transferred += static_cast<uint64_t>(sent);
+		if (m_Progress != nullptr && !m_Progress(static_cast<size_t>(sent)))
+		{
+			Complete(boost::asio::error::operation_aborted);
+			return;
+		}
+		Wait();
+	}
+
+	void Complete(const boost::system::error_code& ec)
+	{
+		if (m_Handler != nullptr)
+			m_Handler(ec, static_cast<size_t>(m_Transferred));
+	}
+private:
+	boost::asio::ip::tcp::socket& m_Socket;
+	int m_File;
+	uint64_t m_Offset;
+	uint64_t m_Remaining;
+	uint64_t m_Transferred;
+	IAsyncChannel::FileProgressHandler m_Progress;
+	TransmitFileHandler m_Handler;
+};
+#endif
+
+// 通道不支持由内核发送时的缓冲发送: 后台线程读文件, 始终比网络写入提前若干个块,
+// 同一通道上同时只有一个写操作, 保证数据顺序
+class BufferedFileOperation :
+	public std::enable_shared_from_this<BufferedFileOperation>
+{
+public:
+	BufferedFileOperation(
+		IAsyncChannel& channel,
+		FILE* file,
+		uint64_t length,
+		const IAsyncChannel::FileOptions& options,
+		IAsyncChannel::FileProgressHandler progress,
+		IAsyncChannel::IoCompletionHandler handler) :
+		m_Channel(channel),
+		m_File(file),
+		m_Remaining(length),
+		m_Transferred(0),
+		m_WriteSize(options.writeSize),
+		m_Blocks(),
+		m_FreeBlocks(),
+		m_ReadyBlocks(),
+		m_Mutex(),
+		m_FreeCondition(),
+		m_Writing(false),
+		m_ReadDone(false),
+		m_ReadFailed(false),
+		m_Cancel(false),
+		m_Finished(false),
+		m_Progress(progress),
+		m_Handler(handler)
+	{
+		auto blockSize = (std::max)(options.blockSize, size_t(1));
+		if (m_WriteSize == 0 || m_WriteSize > blockSize)
+			m_WriteSize = blockSize;
+		for (size_t i = 0; i < (std::max)(options.blockCount, size_t(1)); ++i)
+		{
+			std::unique_ptr<Block> block(new Block());
+			block->data.resize(blockSize);
+			block->size = 0;
+			block->sent = 0;
+			m_FreeBlocks.push_back(block.get());
+			m_Blocks.push_back(std::move(block));
+		}
+	}
+	~BufferedFileOperation(void)
+	{
+		::fclose(m_File);
+	}
+public:
+	void Start(void)
+	{
+		auto self = shared_from_this();
+		std::thread reader([self]()
+		{
+			self->ReadAhead();
+		});
+		reader.detach();
+	}
+private:
+	struct Block
+	{
+		std::vector<uint8_t> data;
+		size_t size;
+		size_t sent;
+	};
+
+	void ReadAhead(void)
+	{
+		for (;;)
+		{
+			Block* block = nullptr;
+			uint64_t remaining = 0;
+			{
+				std::unique_lock<std::mutex> lk(m_Mutex);
+				while (m_FreeBlocks.empty() && !m_Cancel)
+					m_FreeCondition.wait(lk);
+				if (m_Cancel)
+					break;
+				block = m_FreeBlocks.back();
+				m_FreeBlocks.pop_back();
+				remaining = m_Remaining;
+			}
+
+			auto size = ::fread(block->data.data(), 1, static_cast<size_t>((std::min)(remaining, static_cast<uint64_t>(block->data.size()))), m_File);
+			{
+				std::unique_lock<std::mutex> lk(m_Mutex);
+				if (size == 0)
+				{
+					m_FreeBlocks.push_back(block);
+					m_ReadDone = true;
+					// 文件比请求的长度短时按失败结束
+					m_ReadFailed = remaining > 0;
+				}
+				else
+				{
+					block->size = size;
+					block->sent = 0;
+					m_Remaining -= size;
+					m_ReadyBlocks.push_back(block);
+				}
+			}
+			WriteNext();
+			if (size == 0)
+				break;
+		}
+	}
+
+	void WriteNext(void)
+	{
+		Block* block = nullptr;
+		bool finished = false;
+		bool ok = true;
+		{
+			std::unique_lock<std::mutex> lk(m_Mutex);
+			if (m_Writing)
+				return;
+			if (m_Cancel)
+			{
+				finished = true;
+				ok = false;
+			}
+			else if (!m_ReadyBlocks.empty())
+			{
+				block = m_ReadyBlocks.front();
+				m_ReadyBlocks.pop_front();
+				m_Writing = true;
+			}
+			else if (m_ReadDone)
+			{
+				finished = true;
+				ok = !m_ReadFailed;
+			}
+		}
+
+		if (block != nullptr)
+			WriteBlock(block);
+		else if (finished)
+			Finish(ok);
+	}
+
+	void WriteBlock(Block* block)
+	{
+		IAsyncChannel::InputBuffer inbuffer;
+		inbuffer.buffer = block->data.data() + block->sent;
+		inbuffer.bufferSize = (std::min)(block->size - block->sent, m_WriteSize);
+		auto self = shared_from_this();
+		m_Channel.Write(inbuffer, [self, block](bool ok, size_t io_bytes)
+		{
+			if (ok)
+			{
+				self->m_Transferred += io_bytes;
+				if (self->m_Progress != nullptr && !self->m_Progress(io_bytes))
+					ok = false;
+			}
+			if (!ok)
+			{
+				{
+					std::unique_lock<std::mutex> lk(self->m_Mutex);
+					self->m_Writing = false;
+					self->m_Cancel = true;
+					self->m_FreeCondition.notify_all();
+				}
+				self->Finish(false);
+				return;
+			}
+
+			block->sent += io_bytes;
+			if (block->sent < block->size)
+			{
+				self->WriteBlock(block);
+				return;
+			}
+
+			{
+				std::unique_lock<std::mutex> lk(self->m_Mutex);
+				self->m_FreeBlocks.push_back(block);
+				self->m_Writing = false;
+				self->m_FreeCondition.notify_one();
+			}
+			self->WriteNext();
+		});
+	}
+
+	void Finish(bool ok)
+	{
+		if (m_Finished.exchange(true))
+			return;
+		// 释放回调持有的引用, 避免循环引用
+		auto handler = std::move(m_Handler);
+		m_Handler = nullptr;
+		m_Progress = nullptr;
+		if (handler != nullptr)
+			handler(ok, static_cast<size_t>(m_Transferred));
+	}
+private:
+	IAsyncChannel& m_Channel;
+	FILE* m_File;
+	uint64_t m_Remaining;
+	std::atomic<uint64_t> m_Transferred;
+	size_t m_WriteSize;
+	std::vector<std::unique_ptr<Block>> m_Blocks;
+	std::vector<Block*> m_FreeBlocks;
+	std::deque<Block*> m_ReadyBlocks;
+	std::mutex m_Mutex;
+	std::condition_variable m_FreeCondition;
+	bool m_Writing;
+	bool m_ReadDone;
+	bool m_ReadFailed;
+	std::atomic<bool> m_Cancel;
+	std::atomic<bool> m_Finished;
+	IAsyncChannel::FileProgressHandler m_Progress;
+	IAsyncChannel::IoCompletionHandler m_Handler;
+};
+
+bool IAsyncChannel::SendFile(
+	const std::wstring& path,
+	uint64_t offset,
+	uint64_t length,
+	const FileOptions& options,
+	FileProgressHandler progress,
+	IoCompletionHandler handler)
+{
+	FILE* file = nullptr;
+#ifdef _WIN32
+	if (::_wfopen_s(&file, path.c_str(), L"rb") != 0)
+		file = nullptr;
+#else
+	file = ::fopen(WStringToString(path).c_str(), "rb");
+#endif
+	if (file == nullptr)
+		return false;
+#ifdef _WIN32
+	auto seeked = ::_fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+	auto seeked = ::fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	if (!seeked)
+	{
+		::fclose(file);
+		return false;
+	}
+
+	auto operation = std::make_shared<BufferedFileOperation>(*this, file, length, options, progress, handler);
+	operation->Start();
+	return true;
+}
+
+bool AsyncTransmitFile(
+	boost::asio::ip::tcp::socket& socket,
+	const std::wstring& path,
+	uint64_t offset,
+	uint64_t length,
+	IAsyncChannel::FileProgressHandler progress,
+	TransmitFileHandler handler)
+{
+#if defined(BOOST_ASIO_HAS_WINDOWS_OVERLAPPED_PTR)
+	if (!socket.is_open())
+		return false;
+
+	auto file = ::CreateFileW(
+		path.c_str(),
+		GENERIC_READ,
+		FILE_SHARE_READ,
+		nullptr,
+		OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN,
+		nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	auto operation = std::make_shared<TransmitFileOperation>(socket, file, offset, length, progress, handler);
+	operation->Next();
+	return true;
+#elif defined(__linux__)
+	if (!socket.is_open())
+		return false;
+
+	// sendfile 在 socket 发送缓冲区满时需要返回 EAGAIN, 而不是阻塞 IO 线程
+	boost::system::error_code ec;
+	socket.native_non_blocking(true, ec);
+	if (ec)
+		return false;
+	auto file = ::open(WStringToString(path).c_str(), O_RDONLY | O_CLOEXEC);
+	if (file < 0)
+		return false;
+	::posix_fadvise(file, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_SEQUENTIAL);
+
+	auto operation = std::make_shared<SendFileOperation>(socket, file, offset, length, progress, handler);
+	operation->Wait();
+	return true;
+#else
+	(void)socket;
+	(void)path;
+	(void)offset;
+	(void)length;
+	(void)progress;
+	(void)handler;
+	return false;
+#endif
+}
@@ -0,0 +1,14 @@
+﻿#pragma once
+#include "IAsyncStream.h"
+
+using TransmitFileHandler = std::function<void(const boost::system::error_code& ec, size_t bytestransfer)>;
+
+// 使用 TransmitFile(Windows) 或 sendfile(Linux) 把文件直接从内核发送到 socket, 不经过用户态缓冲区;
+// 其他平台返回 false, 由调用方改用 IAsyncChannel::SendFile 的缓冲发送
+bool AsyncTransmitFile(
+	boost::asio::ip::tcp::socket& socket,
+	const std::wstring& path,
+	uint64_t offset,
+	uint64_t length,
+	IAsyncChannel::FileProgressHandler progress,
+	TransmitFileHandler handler);
@@ -1,6 +1,5 @@
-#include "pch.h"
+﻿#include "pch.h"
 #include "UDPStream.h"
-#include "NetDebugger.h"
 #include "OEMStringHelper.hpp"
 
 static std::wstring ProtocolToWstring(const boost::asio::ip::udp::endpoint::protocol_type& protocol)
@@ -19,13 +18,15 @@ static std::wstring to_wstring(const boost::asio::ip::udp::endpoint& ep)
 }
 
 
-UDPBasic::UDPBasic():
-	m_Socket(theApp.GetIOContext()),
+UDPBasic::UDPBasic(NetCore& core):
+	m_Core(core),
+	m_Socket(core.GetIOContext()),
 	m_LocalAddress(L"127.0.0.1"),
 	m_LocalPort(0),
 	m_RemoteAddress(L""),
 	m_ReuseAddress(false),
-	m_RemotePort(0)
+	m_RemotePort(0),
+	m_Behavior(std::make_shared<ServerBehavior>(core.GetIOContext()))
 {
 
 }
@@ -117,7 +118,7 @@ IDevice::PDTable UDPBasic::EnumProperties()
 
 	/*pd = std::make_shared<StaticProperty>(
 		L"Broadcast",
-		L"㲥ģʽ\r\n UDP Ϊ㲥ģʽ",
+		L"广播模式\r\n设置 UDP 为广播模式",
 		bool(false),
 		IDevice::PropertyChangeFlags::CanChangeBeforeStart
 		);
@@ -146,6 +147,7 @@ IDevice::PDTable UDPBasic::EnumProperties()
 		nullptr
 		);
 	results.push_back(pd);
+	results.push_back(ServerBehavior::CreateProperties(m_Behavior));
 
 	return results;
 }
@@ -167,12 +169,27 @@ void UDPBasic::Start(void)
 		return;
 
 	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	m_Behavior->Prepare();
 
 	auto client = shared_from_this();
 	std::thread connectThread([client]()
 	{
 		boost::system::error_code ec;
-		boost::asio::ip::udp::resolver rslv(theApp.GetIOContext());
+		// 内置服务没有指定对端时只绑定本地地址, 回复任意来源的数据报
+		if (client->m_Behavior->Enabled() && client->m_RemoteAddress.empty())
+		{
+			auto address = boost::asio::ip::address::from_string(WStringToString(client->m_LocalAddress), ec);
+			boost::asio::ip::udp::endpoint ep(address, client->m_LocalPort);
+			if (!ec)
+				client->m_Socket.open(ep.protocol(), ec);
+			if (!ec)
+				client->m_Socket.set_option(boost::asio::socket_base::reuse_address(client->m_ReuseAddress), ec);
+			if (!ec)
+				client->m_Socket.bind(ep, ec);
+			client->Opened(ec);
+			return;
+		}
+		boost::asio::ip::udp::resolver rslv(client->m_Core.GetIOContext());
 		boost::asio::ip::udp::resolver::query qry(WStringToString(client->m_RemoteAddress), std::to_string(client->m_RemotePort));
 		boost::asio::ip::udp::resolver::iterator iter = rslv.resolve(qry, ec);
 		boost::asio::ip::udp::resolver::iterator end;
@@ -208,16 +225,7 @@ void UDPBasic::Start(void)
 					++iter;
 				}
 			}
-			if (ec)
-			{
-				client->CloseSocket(ec);
-			}
-			else
-			{
-				client->StatusChanged(DeviceStatus::Connected, StringToWString(ec.message()));
-				client->PropertyChanged();
-				client->ChannelConnected(client, StringToWString(ec.message()));
-			}
+			client->Opened(ec);
 		}
 		else
 		{
@@ -228,6 +236,22 @@ void UDPBasic::Start(void)
 	connectThread.detach();
 }
 
+void UDPBasic::Opened(const boost::system::error_code& ec)
+{
+	if (ec)
+	{
+		CloseSocket(ec);
+		return;
+	}
+	StatusChanged(DeviceStatus::Connected, StringToWString(ec.message()));
+	PropertyChanged();
+	// 内置服务直接在 IO 线程上收发数据报, 套接字不交给界面
+	if (m_Behavior->Enabled())
+		m_Behavior->Serve(m_Socket, shared_from_this());
+	else
+		ChannelConnected(shared_from_this(), StringToWString(ec.message()));
+}
+
 void UDPBasic::Stop(void)
 {
 	if (Started())
@@ -235,7 +259,8 @@ void UDPBasic::Stop(void)
 		boost::system::error_code ec;
 		m_Socket.cancel(ec);
 		m_Socket.close(ec);
-		CommunicationDevice::ChannelDisconnected(shared_from_this(), std::wstring());
+		if (!m_Behavior->Enabled())
+			CommunicationDevice::ChannelDisconnected(shared_from_this(), std::wstring());
 		PropertyChanged();
 		StatusChanged(DeviceStatus::Disconnected, std::wstring());
 	}
@@ -256,7 +281,8 @@ void UDPBasic::CloseSocket(bool notify, const boost::system::error_code& ecClose
 		if (notify)
 		{
 			auto message = StringToWString(ecClose.message());
-			CommunicationDevice::ChannelDisconnected(shared_from_this(), message);
+			if (!m_Behavior->Enabled())
+				CommunicationDevice::ChannelDisconnected(shared_from_this(), message);
 			PropertyChanged();
 			StatusChanged(DeviceStatus::Disconnected, message);
 		}
@@ -411,7 +437,8 @@ UDPBasicChannel::UDPBasicChannel(
 	const boost::asio::ip::udp::endpoint& remote
 ):
 	m_Device(device),
-	m_RemoteEP(remote)
+	m_RemoteEP(remote),
+	m_Endpoints(EndpointDescriptor::Capture(device->m_Socket, remote))
 {
 
 }
@@ -421,7 +448,7 @@ UDPBasicChannel::~UDPBasicChannel(void)
 
 }
 
-// ͨ IAsyncChannel ̳
+// 通过 IAsyncChannel 继承
 std::wstring UDPBasicChannel::Id(void) const
 {
 	if (sizeof(size_t) == sizeof(void*))
@@ -431,52 +458,22 @@ std::wstring UDPBasicChannel::Id(void) const
 }
 std::wstring UDPBasicChannel::Description(void) const
 {
-	std::wstring result;
-	boost::system::error_code ec;
-	auto local = m_Device->m_Socket.local_endpoint(ec);
-	if (ec)
-	{
-		result = L"none" + result;
-	}
-	else
-	{
-		result += L"local(";
-		result += StringToWString(local.address().to_string()) + L":" + std::to_wstring(local.port());
-		result += L")";
-	}
-
-	if (ec)
-	{
-		result = L" <---> none";
-	}
-	else
-	{
-		result += L" <---> remote(";
-		result += StringToWString(m_RemoteEP.address().to_string()) + L":" + std::to_wstring(m_RemoteEP.port());
-		result += L")";
-	}
-	return result;
+	return Endpoints()->Description();
 }
 
 std::wstring UDPBasicChannel::LocalEndPoint(void) const
 {
-	std::wstring result;
-	boost::system::error_code ec;
-	auto local = m_Device->m_Socket.local_endpoint(ec);
-	if (ec)
-	{
-		result = L"none";
-	}
-	else
-	{
-		result = StringToWString(local.address().to_string()) + L"#" + std::to_wstring(local.port());
-	}
-	return result;
+	return Endpoints()->LocalText();
 }
 
 std::wstring UDPBasicChannel::RemoteEndPoint(void) const
 {
-	return StringToWString(m_RemoteEP.address().to_string()) + L"#" + std::to_wstring(m_RemoteEP.port());
+	return Endpoints()->RemoteText();
+}
+
+std::shared_ptr<const EndpointDescriptor> UDPBasicChannel::Endpoints(void) const
+{
+	return m_Endpoints != nullptr ? m_Endpoints : EndpointDescriptor::None();
 }
 
 void UDPBasicChannel::Read(OutputBuffer buffer, IoCompletionHandler handler)
@@ -537,8 +534,9 @@ void UDPBasicChannel::Close(void)
 
 
 
-UDPClient::UDPClient() :
-	m_Socket(theApp.GetIOContext()),
+UDPClient::UDPClient(NetCore& core) :
+	m_Core(core),
+	m_Socket(core.GetIOContext()),
 	m_RemoteAddress(L"127.0.0.1"),
 	m_RemotePort(0),
 	m_ReuseAddress(false),
@@ -652,7 +650,7 @@ void UDPClient::Start(void)
 	std::thread connectThread([client]()
 	{
 		boost::system::error_code ec;
-		boost::asio::ip::udp::resolver rslv(theApp.GetIOContext());
+		boost::asio::ip::udp::resolver rslv(client->m_Core.GetIOContext());
 		boost::asio::ip::udp::resolver::query qry(WStringToString(client->m_RemoteAddress), std::to_string(client->m_RemotePort));
 		boost::asio::ip::udp::resolver::iterator iter = rslv.resolve(qry, ec);
 		boost::asio::ip::udp::resolver::iterator end;
@@ -1,5 +1,8 @@
-#pragma once
+﻿#pragma once
 #include "IAsyncStream.h"
+#include "EndpointDescriptor.h"
+#include "ServerBehavior.h"
+#include "NetCore.h"
 class UDPBasic :
 	public CommunicationDevice,
 	public IAsyncChannel,
@@ -7,17 +10,17 @@ class UDPBasic :
 {
 	friend class UDPBasicChannel;
 public:
-	UDPBasic();
+	UDPBasic(NetCore& core);
 	virtual ~UDPBasic();
 public:
-	// ͨ CommunicationDevice ̳
+	// 通过 CommunicationDevice 继承
 	virtual bool IsServer(void) override;
 	virtual bool IsSingleChannel(void) override;
 	virtual PDTable EnumProperties() override;
 	virtual void Start(void) override;
 	virtual void Stop(void) override;
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
@@ -33,7 +36,9 @@ protected:
 protected:
 	void CloseSocket(const boost::system::error_code& ecClose);
 	void CloseSocket(bool notify, const boost::system::error_code& ecClose);
+	void Opened(const boost::system::error_code& ec);
 private:
+	NetCore& m_Core;
 	boost::asio::ip::udp::socket m_Socket;
 	std::wstring m_LocalAddress;
 	uint16_t m_LocalPort;
@@ -42,6 +47,7 @@ private:
 	bool m_ReuseAddress;
 	std::mutex m_EndpointsMutex;
 	std::map<std::wstring, std::shared_ptr<boost::asio::ip::udp::endpoint>> m_RemoteEndpoints;
+	std::shared_ptr<ServerBehavior> m_Behavior;
 };
 
 
@@ -53,11 +59,12 @@ public:
 	UDPBasicChannel(std::shared_ptr<UDPBasic> device, const boost::asio::ip::udp::endpoint& remote);
 	virtual ~UDPBasicChannel(void);
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
 	virtual std::wstring RemoteEndPoint(void) const override;
+	virtual std::shared_ptr<const EndpointDescriptor> Endpoints(void) const override;
 	virtual void Read(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Write(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void ReadSome(OutputBuffer buffer, IoCompletionHandler handler) override;
@@ -69,6 +76,7 @@ public:
 private:
 	std::shared_ptr<UDPBasic> m_Device;
 	boost::asio::ip::udp::endpoint m_RemoteEP;
+	EndpointDescriptor::Ptr m_Endpoints;
 };
 
 
@@ -78,17 +86,17 @@ class UDPClient:
 	public std::enable_shared_from_this<UDPClient>
 {
 public:
-	UDPClient();
+	UDPClient(NetCore& core);
 	virtual ~UDPClient();
 public:
-	// ͨ CommunicationDevice ̳
+	// 通过 CommunicationDevice 继承
 	virtual bool IsServer(void) override;
 	virtual bool IsSingleChannel(void) override;
 	virtual PDTable EnumProperties() override;
 	virtual void Start(void) override;
 	virtual void Stop(void) override;
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
@@ -103,6 +111,7 @@ protected:
 	void CloseSocket(const boost::system::error_code& ecClose);
 	void CloseSocket(bool notify, const boost::system::error_code& ecClose);
 private:
+	NetCore& m_Core;
 	boost::asio::ip::udp::socket m_Socket;
 	std::wstring m_RemoteAddress;
 	uint16_t m_RemotePort;
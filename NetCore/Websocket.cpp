@@ -1,7 +1,7 @@
-#include "pch.h"
+﻿#include "pch.h"
 #include "Websocket.h"
 #include "OEMStringHelper.hpp"
-#include "NetDebugger.h"
+
 #include <algorithm>
 #include <regex>
 #include <random>
@@ -596,9 +596,11 @@ static bool GetHttpPathCompare(const std::string& p0, const std::string& p1)
 	return std::strcmp(pt0, pt1) == 0;
 }
 
-WebSocketChannel::WebSocketChannel() :
-	m_Socket(theApp.GetIOContext()),
-	m_Opened(false)
+WebSocketChannel::WebSocketChannel(NetCore& core) :
+	m_Core(core),
+	m_Socket(core.GetIOContext()),
+	m_Opened(false),
+	m_Endpoints(nullptr)
 {
 
 }
@@ -617,11 +619,42 @@ bool WebSocketChannel::CloseSocket(void)
 		m_Socket.cancel(ec);
 		m_Socket.shutdown(m_Socket.shutdown_both, ec);
 		m_Socket.close(ec);
+		if (m_Watchdog != nullptr)
+			m_Watchdog->Stop();
 		return true;
 	}
 	return false;
 }
 
+bool WebSocketChannel::Shutdown(bool reset, boost::system::error_code& ec)
+{
+	bool state = true;
+	if (!m_Opened.compare_exchange_strong(state, false))
+		return false;
+	boost::system::error_code ecCancel;
+	m_Socket.cancel(ecCancel);
+	if (reset)
+		m_Socket.set_option(boost::asio::socket_base::linger(true, 0), ec);
+	else
+		m_Socket.shutdown(m_Socket.shutdown_both, ec);
+	boost::system::error_code ecClose;
+	m_Socket.close(ecClose);
+	if (!ec)
+		ec = ecClose;
+	if (m_Watchdog != nullptr)
+		m_Watchdog->Stop();
+	return true;
+}
+
+bool WebSocketChannel::HalfClose(void)
+{
+	if (!m_Opened)
+		return false;
+	boost::system::error_code ec;
+	m_Socket.shutdown(m_Socket.shutdown_send, ec);
+	return !ec;
+}
+
 void WebSocketChannel::CloseSocket(const boost::system::error_code& ecClose)
 {
 	if (CloseSocket())
@@ -630,6 +663,29 @@ void WebSocketChannel::CloseSocket(const boost::system::error_code& ecClose)
 	}
 }
 
+void WebSocketChannel::Watch(std::shared_ptr<StreamTimeouts> timeouts, StreamTimeouts::Phase phase)
+{
+	m_Watchdog = nullptr;
+	if (timeouts == nullptr)
+		return;
+	std::weak_ptr<WebSocketChannel> weak = shared_from_this();
+	m_Watchdog = timeouts->Watch(m_Core.GetTimerWheel(), phase, [weak](StreamTimeouts::Phase phase)
+	{
+		auto channel = weak.lock();
+		if (channel != nullptr)
+			channel->OnTimeout(phase);
+	});
+}
+
+void WebSocketChannel::OnTimeout(StreamTimeouts::Phase phase)
+{
+	// 连接和握手阶段设备还不知道这个通道, 只关闭 socket, 由等待中的回调报告失败
+	if (phase == StreamTimeouts::Phase::Open)
+		CloseSocket(boost::asio::error::timed_out);
+	else
+		CloseSocket();
+}
+
 std::wstring WebSocketChannel::Id(void) const
 {
 	if (sizeof(size_t) == sizeof(void*))
@@ -640,72 +696,35 @@ std::wstring WebSocketChannel::Id(void) const
 
 std::wstring WebSocketChannel::Description(void) const
 {
-	std::wstring result;
-	boost::system::error_code ec;
-	auto local = m_Socket.local_endpoint(ec);
-	if (ec)
-	{
-		result = L"none" + result;
-	}
-	else
-	{
-		result += L"local(";
-		result += StringToWString(local.address().to_string()) + L":" + std::to_wstring(local.port());
-		result += L")";
-	}
-
-	auto remote = m_Socket.remote_endpoint(ec);
-	if (ec)
-	{
-		result += L" <---> none";
-	}
-	else
-	{
-		result += L" <---> remote(";
-		result += StringToWString(remote.address().to_string()) + L":" + std::to_wstring(remote.port());
-		result += L")";
-	}
-	return result;
+	return Endpoints()->Description();
 }
 
 std::wstring WebSocketChannel::LocalEndPoint(void) const
 {
-	std::wstring result;
-	boost::system::error_code ec;
-	auto local = m_Socket.local_endpoint(ec);
-	if (ec)
-	{
-		result = L"none";
-	}
-	else
-	{
-		result = StringToWString(local.address().to_string()) + L"#" + std::to_wstring(local.port());
-	}
-	return result;
+	return Endpoints()->LocalText();
 }
 
 std::wstring WebSocketChannel::RemoteEndPoint(void) const
 {
-	std::wstring result;
-	boost::system::error_code ec;
-	auto local = m_Socket.remote_endpoint(ec);
-	if (ec)
-	{
-		result = L"none";
-	}
-	else
-	{
-		result = StringToWString(local.address().to_string()) + L"#" + std::to_wstring(local.port());
-	}
-	return result;
+	return Endpoints()->RemoteText();
+}
+
+std::shared_ptr<const EndpointDescriptor> WebSocketChannel::Endpoints(void) const
+{
+	// 单连接客户端重连时会替换, 原子地读取
+	auto endpoints = std::atomic_load(&m_Endpoints);
+	return endpoints != nullptr ? endpoints : EndpointDescriptor::None();
 }
 
 void WebSocketChannel::Read(OutputBuffer buffer, IoCompletionHandler handler)
 {
 	auto header = std::make_shared<WebSocketHeader>();
 	auto channel = shared_from_this();
-	header->ReadPacket(channel, m_Socket, buffer, [header, channel, handler](bool ok, size_t bytestransfer)
+	auto watchdog = m_Watchdog;
+	header->ReadPacket(channel, m_Socket, buffer, [header, channel, watchdog, handler](bool ok, size_t bytestransfer)
 	{
+		if (ok && watchdog != nullptr)
+			watchdog->Touch();
 		if (handler != nullptr)
 			handler(ok, bytestransfer);
 		if (!ok)
@@ -729,11 +748,16 @@ void WebSocketChannel::Write(InputBuffer buffer, IoCompletionHandler handler)
 	if (header.mask)
 		header.setRandomMaskKey();
 	header.ToBuffer(*packet);
+	auto watchdog = m_Watchdog;
+	if (watchdog != nullptr)
+		watchdog->BeginWrite();
 	boost::asio::async_write(
 		m_Socket,
 		boost::asio::const_buffer(packet->data(), packet->size()),
-		[client, handler, packet](const boost::system::error_code& ec, size_t bytestransfer)
+		[client, watchdog, handler, packet](const boost::system::error_code& ec, size_t bytestransfer)
 	{
+		if (watchdog != nullptr)
+			watchdog->EndWrite();
 		if (handler != nullptr)
 			handler(!ec, bytestransfer);
 		if (ec)
@@ -763,6 +787,11 @@ void WebSocketChannel::Close(void)
 	CloseSocket(boost::system::errc::make_error_code(boost::system::errc::connection_aborted));
 }
 
+void WebSocketChannel::CaptureEndpoints(void)
+{
+	std::atomic_store(&m_Endpoints, EndpointDescriptor::Capture(m_Socket));
+}
+
 bool WebSocketChannel::TryOpen(void)
 {
 	bool state = false;
@@ -772,7 +801,8 @@ bool WebSocketChannel::TryOpen(void)
 }
 
 
-WebSocketClientChannel::WebSocketClientChannel()
+WebSocketClientChannel::WebSocketClientChannel(NetCore& core) :
+	WebSocketChannel(core)
 {
 
 }
@@ -785,6 +815,7 @@ WebSocketClientChannel::~WebSocketClientChannel(void)
 void WebSocketClientChannel::Connect(
 	const std::wstring& endpoint,
 	const http_header_collections& headers,
+	std::shared_ptr<StreamTimeouts> timeouts,
 	std::function<void(const boost::system::error_code ec)> handler)
 {
 	std::string host;
@@ -799,21 +830,38 @@ void WebSocketClientChannel::Connect(
 			m_RequestHeaders = headers;
 			m_ConnectQueryString = query;
 			auto channel = shared_from_this();
-			boost::system::error_code ec;
-			auto rslv = std::make_shared<boost::asio::ip::tcp::resolver>(theApp.GetIOContext());
-			boost::asio::ip::tcp::resolver::query qry(host, std::to_string(port));
-			rslv->async_resolve(qry, [rslv, channel, query, host, port, handler](const boost::system::error_code &ec, boost::asio::ip::tcp::resolver::iterator iter)
+			Watch(timeouts, StreamTimeouts::Phase::Connect);
+			auto watchdog = m_Watchdog;
+			if (watchdog != nullptr)
 			{
-				if (ec)
+				// 超时时由时间轮关闭 socket, 等待中的操作以 operation_aborted 结束, 按超时报告; 握手成功后进入空闲检查
+				auto done = handler;
+				handler = [watchdog, done](const boost::system::error_code ec)
 				{
-					handler(ec);
+					if (ec && watchdog->TimedOut())
+						done(boost::asio::error::timed_out);
+					else
+					{
+						if (!ec)
+							watchdog->Enter(StreamTimeouts::Phase::Open);
+						done(ec);
+					}
+				};
+			}
+			m_Core.GetEndpointCache().Resolve(host, static_cast<uint16_t>(port), [channel, watchdog, query, host, port, handler](const boost::system::error_code &ec, EndpointCache::Endpoints endpoints)
+			{
+				if (ec || (watchdog != nullptr && watchdog->TimedOut()))
+				{
+					channel->CloseSocket();
+					handler(ec ? ec : boost::asio::error::timed_out);
 				}
 				else
 				{
 					boost::asio::async_connect(
 						channel->GetSocket(),
-						iter,
-						[rslv, channel, query, host, port, handler](const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator iter)
+						endpoints->begin(),
+						endpoints->end(),
+						[endpoints, channel, query, host, port, handler](const boost::system::error_code& ec, std::vector<boost::asio::ip::tcp::endpoint>::const_iterator iter)
 					{
 						if (ec)
 						{
@@ -845,6 +893,9 @@ void WebSocketClientChannel::OnSocketConnected(
 {
 	boost::system::error_code ecSet;
 	channel->GetSocket().set_option(boost::asio::socket_base::keep_alive(true), ecSet);
+	CaptureEndpoints();
+	if (m_Watchdog != nullptr)
+		m_Watchdog->Enter(StreamTimeouts::Phase::Handshake);
 	auto pChannel = dynamic_cast<WebSocketClientChannel*>(channel.get());
 	auto data = HttpConnectString(query, host, GetRandomString(), port, pChannel->m_RequestHeaders);
 	boost::asio::async_write(
@@ -925,10 +976,12 @@ bool WebSocketClientChannel::IsMessageMasked(void)
 }
 
 
-WebSocketClient::WebSocketClient(void):
+WebSocketClient::WebSocketClient(NetCore& core):
+	m_Core(core),
 	m_bBinaryMode(false),
 	m_bMessageMasked(false),
-	m_ServerURL(L"ws://localhost:8080/test")
+	m_ServerURL(L"ws://localhost:8080/test"),
+	m_Timeouts(std::make_shared<StreamTimeouts>())
 {
 	m_Headers.resize(6);
 }
@@ -1056,6 +1109,7 @@ WebSocketClient::PDTable WebSocketClient::EnumProperties()
 		[self](const std::wstring& value) { self->m_Headers[5] = value; }
 	);
 	results.push_back(pd);
+	results.push_back(StreamTimeouts::CreateProperties(m_Timeouts, true, true));
 	return results;
 }
 
@@ -1079,8 +1133,9 @@ http_header_collections WebSocketClient::GetHttpHeader()
 
 
 
-WebSocketSingleClient::WebSocketSingleClient(void) :
-	m_Channel(std::make_shared<WebSocketClientChannel>())
+WebSocketSingleClient::WebSocketSingleClient(NetCore& core) :
+	WebSocketClient(core),
+	m_Channel(std::make_shared<WebSocketClientChannel>(core))
 {
 
 }
@@ -1097,8 +1152,9 @@ void WebSocketSingleClient::Start(void)
 		return;
 
 	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	m_Timeouts->Reset();
 	auto client = shared_from_this();
-	m_Channel->Connect(m_ServerURL, GetHttpHeader(),[client](const boost::system::error_code& ec)
+	m_Channel->Connect(m_ServerURL, GetHttpHeader(), m_Timeouts, [client](const boost::system::error_code& ec)
 	{
 		if (ec)
 		{
@@ -1136,10 +1192,12 @@ void WebSocketSingleClient::NotifyChannelClose(std::shared_ptr<WebSocketChannel>
 
 
 
-WebSocketMultipleClient::WebSocketMultipleClient(void) :
+WebSocketMultipleClient::WebSocketMultipleClient(NetCore& core) :
+	WebSocketClient(core),
 	m_Channels(),
-	m_ConnectConuter(0),
-	m_FailedConuter(0)
+	m_RampOptions({ 0, 500, 128, 0, 500 }),
+	m_Ramp(nullptr),
+	m_Drain(std::make_shared<ChannelDrain>(core))
 {
 
 }
@@ -1165,7 +1223,50 @@ IDevice::PDTable WebSocketMultipleClient::EnumProperties()
 		[self](const std::wstring& value) { self->UpdateCanonsCount(static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10))); }
 	);
 	properties.push_back(pd);
-
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectRate",
+		L"DEVICE.WEBSOCKETMULTIPLECLIENT.PROP.CONNRATE",
+		uint32_t(500),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.rate); },
+		[self](const std::wstring& value) { self->m_RampOptions.rate = static_cast<uint32_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectConcurrency",
+		L"DEVICE.WEBSOCKETMULTIPLECLIENT.PROP.HANDSHAKES",
+		uint16_t(128),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.concurrency); },
+		[self](const std::wstring& value) { self->m_RampOptions.concurrency = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectRetries",
+		L"DEVICE.WEBSOCKETMULTIPLECLIENT.PROP.RETRIES",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.retries); },
+		[self](const std::wstring& value) { self->m_RampOptions.retries = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"ConnectBackoff",
+		L"DEVICE.WEBSOCKETMULTIPLECLIENT.PROP.BACKOFF",
+		uint16_t(500),
+		IDevice::PropertyChangeFlags::CanChangeBeforeStart
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring(self->m_RampOptions.backoff); },
+		[self](const std::wstring& value) { self->m_RampOptions.backoff = static_cast<std::uint16_t>(std::wcstoul(value.c_str(), nullptr, 10)); }
+	);
+	properties.push_back(pd);
 	pd = std::make_shared<StaticProperty>(
 		L"ConnectedConuter",
 		L"DEVICE.WEBSOCKETMULTIPLECLIENT.PROP.CONNCOUNT",
@@ -1173,10 +1274,33 @@ IDevice::PDTable WebSocketMultipleClient::EnumProperties()
 		IDevice::PropertyChangeFlags::Readonly
 		);
 	pd->BindMethod(
-		[self]() { return std::to_wstring(self->m_ConnectConuter.load() - self->m_FailedConuter.load()); },
+		[self]() { return std::to_wstring((self->Started() && self->m_Ramp != nullptr) ? self->m_Ramp->Established() : 0); },
 		nullptr
 	);
 	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"PendingConuter",
+		L"DEVICE.WEBSOCKETMULTIPLECLIENT.PROP.PENDINGCOUNT",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring((self->Started() && self->m_Ramp != nullptr) ? self->m_Ramp->Pending() + self->m_Ramp->Handshaking() : 0); },
+		nullptr
+	);
+	properties.push_back(pd);
+	pd = std::make_shared<StaticProperty>(
+		L"FailedConuter",
+		L"DEVICE.WEBSOCKETMULTIPLECLIENT.PROP.FAILEDCOUNT",
+		uint16_t(0),
+		IDevice::PropertyChangeFlags::Readonly
+		);
+	pd->BindMethod(
+		[self]() { return std::to_wstring((self->Started() && self->m_Ramp != nullptr) ? self->m_Ramp->Failed() : 0); },
+		nullptr
+	);
+	properties.push_back(pd);
+	properties.push_back(ChannelDrain::CreateProperties(m_Drain));
 	return properties;
 }
 
@@ -1186,51 +1310,71 @@ void WebSocketMultipleClient::Start(void)
 		return;
 
 	StatusChanged(DeviceStatus::Connecting, std::wstring());
-	auto client = shared_from_this();
-	m_ConnectConuter = 0;
-	m_FailedConuter = 0;
-	theApp.GetIOContext().post([client]()
-	{
-		for (size_t i = 0; i < client->m_Channels.size(); ++i)
-		{
-			auto& channel = client->m_Channels.at(i);
-			if (channel == nullptr)
-				channel = std::make_shared<WebSocketClientChannel>();
-			ConnectChannel(client, channel);
-		}
-	});
-}
-
-void WebSocketMultipleClient::ConnectChannel(std::shared_ptr<WebSocketMultipleClient> client, std::shared_ptr<WebSocketClientChannel> channel)
-{
-	channel->Connect(client->m_ServerURL, client->GetHttpHeader(), [client, channel](const boost::system::error_code& ec)
-	{
-		auto count = client->m_Channels.size();
-		auto complete = (++client->m_ConnectConuter >= count);
-
-
-		if (ec)
+	m_Timeouts->Reset();
+	// 连接按速率和并发握手数逐步发起, 避免一次性涌向服务器的 SYN 队列
+	std::weak_ptr<WebSocketMultipleClient> weak = shared_from_this();
+	auto options = m_RampOptions;
+	options.target = m_Channels.size();
+	m_Ramp = std::make_shared<ConnectRamp>(
+		m_Core.GetIOContext(),
+		options,
+		[weak](size_t index, ConnectRamp::Completion done)
 		{
-			++client->m_FailedConuter;
-		}
-		else
+			auto client = weak.lock();
+			if (client == nullptr)
+			{
+				done(false, std::wstring());
+				return;
+			}
+			// 每次尝试都使用新的通道, 重试不受上次失败状态的影响
+			auto channel = std::make_shared<WebSocketClientChannel>(client->m_Core);
+			client->m_Channels.at(index) = channel;
+			ConnectChannel(client, channel, done);
+		},
+		[weak]()
 		{
-			channel->SetOwner(client);
-			client->ChannelConnected(channel, StringToWString(ec.message()));
-		}
-		if (complete)
+			auto client = weak.lock();
+			if (client != nullptr)
+				client->PropertyChanged();
+		},
+		[weak]()
 		{
-			if (client->m_FailedConuter == count)
+			auto client = weak.lock();
+			if (client == nullptr)
+				return;
+			auto ramp = client->m_Ramp;
+			if (ramp->Established() == 0)
 			{
 				client->PropertyChanged();
-				client->StatusChanged(DeviceStatus::Disconnected, StringToWString(ec.message()));
+				client->StatusChanged(DeviceStatus::Disconnected, ramp->LastError());
 			}
 			else
 			{
 				client->StatusChanged(DeviceStatus::Connected, std::wstring(L""));
 				client->PropertyChanged();
 			}
+		});
+	m_Ramp->Start();
+}
+
+void WebSocketMultipleClient::ConnectChannel(std::shared_ptr<WebSocketMultipleClient> client, std::shared_ptr<WebSocketClientChannel> channel, ConnectRamp::Completion done)
+{
+	channel->Connect(client->m_ServerURL, client->GetHttpHeader(), client->m_Timeouts, [client, channel, done](const boost::system::error_code& ec)
+	{
+		if (ec)
+		{
+			done(false, StringToWString(ec.message()));
+			return;
 		}
+		if (!done(true, std::wstring()))
+		{
+			channel->CloseSocket();
+			return;
+		}
+		channel->SetOwner(client);
+		client->ChannelConnected(channel, StringToWString(ec.message()));
+		// 第一个连接建立后即进入已连接状态, 其余连接继续在后台爬坡
+		client->StatusChanged(DeviceStatus::Connected, std::wstring(L""));
 	});
 }
 
@@ -1240,27 +1384,46 @@ void WebSocketMultipleClient::Stop(void)
 		return;
 	StatusChanged(DeviceStatus::Disconnecting, std::wstring());
 	auto client = shared_from_this();
-	theApp.GetIOContext().post([client]()
+	auto ramp = m_Ramp;
+	m_Core.GetIOContext().post([client, ramp]()
 	{
-		for (size_t i = 0; i < client->m_Channels.size(); ++i)
+		if (ramp != nullptr)
+			ramp->Stop();
+		ChannelDrain::Channels channels;
+		channels.reserve(client->m_Channels.size());
+		for (auto& channel : client->m_Channels)
 		{
-			auto& channel = client->m_Channels.at(i);
 			if (channel != nullptr)
-			{
-				channel->CloseSocket();
-				client->ChannelDisconnected(channel, std::wstring());
-				channel = nullptr;
-			}
+				channels.push_back(channel);
+			channel = nullptr;
 		}
-		client->m_ConnectConuter = 0;
-		client->m_FailedConuter = 0;
-		client->PropertyChanged();
-		client->StatusChanged(DeviceStatus::Disconnected, std::wstring());
+		// 已经被对端关闭并通知过的连接 Shutdown 返回 false, 不再重复通知
+		client->m_Drain->Run(
+			std::move(channels),
+			[](const ChannelDrain::Channel& channel)
+		{
+			auto wsChannel = std::static_pointer_cast<WebSocketClientChannel>(channel);
+			return wsChannel->HasOwner() && wsChannel->HalfClose();
+		},
+			[](const ChannelDrain::Channel& channel, bool reset)
+		{
+			boost::system::error_code ec;
+			return std::static_pointer_cast<WebSocketClientChannel>(channel)->Shutdown(reset, ec);
+		},
+			[client](const ChannelDrain::Channels& closed)
+		{
+			client->ChannelsDisconnected(closed, std::wstring());
+			client->PropertyChanged();
+			client->StatusChanged(DeviceStatus::Disconnected, std::wstring());
+		});
 	});
 }
 
 void WebSocketMultipleClient::NotifyChannelClose(std::shared_ptr<WebSocketChannel> channel, const boost::system::error_code& ecClose)
 {
+	// 停止过程中被对端关闭的连接并入批量通知
+	if (m_Drain->Collect(channel))
+		return;
 	ChannelDisconnected(channel, StringToWString(ecClose.message()));
 }
 
@@ -1277,11 +1440,14 @@ void WebSocketMultipleClient::UpdateCanonsCount(size_t newCount)
 
 
 
-WebSocketServer::WebSocketServer() :
+WebSocketServer::WebSocketServer(NetCore& core) :
+	m_Core(core),
 	m_ListenAddress(L"127.0.0.1"),
 	m_ListenPort(0),
 	m_URL(L"/"),
-	m_Acceptor(theApp.GetIOContext())
+	m_Acceptor(core.GetIOContext()),
+	m_Timeouts(std::make_shared<StreamTimeouts>()),
+	m_Behavior(std::make_shared<ServerBehavior>(core.GetIOContext()))
 {
 
 }
@@ -1371,6 +1537,8 @@ IDevice::PDTable WebSocketServer::EnumProperties()
 		[self](const std::wstring& value) { self->m_bMessageMasked = value == L"1"; }
 	);
 	results.push_back(pd);
+	results.push_back(StreamTimeouts::CreateProperties(m_Timeouts, false, true));
+	results.push_back(ServerBehavior::CreateProperties(m_Behavior));
 
 	return results;
 }
@@ -1381,6 +1549,8 @@ void WebSocketServer::Start(void)
 		return;
 
 	StatusChanged(DeviceStatus::Connecting, std::wstring());
+	m_Timeouts->Reset();
+	m_Behavior->Prepare();
 	boost::system::error_code ec;
 	auto address = boost::asio::ip::address::from_string(WStringToString(m_ListenAddress), ec);
 	if (ec)
@@ -1427,6 +1597,7 @@ void WebSocketServer::Close(const boost::system::error_code& errorCode)
 	boost::system::error_code ec;
 	m_Acceptor.cancel(ec);
 	m_Acceptor.close(ec);
+	m_Behavior->Shutdown();
 	PropertyChanged();
 	StatusChanged(DeviceStatus::Disconnected, StringToWString(errorCode.message()));
 }
@@ -1434,19 +1605,29 @@ void WebSocketServer::Close(const boost::system::error_code& errorCode)
 void WebSocketServer::StartAcceptClient(void)
 {
 	auto server = this->shared_from_this();
-	auto channel = std::make_shared<WebSocketServerChannel>();
+	auto channel = std::make_shared<WebSocketServerChannel>(m_Core);
 	channel->SetOwner(server);
 	m_Acceptor.async_accept(channel->GetSocket(), [server, channel](const boost::system::error_code& ec)
 	{
 		if (!ec)
 		{
+			// 先投递下一次 accept, 再进行握手和连接通知
+			server->StartAcceptClient();
 			boost::system::error_code ecSet;
 			channel->GetSocket().set_option(boost::asio::socket_base::keep_alive(true), ecSet);
+			// 握手超时覆盖读取请求头和发送响应, 握手完成后转为空闲检查
+			channel->Watch(server->m_Timeouts, StreamTimeouts::Phase::Handshake);
 			channel->Start(WStringToString(server->m_URL),[ec, server, channel]()
 			{
-				server->ChannelConnected(channel, StringToWString(ec.message()));
+				if (server->m_Behavior->Enabled())
+				{
+					// 握手完成后由内置服务收发, 回显时每条消息重新组帧
+					channel->SetServed();
+					server->m_Behavior->Serve(channel);
+				}
+				else
+					server->ChannelConnected(channel, StringToWString(ec.message()));
 			});
-			server->StartAcceptClient();
 		}
 	});
 }
@@ -1459,6 +1640,7 @@ void WebSocketServer::Stop(void)
 		boost::system::error_code ec;
 		m_Acceptor.cancel(ec);
 		m_Acceptor.close(ec);
+		m_Behavior->Shutdown();
 		PropertyChanged();
 		StatusChanged(DeviceStatus::Disconnected, std::wstring());
 	}
@@ -1473,7 +1655,11 @@ void WebSocketServer::NotifyChannelClose(std::shared_ptr<WebSocketChannel> chann
 
 
 
-WebSocketServerChannel::WebSocketServerChannel(void)
+WebSocketServerChannel::WebSocketServerChannel(NetCore& core) :
+	WebSocketChannel(core),
+	m_Device(),
+	m_URLPath(),
+	m_Served(false)
 {
 
 }
@@ -1487,6 +1673,7 @@ void WebSocketServerChannel::Start(std::string url, std::function<void()> cb)
 {
 	if (!TryOpen())
 		return;
+	CaptureEndpoints();
 	auto headerBuf = std::make_shared<boost::asio::streambuf>(1024 * 64);
 	auto channel = shared_from_this();
 	m_URLPath = GetHttpQueryStringPath(url);
@@ -1535,12 +1722,18 @@ void WebSocketServerChannel::ResponseWebsocketRequest(std::function<void()> cb)
 		[httpStatus, channel, cb, data, this](const boost::system::error_code& ec, size_t bytestransfer)
 	{
 		if ((!ec) && (httpStatus==101))
+		{
+			if (m_Watchdog != nullptr)
+				m_Watchdog->Enter(StreamTimeouts::Phase::Open);
 			cb();
+		}
 	});
 }
 
 void WebSocketServerChannel::OnNotifyClose(const boost::system::error_code& ecClose)
 {
+	if (m_Served)
+		return;
 	auto dev = m_Device.lock();
 	if (dev != nullptr)
 	{
@@ -1,5 +1,11 @@
-#pragma once
+﻿#pragma once
 #include "IAsyncStream.h"
+#include "ConnectRamp.h"
+#include "StreamTimeouts.h"
+#include "EndpointDescriptor.h"
+#include "ChannelDrain.h"
+#include "ServerBehavior.h"
+#include "NetCore.h"
 
 struct http_header_key_less
 {
@@ -26,14 +32,15 @@ class WebSocketChannel :
 	public std::enable_shared_from_this<WebSocketChannel>
 {
 public:
-	WebSocketChannel(void);
+	WebSocketChannel(NetCore& core);
 	virtual ~WebSocketChannel(void);
 public:
-	// ͨ IAsyncChannel ̳
+	// 通过 IAsyncChannel 继承
 	virtual std::wstring Id(void) const override;
 	virtual std::wstring Description(void) const override;
 	virtual std::wstring LocalEndPoint(void) const override;
 	virtual std::wstring RemoteEndPoint(void) const override;
+	virtual std::shared_ptr<const EndpointDescriptor> Endpoints(void) const override;
 	virtual void Read(OutputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void Write(InputBuffer buffer, IoCompletionHandler handler) override;
 	virtual void ReadSome(OutputBuffer buffer, IoCompletionHandler handler) override;
@@ -43,34 +50,49 @@ public:
 public:
 	bool CloseSocket(void);
 	void CloseSocket(const boost::system::error_code& ecClose);
+	// 主动关闭, reset 时以 RST 结束连接; 返回 false 表示连接已经关闭
+	bool Shutdown(bool reset, boost::system::error_code& ec);
+	// 只关闭发送方向, 由读取端读到结束时关闭通道; 返回 false 表示连接没有打开
+	bool HalfClose(void);
 	boost::asio::ip::tcp::socket& GetSocket(void) { return m_Socket; }
+	// 在时间轮上登记超时, 从 phase 阶段开始
+	void Watch(std::shared_ptr<StreamTimeouts> timeouts, StreamTimeouts::Phase phase);
 protected:
 	virtual void OnNotifyClose(const boost::system::error_code& ecClose) = 0;
 	virtual bool IsBinaryMode(void) = 0;
 	virtual bool IsMessageMasked(void) = 0;
 protected:
 	bool TryOpen(void);
+	void OnTimeout(StreamTimeouts::Phase phase);
+	// 连接建立或接受后调用一次, 记下两端地址
+	void CaptureEndpoints(void);
 protected:
+	NetCore& m_Core;
 	std::string m_ConnectQueryString;
 	std::string m_HttpVersion;
 	http_header_collections m_RequestHeaders;
 	http_header_collections m_ResponseHeaders;
+	StreamTimeouts::WatchdogPtr m_Watchdog;
 private:
 	boost::asio::ip::tcp::socket m_Socket;
 	std::atomic<bool> m_Opened;
+	EndpointDescriptor::Ptr m_Endpoints;
 };
 
 class WebSocketClientChannel :
 	public WebSocketChannel
 {
 public:
-	WebSocketClientChannel(void);
+	WebSocketClientChannel(NetCore& core);
 	virtual ~WebSocketClientChannel(void);
 public:
 	void SetOwner(std::shared_ptr<WebSocketClient> owner) { m_Device = owner; }
+	// 握手完成后才交给设备, 之前对端关闭也不会通知设备
+	bool HasOwner(void) const { return !m_Device.expired(); }
 	void Connect(
 		const std::wstring& endpoint,
 		const http_header_collections& header, 
+		std::shared_ptr<StreamTimeouts> timeouts,
 		std::function<void(const boost::system::error_code ec)> handler);
 protected:
 	virtual void OnNotifyClose(const boost::system::error_code& ecClose) override;
@@ -91,10 +113,10 @@ class WebSocketClient :
 	public CommunicationDevice
 {
 public:
-	WebSocketClient(void);
+	WebSocketClient(NetCore& core);
 	virtual ~WebSocketClient(void);
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsServer(void) override;
 	virtual PDTable EnumProperties() override;
 	bool BinaryMode(void)const { return m_bBinaryMode; }
@@ -105,10 +127,12 @@ protected:
 	virtual http_header_collections GetHttpHeader();
 	virtual std::shared_ptr<WebSocketClient> GetSharedPtr() = 0;
 protected:
+	NetCore& m_Core;
 	bool m_bBinaryMode;
 	bool m_bMessageMasked;
 	std::wstring m_ServerURL;
 	std::vector<std::wstring> m_Headers;
+	std::shared_ptr<StreamTimeouts> m_Timeouts;
 };
 
 class WebSocketSingleClient :
@@ -116,10 +140,10 @@ class WebSocketSingleClient :
 	public std::enable_shared_from_this<WebSocketSingleClient>
 {
 public:
-	WebSocketSingleClient(void);
+	WebSocketSingleClient(NetCore& core);
 	virtual ~WebSocketSingleClient(void);
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override { return true; }
 	virtual void Start(void) override;
 	virtual void Stop(void) override;
@@ -136,10 +160,10 @@ class WebSocketMultipleClient :
 	public std::enable_shared_from_this<WebSocketMultipleClient>
 {
 public:
-	WebSocketMultipleClient(void);
+	WebSocketMultipleClient(NetCore& core);
 	virtual ~WebSocketMultipleClient(void);
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override { return false; }
 	virtual PDTable EnumProperties() override;
 	virtual void Start(void) override;
@@ -149,11 +173,12 @@ public:
 protected:
 	virtual std::shared_ptr<WebSocketClient> GetSharedPtr() { return this->shared_from_this(); }
 	void UpdateCanonsCount(size_t newCount);
-	static void ConnectChannel(std::shared_ptr<WebSocketMultipleClient> client, std::shared_ptr<WebSocketClientChannel> channel);
+	static void ConnectChannel(std::shared_ptr<WebSocketMultipleClient> client, std::shared_ptr<WebSocketClientChannel> channel, ConnectRamp::Completion done);
 private:
 	std::vector<std::shared_ptr<WebSocketClientChannel>> m_Channels;
-	std::atomic<size_t> m_ConnectConuter;
-	std::atomic<size_t> m_FailedConuter;
+	ConnectRamp::Options m_RampOptions;
+	std::shared_ptr<ConnectRamp> m_Ramp;
+	std::shared_ptr<ChannelDrain> m_Drain;
 };
 
 
@@ -163,11 +188,11 @@ class WebSocketServer :
 {
 	friend class TcpChannel;
 public:
-	WebSocketServer(void);
+	WebSocketServer(NetCore& core);
 	virtual ~WebSocketServer(void);
 
 public:
-	// ͨ IDevice ̳
+	// 通过 IDevice 继承
 	virtual bool IsSingleChannel(void) override;
 	virtual bool IsServer(void) override;
 	virtual PDTable EnumProperties() override;
@@ -181,22 +206,27 @@ private:
 	void StartAcceptClient(void);
 	void Close(const boost::system::error_code& errorCode);
 private:
+	NetCore& m_Core;
 	std::wstring m_ListenAddress;
 	std::uint16_t m_ListenPort;
 	std::wstring m_URL;
 	bool m_bBinaryMode;
 	bool m_bMessageMasked;
 	boost::asio::ip::tcp::acceptor m_Acceptor;
+	std::shared_ptr<StreamTimeouts> m_Timeouts;
+	std::shared_ptr<ServerBehavior> m_Behavior;
 };
 
 class WebSocketServerChannel :
 	public WebSocketChannel
 {
 public:
-	WebSocketServerChannel(void);
+	WebSocketServerChannel(NetCore& core);
 	virtual ~WebSocketServerChannel(void);
 public:
 	void SetOwner(std::shared_ptr<WebSocketServer> owner) { m_Device = owner; }
+	// 由内置服务处理的通道没有交给界面, 关闭时不通知
+	void SetServed(void) { m_Served = true; }
 	void Start(std::string url, std::function<void()> cb);
 protected:
 	virtual void OnNotifyClose(const boost::system::error_code& ecClose) override;
@@ -207,4 +237,5 @@ private:
 private:
 	std::weak_ptr<WebSocketServer> m_Device;
 	std::string m_URLPath;
+	bool m_Served;
 };
\ No newline at end of file
@@ -0,0 +1,141 @@
+﻿// 接收缓冲区的聚合写入基准: 多个线程模拟 IO 线程向大量通道追加数据, 另一个线程按界面的周期合并,
+// 比较按分片保存的 ReceiveStore 与原来所有通道共用一个缓冲区和一把锁的写法.
+// 用法: ReceiveStoreBench [--channels n]... [--threads n] [--seconds n] [--size bytes]
+#include "pch.h"
+#include "ReceiveStore.h"
+#include "DataBuffer.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+constexpr auto kMERGE_INTERVAL = std::chrono::milliseconds(50);
+
+struct Result
+{
+	uint64_t appends;
+	uint64_t bytes;
+	double seconds;
+};
+
+// 通道对象只作为键使用, 不会被访问
+static const IAsyncChannel* ChannelKey(const std::vector<uint64_t>& keys, size_t index)
+{
+	return reinterpret_cast<const IAsyncChannel*>(&keys[index]);
+}
+
+template<typename AppendFunc, typename MergeFunc>
+static Result Run(size_t threads, std::chrono::seconds duration, size_t channels, size_t size, AppendFunc append, MergeFunc merge)
+{
+	std::atomic<bool> stop(false);
+	std::atomic<uint64_t> appends(0);
+	std::vector<std::thread> workers;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t t = 0; t < threads; ++t)
+	{
+		workers.emplace_back([&, t]()
+		{
+			std::vector<uint8_t> payload(size, static_cast<uint8_t>('a' + t % 26));
+			uint64_t count = 0;
+			// 每个线程轮流写自己负责的通道, 与 IO 线程上各通道的读完成相当
+			for (size_t i = t; !stop.load(std::memory_order_relaxed); i += threads)
+			{
+				append(i % channels, payload.data(), payload.size());
+				++count;
+			}
+			appends += count;
+		});
+	}
+	std::thread merger([&]()
+	{
+		while (!stop)
+		{
+			std::this_thread::sleep_for(kMERGE_INTERVAL);
+			merge();
+		}
+	});
+	std::this_thread::sleep_for(duration);
+	stop = true;
+	for (auto& worker : workers)
+		worker.join();
+	merger.join();
+	merge();
+	Result result;
+	result.appends = appends;
+	result.bytes = appends * size;
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static void Print(const char* name, size_t channels, const Result& result)
+{
+	std::printf("%-8s channels %6zu  %10.0f appends/s  %8.1f MB/s\n",
+		name, channels, result.appends / result.seconds, result.bytes / result.seconds / (1024.0 * 1024.0));
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<size_t> channelCounts;
+	size_t threads = (std::max)(std::thread::hardware_concurrency(), 2u);
+	auto duration = std::chrono::seconds(3);
+	size_t size = 512;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		auto value = static_cast<size_t>(std::strtoull(argv[i + 1], nullptr, 10));
+		if (std::strcmp(argv[i], "--channels") == 0)
+			channelCounts.push_back((std::max)(value, size_t(1)));
+		else if (std::strcmp(argv[i], "--threads") == 0)
+			threads = (std::max)(value, size_t(1));
+		else if (std::strcmp(argv[i], "--seconds") == 0)
+			duration = std::chrono::seconds((std::max)(value, size_t(1)));
+		else if (std::strcmp(argv[i], "--size") == 0)
+			size = (std::max)(value, size_t(1));
+		else
+		{
+			std::fprintf(stderr, "unknown option: %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (channelCounts.empty())
+		channelCounts = { 1000, 10000 };
+	std::printf("threads %zu, %zu bytes per read, %llds per run\n", threads, size, static_cast<long long>(duration.count()));
+
+	for (auto channels : channelCounts)
+	{
+		std::vector<uint64_t> keys(channels);
+
+		// 按分片保存: 读完成只锁通道所在的分片
+		ReceiveStore store;
+		std::vector<ReceiveStore::ChannelPtr> opened;
+		for (size_t i = 0; i < channels; ++i)
+			opened.push_back(store.Open(ChannelKey(keys, i), L"bench"));
+		auto sharded = Run(threads, duration, channels, size,
+			[&](size_t channel, const uint8_t* data, size_t length)
+			{
+				store.Append(opened[channel], data, length);
+			},
+			[&]()
+			{
+				// 与下面的写法一样每个周期清空, 只比较接收和合并的开销
+				store.Collect(nullptr);
+				store.Clear();
+			});
+		Print("sharded", channels, sharded);
+
+		// 原来的写法: 所有通道写入同一个缓冲区, 共用一把锁
+		std::mutex mutex;
+		DataBuffer global;
+		auto single = Run(threads, duration, channels, size,
+			[&](size_t, const uint8_t* data, size_t length)
+			{
+				std::unique_lock<std::mutex> lk(mutex);
+				global.Append(data, length);
+			},
+			[&]()
+			{
+				std::unique_lock<std::mutex> lk(mutex);
+				global.Clear();
+			});
+		Print("global", channels, single);
+	}
+	return 0;
+}
@@ -0,0 +1,28 @@
+﻿// pch.h: NetCore 的预编译标头, 只包含标准库和 boost, 不依赖 MFC.
+
+#ifndef PCH_H
+#define PCH_H
+
+#ifdef _WIN32
+#include <SDKDDKVer.h>
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include <map>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <set>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include <boost/asio.hpp>
+
+#endif //PCH_H
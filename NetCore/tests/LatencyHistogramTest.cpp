@@ -0,0 +1,143 @@
+﻿// 直方图的边界值: 超过上限的值必须记入最后一个桶, 不能越界写到其他分片;
+// 分位数在桶边界两侧的误差, 以及多个分片和多个直方图合并后的结果
+#include "pch.h"
+#include "LatencyHistogram.h"
+#include <cstdio>
+#include <thread>
+
+static int g_Failures = 0;
+
+static void Check(bool condition, const char* message)
+{
+	if (condition)
+		return;
+	std::fprintf(stderr, "FAILED: %s\n", message);
+	++g_Failures;
+}
+
+int main(void)
+{
+	// 一小时, 探测器接受的最大往返时间
+	const uint64_t kHOUR = UINT64_C(3600) * 1000 * 1000 * 1000;
+	{
+		LatencyHistogram histogram;
+		histogram.Record(kHOUR);
+		histogram.Record(kHOUR);
+		auto data = histogram.Export();
+		uint64_t total = 0;
+		for (auto n : data.counts)
+			total += n;
+		Check(total == 2, "1h values are counted once each");
+		Check(!data.counts.empty() && data.counts.back() == 2, "1h values land in the last bucket");
+		auto summary = LatencyHistogram::Summarize(data);
+		Check(summary.count == 2, "summary count");
+		Check(summary.max == kHOUR && summary.p50 == kHOUR && summary.p999 == kHOUR, "quantiles are clamped to the recorded value");
+	}
+	{
+		// 每个 2 的幂都能记录, 计数总和不丢失
+		LatencyHistogram histogram;
+		for (unsigned bits = 0; bits < 64; ++bits)
+			histogram.Record(uint64_t(1) << bits);
+		histogram.Record(UINT64_MAX);
+		auto data = histogram.Export();
+		uint64_t total = 0;
+		for (auto n : data.counts)
+			total += n;
+		Check(total == 65, "every power of two is counted");
+		Check(data.max == UINT64_MAX && data.min == 1, "extremes");
+	}
+	{
+		// 线性区间内每个值单独一个桶, 分位数是准确值
+		LatencyHistogram histogram;
+		for (uint64_t v = 0; v < 128; ++v)
+			histogram.Record(v);
+		auto summary = histogram.Snapshot();
+		Check(summary.p50 == 63 && summary.p90 == 114 && summary.p99 == 126, "linear range quantiles are exact");
+	}
+	{
+		// 每个 2 的幂两侧的值: 代表值与实际值的误差不超过桶宽的一半
+		bool ok = true;
+		for (unsigned bits = 7; bits < 36; ++bits)
+		{
+			auto boundary = uint64_t(1) << bits;
+			for (auto value : { boundary - 1, boundary, boundary + 1, boundary + boundary / 2 })
+			{
+				// 另记一个大得多的值, p50 落在 value 所在的桶, 又不会被最大值截断
+				LatencyHistogram histogram;
+				histogram.Record(value);
+				histogram.Record(value * 4);
+				auto p50 = histogram.Snapshot().p50;
+				auto error = p50 > value ? p50 - value : value - p50;
+				if (error > value / 128)
+				{
+					std::fprintf(stderr, "value %llu p50 %llu\n", static_cast<unsigned long long>(value), static_cast<unsigned long long>(p50));
+					ok = false;
+				}
+			}
+		}
+		Check(ok, "quantiles near bucket boundaries stay within half a bucket");
+	}
+	{
+		// 均匀分布的分位数, 相对误差约 1%
+		LatencyHistogram histogram;
+		for (uint64_t v = 1; v <= 100000; ++v)
+			histogram.Record(v * 1000);
+		auto summary = histogram.Snapshot();
+		auto near = [](uint64_t actual, uint64_t expected) { return actual >= expected - expected / 100 && actual <= expected + expected / 100; };
+		Check(near(summary.p50, 50000000) && near(summary.p90, 90000000) && near(summary.p99, 99000000) && near(summary.p999, 99900000), "uniform quantiles");
+		Check(summary.mean == 50000500 && summary.min == 1000 && summary.max == 100000000, "uniform mean and extremes");
+	}
+	{
+		// 多个线程写入不同分片, 导出时合并的计数和总和不丢失
+		const unsigned kTHREADS = 8;
+		const uint64_t kPER_THREAD = 100000;
+		LatencyHistogram histogram;
+		std::vector<std::thread> threads;
+		for (unsigned t = 0; t < kTHREADS; ++t)
+		{
+			threads.emplace_back([&histogram, t, kPER_THREAD]()
+			{
+				for (uint64_t i = 0; i < kPER_THREAD; ++i)
+					histogram.Record(t * 1000 + i % 1000);
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		auto data = histogram.Export();
+		uint64_t total = 0;
+		for (auto n : data.counts)
+			total += n;
+		uint64_t sum = 0;
+		for (unsigned t = 0; t < kTHREADS; ++t)
+			sum += kPER_THREAD * (t * 1000) + kPER_THREAD / 1000 * (999 * 1000 / 2);
+		Check(total == kTHREADS * kPER_THREAD, "shards merge every count");
+		Check(data.sum == sum, "shards merge the sum");
+		Check(data.min == 0 && data.max == (kTHREADS - 1) * 1000 + 999, "shards merge the extremes");
+	}
+	{
+		// 两个直方图的 Data 累加后与记录到同一个直方图的结果相同
+		LatencyHistogram a;
+		LatencyHistogram b;
+		LatencyHistogram all;
+		for (uint64_t v = 1; v <= 5000; ++v)
+		{
+			auto value = v * v;
+			(v % 3 == 0 ? a : b).Record(value);
+			all.Record(value);
+		}
+		LatencyHistogram::Data merged;
+		LatencyHistogram::Accumulate(merged, a.Export());
+		LatencyHistogram::Accumulate(merged, b.Export());
+		auto expected = all.Export();
+		Check(merged.counts == expected.counts && merged.sum == expected.sum, "accumulated counts match");
+		auto x = LatencyHistogram::Summarize(merged);
+		auto y = LatencyHistogram::Summarize(expected);
+		Check(x.count == y.count && x.min == y.min && x.max == y.max && x.mean == y.mean &&
+			x.p50 == y.p50 && x.p90 == y.p90 && x.p99 == y.p99 && x.p999 == y.p999, "accumulated summary matches");
+		LatencyHistogram::Accumulate(merged, LatencyHistogram::Data());
+		Check(merged.counts == expected.counts, "accumulating empty data changes nothing");
+	}
+	if (g_Failures == 0)
+		std::printf("LatencyHistogramTest passed\n");
+	return g_Failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+﻿// 发送模板的字段生成: 编号格式, 长度和校验回填, 随机数据和编译错误
+#include "pch.h"
+#include "PayloadTemplate.h"
+#include "LatencyProbe.h"
+#include <cstdio>
+#include <cstring>
+
+static int g_Failures = 0;
+
+static void Check(bool condition, const char* message)
+{
+	if (condition)
+		return;
+	std::fprintf(stderr, "FAILED: %s\n", message);
+	++g_Failures;
+}
+
+static bool Compile(PayloadTemplate& payload, const char* text)
+{
+	std::wstring error;
+	return payload.Compile(reinterpret_cast<const uint8_t*>(text), std::strlen(text), error);
+}
+
+static std::vector<uint8_t> Render(const PayloadTemplate& payload, PayloadTemplate::Context& context)
+{
+	std::vector<uint8_t> out(payload.MaxSize());
+	out.resize(payload.Render(context, out.data()));
+	return out;
+}
+
+static std::vector<uint8_t> Bytes(const char* text)
+{
+	return std::vector<uint8_t>(text, text + std::strlen(text));
+}
+
+int main(void)
+{
+	PayloadTemplate::Context context{};
+	{
+		// 没有字段的模板原样输出, $$ 输出一个 $
+		PayloadTemplate payload;
+		Check(Compile(payload, "GET $$5 $x {seq}"), "plain text compiles");
+		Check(payload.IsStatic(), "plain text is static");
+		Check(Render(payload, context) == Bytes("GET $5 $x {seq}"), "plain text and $$");
+	}
+	{
+		// 编号的各种格式, 不带 le 的为大端
+		PayloadTemplate payload;
+		Check(Compile(payload, "${seq}|${seq:hex}|${client:u16}|${time:u32le}"), "number fields compile");
+		Check(!payload.IsStatic(), "fields are not static");
+		context.sequence = 1234;
+		context.client = 0x0102;
+		context.time = 0x0A0B0C0D;
+		std::vector<uint8_t> expected = Bytes("1234|4d2|");
+		expected.insert(expected.end(), { 0x01, 0x02, '|', 0x0D, 0x0C, 0x0B, 0x0A });
+		Check(Render(payload, context) == expected, "number formats");
+		context.sequence = 0;
+		Check(Render(payload, context)[0] == '0', "zero in decimal");
+	}
+	{
+		// 长度是整条消息的长度, 校验范围到字段之前
+		PayloadTemplate payload;
+		Check(Compile(payload, "123456789${sum8}${xor8}${crc16}${crc32}${len:u8}"), "checksum fields compile");
+		auto data = Render(payload, context);
+		Check(data.size() == 9 + 1 + 1 + 2 + 4 + 1, "checksum message length");
+		if (data.size() == 18)
+		{
+			Check(data[9] == 0xDD, "sum8");
+			Check(data[10] == (0x31 ^ 0xDD), "xor8 covers the sum8 byte");
+			Check(data[17] == 18, "len:u8 is the whole message");
+		}
+	}
+	{
+		// ${begin} 之后才计入校验, 与标准的 CRC 值比较
+		PayloadTemplate payload;
+		Check(Compile(payload, "\x02${begin}123456789${crc16}"), "crc16 compiles");
+		auto data = Render(payload, context);
+		Check(data.size() == 12 && data[10] == 0x37 && data[11] == 0x4B, "crc16 (modbus) little endian");
+		Check(Compile(payload, "AB${begin}123456789${crc32}"), "crc32 compiles");
+		data = Render(payload, context);
+		const uint8_t crc32[] = { 0xCB, 0xF4, 0x39, 0x26 };
+		Check(data.size() == 15 && std::memcmp(data.data() + 11, crc32, 4) == 0, "crc32 big endian");
+		Check(Compile(payload, "${len}abc"), "len compiles");
+		data = Render(payload, context);
+		Check(data.size() == 5 && data[0] == 0 && data[1] == 5, "len defaults to u16 big endian");
+	}
+	{
+		// 随机数据的长度固定, 同一个种子生成相同的数据
+		PayloadTemplate payload;
+		Check(Compile(payload, "${rand:13}${randhex:20}"), "random fields compile");
+		context.random = 42;
+		auto first = Render(payload, context);
+		context.random = 42;
+		auto second = Render(payload, context);
+		Check(first.size() == 33 && first == second, "random data repeats for the same seed");
+		bool hex = first.size() == 33;
+		for (size_t i = 13; hex && i < first.size(); ++i)
+			hex = (first[i] >= '0' && first[i] <= '9') || (first[i] >= 'a' && first[i] <= 'f');
+		Check(hex, "randhex is lowercase hex");
+		Check(Render(payload, context) != first, "random data advances");
+	}
+	{
+		// 时间戳字段的长度和标记
+		PayloadTemplate payload;
+		Check(Compile(payload, "x${stamp}"), "stamp compiles");
+		auto data = Render(payload, context);
+		Check(data.size() == 1 + LatencyProbe::kSTAMP_SIZE && data[1] == 0xA5 && data[2] == 'L', "stamp layout");
+	}
+	{
+		// 生成的长度不超过 MaxSize
+		PayloadTemplate payload;
+		Check(Compile(payload, "${seq}${seq:hex}${client:u64}${rand:7}${stamp}${crc32}"), "max size template compiles");
+		context.sequence = UINT64_MAX;
+		Check(Render(payload, context).size() <= payload.MaxSize(), "render fits MaxSize");
+	}
+	{
+		// 编译错误
+		PayloadTemplate payload;
+		Check(!Compile(payload, "${seq"), "missing }");
+		Check(!Compile(payload, "${foo}"), "unknown field");
+		Check(!Compile(payload, "${seq:u24}"), "unknown format");
+		Check(!Compile(payload, "${rand:0}"), "empty random");
+		Check(!Compile(payload, "${crc32:dec}"), "checksum needs a fixed width");
+		std::string many;
+		for (int i = 0; i < 17; ++i)
+			many += "${sum8}";
+		Check(!Compile(payload, many.c_str()), "too many patched fields");
+	}
+	if (g_Failures == 0)
+		std::printf("PayloadTemplateTest passed\n");
+	return g_Failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,565 @@
+﻿#include "pch.h"
+#include "NetDebugger.h"
+#include "CDataViewCtrl.h"
+
+constexpr UINT_PTR kREFRESH_TIMER_ID = 1;
+constexpr UINT kDEFAULT_FRAME_RATE = 20;
+constexpr size_t kDEFAULT_FRAME_BUDGET = 1024 * 1024 * 4;
+constexpr int kWHEEL_ROWS = 3;
+constexpr int kMAX_ROW_CHARS = 300;
+constexpr size_t kNO_SELECTION = static_cast<size_t>(-1);
+// 复制时每次从视图取出的行数
+constexpr size_t kCOPY_ROWS = 4096;
+
+BEGIN_MESSAGE_MAP(CDataViewCtrl, CWnd)
+	ON_WM_PAINT()
+	ON_WM_ERASEBKGND()
+	ON_WM_SIZE()
+	ON_WM_TIMER()
+	ON_WM_VSCROLL()
+	ON_WM_HSCROLL()
+	ON_WM_MOUSEWHEEL()
+	ON_WM_LBUTTONDOWN()
+	ON_WM_LBUTTONUP()
+	ON_WM_MOUSEMOVE()
+	ON_WM_KEYDOWN()
+	ON_WM_GETDLGCODE()
+	ON_WM_ENABLE()
+	ON_WM_DESTROY()
+END_MESSAGE_MAP()
+
+static BOOL RegisterWindowClass(void)
+{
+	LPCWSTR className = L"ND_DATA_VIEW_CONTROL";
+	WNDCLASS windowclass;
+	HINSTANCE hInstance = AfxGetInstanceHandle();
+
+	if (!(::GetClassInfo(hInstance, className, &windowclass)))
+	{
+		windowclass.style = CS_DBLCLKS;
+		windowclass.lpfnWndProc = ::DefWindowProc;
+		windowclass.cbClsExtra = windowclass.cbWndExtra = 0;
+		windowclass.hInstance = hInstance;
+		windowclass.hIcon = NULL;
+		windowclass.hCursor = AfxGetApp()->LoadStandardCursor(IDC_IBEAM);
+		windowclass.hbrBackground = ::GetSysColorBrush(COLOR_WINDOW);
+		windowclass.lpszMenuName = NULL;
+		windowclass.lpszClassName = className;
+		if (!AfxRegisterClass(&windowclass))
+		{
+			AfxThrowResourceException();
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static CString RowText(const DataBufferViewport::Row& row)
+{
+	CString text(row.text.c_str(), (int)row.text.length());
+	if (row.skipped > 0)
+		text.Format(LSTEXT(MAINWND.RECV.SAMPLING.SKIPPED), std::to_wstring(row.skipped).c_str());
+	return text;
+}
+
+CDataViewCtrl::CDataViewCtrl():
+	m_Viewport(nullptr),
+	m_Mutex(nullptr),
+	m_Rows(),
+	m_RowHeight(16),
+	m_CharWidth(8),
+	m_ScrollX(0),
+	m_TopRow(0),
+	m_RowCount(0),
+	m_DataSize(0),
+	m_FollowTail(true),
+	m_Indexing(false),
+	m_SelectAnchor(kNO_SELECTION),
+	m_SelectCaret(kNO_SELECTION),
+	m_FrameRate(kDEFAULT_FRAME_RATE),
+	m_FrameBudget(kDEFAULT_FRAME_BUDGET),
+	m_Sampling(false)
+{
+	RegisterWindowClass();
+}
+
+CDataViewCtrl::~CDataViewCtrl()
+{
+
+}
+
+void CDataViewCtrl::PreSubclassWindow()
+{
+	CWnd::PreSubclassWindow();
+	InitializeControl();
+}
+
+void CDataViewCtrl::InitializeControl(void)
+{
+	m_Font.CreatePointFont(90, L"Consolas");
+	LOGFONT lf;
+	m_Font.GetLogFont(&lf);
+	lf.lfWeight = FW_BOLD;
+	m_LabelFont.CreateFontIndirect(&lf);
+
+	CClientDC dc(this);
+	auto oldFont = dc.SelectObject(&m_Font);
+	TEXTMETRIC tm;
+	dc.GetTextMetrics(&tm);
+	dc.SelectObject(oldFont);
+	m_RowHeight = tm.tmHeight + tm.tmExternalLeading;
+	m_CharWidth = tm.tmAveCharWidth;
+
+	SetTimer(kREFRESH_TIMER_ID, 1000 / m_FrameRate, nullptr);
+	UpdateScrollBars();
+}
+
+void CDataViewCtrl::SetGovernor(UINT frameRate, size_t frameBudget, bool sampling)
+{
+	m_FrameRate = (std::max)(1u, (std::min)(frameRate, 100u));
+	m_FrameBudget = (std::max)(frameBudget, static_cast<size_t>(1024));
+	m_Sampling = sampling;
+	if (GetSafeHwnd() != nullptr)
+		SetTimer(kREFRESH_TIMER_ID, 1000 / m_FrameRate, nullptr);
+}
+
+void CDataViewCtrl::Attach(DataBufferViewport* viewport, std::mutex* mutex)
+{
+	m_Viewport = viewport;
+	m_Mutex = mutex;
+	Refresh();
+}
+
+void CDataViewCtrl::Refresh(void)
+{
+	m_RowCount = 0;
+	m_DataSize = 0;
+	m_TopRow = 0;
+	m_FollowTail = true;
+	m_Indexing = false;
+	m_SelectAnchor = kNO_SELECTION;
+	m_SelectCaret = kNO_SELECTION;
+	UpdateRows();
+	UpdateScrollBars();
+	Invalidate(FALSE);
+}
+
+void CDataViewCtrl::UpdateRows(void)
+{
+	if (m_Viewport == nullptr || m_Mutex == nullptr)
+		return;
+
+	size_t rowCount = 0;
+	size_t dataSize = 0;
+	bool indexing = false;
+	{
+		std::unique_lock<std::mutex> clk(*m_Mutex);
+		indexing = m_Viewport->Update(m_FrameBudget, m_Sampling);
+		rowCount = m_Viewport->RowCount();
+		dataSize = m_Viewport->DataSize();
+	}
+	if (rowCount == m_RowCount && dataSize == m_DataSize && indexing == m_Indexing)
+		return;
+
+	m_RowCount = rowCount;
+	m_DataSize = dataSize;
+	// 索引还没建到末尾时, 跟随显示直接取数据末尾的行, 不显示索引建到的位置
+	m_Indexing = indexing;
+	if (m_SelectCaret != kNO_SELECTION && m_SelectCaret >= m_RowCount)
+	{
+		m_SelectAnchor = kNO_SELECTION;
+		m_SelectCaret = kNO_SELECTION;
+	}
+	auto visible = VisibleRows();
+	if (m_FollowTail || m_TopRow >= m_RowCount)
+		m_TopRow = m_RowCount > visible ? m_RowCount - visible : 0;
+	UpdateScrollBars();
+	Invalidate(FALSE);
+}
+
+size_t CDataViewCtrl::VisibleRows(void) const
+{
+	CRect client;
+	GetClientRect(client);
+	auto rows = client.Height() / m_RowHeight;
+	return rows > 0 ? (size_t)rows : 1;
+}
+
+void CDataViewCtrl::UpdateScrollBars(void)
+{
+	if (GetSafeHwnd() == nullptr)
+		return;
+
+	SCROLLINFO si;
+	si.cbSize = sizeof(SCROLLINFO);
+	si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS | SIF_DISABLENOSCROLL;
+	si.nMin = 0;
+	si.nMax = m_RowCount > 0 ? (int)(std::min)(m_RowCount - 1, static_cast<size_t>(INT_MAX)) : 0;
+	si.nPage = (UINT)VisibleRows();
+	si.nPos = (int)(std::min)(m_TopRow, static_cast<size_t>(INT_MAX));
+	SetScrollInfo(SB_VERT, &si, TRUE);
+
+	CRect client;
+	GetClientRect(client);
+	si.nMax = kMAX_ROW_CHARS * m_CharWidth;
+	si.nPage = (UINT)client.Width();
+	si.nPos = m_ScrollX;
+	SetScrollInfo(SB_HORZ, &si, TRUE);
+}
+
+void CDataViewCtrl::ScrollToRow(size_t row)
+{
+	auto visible = VisibleRows();
+	auto maxTop = m_RowCount > visible ? m_RowCount - visible : 0;
+	m_TopRow = (std::min)(row, maxTop);
+	m_FollowTail = m_TopRow >= maxTop;
+	UpdateScrollBars();
+	Invalidate(FALSE);
+}
+
+size_t CDataViewCtrl::RowFromPoint(CPoint point) const
+{
+	auto row = m_TopRow + (point.y > 0 ? (size_t)(point.y / m_RowHeight) : 0);
+	if (row >= m_RowCount)
+		row = m_RowCount > 0 ? m_RowCount - 1 : 0;
+	return row;
+}
+
+bool CDataViewCtrl::HasSelection(void) const
+{
+	return m_SelectAnchor != kNO_SELECTION && m_RowCount > 0;
+}
+
+void CDataViewCtrl::Select(size_t row, bool extend)
+{
+	if (!extend || !HasSelection())
+		m_SelectAnchor = row;
+	m_SelectCaret = row;
+	Invalidate(FALSE);
+}
+
+// 有选中的行时复制选中的行, 否则复制全部数据
+void CDataViewCtrl::CopySelection(void)
+{
+	if (m_Viewport == nullptr || m_Mutex == nullptr)
+		return;
+
+	std::wstring text;
+	{
+		std::unique_lock<std::mutex> clk(*m_Mutex);
+		size_t first = 0;
+		size_t last = 0;
+		if (HasSelection())
+		{
+			first = (std::min)(m_SelectAnchor, m_SelectCaret);
+			last = (std::max)(m_SelectAnchor, m_SelectCaret) + 1;
+		}
+		else
+		{
+			m_Viewport->IndexAll();
+			last = m_Viewport->RowCount();
+		}
+		std::vector<DataBufferViewport::Row> rows;
+		for (auto row = first; row < last; row += rows.size())
+		{
+			if (m_Viewport->Rows(row, (std::min)(last - row, kCOPY_ROWS), rows) == 0)
+				break;
+			for (const auto& r : rows)
+			{
+				text += RowText(r).GetString();
+				text += L"\r\n";
+			}
+		}
+	}
+	if (text.empty() || !OpenClipboard())
+		return;
+
+	EmptyClipboard();
+	auto size = (text.length() + 1) * sizeof(wchar_t);
+	auto hglb = GlobalAlloc(GMEM_MOVEABLE, size);
+	if (hglb != nullptr)
+	{
+		auto lpstr = GlobalLock(hglb);
+		memcpy(lpstr, text.c_str(), size);
+		GlobalUnlock(hglb);
+		SetClipboardData(CF_UNICODETEXT, hglb);
+	}
+	CloseClipboard();
+}
+
+void CDataViewCtrl::OnPaint()
+{
+	CPaintDC dc(this);
+	CRect client;
+	GetClientRect(client);
+	if (client.IsRectEmpty())
+		return;
+
+	CDC memDC;
+	CBitmap bitmap;
+	memDC.CreateCompatibleDC(&dc);
+	bitmap.CreateCompatibleBitmap(&dc, client.Width(), client.Height());
+	auto oldBitmap = memDC.SelectObject(&bitmap);
+	auto enabled = IsWindowEnabled();
+	memDC.FillSolidRect(client, GetSysColor(enabled ? COLOR_WINDOW : COLOR_BTNFACE));
+	if (enabled && m_Viewport != nullptr && m_Mutex != nullptr)
+	{
+		auto tail = m_FollowTail && m_Indexing;
+		{
+			std::unique_lock<std::mutex> clk(*m_Mutex);
+			if (tail)
+				m_Viewport->TailRows(VisibleRows(), m_Rows);
+			else
+				m_Viewport->Rows(m_TopRow, VisibleRows() + 1, m_Rows);
+		}
+
+		auto selectFirst = (std::min)(m_SelectAnchor, m_SelectCaret);
+		auto selectLast = (std::max)(m_SelectAnchor, m_SelectCaret);
+		auto oldFont = memDC.SelectObject(&m_Font);
+		memDC.SetBkMode(TRANSPARENT);
+		int y = client.top;
+		auto index = m_TopRow;
+		for (const auto& row : m_Rows)
+		{
+			CRect rc(client.left + 2 - m_ScrollX, y, client.right, y + m_RowHeight);
+			auto text = RowText(row);
+			auto selected = !tail && HasSelection() && index >= selectFirst && index <= selectLast;
+			if (selected)
+				memDC.FillSolidRect(CRect(client.left, y, client.right, y + m_RowHeight), GetSysColor(COLOR_HIGHLIGHT));
+			if (row.skipped > 0)
+			{
+				memDC.SelectObject(&m_Font);
+				memDC.SetTextColor(GetSysColor(COLOR_GRAYTEXT));
+			}
+			else if (row.label)
+			{
+				memDC.SelectObject(&m_LabelFont);
+				memDC.SetTextColor(RGB(0, 0, 255));
+			}
+			else
+			{
+				memDC.SelectObject(&m_Font);
+				memDC.SetTextColor(GetSysColor(COLOR_WINDOWTEXT));
+			}
+			if (selected)
+				memDC.SetTextColor(GetSysColor(COLOR_HIGHLIGHTTEXT));
+			memDC.DrawText(text, rc, DT_LEFT | DT_SINGLELINE | DT_NOPREFIX | DT_EXPANDTABS | DT_NOCLIP);
+			y += m_RowHeight;
+			++index;
+		}
+		memDC.SelectObject(oldFont);
+	}
+	dc.BitBlt(0, 0, client.Width(), client.Height(), &memDC, 0, 0, SRCCOPY);
+	memDC.SelectObject(oldBitmap);
+}
+
+BOOL CDataViewCtrl::OnEraseBkgnd(CDC* pDC)
+{
+	return TRUE;
+}
+
+void CDataViewCtrl::OnSize(UINT nType, int cx, int cy)
+{
+	CWnd::OnSize(nType, cx, cy);
+	if (m_FollowTail)
+		ScrollToRow(m_RowCount);
+	else
+		ScrollToRow(m_TopRow);
+}
+
+void CDataViewCtrl::OnTimer(UINT_PTR nIDEvent)
+{
+	if (nIDEvent == kREFRESH_TIMER_ID)
+	{
+		if (IsWindowEnabled() && IsWindowVisible())
+			UpdateRows();
+		return;
+	}
+	CWnd::OnTimer(nIDEvent);
+}
+
+void CDataViewCtrl::OnVScroll(UINT nSBCode, UINT nPos, CScrollBar* pScrollBar)
+{
+	auto row = m_TopRow;
+	auto visible = VisibleRows();
+	switch (nSBCode)
+	{
+	case SB_LINEUP:
+		row = row > 0 ? row - 1 : 0;
+		break;
+	case SB_LINEDOWN:
+		row += 1;
+		break;
+	case SB_PAGEUP:
+		row = row > visible ? row - visible : 0;
+		break;
+	case SB_PAGEDOWN:
+		row += visible;
+		break;
+	case SB_TOP:
+		row = 0;
+		break;
+	case SB_BOTTOM:
+		row = m_RowCount;
+		break;
+	case SB_THUMBTRACK:
+	case SB_THUMBPOSITION:
+	{
+		SCROLLINFO si;
+		si.cbSize = sizeof(SCROLLINFO);
+		si.fMask = SIF_TRACKPOS;
+		GetScrollInfo(SB_VERT, &si);
+		row = (size_t)si.nTrackPos;
+	}
+	break;
+	default:
+		return;
+	}
+	ScrollToRow(row);
+}
+
+void CDataViewCtrl::OnHScroll(UINT nSBCode, UINT nPos, CScrollBar* pScrollBar)
+{
+	CRect client;
+	GetClientRect(client);
+	auto x = m_ScrollX;
+	switch (nSBCode)
+	{
+	case SB_LINELEFT:
+		x -= m_CharWidth;
+		break;
+	case SB_LINERIGHT:
+		x += m_CharWidth;
+		break;
+	case SB_PAGELEFT:
+		x -= client.Width();
+		break;
+	case SB_PAGERIGHT:
+		x += client.Width();
+		break;
+	case SB_LEFT:
+		x = 0;
+		break;
+	case SB_RIGHT:
+		x = kMAX_ROW_CHARS * m_CharWidth;
+		break;
+	case SB_THUMBTRACK:
+	case SB_THUMBPOSITION:
+	{
+		SCROLLINFO si;
+		si.cbSize = sizeof(SCROLLINFO);
+		si.fMask = SIF_TRACKPOS;
+		GetScrollInfo(SB_HORZ, &si);
+		x = si.nTrackPos;
+	}
+	break;
+	default:
+		return;
+	}
+	auto maxX = kMAX_ROW_CHARS * m_CharWidth - client.Width();
+	m_ScrollX = (std::max)(0, (std::min)(x, maxX));
+	UpdateScrollBars();
+	Invalidate(FALSE);
+}
+
+BOOL CDataViewCtrl::OnMouseWheel(UINT nFlags, short zDelta, CPoint pt)
+{
+	auto rows = (zDelta / WHEEL_DELTA) * kWHEEL_ROWS;
+	if (rows > 0)
+		ScrollToRow(m_TopRow > (size_t)rows ? m_TopRow - rows : 0);
+	else if (rows < 0)
+		ScrollToRow(m_TopRow + (size_t)(-rows));
+	return TRUE;
+}
+
+void CDataViewCtrl::OnLButtonDown(UINT nFlags, CPoint point)
+{
+	SetFocus();
+	// 跟随显示末尾而索引还没建完时, 显示的行没有行号, 不能选择
+	if (m_RowCount > 0 && !(m_FollowTail && m_Indexing))
+	{
+		Select(RowFromPoint(point), (nFlags & MK_SHIFT) != 0);
+		SetCapture();
+	}
+	CWnd::OnLButtonDown(nFlags, point);
+}
+
+void CDataViewCtrl::OnLButtonUp(UINT nFlags, CPoint point)
+{
+	if (GetCapture() == this)
+		ReleaseCapture();
+	CWnd::OnLButtonUp(nFlags, point);
+}
+
+void CDataViewCtrl::OnMouseMove(UINT nFlags, CPoint point)
+{
+	if (GetCapture() == this && (nFlags & MK_LBUTTON) != 0)
+	{
+		// 拖出窗口上下边缘时滚动一行
+		CRect client;
+		GetClientRect(client);
+		if (point.y < client.top)
+			OnVScroll(SB_LINEUP, 0, nullptr);
+		else if (point.y >= client.bottom)
+			OnVScroll(SB_LINEDOWN, 0, nullptr);
+		Select(RowFromPoint(point), true);
+	}
+	CWnd::OnMouseMove(nFlags, point);
+}
+
+void CDataViewCtrl::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
+{
+	switch (nChar)
+	{
+	case VK_UP:
+		OnVScroll(SB_LINEUP, 0, nullptr);
+		break;
+	case VK_DOWN:
+		OnVScroll(SB_LINEDOWN, 0, nullptr);
+		break;
+	case VK_PRIOR:
+		OnVScroll(SB_PAGEUP, 0, nullptr);
+		break;
+	case VK_NEXT:
+		OnVScroll(SB_PAGEDOWN, 0, nullptr);
+		break;
+	case VK_HOME:
+		OnVScroll(SB_TOP, 0, nullptr);
+		break;
+	case VK_END:
+		OnVScroll(SB_BOTTOM, 0, nullptr);
+		break;
+	case 'A':
+		if ((GetKeyState(VK_CONTROL) & 0x80) != 0 && m_RowCount > 0)
+		{
+			m_SelectAnchor = 0;
+			m_SelectCaret = m_RowCount - 1;
+			Invalidate(FALSE);
+		}
+		break;
+	case 'C':
+		if ((GetKeyState(VK_CONTROL) & 0x80) != 0)
+			CopySelection();
+		break;
+	default:
+		CWnd::OnKeyDown(nChar, nRepCnt, nFlags);
+		break;
+	}
+}
+
+UINT CDataViewCtrl::OnGetDlgCode()
+{
+	return DLGC_WANTARROWS;
+}
+
+void CDataViewCtrl::OnEnable(BOOL bEnable)
+{
+	CWnd::OnEnable(bEnable);
+	Invalidate(FALSE);
+}
+
+void CDataViewCtrl::OnDestroy()
+{
+	KillTimer(kREFRESH_TIMER_ID);
+	CWnd::OnDestroy();
+}
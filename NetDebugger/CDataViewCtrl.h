@@ -0,0 +1,64 @@
+#pragma once
+#include <afxwin.h>
+#include <mutex>
+#include <vector>
+#include "DataBufferViewport.h"
+
+class CDataViewCtrl :
+	public CWnd
+{
+public:
+	CDataViewCtrl();
+	virtual ~CDataViewCtrl();
+public:
+	void Attach(DataBufferViewport* viewport, std::mutex* mutex);
+	void Refresh(void);
+	void SetGovernor(UINT frameRate, size_t frameBudget, bool sampling);
+private:
+	void InitializeControl(void);
+	void UpdateRows(void);
+	void UpdateScrollBars(void);
+	void ScrollToRow(size_t row);
+	size_t VisibleRows(void) const;
+	size_t RowFromPoint(CPoint point) const;
+	bool HasSelection(void) const;
+	void Select(size_t row, bool extend);
+	void CopySelection(void);
+private:
+	DataBufferViewport* m_Viewport;
+	std::mutex* m_Mutex;
+	std::vector<DataBufferViewport::Row> m_Rows;
+	CFont m_Font;
+	CFont m_LabelFont;
+	int m_RowHeight;
+	int m_CharWidth;
+	int m_ScrollX;
+	size_t m_TopRow;
+	size_t m_RowCount;
+	size_t m_DataSize;
+	bool m_FollowTail;
+	bool m_Indexing;
+	size_t m_SelectAnchor;
+	size_t m_SelectCaret;
+	UINT m_FrameRate;
+	size_t m_FrameBudget;
+	bool m_Sampling;
+protected:
+	virtual void PreSubclassWindow();
+public:
+	DECLARE_MESSAGE_MAP()
+	afx_msg void OnPaint();
+	afx_msg BOOL OnEraseBkgnd(CDC* pDC);
+	afx_msg void OnSize(UINT nType, int cx, int cy);
+	afx_msg void OnTimer(UINT_PTR nIDEvent);
+	afx_msg void OnVScroll(UINT nSBCode, UINT nPos, CScrollBar* pScrollBar);
+	afx_msg void OnHScroll(UINT nSBCode, UINT nPos, CScrollBar* pScrollBar);
+	afx_msg BOOL OnMouseWheel(UINT nFlags, short zDelta, CPoint pt);
+	afx_msg void OnLButtonDown(UINT nFlags, CPoint point);
+	afx_msg void OnLButtonUp(UINT nFlags, CPoint point);
+	afx_msg void OnMouseMove(UINT nFlags, CPoint point);
+	afx_msg void OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
+	afx_msg UINT OnGetDlgCode();
+	afx_msg void OnEnable(BOOL bEnable);
+	afx_msg void OnDestroy();
+};
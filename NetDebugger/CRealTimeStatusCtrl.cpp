@@ -16,7 +16,14 @@ CRealTimeStatusCtrl::CRealTimeStatusCtrl():
 	m_MaxReadSpeed(0),
 	m_MaxWriteSpeed(0),
 	m_AveReadSpeed(0),
-	m_AveWriteSpeed(0)
+	m_AveWriteSpeed(0),
+	m_LatencyEnabled(false),
+	m_Latency(),
+	m_LoadEnabled(false),
+	m_LoadMessages(0),
+	m_LoadRate(0),
+	m_LoadTargetRate(0),
+	m_LoadUpdateTime(std::chrono::high_resolution_clock::now())
 {
 
 }
@@ -96,6 +103,26 @@ void CRealTimeStatusCtrl::UpdateStatistics(bool connected, uint64_t readBytes, u
 	RedrawWindow();
 }
 
+void CRealTimeStatusCtrl::UpdateLatency(bool enabled, const LatencyHistogram::Summary& summary)
+{
+	m_LatencyEnabled = enabled;
+	m_Latency = summary;
+}
+
+void CRealTimeStatusCtrl::UpdateLoad(bool enabled, uint64_t messages, double targetRate)
+{
+	auto now = std::chrono::high_resolution_clock::now();
+	auto seconds = std::chrono::duration<double>(now - m_LoadUpdateTime).count();
+	if (enabled && m_LoadEnabled && seconds > 0 && messages >= m_LoadMessages)
+		m_LoadRate = (messages - m_LoadMessages) / seconds;
+	else
+		m_LoadRate = 0;
+	m_LoadUpdateTime = now;
+	m_LoadEnabled = enabled;
+	m_LoadMessages = messages;
+	m_LoadTargetRate = targetRate;
+}
+
 BOOL CRealTimeStatusCtrl::OnEraseBkgnd(CDC* pDC)
 {
 	return FALSE;
@@ -112,11 +139,24 @@ int CRealTimeStatusCtrl::DrawStatisicsString(Gdiplus::Graphics& graphics,const G
 	CString statisticsTXC;
 	CString statisticsRXS;
 	CString statisticsTXS;
+	CString statisticsLAT;
+	CString statisticsLOD;
 
 	statisticsRXC.Format(LSTEXT(MAINWND.STATISTICSCTRL.RECV.BYTES), std::to_wstring(m_readBytes).c_str());
 	statisticsTXC.Format(LSTEXT(MAINWND.STATISTICSCTRL.SEND.BYTES), std::to_wstring(m_writeBytes).c_str());
 	statisticsRXS.Format(LSTEXT(MAINWND.STATISTICSCTRL.RECV.SPEED), GetReadSpeedString().GetString());
 	statisticsTXS.Format(LSTEXT(MAINWND.STATISTICSCTRL.SEND.SPEED), GetWriteSpeedString().GetString());
+	if (m_LatencyEnabled)
+		statisticsLAT.Format(LSTEXT(MAINWND.STATISTICSCTRL.LATENCY), FormatLatency(m_Latency).GetString());
+	if (m_LoadEnabled)
+	{
+		CString achieved;
+		CString target = L"-";
+		achieved.Format(L"%.0lf/s", m_LoadRate);
+		if (m_LoadTargetRate > 0)
+			target.Format(L"%.0lf/s", m_LoadTargetRate);
+		statisticsLOD.Format(LSTEXT(MAINWND.STATISTICSCTRL.LOAD), achieved.GetString(), target.GetString());
+	}
 
 	Gdiplus::StringFormat sf;
 	sf.SetAlignment(Gdiplus::StringAlignment::StringAlignmentNear);
@@ -143,7 +183,21 @@ int CRealTimeStatusCtrl::DrawStatisicsString(Gdiplus::Graphics& graphics,const G
 	textRectTXS.Y = textRectRXS.GetBottom();
 	textRectTXS.Height = (Gdiplus::REAL)(MeasureStringHeight(graphics, statisticsTXS, font, (int)textRectTXS.Width) + 3);
 
-	auto bottom = textRectTXS.GetBottom();
+	auto textRectLAT = clientRect;
+	textRectLAT.Inflate(-6.0f, -6.0f);
+	textRectLAT.Y = textRectTXS.GetBottom();
+	textRectLAT.Height = 0;
+	if (m_LatencyEnabled)
+		textRectLAT.Height = (Gdiplus::REAL)(MeasureStringHeight(graphics, statisticsLAT, font, (int)textRectLAT.Width) + 3);
+
+	auto textRectLOD = clientRect;
+	textRectLOD.Inflate(-6.0f, -6.0f);
+	textRectLOD.Y = textRectLAT.GetBottom();
+	textRectLOD.Height = 0;
+	if (m_LoadEnabled)
+		textRectLOD.Height = (Gdiplus::REAL)(MeasureStringHeight(graphics, statisticsLOD, font, (int)textRectLOD.Width) + 3);
+
+	auto bottom = textRectLOD.GetBottom();
 	auto textBKRect = clientRect;
 	textBKRect.Height = bottom - textBKRect.GetTop();
 
@@ -179,6 +233,26 @@ int CRealTimeStatusCtrl::DrawStatisicsString(Gdiplus::Graphics& graphics,const G
 	textRectTXS.Offset(-1.0f, -1.0f);
 	graphics.DrawString(statisticsTXS.GetString(), statisticsTXS.GetLength(), &font, textRectTXS, &sf, &textBrush);
 
+	if (m_LatencyEnabled)
+	{
+		textBrush.SetColor(Gdiplus::Color::Black);
+		textRectLAT.Offset(1.0f, 1.0f);
+		graphics.DrawString(statisticsLAT.GetString(), statisticsLAT.GetLength(), &font, textRectLAT, &sf, &textBrush);
+		textBrush.SetColor(Gdiplus::Color(255, 204, 102));
+		textRectLAT.Offset(-1.0f, -1.0f);
+		graphics.DrawString(statisticsLAT.GetString(), statisticsLAT.GetLength(), &font, textRectLAT, &sf, &textBrush);
+	}
+
+	if (m_LoadEnabled)
+	{
+		textBrush.SetColor(Gdiplus::Color::Black);
+		textRectLOD.Offset(1.0f, 1.0f);
+		graphics.DrawString(statisticsLOD.GetString(), statisticsLOD.GetLength(), &font, textRectLOD, &sf, &textBrush);
+		textBrush.SetColor(Gdiplus::Color(153, 204, 255));
+		textRectLOD.Offset(-1.0f, -1.0f);
+		graphics.DrawString(statisticsLOD.GetString(), statisticsLOD.GetLength(), &font, textRectLOD, &sf, &textBrush);
+	}
+
 	return (int)bottom;
 }
 
@@ -322,4 +396,31 @@ CString CRealTimeStatusCtrl::GetWriteSpeedString(void) const
 		return HumanReadableSize(0);
 	auto speed = m_WriteSpeeds.back();
 	return HumanReadableSize(m_AveWriteSpeed);
-}
\ No newline at end of file
+}
+static CString HumanReadableLatency(uint64_t ns)
+{
+	CString result;
+	if (ns < 1000)
+		result.Format(L"%lluns", (unsigned long long)ns);
+	else if (ns < 1000 * 1000)
+		result.Format(L"%.1lfus", ns / 1000.0);
+	else if (ns < 1000 * 1000 * 1000)
+		result.Format(L"%.2lfms", ns / 1000000.0);
+	else
+		result.Format(L"%.2lfs", ns / 1000000000.0);
+	return result;
+}
+
+CString CRealTimeStatusCtrl::FormatLatency(const LatencyHistogram::Summary& summary)
+{
+	if (summary.count == 0)
+		return L"-";
+	CString result;
+	result.Format(L"P50 %s  P90 %s  P99 %s  P99.9 %s  Max %s",
+		HumanReadableLatency(summary.p50).GetString(),
+		HumanReadableLatency(summary.p90).GetString(),
+		HumanReadableLatency(summary.p99).GetString(),
+		HumanReadableLatency(summary.p999).GetString(),
+		HumanReadableLatency(summary.max).GetString());
+	return result;
+}
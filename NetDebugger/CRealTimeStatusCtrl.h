@@ -1,5 +1,6 @@
 #pragma once
 #include <afxwin.h>
+#include "LatencyHistogram.h"
 class CRealTimeStatusCtrl :
 	public CWnd
 {
@@ -15,9 +16,16 @@ public:
 		m_MaxWriteSpeed = 0;
 		m_readBytes = 0;
 		m_writeBytes = 0;
+		m_Latency = LatencyHistogram::Summary();
+		m_LoadMessages = 0;
+		m_LoadRate = 0;
 		m_lastUpdateTime = std::chrono::high_resolution_clock::now();
 	}
 	void UpdateStatistics(bool connected, uint64_t readBytes, uint64_t writeBytes);
+	void UpdateLatency(bool enabled, const LatencyHistogram::Summary& summary);
+	static CString FormatLatency(const LatencyHistogram::Summary& summary);
+	// 定时发送的实际速率与目标速率(条/秒), 目标为 0 时表示闭环发送
+	void UpdateLoad(bool enabled, uint64_t messages, double targetRate);
 private:
 	void AddSpeedPoint(uint64_t readspeed, uint64_t writespeed);
 	int DrawStatisicsString(Gdiplus::Graphics& graphics, const Gdiplus::RectF& clientRect);
@@ -34,6 +42,13 @@ private:
 	uint64_t m_MaxWriteSpeed;
 	uint64_t m_AveReadSpeed;
 	uint64_t m_AveWriteSpeed;
+	bool m_LatencyEnabled;
+	LatencyHistogram::Summary m_Latency;
+	bool m_LoadEnabled;
+	uint64_t m_LoadMessages;
+	double m_LoadRate;
+	double m_LoadTargetRate;
+	std::chrono::high_resolution_clock::time_point m_LoadUpdateTime;
 	std::vector<uint64_t> m_ReadSpeeds;
 	std::vector<uint64_t> m_WriteSpeeds;
 	std::chrono::high_resolution_clock::time_point m_lastUpdateTime;
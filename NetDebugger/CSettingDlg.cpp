@@ -47,6 +47,18 @@ BOOL CSettingDlg::OnInitDialog()
 			m_LanguageCtrl.SetCurSel(item);
 		++index;
 	}
+	SetDlgItemInt(IDC_EDIT_FRAME_RATE, theApp.GetProfileInt(L"Setting", L"DisplayFrameRate", 20), FALSE);
+	SetDlgItemInt(IDC_EDIT_FRAME_BUDGET, theApp.GetProfileInt(L"Setting", L"DisplayFrameBudget", 4096), FALSE);
+	CheckDlgButton(IDC_CHECK_SAMPLING, theApp.GetProfileInt(L"Setting", L"DisplaySampling", FALSE));
+	SetDlgItemInt(IDC_EDIT_FILE_BLOCK_SIZE, theApp.GetProfileInt(L"Setting", L"FileBlockSize", 1024), FALSE);
+	SetDlgItemInt(IDC_EDIT_FILE_BLOCK_COUNT, theApp.GetProfileInt(L"Setting", L"FileBlockCount", 4), FALSE);
+	CheckDlgButton(IDC_CHECK_SEND_MICROSECOND, theApp.GetProfileInt(L"Setting", L"AutoSendMicrosecond", FALSE));
+	SetDlgItemInt(IDC_EDIT_SEND_BURST, theApp.GetProfileInt(L"Setting", L"AutoSendBurst", 1), FALSE);
+	CheckDlgButton(IDC_CHECK_SEND_POISSON, theApp.GetProfileInt(L"Setting", L"AutoSendPoisson", FALSE));
+	CheckDlgButton(IDC_CHECK_SEND_CLOSED_LOOP, theApp.GetProfileInt(L"Setting", L"AutoSendClosedLoop", FALSE));
+	CheckDlgButton(IDC_CHECK_SEND_TEMPLATE, theApp.GetProfileInt(L"Setting", L"SendTemplate", FALSE));
+	CheckDlgButton(IDC_CHECK_LATENCY_PROBE, theApp.GetProfileInt(L"Setting", L"LatencyProbe", FALSE));
+	SetDlgItemText(IDC_EDIT_LATENCY_DELIMITER, theApp.GetProfileString(L"Setting", L"LatencyDelimiter", L""));
 	return TRUE;
 }
 
@@ -59,5 +71,24 @@ void CSettingDlg::OnOK()
 		auto i = (int)m_LanguageCtrl.GetItemData(sel);
 		theApp.GetLS().SetLanguage(m_Languages[i].first);
 	}
+	auto frameRate = GetDlgItemInt(IDC_EDIT_FRAME_RATE, nullptr, FALSE);
+	auto frameBudget = GetDlgItemInt(IDC_EDIT_FRAME_BUDGET, nullptr, FALSE);
+	theApp.WriteProfileInt(L"Setting", L"DisplayFrameRate", (std::max)(1u, (std::min)(frameRate, 100u)));
+	theApp.WriteProfileInt(L"Setting", L"DisplayFrameBudget", (std::max)(1u, frameBudget));
+	theApp.WriteProfileInt(L"Setting", L"DisplaySampling", IsDlgButtonChecked(IDC_CHECK_SAMPLING));
+	auto fileBlockSize = GetDlgItemInt(IDC_EDIT_FILE_BLOCK_SIZE, nullptr, FALSE);
+	auto fileBlockCount = GetDlgItemInt(IDC_EDIT_FILE_BLOCK_COUNT, nullptr, FALSE);
+	theApp.WriteProfileInt(L"Setting", L"FileBlockSize", (std::max)(4u, (std::min)(fileBlockSize, 16384u)));
+	theApp.WriteProfileInt(L"Setting", L"FileBlockCount", (std::max)(1u, (std::min)(fileBlockCount, 64u)));
+	auto sendBurst = GetDlgItemInt(IDC_EDIT_SEND_BURST, nullptr, FALSE);
+	theApp.WriteProfileInt(L"Setting", L"AutoSendMicrosecond", IsDlgButtonChecked(IDC_CHECK_SEND_MICROSECOND));
+	theApp.WriteProfileInt(L"Setting", L"AutoSendBurst", (std::max)(1u, (std::min)(sendBurst, 10000u)));
+	theApp.WriteProfileInt(L"Setting", L"AutoSendPoisson", IsDlgButtonChecked(IDC_CHECK_SEND_POISSON));
+	theApp.WriteProfileInt(L"Setting", L"AutoSendClosedLoop", IsDlgButtonChecked(IDC_CHECK_SEND_CLOSED_LOOP));
+	theApp.WriteProfileInt(L"Setting", L"SendTemplate", IsDlgButtonChecked(IDC_CHECK_SEND_TEMPLATE));
+	CString delimiter;
+	GetDlgItemText(IDC_EDIT_LATENCY_DELIMITER, delimiter);
+	theApp.WriteProfileInt(L"Setting", L"LatencyProbe", IsDlgButtonChecked(IDC_CHECK_LATENCY_PROBE));
+	theApp.WriteProfileString(L"Setting", L"LatencyDelimiter", delimiter.Trim());
 	CDialogEx::OnOK();
 }
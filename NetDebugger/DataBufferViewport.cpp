@@ -0,0 +1,497 @@
+﻿#include "pch.h"
+#include "DataBufferViewport.h"
+
+constexpr size_t kROWS_PER_CHECKPOINT = 64;
+constexpr size_t kMAX_ROW_UNITS = 256;
+constexpr size_t kHEX_ROW_BYTES = 16;
+constexpr size_t kWINDOW_SIZE = 64 * 1024;
+// 切换编码后重建已有数据的索引不受每帧预算限制, 每次最多占用的时间
+constexpr auto kREBUILD_SLICE = std::chrono::milliseconds(20);
+
+DataBufferViewport::DataBufferViewport(const ReceiveStore& store) :
+	m_Store(store),
+	m_Encoding(TextEncodeType::ASCII),
+	m_Labels(),
+	m_Skips(),
+	m_Checkpoints(),
+	m_Marks(),
+	m_End({ 0, 0, 0 }),
+	m_RowCount(0),
+	m_Backlog(0),
+	m_Window(),
+	m_WindowOffset(0)
+{
+	ResetIndex();
+}
+
+void DataBufferViewport::Encoding(TextEncodeType type)
+{
+	if (m_Encoding != type)
+	{
+		m_Encoding = type;
+		ResetIndex();
+	}
+}
+
+void DataBufferViewport::AddLabel(const std::wstring& text)
+{
+	Label label;
+	label.offset = m_Store.Size();
+	label.text = text;
+	m_Labels.push_back(label);
+}
+
+void DataBufferViewport::Reset(void)
+{
+	m_Labels.clear();
+	ResetIndex();
+}
+
+void DataBufferViewport::ResetIndex(void)
+{
+	m_Skips.clear();
+	m_Checkpoints.assign(1, Cursor{ 0, 0, 0 });
+	m_Marks.clear();
+	m_End = Cursor{ 0, 0, 0 };
+	m_RowCount = 0;
+	m_Backlog = m_Store.Size();
+	m_Window.clear();
+	m_WindowOffset = 0;
+}
+
+// 从上次位置继续建立行索引，最多处理 budget 字节，返回 true 表示还有未处理的数据
+// sampling 模式下超出预算的数据不再显示，只记录一个跳过行
+bool DataBufferViewport::Update(size_t budget, bool sampling)
+{
+	// 关闭抽样后重建索引, 之前跳过的数据重新显示
+	if (m_Store.Size() < m_End.offset || m_Labels.size() < m_End.label || (!sampling && !m_Skips.empty()))
+		ResetIndex();
+
+	if (m_Encoding == TextEncodeType::HEX)
+	{
+		// 重建前已有的数据不抽样
+		auto total = m_Store.Size();
+		auto start = (std::max)(m_End.offset, m_Backlog);
+		if (sampling && total - start > budget)
+		{
+			IndexHex(start + budget);
+			SkipToEnd();
+		}
+		IndexHex(total);
+		return false;
+	}
+
+	// 重建索引时已有的数据按时间片尽快处理, 不受每帧预算限制, 也不抽样
+	if (m_End.offset < m_Backlog)
+	{
+		auto deadline = std::chrono::steady_clock::now() + kREBUILD_SLICE;
+		while (m_End.offset < m_Backlog && Advance())
+		{
+			if (m_RowCount % kROWS_PER_CHECKPOINT == 0 && std::chrono::steady_clock::now() >= deadline)
+				return true;
+		}
+	}
+
+	auto start = m_End.offset;
+	while (m_End.offset - start < budget)
+	{
+		if (!Advance())
+			return false;
+	}
+	if (!sampling)
+		return true;
+	SkipToEnd();
+	return false;
+}
+
+// 一次建立全部数据的索引, 复制全部内容前调用
+void DataBufferViewport::IndexAll(void)
+{
+	if (m_Store.Size() < m_End.offset || m_Labels.size() < m_End.label)
+		ResetIndex();
+	if (m_Encoding == TextEncodeType::HEX)
+		IndexHex(m_Store.Size());
+	else
+		while (Advance());
+}
+
+bool DataBufferViewport::Advance(void)
+{
+	auto cursor = m_End;
+	size_t length = 0;
+	bool label = false;
+	if (!Step(cursor, length, label, false))
+		return false;
+	m_End = cursor;
+	if (++m_RowCount % kROWS_PER_CHECKPOINT == 0)
+		m_Checkpoints.push_back(m_End);
+	return true;
+}
+
+// HEX 每行固定长度, 不需要逐行扫描, 只记录 limit 之前每个标签行的行号
+void DataBufferViewport::IndexHex(size_t limit)
+{
+	for (;;)
+	{
+		auto next = m_End.label < m_Labels.size() ? m_Labels[m_End.label].offset : SIZE_MAX;
+		if (m_End.skip < m_Skips.size())
+			next = (std::min)(next, m_Skips[m_End.skip].offset);
+		auto stop = (std::min)(next, limit);
+		auto rows = (stop - m_End.offset) / kHEX_ROW_BYTES;
+		m_End.offset += rows * kHEX_ROW_BYTES;
+		m_RowCount += rows;
+		if (next > limit)
+			return;
+
+		// 标签或跳过行前不足一行的数据单独成行
+		if (m_End.offset < next)
+		{
+			m_End.offset = next;
+			++m_RowCount;
+		}
+		m_Marks.push_back({ m_End, m_RowCount });
+		size_t length = 0;
+		bool label = false;
+		Step(m_End, length, label, false);
+		++m_RowCount;
+	}
+}
+
+void DataBufferViewport::SkipToEnd(void)
+{
+	auto skipped = m_Store.Size() - m_End.offset;
+	skipped -= skipped % UnitSize();
+	if (skipped == 0)
+		return;
+	m_Skips.push_back({ m_End.offset, skipped });
+}
+
+size_t DataBufferViewport::RowCount(void)
+{
+	auto cursor = m_End;
+	size_t length = 0;
+	bool label = false;
+	if (Step(cursor, length, label, true))
+		return m_RowCount + 1;
+	return m_RowCount;
+}
+
+size_t DataBufferViewport::Rows(size_t first, size_t count, std::vector<Row>& rows)
+{
+	rows.clear();
+	size_t index = 0;
+	auto cursor = SeekRow(first, index);
+	while (rows.size() < count)
+	{
+		auto start = cursor;
+		size_t length = 0;
+		bool label = false;
+		if (!Step(cursor, length, label, true))
+			break;
+		if (index >= first)
+			rows.push_back(MakeRow(start, length, label));
+		++index;
+	}
+	return rows.size();
+}
+
+// 行索引还没有建到末尾时跟随显示用: 从末尾向前找到行首, 直接取最后 count 行
+size_t DataBufferViewport::TailRows(size_t count, std::vector<Row>& rows)
+{
+	auto total = m_Store.Size();
+	auto unit = UnitSize();
+	auto span = (count + 1) * MaxRowBytes();
+	auto start = total > span ? total - span : 0;
+
+	// 末尾离索引位置不远时从索引位置往后走, 行数不够再从索引中取
+	auto base = m_End.offset;
+	if (m_End.skip < m_Skips.size())
+		base = m_Skips[m_End.skip].offset + m_Skips[m_End.skip].size;
+	auto fromEnd = m_Encoding == TextEncodeType::HEX || start <= base;
+	if (!fromEnd)
+	{
+		// 行从最近的标签或索引位置开始按编码单元对齐, 再向前找换行作为行首;
+		// 一行最大长度内没有换行时按从 base 起每行最大长度折行计算, base 之后有更早的换行时只是近似位置
+		auto label = LabelAfter(start, m_End.label);
+		if (label > m_End.label && m_Labels[label - 1].offset > base)
+			base = m_Labels[label - 1].offset;
+		start -= (start - base) % unit;
+		auto back = (std::min)(start - base, MaxRowBytes());
+		size_t available = 0;
+		auto data = back > 0 ? Fetch(start - back, back, available) : nullptr;
+		auto i = (std::min)(available, back);
+		for (; data != nullptr && i >= unit; i -= unit)
+		{
+			if (IsNewLine(data + i - unit))
+				break;
+		}
+		if (data != nullptr && i >= unit)
+			start = start - back + i;
+		else
+			start -= (start - base) % MaxRowBytes();
+	}
+
+	// 先只确定行的位置, 最后 count 行才解码
+	struct Position
+	{
+		Cursor start;
+		size_t length;
+		bool label;
+	};
+	std::vector<Position> positions;
+	auto cursor = fromEnd ? m_End : SeekOffset(start);
+	for (;;)
+	{
+		Position position{ cursor, 0, false };
+		if (!Step(cursor, position.length, position.label, true))
+			break;
+		positions.push_back(position);
+	}
+
+	rows.clear();
+	auto first = positions.size() > count ? positions.size() - count : 0;
+	auto missing = count - (positions.size() - first);
+	if (fromEnd && missing > 0)
+		Rows(m_RowCount > missing ? m_RowCount - missing : 0, (std::min)(missing, m_RowCount), rows);
+	for (auto i = first; i < positions.size(); ++i)
+		rows.push_back(MakeRow(positions[i].start, positions[i].length, positions[i].label));
+	return rows.size();
+}
+
+DataBufferViewport::Cursor DataBufferViewport::SeekRow(size_t row, size_t& index)
+{
+	if (m_Encoding == TextEncodeType::HEX)
+	{
+		// 找到 row 之前最后一个标签行或跳过行, 之后的数据行直接按行长计算偏移
+		index = row;
+		auto it = std::upper_bound(m_Marks.begin(), m_Marks.end(), row, [](size_t value, const Mark& mark) { return value < mark.row; });
+		if (it == m_Marks.begin())
+			return Cursor{ row * kHEX_ROW_BYTES, 0, 0 };
+		--it;
+		auto cursor = it->cursor;
+		if (it->row == row)
+			return cursor;
+		size_t length = 0;
+		bool label = false;
+		Step(cursor, length, label, true);
+		cursor.offset += (row - it->row - 1) * kHEX_ROW_BYTES;
+		return cursor;
+	}
+
+	auto checkpoint = row / kROWS_PER_CHECKPOINT;
+	if (checkpoint >= m_Checkpoints.size())
+		checkpoint = m_Checkpoints.size() - 1;
+	index = checkpoint * kROWS_PER_CHECKPOINT;
+	return m_Checkpoints[checkpoint];
+}
+
+DataBufferViewport::Cursor DataBufferViewport::SeekOffset(size_t offset)
+{
+	// 落在跳过范围内时从跳过行开始
+	auto skip = std::upper_bound(m_Skips.begin(), m_Skips.end(), offset, [](size_t value, const Skip& skip) { return value < skip.offset + skip.size; });
+	if (skip != m_Skips.end() && skip->offset < offset)
+		offset = skip->offset;
+	return Cursor{ offset, LabelAfter(offset, 0), static_cast<size_t>(skip - m_Skips.begin()) };
+}
+
+size_t DataBufferViewport::LabelAfter(size_t offset, size_t first) const
+{
+	auto it = std::lower_bound(m_Labels.begin() + first, m_Labels.end(), offset, [](const Label& label, size_t value) { return label.offset < value; });
+	return static_cast<size_t>(it - m_Labels.begin());
+}
+
+DataBufferViewport::Row DataBufferViewport::MakeRow(const Cursor& start, size_t length, bool label)
+{
+	Row row;
+	row.offset = start.offset;
+	row.skipped = 0;
+	row.label = label;
+	if (label && start.skip < m_Skips.size() && m_Skips[start.skip].offset <= start.offset)
+		row.skipped = m_Skips[start.skip].size;
+	else if (label)
+		row.text = m_Labels[start.label].text;
+	else
+		row.text = DecodeRow(start.offset, length);
+	return row;
+}
+
+bool DataBufferViewport::Step(Cursor& cursor, size_t& length, bool& label, bool partial)
+{
+	// 跳过行占一行, 范围内的标签不显示
+	if (cursor.skip < m_Skips.size() && m_Skips[cursor.skip].offset <= cursor.offset)
+	{
+		label = true;
+		length = 0;
+		cursor.offset = m_Skips[cursor.skip].offset + m_Skips[cursor.skip].size;
+		cursor.label = LabelAfter(cursor.offset, cursor.label);
+		++cursor.skip;
+		return true;
+	}
+	if (cursor.label < m_Labels.size() && m_Labels[cursor.label].offset <= cursor.offset)
+	{
+		label = true;
+		length = 0;
+		++cursor.label;
+		return true;
+	}
+
+	label = false;
+	auto total = m_Store.Size();
+	if (cursor.offset >= total)
+		return false;
+
+	auto limit = total - cursor.offset;
+	auto final = partial;
+	auto next = SIZE_MAX;
+	if (cursor.label < m_Labels.size())
+		next = m_Labels[cursor.label].offset;
+	if (cursor.skip < m_Skips.size())
+		next = (std::min)(next, m_Skips[cursor.skip].offset);
+	if (next - cursor.offset <= limit)
+	{
+		limit = next - cursor.offset;
+		final = true;
+	}
+
+	size_t available = 0;
+	auto data = Fetch(cursor.offset, (std::min)(limit, MaxRowBytes() + UnitSize()), available);
+	if (data == nullptr)
+		return false;
+	if (available > limit)
+		available = limit;
+
+	length = MeasureRow(data, available, final);
+	if (length == 0)
+		return false;
+	cursor.offset += length;
+	return true;
+}
+
+size_t DataBufferViewport::MeasureRow(const uint8_t* data, size_t length, bool final) const
+{
+	if (m_Encoding == TextEncodeType::HEX)
+	{
+		if (length >= kHEX_ROW_BYTES)
+			return kHEX_ROW_BYTES;
+		return final ? length : 0;
+	}
+
+	auto unit = UnitSize();
+	auto maxBytes = MaxRowBytes();
+	auto scan = (std::min)(length, maxBytes);
+	scan -= scan % unit;
+	if (unit == 1)
+	{
+		auto p = static_cast<const uint8_t*>(memchr(data, '\n', scan));
+		if (p != nullptr)
+			return static_cast<size_t>(p - data) + 1;
+	}
+	else
+	{
+		for (size_t i = 0; i < scan; i += unit)
+		{
+			if (IsNewLine(data + i))
+				return i + unit;
+		}
+	}
+
+	if (length > maxBytes || (final && length == maxBytes))
+	{
+		auto cut = maxBytes;
+		if (m_Encoding == TextEncodeType::UTF8 && length > maxBytes)
+		{
+			while (cut > 0 && (data[cut] & 0xC0) == 0x80)
+				--cut;
+			if (cut == 0)
+				cut = maxBytes;
+		}
+		return cut;
+	}
+	return final ? length : 0;
+}
+
+bool DataBufferViewport::IsNewLine(const uint8_t* data) const
+{
+	switch (m_Encoding)
+	{
+	case TextEncodeType::UTF16LE:
+		return data[0] == '\n' && data[1] == 0;
+	case TextEncodeType::UTF16BE:
+		return data[0] == 0 && data[1] == '\n';
+	case TextEncodeType::UTF32LE:
+		return data[0] == '\n' && data[1] == 0 && data[2] == 0 && data[3] == 0;
+	case TextEncodeType::UTF32BE:
+		return data[0] == 0 && data[1] == 0 && data[2] == 0 && data[3] == '\n';
+	case TextEncodeType::HEX:
+		return false;
+	default:
+		return data[0] == '\n';
+	}
+}
+
+size_t DataBufferViewport::UnitSize(void) const
+{
+	switch (m_Encoding)
+	{
+	case TextEncodeType::UTF16LE:
+	case TextEncodeType::UTF16BE:
+		return sizeof(uint16_t);
+	case TextEncodeType::UTF32LE:
+	case TextEncodeType::UTF32BE:
+		return sizeof(uint32_t);
+	default:
+		return 1;
+	}
+}
+
+size_t DataBufferViewport::MaxRowBytes(void) const
+{
+	if (m_Encoding == TextEncodeType::HEX)
+		return kHEX_ROW_BYTES;
+	return kMAX_ROW_UNITS * UnitSize();
+}
+
+const uint8_t* DataBufferViewport::Fetch(size_t offset, size_t size, size_t& available)
+{
+	available = 0;
+	auto total = m_Store.Size();
+	if (offset >= total)
+		return nullptr;
+	if (size > total - offset)
+		size = total - offset;
+
+	if (offset < m_WindowOffset || offset + size > m_WindowOffset + m_Window.size())
+	{
+		auto length = (std::max)(size, kWINDOW_SIZE);
+		if (length > total - offset)
+			length = total - offset;
+		m_Window.resize(length);
+		m_Window.resize(m_Store.CopyData(offset, length, m_Window.data()));
+		m_WindowOffset = offset;
+	}
+	available = m_WindowOffset + m_Window.size() - offset;
+	return m_Window.data() + (offset - m_WindowOffset);
+}
+
+std::wstring DataBufferViewport::DecodeRow(size_t offset, size_t length)
+{
+	size_t available = 0;
+	auto data = Fetch(offset, length, available);
+	if (data == nullptr)
+		return std::wstring();
+	if (available > length)
+		available = length;
+
+	std::vector<uint8_t> bytes(data, data + available);
+	if (m_Encoding == TextEncodeType::HEX)
+	{
+		wchar_t address[32];
+		swprintf_s(address, L"%08zX  ", offset);
+		return address + Transform::bin_string_to_hexwstring_format(bytes);
+	}
+
+	auto text = Transform::DecodeToWString(bytes, m_Encoding);
+	while (!text.empty() && (text.back() == L'\n' || text.back() == L'\r'))
+		text.pop_back();
+	return text;
+}
@@ -0,0 +1,85 @@
+﻿#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ReceiveStore.h"
+#include "TextEncodeType.h"
+
+class DataBufferViewport
+{
+public:
+	struct Row
+	{
+		std::wstring text;
+		size_t offset;
+		size_t skipped;
+		bool label;
+	};
+public:
+	DataBufferViewport(void) = delete;
+	DataBufferViewport(const DataBufferViewport&) = delete;
+	DataBufferViewport(const ReceiveStore& store);
+	~DataBufferViewport(void) = default;
+public:
+	TextEncodeType Encoding(void) const { return m_Encoding; }
+	void Encoding(TextEncodeType type);
+	void AddLabel(const std::wstring& text);
+	void Reset(void);
+	bool Update(size_t budget, bool sampling);
+	void IndexAll(void);
+	size_t RowCount(void);
+	size_t DataSize(void) const { return m_Store.Size(); }
+	size_t Rows(size_t first, size_t count, std::vector<Row>& rows);
+	size_t TailRows(size_t count, std::vector<Row>& rows);
+private:
+	struct Cursor
+	{
+		size_t offset;
+		size_t label;
+		size_t skip;
+	};
+	struct Label
+	{
+		size_t offset;
+		std::wstring text;
+	};
+	// 抽样时不显示的数据范围, 只属于当前索引, 重建索引或关闭抽样时丢弃, 数据和标签都不改动
+	struct Skip
+	{
+		size_t offset;
+		size_t size;
+	};
+	// HEX 模式下标签行和跳过行的位置, 两者之间的数据行按固定长度计算
+	struct Mark
+	{
+		Cursor cursor;
+		size_t row;
+	};
+	void ResetIndex(void);
+	bool Advance(void);
+	void IndexHex(size_t limit);
+	Cursor SeekRow(size_t row, size_t& index);
+	Cursor SeekOffset(size_t offset);
+	size_t LabelAfter(size_t offset, size_t first) const;
+	Row MakeRow(const Cursor& start, size_t length, bool label);
+	void SkipToEnd(void);
+	bool Step(Cursor& cursor, size_t& length, bool& label, bool partial);
+	size_t MeasureRow(const uint8_t* data, size_t length, bool final) const;
+	bool IsNewLine(const uint8_t* data) const;
+	size_t UnitSize(void) const;
+	size_t MaxRowBytes(void) const;
+	const uint8_t* Fetch(size_t offset, size_t size, size_t& available);
+	std::wstring DecodeRow(size_t offset, size_t length);
+private:
+	const ReceiveStore& m_Store;
+	TextEncodeType m_Encoding;
+	std::vector<Label> m_Labels;
+	std::vector<Skip> m_Skips;
+	std::vector<Cursor> m_Checkpoints;
+	std::vector<Mark> m_Marks;
+	Cursor m_End;
+	size_t m_RowCount;
+	size_t m_Backlog;
+	std::vector<uint8_t> m_Window;
+	size_t m_WindowOffset;
+};
@@ -0,0 +1,77 @@
+﻿#include "pch.h"
+#include "FileSender.h"
+
+FileSender::FileSender(std::shared_ptr<IAsyncChannel> channel, size_t blockSize, size_t blockCount, size_t writeSize) :
+	m_Channel(channel),
+	m_Options(),
+	m_FilePath(),
+	m_FileLength(0),
+	m_SentLength(0),
+	m_Cancel(false),
+	m_Stoped(true),
+	m_OnProgress(nullptr),
+	m_OnCompletion(nullptr)
+{
+	m_Options.blockSize = blockSize;
+	m_Options.blockCount = blockCount;
+	m_Options.writeSize = writeSize;
+}
+
+bool FileSender::Open(const CString& fileName, CFileException* ex)
+{
+	// 只在这里检查文件并取得长度, 打开失败时可以给出原因; 发送时由通道打开文件
+	CFile file;
+	if (!file.Open(fileName, CFile::modeRead | CFile::shareDenyWrite, ex))
+		return false;
+	m_FilePath = file.GetFilePath();
+	m_FileLength = file.GetLength();
+	file.Close();
+	return true;
+}
+
+void FileSender::Start(ProgressHandler progress, CompletionHandler completion)
+{
+	m_OnProgress = progress;
+	m_OnCompletion = completion;
+	m_Stoped = false;
+	auto self = shared_from_this();
+	// 通道支持时由内核直接发送文件, 否则由通道的默认实现预读并分块写入
+	auto started = m_Channel->SendFile(
+		std::wstring(m_FilePath.GetString()),
+		0,
+		m_FileLength,
+		m_Options,
+		[self](size_t io_bytes)
+	{
+		auto sentLength = self->m_SentLength += io_bytes;
+		if (self->m_OnProgress)
+			self->m_OnProgress(io_bytes, sentLength, self->m_FileLength);
+		return !self->m_Cancel;
+	},
+		[self](bool ok, size_t io_bytes)
+	{
+		if (self->m_Cancel)
+			self->Finish(Result::Canceled);
+		else
+			self->Finish(ok ? Result::Completed : Result::Failed);
+	});
+	if (!started)
+		Finish(Result::Failed);
+}
+
+void FileSender::Cancel(void)
+{
+	// 在下一次回报进度时中止
+	m_Cancel = true;
+}
+
+void FileSender::Finish(Result result)
+{
+	if (m_Stoped.exchange(true))
+		return;
+	// 释放回调持有的引用, 避免循环引用
+	auto completion = std::move(m_OnCompletion);
+	m_OnCompletion = nullptr;
+	if (completion)
+		completion(result);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include "IAsyncStream.h"
+
+class FileSender : public std::enable_shared_from_this<FileSender>
+{
+public:
+	enum class Result
+	{
+		Completed,
+		Canceled,
+		Failed
+	};
+	using ProgressHandler = std::function<void(size_t io_bytes, ULONGLONG sentLength, ULONGLONG fileLength)>;
+	using CompletionHandler = std::function<void(Result result)>;
+public:
+	FileSender(void) = delete;
+	FileSender(const FileSender&) = delete;
+	FileSender(std::shared_ptr<IAsyncChannel> channel, size_t blockSize, size_t blockCount, size_t writeSize);
+	~FileSender(void) = default;
+public:
+	bool Open(const CString& fileName, CFileException* ex);
+	void Start(ProgressHandler progress, CompletionHandler completion);
+	void Cancel(void);
+	bool Stoped(void) const { return m_Stoped; }
+	CString FilePath(void) const { return m_FilePath; }
+	ULONGLONG FileLength(void) const { return m_FileLength; }
+	ULONGLONG SentLength(void) const { return m_SentLength; }
+private:
+	void Finish(Result result);
+private:
+	std::shared_ptr<IAsyncChannel> m_Channel;
+	IAsyncChannel::FileOptions m_Options;
+	CString m_FilePath;
+	ULONGLONG m_FileLength;
+	std::atomic<ULONGLONG> m_SentLength;
+	std::atomic<bool> m_Cancel;
+	std::atomic<bool> m_Stoped;
+	ProgressHandler m_OnProgress;
+	CompletionHandler m_OnCompletion;
+};
@@ -9,6 +9,8 @@
 #include "CSettingDlg.h"
 #include "CHelpDialog.h"
 #include "ContainerWnd.h"
+#include "HeadlessRunner.h"
+#include <iostream>
 
 
 #ifdef _DEBUG
@@ -25,7 +27,11 @@ END_MESSAGE_MAP()
 
 // CNetDebuggerApp 构造
 
-CNetDebuggerApp::CNetDebuggerApp()
+CNetDebuggerApp::CNetDebuggerApp() :
+	m_IOWork(),
+	m_IOThreads(),
+	m_ExitCode(0),
+	m_Core(m_IOContext)
 {
 	// 支持重新启动管理器
 	m_dwRestartManagerSupportFlags = AFX_RESTART_MANAGER_SUPPORT_RESTART;
@@ -59,8 +65,29 @@ static void LoadLangData(HMODULE hInstance, LanguageService& ls)
 	}
 }
 
+static HeadlessRunner* g_HeadlessRunner = nullptr;
+static BOOL WINAPI HeadlessCtrlHandler(DWORD type)
+{
+	if (g_HeadlessRunner == nullptr)
+		return FALSE;
+	g_HeadlessRunner->Stop();
+	return TRUE;
+}
+
 BOOL CNetDebuggerApp::InitInstance()
 {
+	LoadLangData(m_hInstance, m_LangService);
+
+	// 命令行带 --headless 时不创建任何窗口, 在控制台中直接运行设备
+	for (int i = 1; i < __argc; ++i)
+	{
+		if (wcscmp(__wargv[i], L"--headless") == 0)
+		{
+			m_ExitCode = RunHeadless();
+			return FALSE;
+		}
+	}
+
 	// 如果一个运行在 Windows XP 上的应用程序清单指定要
 	// 使用 ComCtl32.dll 版本 6 或更高版本来启用可视化方式，
 	//则需要 InitCommonControlsEx()。  否则，将无法创建窗口。
@@ -73,8 +100,6 @@ BOOL CNetDebuggerApp::InitInstance()
 
 	InitContainerWnd();
 
-	LoadLangData(m_hInstance, m_LangService);
-
 	ULONG_PTR gdiplusToken = 0;
 	Gdiplus::GdiplusStartupInput gdiplusStartupInput;
 	Gdiplus::GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, nullptr);
@@ -108,15 +133,7 @@ BOOL CNetDebuggerApp::InitInstance()
 
 	WriteProfileString(L"Setting", L"LanguageId", m_LangService.GetLanguage());
 
-	SYSTEM_INFO si;
-	GetSystemInfo(&si);
-	boost::asio::io_service::work work(m_IOContext);
-	std::vector<std::unique_ptr<std::thread>> ioThreads;
-	ioThreads.resize(si.dwNumberOfProcessors * 2);
-	for (size_t i = 0; i < ioThreads.size(); ++i)
-	{
-		ioThreads[i].reset(new std::thread([this]() { m_IOContext.run(); }));
-	}
+	StartIOThreads();
 
 	CNetDebuggerDlg dlg;
 	m_pMainWnd = &dlg;
@@ -137,12 +154,7 @@ BOOL CNetDebuggerApp::InitInstance()
 		TRACE(traceAppMsg, 0, "警告: 如果您在对话框上使用 MFC 控件，则无法 #define _AFX_NO_MFC_CONTROLS_IN_DIALOGS。\n");
 	}
 
-	m_IOContext.stop();
-	for (size_t i = 0; i < ioThreads.size(); ++i)
-	{
-		if (ioThreads[i]->joinable())
-			ioThreads[i]->join();
-	}
+	StopIOThreads();
 
 	// 删除上面创建的 shell 管理器。
 	if (pShellManager != nullptr)
@@ -160,28 +172,83 @@ BOOL CNetDebuggerApp::InitInstance()
 	return FALSE;
 }
 
-std::shared_ptr<IDevice> CNetDebuggerApp::CreateCommunicationDevice(const std::wstring& className)
+int CNetDebuggerApp::ExitInstance()
 {
-	auto it = m_CDCreatorMap.find(className);
-	if (it == m_CDCreatorMap.end())
-		return nullptr;
-	auto crector = std::get<2>(it->second);
-	return crector();
+	auto code = CWinApp::ExitInstance();
+	return m_ExitCode != 0 ? m_ExitCode : code;
 }
 
-void CNetDebuggerApp::RegisterDeviceClass(const std::wstring& className, const std::wstring& title, FactoryCreator crector)
+void CNetDebuggerApp::StartIOThreads(void)
 {
-	m_CDCreatorMap.insert(std::make_pair(className, std::make_tuple(className, title, crector)));
+	SYSTEM_INFO si;
+	GetSystemInfo(&si);
+	m_IOWork.reset(new boost::asio::io_context::work(m_IOContext));
+	m_IOThreads.resize(si.dwNumberOfProcessors * 2);
+	m_Core.SetIOThreadCount(m_IOThreads.size());
+	for (size_t i = 0; i < m_IOThreads.size(); ++i)
+	{
+		m_IOThreads[i].reset(new std::thread([this]() { m_IOContext.run(); }));
+	}
 }
 
-CNetDebuggerApp::TypeDesc CNetDebuggerApp::GetDeviceTypes(void)
+void CNetDebuggerApp::StopIOThreads(void)
+{
+	m_IOContext.stop();
+	for (size_t i = 0; i < m_IOThreads.size(); ++i)
+	{
+		if (m_IOThreads[i]->joinable())
+			m_IOThreads[i]->join();
+	}
+	m_IOThreads.clear();
+	m_IOWork.reset();
+}
+
+int CNetDebuggerApp::RunHeadless(void)
 {
-	TypeDesc results;
-	for (auto& kv : m_CDCreatorMap)
+	// 程序是窗口子系统, 没有自己的控制台, 优先附加到启动它的命令行窗口
+	if (!AttachConsole(ATTACH_PARENT_PROCESS))
+		AllocConsole();
+	FILE* stream = nullptr;
+	freopen_s(&stream, "CONOUT$", "w", stdout);
+	freopen_s(&stream, "CONOUT$", "w", stderr);
+	std::wcout.clear();
+
+	std::vector<std::wstring> args(__wargv + 1, __wargv + __argc);
+	HeadlessRunner::Options options;
+	std::wstring error;
+	if (!HeadlessRunner::ParseArguments(args, options, error))
 	{
-		results.push_back(std::make_tuple(std::get<0>(kv.second), std::get<1>(kv.second)));
+		std::wcout << error << std::endl << HeadlessRunner::Usage();
+		return 2;
 	}
-	return results;
+	// 协调者启动代理进程时使用本程序的路径
+	wchar_t path[MAX_PATH] = { 0 };
+	::GetModuleFileNameW(nullptr, path, MAX_PATH);
+	options.executable = path;
+
+	HeadlessRunner::DeviceTypes types;
+	for (auto& type : NetCore::GetDeviceTypes())
+		types.push_back(std::get<0>(type));
+	HeadlessRunner runner(m_IOContext, [this](const std::wstring& className) { return m_Core.CreateDevice(className); }, types);
+	g_HeadlessRunner = &runner;
+	SetConsoleCtrlHandler(HeadlessCtrlHandler, TRUE);
+	StartIOThreads();
+	auto code = runner.Run(options, std::wcout);
+	// IO 线程退出后才能销毁 runner, 读完成回调仍持有它的指针
+	StopIOThreads();
+	SetConsoleCtrlHandler(HeadlessCtrlHandler, FALSE);
+	g_HeadlessRunner = nullptr;
+	return code;
+}
+
+std::shared_ptr<IDevice> CNetDebuggerApp::CreateCommunicationDevice(const std::wstring& className)
+{
+	return m_Core.CreateDevice(className);
+}
+
+CNetDebuggerApp::TypeDesc CNetDebuggerApp::GetDeviceTypes(void)
+{
+	return NetCore::GetDeviceTypes();
 }
 
 
@@ -16,6 +16,7 @@
 #include <string>
 #include <tuple>
 #include "LanguageService.h"
+#include "NetCore.h"
 
 // CNetDebuggerApp:
 // 有关此类的实现，请参阅 NetDebugger.cpp
@@ -23,27 +24,33 @@
 class IDevice;
 class CNetDebuggerApp : public CWinApp
 {
-public:
-	using FactoryCreator = std::function<std::shared_ptr<IDevice>(void)>;
 public:
 	CNetDebuggerApp();
 
 // 重写
 public:
 	virtual BOOL InitInstance();
+	virtual int ExitInstance();
 
 public:
 	boost::asio::io_context& GetIOContext(void) { return m_IOContext; }
+	size_t GetIOThreadCount(void) const { return m_Core.GetIOThreadCount(); }
+	NetCore& GetCore(void) { return m_Core; }
 public:
-	using TypeDesc = std::vector<std::tuple<std::wstring, std::wstring>>;
+	using TypeDesc = NetCore::TypeDesc;
 	std::shared_ptr<IDevice> CreateCommunicationDevice(const std::wstring& className);
-	void RegisterDeviceClass(const std::wstring& className, const std::wstring& title, FactoryCreator crector);
 	TypeDesc GetDeviceTypes(void);
 	LanguageService& GetLS(void) { return m_LangService; }
 private:
-	using CreatorNode = std::tuple<std::wstring, std::wstring, FactoryCreator>;
+	void StartIOThreads(void);
+	void StopIOThreads(void);
+	int RunHeadless(void);
+private:
 	boost::asio::io_context m_IOContext;
-	std::map<std::wstring, CreatorNode> m_CDCreatorMap;
+	std::unique_ptr<boost::asio::io_context::work> m_IOWork;
+	std::vector<std::unique_ptr<std::thread>> m_IOThreads;
+	int m_ExitCode;
+	NetCore m_Core;
 	LanguageService m_LangService;
 // 实现
 
@@ -54,37 +61,5 @@ private:
 
 extern CNetDebuggerApp theApp;
 
-class AutoRegisterCDClass
-{
-public:
-	AutoRegisterCDClass(const std::wstring& className, const std::wstring& title, CNetDebuggerApp::FactoryCreator creator)
-	{
-		theApp.RegisterDeviceClass(className, title, creator);
-	}
-	AutoRegisterCDClass(const std::wstring& className, CNetDebuggerApp::FactoryCreator creator)
-	{
-		theApp.RegisterDeviceClass(className, className, creator);
-	}
-
-	~AutoRegisterCDClass(void) = default;
-};
-
-#define REGISTER_CLASS(className) \
-	AutoRegisterCDClass _AutoRegisterDevice_##className##_object__(	\
-		L#className, \
-		[](){ \
-			return std::dynamic_pointer_cast<IDevice>(std::make_shared<className>()); \
-		} \
-	)
-
-#define REGISTER_CLASS_TITLE(className,title) \
-	AutoRegisterCDClass _AutoRegisterDevice_##className##_object__(	\
-		L#className, \
-		title, \
-		[](){ \
-			return std::dynamic_pointer_cast<IDevice>(std::make_shared<className>()); \
-		} \
-	)
-
 #define LSTEXT(t) theApp.GetLS().Translate(L#t)
 #define LSVT(t) theApp.GetLS().Translate(t)
\ No newline at end of file
@@ -16,58 +16,30 @@
 #include "TextEncodeType.h"
 #include "GdiplusAux.hpp"
 #include "fast_memcpy.hpp"
+#include "FileSender.h"
+#include "Broadcast.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
 #endif
 constexpr UINT kSTATISTICS_TIMER_ID = 0;
 constexpr UINT kAUTO_SEND_TIMER_ID = 1;
+constexpr UINT kRECV_MERGE_TIMER_ID = 2;
+constexpr UINT kRECV_MERGE_TIME = 50;
+constexpr UINT kAUTO_SEND_REFRESH_TIME = 500;
 constexpr UINT kSTATISTICS_UPDATE_TIME = 1000;
 constexpr size_t kFILE_IO_BLOCK_SIZE = 1024 * 8;
+// 双击统计区域时列出的流量最大和最久无读写的通道数
+constexpr size_t kTOP_TALKERS = 5;
 
 
-class FileSendContext
-{
-public:
-	FileSendContext() :
-		channel(nullptr),
-		wid(-1),
-		cancel(false),
-		stoped(true),
-		dataSize(0),
-		fileLength(0),
-		sentLength(0)
-	{
-		file.m_hFile = INVALID_HANDLE_VALUE;
-		nextUpdateUI = std::chrono::system_clock::now();
-	}
-	~FileSendContext()
-	{
-		if(file.m_hFile != INVALID_HANDLE_VALUE)
-			file.Close();
-	}
-	using TimePoint = std::chrono::time_point<std::chrono::system_clock>;
-	std::shared_ptr<IAsyncChannel> channel;
-	int wid;
-	std::atomic<bool> cancel;
-	std::atomic<bool> stoped;
-	TimePoint nextUpdateUI;
-	CFile file;
-	ULONGLONG fileLength;
-	ULONGLONG sentLength;
-	size_t dataSize;
-	uint8_t buffer[kFILE_IO_BLOCK_SIZE];
-};
 
-template <class T, class K>
-static std::vector<T> ToVector(std::map<K, T> map)
+// 十六进制文本转为字节, 忽略其中的空白
+static std::vector<uint8_t> ParseHexBytes(const CString& text)
 {
-	std::vector<T> channels;
-	for (auto kv : map)
-	{
-		channels.push_back(kv.second);
-	}
-	return channels;
+	std::vector<uint8_t> bytes;
+	Transform::DecodeWStringTo(text.GetString(), TextEncodeType::HEX, bytes);
+	return bytes;
 }
 
 // 用于应用程序“关于”菜单项的 CAboutDlg 对话框
@@ -120,17 +92,23 @@ CNetDebuggerDlg::CNetDebuggerDlg(CWnd* pParent /*=nullptr*/)
 	: CDialogEx(IDD_NETDEBUGGER_DIALOG, pParent),
 	m_ConnectStatusPop(-1),
 	m_MaxReadMemorySize(0),
-	m_ReadByteCount(0),
-	m_WriteByteCount(0),
+	m_Traffic(),
 	m_bShowRecvData(true),
 	m_bAutoSave(false),
 	m_bRecvInfoAdditional(false),
-	m_ReadBuffer(),
 	m_ReadBufferMutex(),
+	m_ReceiveStore(),
+	m_ReadViewport(m_ReceiveStore),
+	m_SendScheduler(nullptr),
+	m_AutoSendPayload(nullptr),
+	m_SendContext(),
+	m_LatencyProbe(),
 	m_HistoryRecords(),
 	m_ReceivedMessageQueue(4096),
 	m_Closed(false),
 	m_UILUpdates(),
+	m_ChannelEventsMutex(),
+	m_ChannelEvents(),
 	m_SendEditor(nullptr)
 {
 	m_hIcon = AfxGetApp()->LoadIcon(IDR_MAINFRAME);
@@ -141,7 +119,7 @@ void CNetDebuggerDlg::DoDataExchange(CDataExchange* pDX)
 	CDialogEx::DoDataExchange(pDX);
 	DDX_Control(pDX, IDC_CMB_NET_TYPE, m_DeviceTypeCtrl);
 	DDX_Control(pDX, IDC_RECV_DISPLAY_TYPE, m_RecvDisplayTypeCtrl);
-	DDX_Control(pDX, IDC_RECV_EDITBOX, m_RecvEditCtrl);
+	DDX_Control(pDX, IDC_RECV_EDITBOX, m_RecvViewCtrl);
 	DDX_Control(pDX, IDC_NET_DEVICE_SETTING, m_DevicePropertyPanel);
 	DDX_Control(pDX, IDC_DEVICE_STATISTICS, m_DeviceStatisticsCtrl);
 	DDX_Control(pDX, IDC_CMB_CHANNELS, m_ChannelsCtrl);
@@ -178,6 +156,8 @@ BEGIN_MESSAGE_MAP(CNetDebuggerDlg, CDialogEx)
 	ON_BN_CLICKED(IDC_CHECK_AUTO_ADDITIONAL, &CNetDebuggerDlg::OnBnClickedCheckAutoAdditional)
 	ON_EN_CHANGE(IDC_EDIT_SEND_INTERVAL, &CNetDebuggerDlg::OnEnChangeEditSendInterval)
 	ON_BN_CLICKED(IDC_CHECK_SHOW_RECVDATA, &CNetDebuggerDlg::OnBnClickedCheckShowRecvdata)
+	ON_CBN_SELCHANGE(IDC_CMB_CHANNELS, &CNetDebuggerDlg::OnCbnSelchangeCmbChannels)
+	ON_STN_DBLCLK(IDC_DEVICE_STATISTICS, &CNetDebuggerDlg::OnStnDblclkDeviceStatistics)
 END_MESSAGE_MAP()
 
 
@@ -276,6 +256,22 @@ void CNetDebuggerDlg::SaveSendHistory(void)
 	theApp.WriteProfileInt(L"SendHistorys", L"HistoryCount", (int)m_HistoryRecords.size());
 }
 
+void CNetDebuggerDlg::ApplyDisplayGovernor(void)
+{
+	auto frameRate = theApp.GetProfileInt(L"Setting", L"DisplayFrameRate", 20);
+	auto frameBudget = theApp.GetProfileInt(L"Setting", L"DisplayFrameBudget", 4096);
+	auto sampling = theApp.GetProfileInt(L"Setting", L"DisplaySampling", FALSE);
+	m_RecvViewCtrl.SetGovernor((UINT)frameRate, (size_t)frameBudget * 1024, sampling != FALSE);
+}
+
+void CNetDebuggerDlg::ApplyLatencyProbe(void)
+{
+	auto enabled = theApp.GetProfileInt(L"Setting", L"LatencyProbe", FALSE) != FALSE;
+	auto delimiter = ParseHexBytes(theApp.GetProfileString(L"Setting", L"LatencyDelimiter", L""));
+	m_LatencyProbe.Configure(enabled, delimiter);
+	m_DeviceStatisticsCtrl.UpdateLatency(enabled, m_LatencyProbe.Summary());
+}
+
 void CNetDebuggerDlg::UpdateUILangText(void)
 {
 	for (auto h : m_UILUpdates)
@@ -339,6 +335,7 @@ BOOL CNetDebuggerDlg::OnInitDialog()
 
 	m_ToolTipCtrl.AddTool(GetDlgItem(IDC_BUTTON_CONNECT), LSTEXT(TOOLTIP.BTN.CONNECT));
 	m_ToolTipCtrl.AddTool(GetDlgItem(IDC_BUTTON_CLEAR_STATISTICS), LSTEXT(TOOLTIP.BTN.CLEARSTAT));
+	m_ToolTipCtrl.AddTool(GetDlgItem(IDC_DEVICE_STATISTICS), LSTEXT(TOOLTIP.DEVICE.STATISTICS));
 	m_ToolTipCtrl.AddTool(GetDlgItem(IDC_COMBO_MEMORY_MAX), LSTEXT(TOOLTIP.COMBO.MEMORY.MAX));
 	m_ToolTipCtrl.AddTool(GetDlgItem(IDC_CHECK_SHOW_RECVDATA), LSTEXT(TOOLTIP.CHECK.SHOW.RECVDATA));
 	m_ToolTipCtrl.AddTool(GetDlgItem(IDC_CHECK_AUTO_ADDITIONAL), LSTEXT(TOOLTIP.CHECK.AUTO.ADDITIONAL));
@@ -378,6 +375,7 @@ BOOL CNetDebuggerDlg::OnInitDialog()
 	{
 		m_ToolTipCtrl.UpdateTipText(LSTEXT(TOOLTIP.BTN.CONNECT), GetDlgItem(IDC_BUTTON_CONNECT));
 		m_ToolTipCtrl.UpdateTipText(LSTEXT(TOOLTIP.BTN.CLEARSTAT), GetDlgItem(IDC_BUTTON_CLEAR_STATISTICS));
+		m_ToolTipCtrl.UpdateTipText(LSTEXT(TOOLTIP.DEVICE.STATISTICS), GetDlgItem(IDC_DEVICE_STATISTICS));
 		m_ToolTipCtrl.UpdateTipText(LSTEXT(TOOLTIP.COMBO.MEMORY.MAX), GetDlgItem(IDC_COMBO_MEMORY_MAX));
 		m_ToolTipCtrl.UpdateTipText(LSTEXT(TOOLTIP.CHECK.SHOW.RECVDATA), GetDlgItem(IDC_CHECK_SHOW_RECVDATA));
 		m_ToolTipCtrl.UpdateTipText(LSTEXT(TOOLTIP.CHECK.AUTO.ADDITIONAL), GetDlgItem(IDC_CHECK_AUTO_ADDITIONAL));
@@ -468,6 +466,10 @@ BOOL CNetDebuggerDlg::OnInitDialog()
 	m_RecvInfoAdditionalCtrl.SetCheck(theApp.GetProfileInt(L"Setting", L"LabelAdditional", FALSE));
 	//m_ShowRecvDataCtrl.SetCheck(theApp.GetProfileInt(L"Setting", L"ShowRecvData", FALSE));
 	m_RecvDisplayTypeCtrl.SetValue(theApp.GetProfileInt(L"Setting", L"RecvDisplayType", 0));
+	m_ReadViewport.Encoding((TextEncodeType)m_RecvDisplayTypeCtrl.GetValue());
+	m_RecvViewCtrl.Attach(&m_ReadViewport, &m_ReadBufferMutex);
+	ApplyDisplayGovernor();
+	SetTimer(kRECV_MERGE_TIMER_ID, kRECV_MERGE_TIME, nullptr);
 	m_bRecvInfoAdditional = m_RecvInfoAdditionalCtrl.GetCheck() != 0;
 	//m_bShowRecvData = m_ShowRecvDataCtrl.GetCheck() == 0;
 
@@ -475,11 +477,12 @@ BOOL CNetDebuggerDlg::OnInitDialog()
 
 	m_UILUpdates.push_back([this]()
 	{
-		m_AutoSendIntervalCtrl.Placeholder(LSTEXT(MAINWND.TXT.SEND.INTERVAL.PLACEHOLDER));
+		if (theApp.GetProfileInt(L"Setting", L"AutoSendMicrosecond", FALSE))
+			m_AutoSendIntervalCtrl.Placeholder(LSTEXT(MAINWND.TXT.SEND.INTERVAL.US.PLACEHOLDER));
+		else
+			m_AutoSendIntervalCtrl.Placeholder(LSTEXT(MAINWND.TXT.SEND.INTERVAL.PLACEHOLDER));
 	});
 
-	m_RecvEditCtrl.SetReadOnly(TRUE);
-
 	CRect rect;
 	GetWindowRect(rect);
 	m_MinSize = rect.Size();
@@ -508,6 +511,9 @@ void CNetDebuggerDlg::OnSysCommand(UINT nID, LPARAM lParam)
 		{
 			theApp.WriteProfileString(L"Setting", L"LanguageId", theApp.GetLS().GetLanguage());
 			UpdateUILangText();
+			ApplyDisplayGovernor();
+			if (m_SendScheduler != nullptr)
+				StartAutoSend();
 		}
 	}
 	break;
@@ -600,6 +606,7 @@ void CNetDebuggerDlg::OnDeviceStatusChanged(IDevice::DeviceStatus status, const
 				return true;
 			};
 			m_ConnectStatusPop = PopWindow::Show(L"状态", L"正在进行连接...", PopWindow::MLOADING, 0, listener);
+			ApplyLatencyProbe();
 		}
 		else
 		{
@@ -647,10 +654,10 @@ void CNetDebuggerDlg::OnDeviceStatusChanged(IDevice::DeviceStatus status, const
 			SetControlEnable(IDC_BUTTON_CLOSE_CHANNEL, true);
 			SetControlEnable(IDC_CMB_CHANNELS, true);
 		}
-		m_DeviceStatisticsCtrl.UpdateStatistics(true, m_ReadByteCount, m_WriteByteCount);
+		auto traffic = m_Traffic.Total();
+		m_DeviceStatisticsCtrl.UpdateStatistics(true, traffic.readBytes, traffic.writeBytes);
 		SetTimer(kSTATISTICS_TIMER_ID, kSTATISTICS_UPDATE_TIME, nullptr);
-		if(GetDlgItemInt(IDC_EDIT_SEND_INTERVAL)>0)
-			SetTimer(kAUTO_SEND_TIMER_ID, GetDlgItemInt(IDC_EDIT_SEND_INTERVAL), nullptr);
+		StartAutoSend();
 	}
 	break;
 	case IDevice::DeviceStatus::Disconnected:
@@ -674,17 +681,37 @@ void CNetDebuggerDlg::OnDeviceStatusChanged(IDevice::DeviceStatus status, const
 			SetControlEnable(IDC_CMB_CHANNELS, false);
 		}
 		m_AutoSendIntervalCtrl.SetWindowText(L"");
-		m_DeviceStatisticsCtrl.UpdateStatistics(false, m_ReadByteCount, m_WriteByteCount);
+		m_DeviceStatisticsCtrl.UpdateLatency(m_LatencyProbe.Enabled(), m_LatencyProbe.Summary());
+		m_DeviceStatisticsCtrl.UpdateLoad(false, 0, 0);
+		auto traffic = m_Traffic.Total();
+		m_DeviceStatisticsCtrl.UpdateStatistics(false, traffic.readBytes, traffic.writeBytes);
 		KillTimer(kSTATISTICS_TIMER_ID);
-		KillTimer(kAUTO_SEND_TIMER_ID);
+		StopAutoSend();
+		if (m_LatencyProbe.Enabled())
+		{
+			// 测试结束时给出本次的延迟统计
+			auto summary = m_LatencyProbe.Summary();
+			if (summary.count > 0)
+			{
+				CString report;
+				report.Format(L"样本[%llu], 未应答[%llu], 平均[%.2lfms]\r\n%s",
+					(unsigned long long)summary.count,
+					(unsigned long long)m_LatencyProbe.Unmatched(),
+					summary.mean / 1000000.0,
+					CRealTimeStatusCtrl::FormatLatency(summary).GetString());
+				PopWindow::Show(L"延迟统计", report, PopWindow::MINFO, 10000);
+			}
+		}
 		SendUIThreadTask([this]()
 		{
-			auto channels = ToVector(m_ChannelsMap);
+			// 先处理尚未送达的连接事件, 这些通道同样需要关闭
+			FlushChannelEvents();
+			auto channels = m_Channels.All();
 			for (auto channel : channels)
 			{
 				channel->Close();
 			}
-			m_ChannelsMap.clear();
+			m_Channels.Clear();
 		});
 
 		m_Closed = true;
@@ -711,96 +738,157 @@ void CNetDebuggerDlg::OnDevicePropertyChanged(void)
 
 void CNetDebuggerDlg::OnDeviceChannelConnected(std::shared_ptr<IAsyncChannel> channel, const std::wstring& message)
 {
-	SendUIThreadTask([this, channel]()
-	{
-		AddComboBoxString(m_ChannelsCtrl, channel->Description().c_str(), channel.get());
-		m_ChannelsMap.insert(std::make_pair(channel->Id(), channel));
-		if (m_ChannelsCtrl.GetCount() == 1)
-			m_ChannelsCtrl.SetCurSel(0);
-	});
+	QueueChannelEvents({ channel }, true);
 
+	m_LatencyProbe.Open(channel.get());
+	auto store = m_ReceiveStore.Open(channel.get(), channel->RemoteEndPoint());
+	auto traffic = m_Traffic.Attach(channel.get(), channel->Description());
 	auto buffer = std::make_shared<std::vector<uint8_t>>();
 	buffer->reserve(1024 * 8);
 	buffer->resize(buffer->capacity());
-	ReadChannelData(channel, buffer);
+	ReadChannelData(channel, store, traffic, buffer);
 }
 
 void CNetDebuggerDlg::OnDeviceChannelDisconnected(std::shared_ptr<IAsyncChannel> channel, const std::wstring& message)
 {
-	SendUIThreadTask([this, channel]()
+	m_ReceiveStore.Close(channel.get());
+	m_LatencyProbe.Close(channel.get());
+	m_Traffic.Detach(channel.get());
+	QueueChannelEvents({ channel }, false);
+}
+
+void CNetDebuggerDlg::OnDeviceChannelsDisconnected(const std::vector<std::shared_ptr<IAsyncChannel>>& channels, const std::wstring& message)
+{
+	for (auto& channel : channels)
 	{
-		m_ChannelsMap.erase(channel->Id());
-		auto count = m_ChannelsCtrl.GetCount();
-		for (int i = 0; i < count; ++i)
+		m_ReceiveStore.Close(channel.get());
+		m_LatencyProbe.Close(channel.get());
+		m_Traffic.Detach(channel.get());
+	}
+	QueueChannelEvents(channels, false);
+}
+
+void CNetDebuggerDlg::QueueChannelEvents(const std::vector<std::shared_ptr<IAsyncChannel>>& channels, bool connected)
+{
+	// 队列由空变为非空时才投递一次处理任务, 不等待界面线程, 接受连接的速度与界面无关;
+	// 设备停止时整批断开的通道只加锁和投递一次
+	bool post = false;
+	{
+		std::unique_lock<std::mutex> lk(m_ChannelEventsMutex);
+		post = m_ChannelEvents.empty();
+		for (auto& channel : channels)
+			m_ChannelEvents.push_back({ channel, connected });
+	}
+	if (post)
+	{
+		PostUIThreadTask([this]()
 		{
-			if (m_ChannelsCtrl.GetItemDataPtr(i) == channel.get())
-			{
+			FlushChannelEvents();
+		});
+	}
+}
+
+void CNetDebuggerDlg::FlushChannelEvents(void)
+{
+	std::vector<ChannelEvent> events;
+	{
+		std::unique_lock<std::mutex> lk(m_ChannelEventsMutex);
+		events.swap(m_ChannelEvents);
+	}
+	if (events.empty() || this->GetSafeHwnd() == nullptr)
+		return;
+
+	// 断开的通道先记下, 整批处理完后只扫描一遍下拉列表, 大量连接同时断开时不必每个都扫描一遍
+	std::unordered_set<const void*> removed;
+	auto removeItems = [this, &removed]()
+	{
+		for (int i = m_ChannelsCtrl.GetCount() - 1; i >= 0 && !removed.empty(); --i)
+		{
+			if (removed.erase(m_ChannelsCtrl.GetItemDataPtr(i)) > 0)
 				m_ChannelsCtrl.DeleteItem(i);
-				break;
-			}
 		}
-	});
+		removed.clear();
+	};
+
+	m_ChannelsCtrl.SetRedraw(FALSE);
+	for (auto& e : events)
+	{
+		auto& channel = e.channel;
+		if (e.connected)
+		{
+			// 新通道复用了本批中刚断开的通道的地址, 先删除旧的列表项
+			if (removed.count(channel.get()) > 0)
+				removeItems();
+			AddComboBoxString(m_ChannelsCtrl, channel->Description().c_str(), channel.get());
+			m_Channels.Add(channel);
+			if (m_ChannelsCtrl.GetCount() == 1)
+				m_ChannelsCtrl.SetCurSel(0);
+			continue;
+		}
+		m_Channels.Remove(channel.get());
+		removed.insert(channel.get());
+	}
+	removeItems();
+	m_ChannelsCtrl.SetRedraw(TRUE);
+	m_ChannelsCtrl.Invalidate();
+	UpdateAutoSendChannels();
 }
 
-void CNetDebuggerDlg::ReadChannelData(std::shared_ptr<IAsyncChannel> channel, std::shared_ptr<std::vector<uint8_t>> buffer)
+void CNetDebuggerDlg::ReadChannelData(std::shared_ptr<IAsyncChannel> channel, ReceiveStore::ChannelPtr store, TrafficCounters::Handle traffic, std::shared_ptr<std::vector<uint8_t>> buffer)
 {
-	auto startTime = std::chrono::high_resolution_clock::now();
-	channel->ReadSome(buffer, [buffer, channel, startTime, this](bool ok, size_t io_bytes)
+	channel->ReadSome(buffer, [buffer, channel, store, traffic, this](bool ok, size_t io_bytes)
 	{
 		if (ok && io_bytes>0)
 		{
-			m_ReadByteCount += io_bytes;
-			buffer->resize(io_bytes);
-			AppendDataToRecvBuffer(channel, buffer);
-			buffer->resize(buffer->capacity());
+			m_Traffic.Read(traffic, io_bytes);
+			m_LatencyProbe.OnReceived(channel.get(), buffer->data(), io_bytes);
+			// 闭环发送按收到的响应补发
+			auto scheduler = std::atomic_load(&m_SendScheduler);
+			if (scheduler != nullptr)
+				scheduler->OnReceived(channel.get(), buffer->data(), io_bytes);
+			// 每个通道写入各自的缓冲区, 读完成之间不再争用同一把锁
+			m_ReceiveStore.Append(store, buffer->data(), io_bytes);
 		}
 		if(ok)
-			ReadChannelData(channel, buffer);
+			ReadChannelData(channel, store, traffic, buffer);
 	});
 }
 
-void CNetDebuggerDlg::AppendDataToRecvBuffer(std::shared_ptr<IAsyncChannel> channel,std::shared_ptr<std::vector<uint8_t>> buffer)
+void CNetDebuggerDlg::MergeRecvBuffer(void)
 {
+	// 按接收顺序把各通道的新数据追加到显示视图, 数据仍保存在各通道中
+	std::unique_lock<std::mutex> clk(m_ReadBufferMutex);
+	m_ReceiveStore.Collect([this](const ReceiveStore::Channel& channel, ReceiveStore::Clock::time_point time, size_t)
 	{
-		std::unique_lock<std::mutex> clk(m_ReadBufferMutex);
-		m_ReadBuffer.Append(buffer->data(), buffer->size());
-		if (m_ReadBuffer.Size() > m_MaxReadMemorySize)
-		{
-			if (m_bAutoSave)
-			{
-				CString fileName;
-				m_AutoSaveFilePathCtrl.GetWindowText(fileName);
-				if (fileName.GetLength() > 0)
-					SaveReadHistory(fileName, false, true, false);
-			}
-			auto size = m_ReadBuffer.Size() - m_MaxReadMemorySize;
-			m_ReadBuffer.Clear();
-		}
-	}
-
-	if (m_bShowRecvData)
-	{
-		if (m_bRecvInfoAdditional)
+		if (m_bShowRecvData && m_bRecvInfoAdditional)
 		{
-			auto t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+			auto t = ReceiveStore::Clock::to_time_t(time);
 			std::wstringstream ss;
 			struct tm tm;
 			localtime_s(&tm, &t);
 			ss << std::put_time(&tm, L"%Y-%m-%d %X");
-			std::wstring label = L"\r\n[";
-			label += channel->RemoteEndPoint();
+			std::wstring label = L"[";
+			label += channel.EndPoint();
 			label += L"] ";
 			label += ss.str();
-			label += L"\r\n";
-			m_RecvEditCtrl.AppendLabelText(label);
-		}
-		m_RecvEditCtrl.AppendText(Transform::DecodeToWString(*buffer, (TextEncodeType)m_RecvDisplayTypeCtrl.GetValue()));
-		auto textLen = m_RecvEditCtrl.GetTextLength();
-		if (textLen > (long)m_MaxReadMemorySize)
-		{
-			m_RecvEditCtrl.ClearAll();
+			m_ReadViewport.AddLabel(label);
 		}
+	});
+	// 内存上限在接收时检查, 这里只负责保存和清空, 清空前未能保存的数据在视图开头提示
+	if (!m_ReceiveStore.Full())
+		return;
+	if (m_bAutoSave)
+	{
+		CString fileName;
+		m_AutoSaveFilePathCtrl.GetWindowText(fileName);
+		if (fileName.GetLength() > 0)
+			SaveReadHistory(fileName, false, true, false);
 	}
+	auto dropped = m_ReceiveStore.DroppedBytes();
+	m_ReceiveStore.Clear();
+	m_ReadViewport.Reset();
+	if (dropped > 0)
+		m_ReadViewport.AddLabel(L"[超出内存上限, 丢弃 " + std::to_wstring(dropped) + L" 字节]");
 }
 
 void CNetDebuggerDlg::SendUIThreadTask(std::function<void()> task)
@@ -832,34 +920,11 @@ LRESULT CNetDebuggerDlg::OnEditRecvBoxDisplayTypeChanged(WPARAM wParam, LPARAM l
 	auto id = static_cast<UINT>(wParam);
 	auto value = static_cast<TextEncodeType>(lParam);
 	if (id == IDC_RECV_DISPLAY_TYPE) {
-		m_ReadBufferMutex.lock();
-
-		DataBufferIterator it(m_ReadBuffer);
-		auto dataLength = m_ReadBuffer.Size();
-		if (dataLength == 0) {
-			m_ReadBufferMutex.unlock();
-			return 0;
-		}
-
-		std::vector<uint8_t> str(dataLength);
-		size_t offset = 0;
-		uint8_t* dst = static_cast<uint8_t*>(str.data());
-
-		do
-		{
-			fast_memcpy(dst + offset, it.Data(), it.Length());
-			offset += it.Length();
-		} while (it.Next());
-
-		m_ReadBufferMutex.unlock();
-
-
-		m_RecvEditCtrl.SetText(Transform::DecodeToWString(str, (TextEncodeType)m_RecvDisplayTypeCtrl.GetValue()));
-		auto textLen = m_RecvEditCtrl.GetTextLength();
-		if (textLen > (long)m_MaxReadMemorySize)
 		{
-			m_RecvEditCtrl.ClearAll();
+			std::unique_lock<std::mutex> clk(m_ReadBufferMutex);
+			m_ReadViewport.Encoding((TextEncodeType)m_RecvDisplayTypeCtrl.GetValue());
 		}
+		m_RecvViewCtrl.Refresh();
 	}
 	return 0;
 }
@@ -959,6 +1024,10 @@ void CNetDebuggerDlg::OnCbnSelchangeCmbNetType()
 		{
 			OnDeviceChannelDisconnected(channel, message);
 		});
+		dev->OnChannelsDisconnected([this](const std::vector<std::shared_ptr<IAsyncChannel>>& channels, const std::wstring& message)
+		{
+			OnDeviceChannelsDisconnected(channels, message);
+		});
 		m_DevicePropertyPanel.SetFocus();
 	}
 	else
@@ -1031,71 +1100,23 @@ void CNetDebuggerDlg::SendDataToChannel(
 	IAsyncChannel::InputBuffer inbuffer;
 	inbuffer.buffer = buffer;
 	inbuffer.bufferSize = size;
-	channel->Write(inbuffer, [startTime, cphandler, this](bool ok, size_t io_bytes)
+	auto traffic = m_Traffic.Find(channel.get());
+	channel->Write(inbuffer, [startTime, cphandler, traffic, this](bool ok, size_t io_bytes)
 	{
-		if (ok)
-		{
-			m_WriteByteCount += io_bytes;
-		}
+		m_Traffic.Written(traffic, ok, io_bytes, 1);
 		cphandler(ok, io_bytes);
 	});
 }
 
-void CNetDebuggerDlg::SendFileBlockToChannel(std::shared_ptr<FileSendContext> ctx)
-{
-	if (ctx->cancel)
-	{
-		CString message;
-		auto name = ctx->file.GetFilePath();
-		message.Format(L"%s\r\n文件发送被取消.", name.GetString());
-		PopWindow::Update(ctx->wid, L"发送文件", message, PopWindow::MWARNING);
-		ctx->stoped = true;
-		return;
-	}
-	ctx->dataSize = ctx->file.Read(ctx->buffer, kFILE_IO_BLOCK_SIZE);
-	if (ctx->dataSize > 0)
-	{
-		SendDataToChannel(ctx->channel, ctx->buffer, ctx->dataSize, [ctx, this](bool ok, size_t io_bytes)
-		{
-			if (ok)
-			{
-				ctx->sentLength += io_bytes;
-				if (std::chrono::system_clock::now() >= ctx->nextUpdateUI)
-				{
-					auto sent = (int)((ctx->sentLength * 100) / ctx->fileLength);
-					CString message;
-					auto name = ctx->file.GetFilePath();
-					message.Format(L"%s\r\n已完成[%d]%%", name.GetString(), sent);
-					PopWindow::Update(ctx->wid, L"发送文件", message, PopWindow::MNONE);
-					ctx->nextUpdateUI = std::chrono::system_clock::now() + std::chrono::seconds(1);
-				}
-				SendFileBlockToChannel(ctx);
-			}
-			else
-			{
-				CString message;
-				auto name = ctx->file.GetFilePath();
-				message.Format(L"%s\r\n文件发送失败.", name.GetString());
-				PopWindow::Update(ctx->wid, L"发送文件", message, PopWindow::MERROR, 5000);
-				ctx->stoped = true;
-			}
-		});
-	}
-	else
-	{
-		CString message;
-		auto name = ctx->file.GetFilePath();
-		message.Format(L"%s\r\n文件发送成功.", name.GetString());
-		PopWindow::Update(ctx->wid, L"发送文件", message, PopWindow::MOK, 5000);
-		ctx->stoped = true;
-	}
-}
-
 void CNetDebuggerDlg::StartSendFileToChannel(std::shared_ptr<IAsyncChannel> channel, const CString& fileName)
 {
-	auto fsctx = std::make_shared<FileSendContext>();
+	auto blockSize = (size_t)theApp.GetProfileInt(L"Setting", L"FileBlockSize", 1024) * 1024;
+	auto blockCount = (size_t)theApp.GetProfileInt(L"Setting", L"FileBlockCount", 4);
+	// UDP 每次写入就是一个数据报, 仍按原来的大小分包发送
+	auto writeSize = GetCComboBoxDataText(m_DeviceTypeCtrl).Find(L"UDP") == 0 ? kFILE_IO_BLOCK_SIZE : blockSize;
+	auto sender = std::make_shared<FileSender>(channel, blockSize, blockCount, writeSize);
 	CFileException ex;
-	if (!fsctx->file.Open(fileName, CFile::modeRead | CFile::shareDenyWrite, &ex))
+	if (!sender->Open(fileName, &ex))
 	{
 		CString message;
 		WCHAR tempBuffer[256];
@@ -1105,26 +1126,55 @@ void CNetDebuggerDlg::StartSendFileToChannel(std::shared_ptr<IAsyncChannel> chan
 		return;
 	}
 	auto listener = std::make_shared<PopWindowListener>();
-	listener->OnClosing = [fsctx](int iReason)
+	listener->OnClosing = [sender](int iReason)
 	{
-		if (fsctx->stoped)
+		if (sender->Stoped())
 			return true;
-		fsctx->cancel = AfxMessageBox(L"是否取消文件发送?", MB_YESNO | MB_ICONQUESTION) == IDYES;
+		if (AfxMessageBox(L"是否取消文件发送?", MB_YESNO | MB_ICONQUESTION) == IDYES)
+			sender->Cancel();
 		return false;
 	};
 
-	listener->OnClosed = [fsctx]()
+	listener->OnClosed = [sender]()
 	{
-		fsctx->cancel = true;
+		sender->Cancel();
 	};
 
-	fsctx->wid = PopWindow::Show(L"发送文件", L"正在发送文件...", PopWindow::MLOADING, 0, listener);
-	fsctx->channel = channel;
-	fsctx->dataSize = 0;
-	fsctx->fileLength = fsctx->file.GetLength();
-	fsctx->sentLength = 0;
-	fsctx->stoped = false;
-	SendFileBlockToChannel(fsctx);
+	auto wid = PopWindow::Show(L"发送文件", L"正在发送文件...", PopWindow::MLOADING, 0, listener);
+	auto name = sender->FilePath();
+	auto nextUpdateUI = std::make_shared<std::chrono::system_clock::time_point>(std::chrono::system_clock::now());
+	auto traffic = m_Traffic.Find(channel.get());
+	sender->Start([this, wid, name, nextUpdateUI, traffic](size_t io_bytes, ULONGLONG sentLength, ULONGLONG fileLength)
+	{
+		m_Traffic.Written(traffic, true, io_bytes, 1);
+		if (std::chrono::system_clock::now() >= *nextUpdateUI)
+		{
+			auto sent = (int)((sentLength * 100) / fileLength);
+			CString message;
+			message.Format(L"%s\r\n已完成[%d]%%", name.GetString(), sent);
+			PopWindow::Update(wid, L"发送文件", message, PopWindow::MNONE);
+			*nextUpdateUI = std::chrono::system_clock::now() + std::chrono::seconds(1);
+		}
+	},
+	[wid, name](FileSender::Result result)
+	{
+		CString message;
+		switch (result)
+		{
+		case FileSender::Result::Completed:
+			message.Format(L"%s\r\n文件发送成功.", name.GetString());
+			PopWindow::Update(wid, L"发送文件", message, PopWindow::MOK, 5000);
+			break;
+		case FileSender::Result::Canceled:
+			message.Format(L"%s\r\n文件发送被取消.", name.GetString());
+			PopWindow::Update(wid, L"发送文件", message, PopWindow::MWARNING);
+			break;
+		default:
+			message.Format(L"%s\r\n文件发送失败.", name.GetString());
+			PopWindow::Update(wid, L"发送文件", message, PopWindow::MERROR, 5000);
+			break;
+		}
+	});
 }
 
 void CNetDebuggerDlg::AppendSendHistory(UINT type, std::shared_ptr<std::vector<uint8_t>> buffer)
@@ -1146,13 +1196,72 @@ void CNetDebuggerDlg::AppendSendHistory(UINT type, std::shared_ptr<std::vector<u
 
 void CNetDebuggerDlg::OnBnClickedButtonSend()
 {
-	if (m_ChannelsMap.empty())
+	if (m_Channels.Empty())
 	{
 		PopWindow::Show(L"提示", L"当前没有可用的道通.", PopWindow::MWARNING, 3000);
 		return;
 	}
 
+	auto buffer = GetSendPayload();
+	if (buffer->empty())
+		return;
+
+	// 手动发送时模板只生成一条消息, 序号在每次发送后递增
+	auto payload = buffer;
+	auto tpl = CompileSendTemplate(*buffer);
+	if (tpl != nullptr)
+	{
+		m_SendContext.time = (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		payload = std::make_shared<std::vector<uint8_t>>(tpl->MaxSize());
+		payload->resize(tpl->Render(m_SendContext, payload->data()));
+		++m_SendContext.sequence;
+	}
+
+	auto channels = GetSendTargets();
+	for (auto& channel : channels)
+		m_LatencyProbe.OnSent(channel.get(), 1);
+	if (channels.size() == 1)
+	{
+		SendDataToChannel(channels.front(), payload->data(), payload->size(), [payload](bool, size_t) {});
+	}
+	else if (!channels.empty())
+	{
+		// 多个通道时在 IO 线程上分片广播, 所有通道共享同一份数据
+		Broadcast::Send(theApp.GetIOContext(), std::move(channels), payload, theApp.GetIOThreadCount(), [this](const Broadcast::Result& result)
+		{
+			// 广播只有汇总结果, 只计入总量
+			m_Traffic.Written(TrafficCounters::Handle{ nullptr, 0 }, true, static_cast<size_t>(result.bytes), result.sent);
+			if (result.failed > 0)
+			{
+				CString message;
+				message.Format(L"成功[%zu], 失败[%zu].", result.sent, result.failed);
+				PopWindow::Show(L"广播发送", message, PopWindow::MWARNING, 3000);
+			}
+		});
+	}
+
+	AppendSendHistory(m_SendEditor->GetDataType(), buffer);
+}
+
+std::vector<std::shared_ptr<IAsyncChannel>> CNetDebuggerDlg::GetSendTargets(void)
+{
+	std::vector<std::shared_ptr<IAsyncChannel>> channels;
 	auto item = m_ChannelsCtrl.GetCurSel();
+	if (item >= 0 && m_ChannelsCtrl.GetItemDataPtr(item) != nullptr)
+	{
+		auto channel = m_Channels.Find(static_cast<const IAsyncChannel*>(m_ChannelsCtrl.GetItemDataPtr(item)));
+		if (channel != nullptr)
+			channels.push_back(channel);
+	}
+	else
+	{
+		channels = m_Channels.All();
+	}
+	return channels;
+}
+
+std::shared_ptr<std::vector<uint8_t>> CNetDebuggerDlg::GetSendPayload(void)
+{
 	auto buffer = std::make_shared<std::vector<uint8_t>>();
 	buffer->reserve(1024);
 	m_SendEditor->GetDataBuffer([buffer](const uint8_t* data, size_t size)
@@ -1162,37 +1271,87 @@ void CNetDebuggerDlg::OnBnClickedButtonSend()
 		memcpy(buffer->data() + offset, data, size);
 		return true;
 	});
+	return buffer;
+}
 
-	if (buffer->empty())
-		return;
+SendScheduler::Template CNetDebuggerDlg::CompileSendTemplate(const std::vector<uint8_t>& payload)
+{
+	if (!theApp.GetProfileInt(L"Setting", L"SendTemplate", FALSE))
+		return nullptr;
 
-	if (item >= 0 && m_ChannelsCtrl.GetItemDataPtr(item)!=nullptr)
+	// 模板按编码后的字节解析, 无法解析时按原始内容发送
+	auto tpl = std::make_shared<PayloadTemplate>();
+	std::wstring error;
+	if (!tpl->Compile(payload.data(), payload.size(), error))
 	{
-		std::shared_ptr<IAsyncChannel> channel;
-		auto ptr = m_ChannelsCtrl.GetItemDataPtr(item);
-		for (const auto& kv : m_ChannelsMap)
-		{
-			if (kv.second.get() == ptr)
-			{
-				channel = kv.second;
-				break;
-			}
-		}
-
-		if (channel != nullptr)
-		{
-			SendDataToChannel(channel, buffer->data(), buffer->size(), [buffer](bool,size_t) {});
-		}
+		PopWindow::Show(L"发送模板", error.c_str(), PopWindow::MERROR, 5000);
+		return nullptr;
 	}
+	if (tpl->IsStatic())
+		return nullptr;
+	return tpl;
+}
+
+void CNetDebuggerDlg::StartAutoSend(void)
+{
+	StopAutoSend();
+	auto interval = GetDlgItemInt(IDC_EDIT_SEND_INTERVAL);
+	if (interval == 0 || m_CDevice == nullptr || !m_CDevice->Started())
+		return;
+
+	SendScheduler::Options options;
+	if (theApp.GetProfileInt(L"Setting", L"AutoSendMicrosecond", FALSE))
+		options.interval = std::chrono::microseconds(interval);
 	else
+		options.interval = std::chrono::milliseconds(interval);
+	options.burst = (size_t)theApp.GetProfileInt(L"Setting", L"AutoSendBurst", 1);
+	options.poisson = theApp.GetProfileInt(L"Setting", L"AutoSendPoisson", FALSE) != FALSE;
+	// 流式通道把到期的消息合并写入, 数据报通道逐条发送
+	options.coalesce = GetCComboBoxDataText(m_DeviceTypeCtrl).Find(L"UDP") != 0;
+	// 闭环发送时每条响应以分隔符结束, 与延迟测量共用同一个分隔符
+	options.closedLoop = theApp.GetProfileInt(L"Setting", L"AutoSendClosedLoop", FALSE) != FALSE;
+	options.delimiter = ParseHexBytes(theApp.GetProfileString(L"Setting", L"LatencyDelimiter", L""));
+
+	// 定时发送在 IO 线程上按预先编码好的数据发送, 界面定时器只负责刷新发送内容
+	m_AutoSendPayload = GetSendPayload();
+	// 发送字节由调度器计入各通道的流量统计
+	auto scheduler = std::make_shared<SendScheduler>(theApp.GetIOContext(), options, nullptr);
+	scheduler->SetTraffic(&m_Traffic);
+	scheduler->SetPayload(m_AutoSendPayload, CompileSendTemplate(*m_AutoSendPayload));
+	scheduler->SetChannels(GetSendTargets());
+	scheduler->SetProbe(m_LatencyProbe.Enabled() ? &m_LatencyProbe : nullptr);
+	// 读完成在 IO 线程上取用调度器
+	std::atomic_store(&m_SendScheduler, scheduler);
+	scheduler->Start();
+	SetTimer(kAUTO_SEND_TIMER_ID, kAUTO_SEND_REFRESH_TIME, nullptr);
+}
+
+void CNetDebuggerDlg::StopAutoSend(void)
+{
+	KillTimer(kAUTO_SEND_TIMER_ID);
+	if (m_SendScheduler != nullptr)
 	{
-		for (const auto& kv : m_ChannelsMap)
-		{
-			SendDataToChannel(kv.second, buffer->data(), buffer->size(), [buffer](bool, size_t) {});
-		}
+		m_SendScheduler->Stop();
+		std::atomic_store(&m_SendScheduler, std::shared_ptr<SendScheduler>());
 	}
+	m_AutoSendPayload = nullptr;
+}
 
-	AppendSendHistory(m_SendEditor->GetDataType(), buffer);
+void CNetDebuggerDlg::UpdateAutoSendPayload(void)
+{
+	if (m_SendScheduler == nullptr)
+		return;
+	auto buffer = GetSendPayload();
+	if (m_AutoSendPayload != nullptr && *m_AutoSendPayload == *buffer)
+		return;
+	m_AutoSendPayload = buffer;
+	m_SendScheduler->SetPayload(m_AutoSendPayload, CompileSendTemplate(*m_AutoSendPayload));
+}
+
+void CNetDebuggerDlg::UpdateAutoSendChannels(void)
+{
+	if (m_SendScheduler != nullptr)
+		m_SendScheduler->SetChannels(GetSendTargets());
 }
 
 void CNetDebuggerDlg::OnBnClickedButtonCloseChannel()
@@ -1200,17 +1359,7 @@ void CNetDebuggerDlg::OnBnClickedButtonCloseChannel()
 	auto item = m_ChannelsCtrl.GetCurSel();
 	if (item >= 0 && m_ChannelsCtrl.GetItemDataPtr(item) != nullptr)
 	{
-		std::shared_ptr<IAsyncChannel> channel;
-		auto ptr = m_ChannelsCtrl.GetItemDataPtr(item);
-		for (const auto& kv : m_ChannelsMap)
-		{
-			if (kv.second.get() == ptr)
-			{
-				channel = kv.second;
-				break;
-			}
-		}
-
+		auto channel = m_Channels.Find(static_cast<const IAsyncChannel*>(m_ChannelsCtrl.GetItemDataPtr(item)));
 		if (channel != nullptr)
 		{
 			channel->Close();
@@ -1223,7 +1372,7 @@ void CNetDebuggerDlg::OnBnClickedButtonCloseChannel()
 		{
 			AddComboBoxString(m_ChannelsCtrl, L"所有通道", nullptr);
 		}
-		auto channels = ToVector(m_ChannelsMap);
+		auto channels = m_Channels.All();
 		for (auto& channel : channels)
 		{
 			channel->Close();
@@ -1233,7 +1382,7 @@ void CNetDebuggerDlg::OnBnClickedButtonCloseChannel()
 
 void CNetDebuggerDlg::OnBnClickedButtonSendFile()
 {
-	if (m_ChannelsMap.empty())
+	if (m_Channels.Empty())
 	{
 		PopWindow::Show(L"提示", L"当前没有可用的道通.", PopWindow::MWARNING, 3000);
 		return;
@@ -1245,17 +1394,7 @@ void CNetDebuggerDlg::OnBnClickedButtonSendFile()
 		auto item = m_ChannelsCtrl.GetCurSel();
 		if (item >= 0 && m_ChannelsCtrl.GetItemDataPtr(item) != nullptr)
 		{
-			std::shared_ptr<IAsyncChannel> channel;
-			auto ptr = m_ChannelsCtrl.GetItemDataPtr(item);
-			for (const auto& kv : m_ChannelsMap)
-			{
-				if (kv.second.get() == ptr)
-				{
-					channel = kv.second;
-					break;
-				}
-			}
-
+			auto channel = m_Channels.Find(static_cast<const IAsyncChannel*>(m_ChannelsCtrl.GetItemDataPtr(item)));
 			if (channel != nullptr)
 			{
 				StartSendFileToChannel(channel, dlg.GetPathName());
@@ -1263,7 +1402,7 @@ void CNetDebuggerDlg::OnBnClickedButtonSendFile()
 		}
 		else
 		{
-			auto channels = ToVector(m_ChannelsMap);
+			auto channels = m_Channels.All();
 			for (auto& channel : channels)
 			{
 				StartSendFileToChannel(channel, dlg.GetPathName());
@@ -1300,6 +1439,7 @@ void CNetDebuggerDlg::OnClose()
 
 void CNetDebuggerDlg::OnDestroy()
 {
+	StopAutoSend();
 	SaveSendHistory();
 	theApp.WriteProfileInt(L"Setting", L"MemoryLimit", m_MemoryMaxCtrl.GetCurSel());
 	theApp.WriteProfileInt(L"Setting", L"AutoSave", m_AutoSaveCtrl.GetCheck());
@@ -1344,13 +1484,24 @@ void CNetDebuggerDlg::OnTimer(UINT_PTR nIDEvent)
 	{
 	case kSTATISTICS_TIMER_ID:
 	{
-		m_DeviceStatisticsCtrl.UpdateStatistics(true, m_ReadByteCount, m_WriteByteCount);
+		m_DeviceStatisticsCtrl.UpdateLatency(m_LatencyProbe.Enabled(), m_LatencyProbe.Summary());
+		if (m_SendScheduler != nullptr)
+			m_DeviceStatisticsCtrl.UpdateLoad(true, m_SendScheduler->SentMessages(), m_SendScheduler->TargetRate());
+		else
+			m_DeviceStatisticsCtrl.UpdateLoad(false, 0, 0);
+		auto traffic = m_Traffic.Total();
+		m_DeviceStatisticsCtrl.UpdateStatistics(true, traffic.readBytes, traffic.writeBytes);
 		m_DeviceStatisticsCtrl.RedrawWindow();
 	}
 	break;
 	case kAUTO_SEND_TIMER_ID:
 	{
-		OnBnClickedButtonSend();
+		UpdateAutoSendPayload();
+	}
+	break;
+	case kRECV_MERGE_TIMER_ID:
+	{
+		MergeRecvBuffer();
 	}
 	break;
 	default:
@@ -1361,19 +1512,46 @@ void CNetDebuggerDlg::OnTimer(UINT_PTR nIDEvent)
 
 void CNetDebuggerDlg::OnBnClickedButtonClearStatistics()
 {
-	m_ReadByteCount = 0;
-	m_WriteByteCount = 0;
+	m_Traffic.Reset();
+	m_LatencyProbe.Reset();
 	m_DeviceStatisticsCtrl.Clear();
 	m_DeviceStatisticsCtrl.Invalidate();
 }
 
+void CNetDebuggerDlg::OnStnDblclkDeviceStatistics()
+{
+	if (m_Traffic.Size() == 0)
+		return;
+	CString report;
+	auto append = [&report](const wchar_t* title, const std::vector<TrafficCounters::Talker>& talkers)
+	{
+		report += title;
+		for (auto& talker : talkers)
+		{
+			CString line;
+			line.Format(L"\r\n%s 收[%llu] 发[%llu] 错误[%llu] 空闲[%.1lfs]",
+				talker.description.c_str(),
+				(unsigned long long)talker.counters.readBytes,
+				(unsigned long long)talker.counters.writeBytes,
+				(unsigned long long)talker.counters.errors,
+				talker.idle / 1000.0);
+			report += line;
+		}
+	};
+	append(L"流量最大:", m_Traffic.Top(kTOP_TALKERS, TrafficCounters::Order::Bytes));
+	report += L"\r\n";
+	append(L"最久无读写:", m_Traffic.Top(kTOP_TALKERS, TrafficCounters::Order::Idle));
+	PopWindow::Show(L"通道流量", report, PopWindow::MINFO, 10000);
+}
+
 void CNetDebuggerDlg::OnBnClickedButtonRecvClear()
 {
 	{
 		std::unique_lock<std::mutex> clk(m_ReadBufferMutex);
-		m_ReadBuffer.Clear();
+		m_ReceiveStore.Clear();
+		m_ReadViewport.Reset();
 	}
-	m_RecvEditCtrl.ClearAll();
+	m_RecvViewCtrl.Refresh();
 }
 
 void CNetDebuggerDlg::SaveReadHistory(const CString& fileName, bool tip, bool append, bool lockBuffer)
@@ -1404,16 +1582,17 @@ void CNetDebuggerDlg::SaveReadHistory(const CString& fileName, bool tip, bool ap
 	{
 		if (lockBuffer)
 			m_ReadBufferMutex.lock();
-		DataBufferIterator it(m_ReadBuffer);
-		auto dataLength = m_ReadBuffer.Size();
-		auto savedLength = 0;
-		if (dataLength == 0)
-			dataLength = 1;
+		auto dataLength = m_ReceiveStore.Size();
+		size_t savedLength = 0;
+		std::vector<uint8_t> chunk(kFILE_IO_BLOCK_SIZE);
 		std::chrono::time_point<std::chrono::system_clock> nextUpdateUI = std::chrono::system_clock::now();
-		do
+		while (savedLength < dataLength)
 		{
-			file.Write(it.Data(), (UINT)it.Length());
-			savedLength += (int)it.Length();
+			auto length = m_ReceiveStore.CopyData(savedLength, chunk.size(), chunk.data());
+			if (length == 0)
+				break;
+			file.Write(chunk.data(), (UINT)length);
+			savedLength += length;
 			if (tip && std::chrono::system_clock::now() >= nextUpdateUI)
 			{
 				auto saved = (int)((savedLength * 100) / dataLength);
@@ -1422,7 +1601,7 @@ void CNetDebuggerDlg::SaveReadHistory(const CString& fileName, bool tip, bool ap
 				PopWindow::Update(tipWin, L"保存文件", message, PopWindow::MNONE);
 				nextUpdateUI = std::chrono::system_clock::now() + std::chrono::seconds(1);
 			}
-		} while (it.Next());
+		}
 		if (lockBuffer)
 			m_ReadBufferMutex.unlock();
 	}
@@ -1447,6 +1626,7 @@ void CNetDebuggerDlg::OnBnClickedButtonRecvSave()
 	if (dlg.DoModal() == IDOK)
 	{
 		auto fileName = dlg.GetPathName();
+		MergeRecvBuffer();
 		std::thread saveThread([this, fileName]()
 		{
 			SaveReadHistory(fileName, true, false, true);
@@ -1490,6 +1670,7 @@ void CNetDebuggerDlg::OnCbnSelchangeComboMemoryMax()
 		size *= 1024 * 1024 * 1024;
 
 	m_MaxReadMemorySize = (size_t)size;
+	m_ReceiveStore.Limit(m_MaxReadMemorySize);
 }
 
 
@@ -1513,18 +1694,21 @@ void CNetDebuggerDlg::OnBnClickedCheckShowRecvdata()
 	if (!m_bShowRecvData)
 	{
 		PopWindow::Show(LSTEXT(POPTIP.TITLE.INFO), LSTEXT(POPTIP.BODY.HIDE_OUTPUT_WARNING), PopWindow::MINFO, 10000);
-		m_RecvEditCtrl.EnableWindow(FALSE);
+		m_RecvViewCtrl.EnableWindow(FALSE);
 	}
 	else
-		m_RecvEditCtrl.EnableWindow(TRUE);
+		m_RecvViewCtrl.EnableWindow(TRUE);
 }
 
 
 void CNetDebuggerDlg::OnEnChangeEditSendInterval()
 {
-	KillTimer(kAUTO_SEND_TIMER_ID);
-	if (GetDlgItemInt(IDC_EDIT_SEND_INTERVAL) > 0)
-		SetTimer(kAUTO_SEND_TIMER_ID, GetDlgItemInt(IDC_EDIT_SEND_INTERVAL), nullptr);
+	StartAutoSend();
+}
+
+void CNetDebuggerDlg::OnCbnSelchangeCmbChannels()
+{
+	UpdateAutoSendChannels();
 }
 
 
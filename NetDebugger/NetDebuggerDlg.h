@@ -7,14 +7,18 @@
 #include "CDPropertyGridCtrl.h"
 #include "CRealTimeStatusCtrl.h"
 #include "CPlaceholderEdit.h"
-#include "CEditEx.h"
+#include "CDataViewCtrl.h"
 #include "IDeviceUI.h"
 #include "IndicatorButton.h"
 #include "IAsyncStream.h"
 #include "BlockingQueue.hpp"
 #include "DataBuffer.h"
+#include "DataBufferViewport.h"
+#include "ReceiveStore.h"
+#include "SendScheduler.h"
+#include "ChannelRegistry.h"
+#include "TrafficCounters.h"
 
-class FileSendContext;
 class SendHistoryRecord;
 // CNetDebuggerDlg 对话框
 class CNetDebuggerDlg : public CDialogEx
@@ -40,18 +44,29 @@ private:
 	void OnDevicePropertyChanged(void);
 	void OnDeviceChannelConnected(std::shared_ptr<IAsyncChannel> channel, const std::wstring& message);
 	void OnDeviceChannelDisconnected(std::shared_ptr<IAsyncChannel> channel, const std::wstring& message);
+	void OnDeviceChannelsDisconnected(const std::vector<std::shared_ptr<IAsyncChannel>>& channels, const std::wstring& message);
+	void QueueChannelEvents(const std::vector<std::shared_ptr<IAsyncChannel>>& channels, bool connected);
+	void FlushChannelEvents(void);
 private:
-	void ReadChannelData(std::shared_ptr<IAsyncChannel> channel, std::shared_ptr<std::vector<uint8_t>> buffer);
+	void ReadChannelData(std::shared_ptr<IAsyncChannel> channel, ReceiveStore::ChannelPtr store, TrafficCounters::Handle traffic, std::shared_ptr<std::vector<uint8_t>> buffer);
 	void SendDataToChannel(std::shared_ptr<IAsyncChannel> channel, const void* buffer, size_t size, IAsyncChannel::IoCompletionHandler cphandler);
-	void SendFileBlockToChannel(std::shared_ptr<FileSendContext> ctx);
 	void StartSendFileToChannel(std::shared_ptr<IAsyncChannel> channel, const CString& filename);
+	std::vector<std::shared_ptr<IAsyncChannel>> GetSendTargets(void);
+	std::shared_ptr<std::vector<uint8_t>> GetSendPayload(void);
+	SendScheduler::Template CompileSendTemplate(const std::vector<uint8_t>& payload);
+	void StartAutoSend(void);
+	void StopAutoSend(void);
+	void UpdateAutoSendPayload(void);
+	void UpdateAutoSendChannels(void);
 private:
 	void LoadSendHistory(void);
 	void SaveSendHistory(void);
+	void ApplyDisplayGovernor(void);
+	void ApplyLatencyProbe(void);
 protected:
 	void SendUIThreadTask(std::function<void()> task);
 	void PostUIThreadTask(std::function<void()> task);
-	void AppendDataToRecvBuffer(std::shared_ptr<IAsyncChannel> channel, std::shared_ptr<std::vector<uint8_t>> buffer);
+	void MergeRecvBuffer(void);
 	void AppendSendHistory(UINT type, std::shared_ptr<std::vector<uint8_t>> buffer);
 	void SaveReadHistory(const CString& path,bool tip, bool append, bool lockBuffer);
 
@@ -63,13 +78,19 @@ private:
 		std::string label;
 		std::string message;
 	};
+	// 通道连接/断开事件, IO 线程只入队, 界面线程成批处理
+	struct ChannelEvent
+	{
+		std::shared_ptr<IAsyncChannel> channel;
+		bool connected;
+	};
 
 	HICON m_hIcon;
 	CSize m_MinSize;
 	CComboBoxEx m_DeviceTypeCtrl;
 	CComboBoxEx m_ChannelsCtrl;
 	CSelectControl m_RecvDisplayTypeCtrl;
-	CRichEditEx m_RecvEditCtrl;
+	CDataViewCtrl m_RecvViewCtrl;
 	CPropertyTableCtrl m_DevicePropertyPanel;
 	CRealTimeStatusCtrl m_DeviceStatisticsCtrl;
 	CComboBox m_MemoryMaxCtrl;
@@ -82,16 +103,22 @@ private:
 	CMFCToolTipCtrl m_ToolTipCtrl;
 	std::unique_ptr<ISendEditor> m_SendEditor;
 	std::shared_ptr<IDevice> m_CDevice;
-	std::map<std::wstring, std::shared_ptr<IAsyncChannel>> m_ChannelsMap;
+	ChannelRegistry m_Channels;
+	std::mutex m_ChannelEventsMutex;
+	std::vector<ChannelEvent> m_ChannelEvents;
 	int m_ConnectStatusPop;
 	size_t m_MaxReadMemorySize;
-	std::atomic<uint64_t> m_ReadByteCount;
-	std::atomic<uint64_t> m_WriteByteCount;
+	TrafficCounters m_Traffic;
 	bool m_bAutoSave;
 	bool m_bRecvInfoAdditional;
 	bool m_bShowRecvData;
-	DataBuffer m_ReadBuffer;
 	std::mutex m_ReadBufferMutex;
+	ReceiveStore m_ReceiveStore;
+	DataBufferViewport m_ReadViewport;
+	std::shared_ptr<SendScheduler> m_SendScheduler;
+	std::shared_ptr<std::vector<uint8_t>> m_AutoSendPayload;
+	PayloadTemplate::Context m_SendContext;
+	LatencyProbe m_LatencyProbe;
 	std::vector<std::shared_ptr<SendHistoryRecord>> m_HistoryRecords;
 	BlockingQueue<ReceivedMessage*> m_ReceivedMessageQueue;
 	std::atomic<bool> m_Closed;
@@ -130,4 +157,6 @@ protected:
 	afx_msg void OnBnClickedCheckAutoAdditional();
 	afx_msg void OnEnChangeEditSendInterval();
 	afx_msg void OnBnClickedCheckShowRecvdata();
+	afx_msg void OnCbnSelchangeCmbChannels();
+	afx_msg void OnStnDblclkDeviceStatistics();
 };
@@ -16,6 +16,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <unordered_set>
 #include <list>
 #include <thread>
 #include <mutex>
@@ -49,6 +49,18 @@
 #define IDC_STATIC_CHANNEL              1057
 #define IDC_STATIC_V                    1058
 #define IDC_STATIC_C                    1059
+#define IDC_EDIT_FRAME_RATE             1060
+#define IDC_EDIT_FRAME_BUDGET           1061
+#define IDC_CHECK_SAMPLING              1062
+#define IDC_EDIT_FILE_BLOCK_SIZE        1063
+#define IDC_EDIT_FILE_BLOCK_COUNT       1064
+#define IDC_CHECK_SEND_MICROSECOND      1065
+#define IDC_EDIT_SEND_BURST             1066
+#define IDC_CHECK_SEND_POISSON          1067
+#define IDC_CHECK_SEND_TEMPLATE         1068
+#define IDC_CHECK_LATENCY_PROBE         1069
+#define IDC_EDIT_LATENCY_DELIMITER      1070
+#define IDC_CHECK_SEND_CLOSED_LOOP      1071
 
 // Next default values for new objects
 // 
@@ -56,7 +68,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        150
 #define _APS_NEXT_COMMAND_VALUE         32774
-#define _APS_NEXT_CONTROL_VALUE         1060
+#define _APS_NEXT_CONTROL_VALUE         1072
 #define _APS_NEXT_SYMED_VALUE           104
 #endif
 #endif